@@ -0,0 +1,403 @@
+/**
+ * @author weichbr
+ */
+
+#include "main.h"
+#include "budget.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+
+#define INI_IMPLEMENTATION
+#include "ini.h"
+
+extern std::map<uint64_t, enclave_data_t> encls;
+extern general_data_t general_data;
+
+/**
+ * Latency budgets
+ *
+ * A budget file lists limits per ECall/OCall symbol, one INI section per call:
+ *
+ *   [ECall ecall_handle_request]
+ *   max_p99=250us
+ *   max_mean=40us
+ *   max_rate=20000
+ *   max_ocalls_per_ecall=3
+ *
+ * The trace is checked against them after the call statistics are computed.
+ */
+
+typedef enum __budget_metric
+{
+	BUDGET_P99 = 0,
+	BUDGET_MEAN,
+	BUDGET_RATE,
+	BUDGET_OCALLS_PER_ECALL,
+	BUDGET_METRICS
+} budget_metric_t;
+
+typedef struct __budget_metric_info
+{
+	char const *property; // Key in the budget file
+	char const *metric; // Key in the report
+	char const *label; // Name in the printed report
+	bool duration; // Value is a duration in ns
+} budget_metric_info_t;
+
+static budget_metric_info_t const budget_metrics[BUDGET_METRICS] = {
+		{"max_p99", "p99", "99% percentile", true},
+		{"max_mean", "mean", "Ø duration", true},
+		{"max_rate", "rate", "Calls per second", false},
+		{"max_ocalls_per_ecall", "ocalls_per_ecall", "OCalls per ECall", false},
+};
+
+typedef struct __budget
+{
+	call_type_t type;
+	std::string name;
+	bool has[BUDGET_METRICS]; // Limit is given in the budget file
+	double limit[BUDGET_METRICS];
+} budget_t;
+
+typedef struct __budget_check
+{
+	budget_metric_t metric;
+	double value;
+	bool passed;
+} budget_check_t;
+
+/**
+ * @brief Result of a budget for one ECall/OCall. Calls with the same symbol in several enclaves get one result each.
+ */
+typedef struct __budget_result
+{
+	budget_t const *budget;
+	call_data_t *call; // nullptr if the symbol is not in the trace
+	uint64_t eid;
+	std::vector<budget_check_t> checks;
+	bool passed;
+} budget_result_t;
+
+/**
+ * @brief Removes leading and trailing blanks, which the INI parser keeps around "=".
+ */
+static std::string trim(std::string const &s)
+{
+	auto first = s.find_first_not_of(" \t\r");
+	if (first == std::string::npos)
+	{
+		return "";
+	}
+	auto last = s.find_last_not_of(" \t\r");
+	return s.substr(first, last - first + 1);
+}
+
+/**
+ * @brief Reads a budget file. Exits on errors, as a gate with a broken budget must not pass.
+ * @param path
+ * @return Budgets in the order of the file
+ */
+static std::vector<budget_t> load_budgets(std::string const &path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "/!\\ Could not open budget file " << path << std::endl;
+		exit(1);
+	}
+	std::stringstream content;
+	content << file.rdbuf();
+
+	std::vector<budget_t> budgets;
+	ini_t *ini = ini_load(content.str().c_str(), nullptr);
+	if (ini == nullptr)
+	{
+		std::cout << "/!\\ Could not parse budget file " << path << std::endl;
+		exit(1);
+	}
+	if (ini_property_count(ini, INI_GLOBAL_SECTION) > 0)
+	{
+		std::cout << YELLOW() << "/!\\ Ignoring properties outside of an [ECall name] or [OCall name] section in the budget file" << NORMAL() << std::endl;
+	}
+	for (int s = 1; s < ini_section_count(ini); ++s)
+	{
+		std::string section = trim(ini_section_name(ini, s));
+		budget_t b = {};
+		if (section.compare(0, 6, "ECall ") == 0)
+		{
+			b.type = call_type_t::ECALL;
+		}
+		else if (section.compare(0, 6, "OCall ") == 0)
+		{
+			b.type = call_type_t::OCALL;
+		}
+		else
+		{
+			std::cout << "/!\\ Budget section [" << section << "] must be [ECall name] or [OCall name]" << std::endl;
+			exit(1);
+		}
+		b.name = section.substr(6);
+
+		for (int p = 0; p < ini_property_count(ini, s); ++p)
+		{
+			std::string property = trim(ini_property_name(ini, s, p));
+			std::string value = trim(ini_property_value(ini, s, p));
+			int m = 0;
+			while (m < BUDGET_METRICS && property != budget_metrics[m].property)
+			{
+				++m;
+			}
+			if (m == BUDGET_METRICS)
+			{
+				std::cout << "/!\\ Unknown budget " << property << " in [" << section << "]" << std::endl;
+				exit(1);
+			}
+			if (m == BUDGET_OCALLS_PER_ECALL && b.type != call_type_t::ECALL)
+			{
+				std::cout << "/!\\ " << property << " only applies to ECalls, not to [" << section << "]" << std::endl;
+				exit(1);
+			}
+
+			bool ok;
+			double limit = 0;
+			if (budget_metrics[m].duration)
+			{
+				uint64_t ns = 0;
+				ok = parse_duration(value, ns);
+				limit = ns;
+			}
+			else
+			{
+				char *end = nullptr;
+				limit = strtod(value.c_str(), &end);
+				ok = end != value.c_str() && *end == '\0' && limit >= 0;
+			}
+			if (!ok)
+			{
+				std::cout << "/!\\ Malformed budget " << property << "=" << value << " in [" << section << "]" << std::endl;
+				exit(1);
+			}
+			b.has[m] = true;
+			b.limit[m] = limit;
+		}
+		budgets.push_back(b);
+	}
+	ini_destroy(ini);
+	return budgets;
+}
+
+/**
+ * @brief Number of OCalls the given ECall executed directly, taken from the direct parents of the OCalls of its enclave.
+ */
+static uint64_t count_ocalls_of(enclave_data_t &e, call_data_t *ecall)
+{
+	uint64_t ocalls = 0;
+	for (auto o : e.ocalls)
+	{
+		if (o == nullptr || o->direct_parents_data == nullptr)
+		{
+			continue;
+		}
+		auto pcd = find_parent_data(o->direct_parents_data, ecall->call_id);
+		if (pcd != nullptr)
+		{
+			ocalls += pcd->count;
+		}
+	}
+	return ocalls;
+}
+
+/**
+ * @brief Checks an ECall/OCall against its budget.
+ * Durations are those of the printed statistics, i.e. without logger overhead with "-c".
+ */
+static budget_result_t check_call(budget_t const &b, uint64_t eid, enclave_data_t &e, call_data_t *c)
+{
+	budget_result_t r = {};
+	r.budget = &b;
+	r.call = c;
+	r.eid = eid;
+	r.passed = true;
+
+	bool corrected = config.overhead_correction && general_data.overhead_call > 0;
+	auto &stats = corrected ? c->corrected_stats : c->all_stats;
+	auto &quantiles = corrected ? c->corrected_quantiles : c->quantiles;
+	uint64_t calls = c->all_stats.calls;
+	uint64_t runtime = general_data.endtime - general_data.starttime;
+
+	for (int m = 0; m < BUDGET_METRICS; ++m)
+	{
+		if (!b.has[m])
+		{
+			continue;
+		}
+		budget_check_t check = {};
+		check.metric = static_cast<budget_metric_t>(m);
+		switch (check.metric)
+		{
+			case BUDGET_P99:
+				check.value = calls > 0 ? quantiles.value[QUANTILE_99TH] : 0;
+				break;
+			case BUDGET_MEAN:
+				check.value = calls > 0 ? stats.avg : 0;
+				break;
+			case BUDGET_RATE:
+				check.value = runtime > 0 ? calls * 1e9 / runtime : 0;
+				break;
+			case BUDGET_OCALLS_PER_ECALL:
+				check.value = calls > 0 ? static_cast<double>(count_ocalls_of(e, c)) / calls : 0;
+				break;
+			default:
+				break;
+		}
+		check.passed = check.value <= b.limit[m];
+		r.passed = r.passed && check.passed;
+		r.checks.push_back(check);
+	}
+	return r;
+}
+
+static std::string budgetvalue(budget_metric_t m, double value)
+{
+	if (budget_metrics[m].duration)
+	{
+		auto ns = static_cast<uint64_t>(std::llround(value));
+		return timeformat(ns, ns >= 1000);
+	}
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(2) << value;
+	return ss.str();
+}
+
+static std::string calltype(call_type_t type)
+{
+	return type == call_type_t::ECALL ? "ECall" : "OCall";
+}
+
+static void print_result(budget_result_t const &r)
+{
+	auto &b = *r.budget;
+	std::cout << "/ " << WHITE() << calltype(b.type) << " " << b.name << NORMAL();
+	if (r.call == nullptr)
+	{
+		std::cout << ": " << RED() << "/!\\ not in the trace" << NORMAL() << std::endl;
+		std::cout << "\\ ___" << std::endl;
+		return;
+	}
+	std::cout << " (enclave " << r.eid << ", " << r.call->all_stats.calls << " calls): "
+	          << (r.passed ? GREEN() : RED()) << (r.passed ? "passed" : "violated") << NORMAL() << std::endl;
+	for (auto const &check : r.checks)
+	{
+		std::cout << "| " << (check.passed ? "" : RED()) << budget_metrics[check.metric].label << ": " << budgetvalue(check.metric, check.value)
+		          << " (budget " << budgetvalue(check.metric, b.limit[check.metric]) << ")" << (check.passed ? "" : " /!\\") << NORMAL() << std::endl;
+	}
+	std::cout << "\\ ___" << std::endl;
+}
+
+/**
+ * @brief Writes the machine-readable report. Durations are in ns.
+ */
+static void write_report(std::string const &path, std::string const &trace, std::vector<budget_result_t> const &results, bool passed)
+{
+	std::ofstream report(path);
+	if (!report)
+	{
+		std::cout << "/!\\ Could not write budget report " << path << std::endl;
+		exit(1);
+	}
+	report << std::setprecision(15);
+	report << "{" << std::endl;
+	report << "  \"trace\": " << jsonstring(trace) << "," << std::endl;
+	report << "  \"passed\": " << (passed ? "true" : "false") << "," << std::endl;
+	report << "  \"budgets\": [";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		auto &r = results[i];
+		auto &b = *r.budget;
+		report << (i > 0 ? "," : "") << std::endl;
+		report << "    {\"type\": " << jsonstring(calltype(b.type)) << ", \"name\": " << jsonstring(b.name);
+		if (r.call == nullptr)
+		{
+			report << ", \"status\": \"missing\", \"checks\": []}";
+			continue;
+		}
+		report << ", \"eid\": " << r.eid << ", \"call_id\": " << r.call->call_id << ", \"calls\": " << r.call->all_stats.calls
+		       << ", \"status\": " << (r.passed ? "\"passed\"" : "\"violated\"") << ", \"checks\": [";
+		for (size_t j = 0; j < r.checks.size(); ++j)
+		{
+			auto &check = r.checks[j];
+			report << (j > 0 ? ", " : "") << "{\"metric\": " << jsonstring(budget_metrics[check.metric].metric)
+			       << ", \"value\": " << check.value << ", \"limit\": " << b.limit[check.metric]
+			       << ", \"passed\": " << (check.passed ? "true" : "false") << "}";
+		}
+		report << "]}";
+	}
+	report << std::endl << "  ]" << std::endl;
+	report << "}" << std::endl;
+}
+
+/**
+ * @brief Checks the analysed trace against a budget file and prints the result.
+ * A symbol that is not in the trace violates its budget, so that renamed calls do not slip through unchecked.
+ * @param budget_file
+ * @param report_file Path of the JSON report, empty for none
+ * @param trace Path of the trace, for the report
+ * @return true, if all budgets are met
+ */
+bool check_budgets(std::string const &budget_file, std::string const &report_file, std::string const &trace)
+{
+	auto budgets = load_budgets(budget_file);
+
+	std::vector<budget_result_t> results;
+	for (auto const &b : budgets)
+	{
+		bool found = false;
+		for (auto &p : encls)
+		{
+			auto &e = p.second;
+			auto &calls = b.type == call_type_t::ECALL ? e.ecalls : e.ocalls;
+			for (auto c : calls)
+			{
+				if (c != nullptr && *c->name == b.name)
+				{
+					results.push_back(check_call(b, p.first, e, c));
+					found = true;
+				}
+			}
+		}
+		if (!found)
+		{
+			budget_result_t r = {};
+			r.budget = &b;
+			r.passed = false;
+			results.push_back(r);
+		}
+	}
+
+	size_t violated = std::count_if(results.begin(), results.end(), [](budget_result_t const &r) { return !r.passed; });
+
+	std::cout << "(i) Budgets" << std::endl;
+	std::for_each(results.begin(), results.end(), print_result);
+	if (results.empty())
+	{
+		std::cout << "No budgets" << std::endl;
+	}
+	else if (violated == 0)
+	{
+		std::cout << GREEN() << "All " << results.size() << " budgets met" << NORMAL() << std::endl;
+	}
+	else
+	{
+		std::cout << RED() << "/!\\ " << violated << " of " << results.size() << " budgets violated" << NORMAL() << std::endl;
+	}
+	std::cout << std::endl;
+
+	if (!report_file.empty())
+	{
+		write_report(report_file, trace, results, violated == 0);
+		std::cout << "(i) Wrote budget report to " << report_file << std::endl;
+	}
+	return violated == 0;
+}
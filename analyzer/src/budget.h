@@ -0,0 +1,17 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_BUDGET_H
+#define SGX_PERF_BUDGET_H
+
+#include <string>
+
+/**
+ * @brief Exit code of the analyzer if the trace exceeds a budget
+ */
+#define BUDGET_EXIT 3
+
+bool check_budgets(std::string const &budget_file, std::string const &report_file, std::string const &trace);
+
+#endif //SGX_PERF_BUDGET_H
@@ -0,0 +1,918 @@
+/**
+ * @author weichbr
+ */
+
+#include "main.h"
+#include "cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+extern std::map<uint64_t, enclave_data_t> encls;
+extern std::map<uint64_t, thread_t> threads;
+extern std::vector<call_data_t *> call_list;
+extern general_data_t general_data;
+
+/**
+ * Analysis cache
+ *
+ * The results of the analysis phases are kept in a sidecar database next to the trace, <trace>.cache.
+ * It is bound to a fingerprint of the trace, any change to the trace discards it.
+ * Every phase also stores the options its results depend on and is only restored if they are the same.
+ */
+
+static sqlite3 *cache = nullptr;
+
+static char const *cache_schema =
+	"create table if not exists meta (key text primary key, value text not null);"
+	"create table if not exists calls (idx integer primary key, type integer not null, eid integer not null, call_id integer not null, name text not null, count integer not null, from_ocalls integer not null, all_stats blob, aex_stats blob, stats_95th blob, corrected_stats blob, quantiles blob, corrected_quantiles blob, sketch blob, breakdown blob);"
+	"create table if not exists parents (idx integer not null, direct integer not null, parent integer not null, count integer not null, start_10us integer not null, start_20us integer not null, end_10us integer not null, end_20us integer not null, less_1us integer not null, less_5us integer not null, less_10us integer not null, less_20us integer not null, below blob);"
+	"create table if not exists enclaves (eid integer primary key, first_ecall_start integer not null, last_ecall_end integer not null);"
+	"create table if not exists threads (id integer primary key, pthread_id integer not null, ecalls blob, ocalls blob);"
+	"create table if not exists snapshots (thread integer not null, age integer not null, type integer not null, call_id integer not null, eid integer not null, rip integer not null, stack text not null);"
+	"create table if not exists sync (ocalls integer not null, wait_events integer not null, below blob);"
+	"create table if not exists concurrency (eid integer primary key, threads integer not null, ecalls integer not null, active integer not null, peak integer not null, time_at blob, entered_at blob, handoffs integer not null, handoff_time integer not null, lift real not null, out_of_tcs integer not null, saturated integer not null, recommended_tcs integer not null);";
+
+static char const *cache_tables[] = {"meta", "calls", "parents", "enclaves", "threads", "snapshots", "sync", "concurrency"};
+
+/**
+ * @brief Gives up on the cache after an error, the analysis continues without it.
+ * @param what
+ */
+static void cache_failed(char const *what)
+{
+	std::cout << "/!\\ Could not " << what << " analysis cache: " << sqlite3_errmsg(cache) << ", continuing without" << std::endl;
+	sqlite3_exec(cache, "rollback;", nullptr, nullptr, nullptr);
+	sqlite3_close(cache);
+	cache = nullptr;
+}
+
+static bool cache_exec(std::string const &sql)
+{
+	return sqlite3_exec(cache, sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+}
+
+/**
+ * @brief Executes a prepared insert and resets it for the next row.
+ * @return false on errors
+ */
+static bool cache_insert(sqlite3_stmt *stmt)
+{
+	bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	return ok;
+}
+
+/**
+ * @brief Fingerprint of the trace: size and modification time of the database and its WAL, and the database header.
+ * The header contains the change counter, which SQLite increments with every write.
+ * @param trace
+ */
+static std::string trace_key(std::string const &trace)
+{
+	uint64_t hash = 14695981039346656037ULL; // FNV-1a
+	auto add = [&hash](void const *data, size_t size) {
+		auto bytes = static_cast<unsigned char const *>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+		}
+	};
+
+	for (auto const &path : {trace, trace + "-wal"})
+	{
+		struct stat st = {};
+		uint64_t meta[3] = {};
+		if (stat(path.c_str(), &st) == 0)
+		{
+			meta[0] = static_cast<uint64_t>(st.st_size);
+			meta[1] = static_cast<uint64_t>(st.st_mtim.tv_sec);
+			meta[2] = static_cast<uint64_t>(st.st_mtim.tv_nsec);
+		}
+		add(meta, sizeof(meta));
+	}
+
+	char header[100] = {};
+	std::ifstream file(trace, std::ios::binary);
+	file.read(header, sizeof(header));
+	add(header, sizeof(header));
+
+	std::stringstream ss;
+	ss << std::hex << hash;
+	return ss.str();
+}
+
+/**
+ * @brief Prepares a statement on a cache connection. Unlike sql_prepare(), errors do not exit, a broken cache must not stop the analysis.
+ * @return nullptr on errors. Stepping, binding and finalizing nullptr fails without side effects.
+ */
+static sqlite3_stmt *cache_prepare(std::string const &sql, sqlite3 *conn = cache)
+{
+	sqlite3_stmt *stmt = nullptr;
+	if (sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+	{
+		sqlite3_finalize(stmt);
+		return nullptr;
+	}
+	return stmt;
+}
+
+/**
+ * @brief Executes the query inside the given string stream on a cache connection, like sql_load(), but returns errors instead of exiting.
+ * @return false on errors
+ */
+template<typename T, typename R, typename C>
+static bool cache_load(sqlite3 *conn, std::stringstream &ss, R read, C consume)
+{
+	auto stmt = cache_prepare(ss.str(), conn);
+	ss.str(std::string());
+	if (stmt == nullptr)
+	{
+		return false;
+	}
+
+	int rc;
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		T row = {};
+		read(stmt, row);
+		consume(row);
+	}
+	sqlite3_finalize(stmt);
+	return rc == SQLITE_DONE;
+}
+
+/**
+ * @brief Reads the layout version of a cache.
+ * @return false on errors, e.g. if the file is no database
+ */
+static bool read_version(sqlite3 *conn, uint64_t &version)
+{
+	version = 0;
+	return sqlite3_exec(conn, "pragma user_version;", [](void *arg, int, char **values, char **) {
+		*static_cast<uint64_t *>(arg) = strtoull(values[0], nullptr, 10);
+		return 0;
+	}, &version, nullptr) == SQLITE_OK;
+}
+
+/**
+ * @brief Reads a value of the meta table, an empty string if there is none.
+ * @return false on errors
+ */
+static bool read_meta(std::string const &key, std::string &value, sqlite3 *conn = cache)
+{
+	value.clear();
+	std::stringstream ss;
+	ss << "select value from meta where key = '" << key << "';";
+	return cache_load<std::string>(conn, ss, [](sqlite3_stmt *stmt, std::string &row) { row = sql_text(stmt, 0); }, [&value](std::string const &row) { value = row; });
+}
+
+/**
+ * @brief Checks whether a value of the meta table is as expected.
+ * @return false if it is not, or on errors
+ */
+static bool meta_is(std::string const &key, std::string const &expected, sqlite3 *conn = cache)
+{
+	std::string value;
+	return read_meta(key, value, conn) && value == expected;
+}
+
+static bool write_meta(std::string const &key, std::string const &value)
+{
+	return cache_exec("insert or replace into meta (key, value) values ('" + key + "', '" + value + "');");
+}
+
+/**
+ * @brief Opens the cache of the given trace, <trace>.cache, see open_cache(std::string const &, std::string const &).
+ * @param trace Path of the trace database
+ */
+void open_cache(std::string const &trace)
+{
+	open_cache(trace, trace + ".cache");
+}
+
+/**
+ * @brief Opens the cache of the given trace, creates it if there is none yet. A cache of another version or of an older state of the trace is cleared.
+ * Without a usable cache, e.g. if the folder of the trace is read-only, the analysis continues without it.
+ * @param trace Path of the trace database
+ * @param path Path of the cache
+ */
+void open_cache(std::string const &trace, std::string const &path)
+{
+	if (sqlite3_open_v2(path.c_str(), &cache, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK)
+	{
+		cache_failed("open");
+		return;
+	}
+	sqlite3_busy_timeout(cache, 5000);
+
+	uint64_t version = 0;
+	if (!read_version(cache, version))
+	{
+		cache_failed("open");
+		return;
+	}
+	if (version != CACHE_VERSION)
+	{
+		std::stringstream ss;
+		ss << "begin;";
+		for (auto table : cache_tables)
+		{
+			ss << "drop table if exists " << table << ";";
+		}
+		ss << cache_schema << "pragma user_version = " << CACHE_VERSION << "; commit;";
+		if (!cache_exec(ss.str()))
+		{
+			cache_failed("create");
+			return;
+		}
+	}
+
+	auto key = trace_key(trace);
+	std::string cached_key;
+	if (!read_meta("trace", cached_key))
+	{
+		cache_failed("read");
+		return;
+	}
+	if (cached_key != key)
+	{
+		std::stringstream ss;
+		ss << "begin;";
+		for (auto table : cache_tables)
+		{
+			ss << "delete from " << table << ";";
+		}
+		if (!cache_exec(ss.str()) || !write_meta("trace", key) || !cache_exec("commit;"))
+		{
+			cache_failed("reset");
+			return;
+		}
+	}
+	std::cout << "(i) Using analysis cache " << path << std::endl;
+}
+
+void close_cache()
+{
+	if (cache != nullptr)
+	{
+		sqlite3_close(cache);
+		cache = nullptr;
+	}
+}
+
+bool cache_enabled()
+{
+	return cache != nullptr;
+}
+
+/**
+ * @brief Options the results of the call phase depend on. Thresholds, graphs and exports are applied to the results and do not matter.
+ */
+static std::string calls_params()
+{
+	std::stringstream ss;
+	ss << "buckets=";
+	for (size_t b = 0; b < config.buckets.count; ++b)
+	{
+		ss << config.buckets.bounds[b] << ",";
+	}
+	// Out of core, the statistics of the fastest 95% are estimated from the sketch
+	ss << ";percentiles=" << (!config.sketch_percentiles ? "exact" : config.out_of_core ? "streamed" : "sketch");
+	ss << ";corrected=" << config.overhead_correction;
+	ss << ";window=" << config.window_start << ":" << config.window_end;
+	return ss.str();
+}
+
+static std::string sync_params()
+{
+	std::stringstream ss;
+	ss << "buckets=";
+	for (size_t b = 0; b < config.buckets.count; ++b)
+	{
+		ss << config.buckets.bounds[b] << ",";
+	}
+	return ss.str();
+}
+
+/**
+ * @brief Options the enclave concurrency depends on.
+ */
+static std::string concurrency_params()
+{
+	std::stringstream ss;
+	ss << "window=" << config.window_start << ":" << config.window_end;
+	return ss.str();
+}
+
+template<typename T>
+static void bind_struct(sqlite3_stmt *stmt, int column, T const &value)
+{
+	sqlite3_bind_blob(stmt, column, &value, sizeof(T), SQLITE_TRANSIENT);
+}
+
+/**
+ * @brief Reads a blob written by bind_struct().
+ * @return false, if the blob does not have the size of T
+ */
+template<typename T>
+static bool read_struct(sqlite3_stmt *stmt, int column, T &value)
+{
+	if (static_cast<size_t>(sqlite3_column_bytes(stmt, column)) != sizeof(T))
+	{
+		return false;
+	}
+	memcpy(&value, sqlite3_column_blob(stmt, column), sizeof(T));
+	return true;
+}
+
+static void bind_vector(sqlite3_stmt *stmt, int column, std::vector<uint64_t> const &values)
+{
+	sqlite3_bind_blob(stmt, column, values.data(), static_cast<int>(values.size() * sizeof(uint64_t)), SQLITE_TRANSIENT);
+}
+
+/**
+ * @brief Reads a blob written by bind_vector().
+ * @return false, if the blob is no array of uint64_t
+ */
+static bool read_vector(sqlite3_stmt *stmt, int column, std::vector<uint64_t> &values)
+{
+	auto bytes = static_cast<size_t>(sqlite3_column_bytes(stmt, column));
+	if (bytes % sizeof(uint64_t) != 0)
+	{
+		return false;
+	}
+	values.resize(bytes / sizeof(uint64_t));
+	if (bytes > 0)
+	{
+		memcpy(values.data(), sqlite3_column_blob(stmt, column), bytes);
+	}
+	return true;
+}
+
+/**
+ * @brief Stores a sketch as count, min, max and the index and count of every non-empty bucket.
+ */
+static void bind_sketch(sqlite3_stmt *stmt, int column, sketch_t const &s)
+{
+	if (s.buckets.empty() || s.count == 0)
+	{
+		sqlite3_bind_null(stmt, column);
+		return;
+	}
+	std::vector<uint64_t> packed = {s.count, s.min, s.max};
+	for (size_t b = 0; b < s.buckets.size(); ++b)
+	{
+		if (s.buckets[b] > 0)
+		{
+			packed.push_back(b);
+			packed.push_back(s.buckets[b]);
+		}
+	}
+	sqlite3_bind_blob(stmt, column, packed.data(), static_cast<int>(packed.size() * sizeof(uint64_t)), SQLITE_TRANSIENT);
+}
+
+static void read_sketch(sqlite3_stmt *stmt, int column, sketch_t &s)
+{
+	s = {};
+	auto n = static_cast<size_t>(sqlite3_column_bytes(stmt, column)) / sizeof(uint64_t);
+	if (n < 3)
+	{
+		return;
+	}
+	std::vector<uint64_t> packed(n);
+	memcpy(packed.data(), sqlite3_column_blob(stmt, column), n * sizeof(uint64_t));
+	init_sketch(s);
+	s.count = packed[0];
+	s.min = packed[1];
+	s.max = packed[2];
+	for (size_t i = 3; i + 1 < n; i += 2)
+	{
+		if (packed[i] < s.buckets.size())
+		{
+			s.buckets[packed[i]] = packed[i + 1];
+		}
+	}
+}
+
+typedef struct __cached_call
+{
+	uint64_t idx;
+	uint64_t type;
+	uint64_t eid;
+	uint64_t call_id;
+	bool valid; // All blobs have the expected size
+	call_data_t data; // Only the cached fields are set
+} cached_call_t;
+
+static void read_cached_call(sqlite3_stmt *stmt, cached_call_t &row)
+{
+	row.idx = sql_uint(stmt, 0);
+	row.type = sql_uint(stmt, 1);
+	row.eid = sql_uint(stmt, 2);
+	row.call_id = sql_uint(stmt, 3);
+	row.data.count = sql_uint(stmt, 4);
+	row.data.num_ecall_called_from_ocalls = sql_uint(stmt, 5);
+	row.valid = read_struct(stmt, 6, row.data.all_stats);
+	row.valid = read_struct(stmt, 7, row.data.aex_stats) && row.valid;
+	row.valid = read_struct(stmt, 8, row.data.stats_95th) && row.valid;
+	row.valid = read_struct(stmt, 9, row.data.corrected_stats) && row.valid;
+	row.valid = read_struct(stmt, 10, row.data.quantiles) && row.valid;
+	row.valid = read_struct(stmt, 11, row.data.corrected_quantiles) && row.valid;
+	read_sketch(stmt, 12, row.data.sketch);
+	row.valid = read_struct(stmt, 13, row.data.breakdown) && row.valid;
+}
+
+typedef struct __cached_parent
+{
+	uint64_t idx;
+	bool direct;
+	uint64_t parent;
+	bool valid;
+	parent_call_data_t data;
+} cached_parent_t;
+
+static void read_cached_parent(sqlite3_stmt *stmt, cached_parent_t &row)
+{
+	row.data = {};
+	row.idx = sql_uint(stmt, 0);
+	row.direct = sql_uint(stmt, 1) != 0;
+	row.parent = sql_uint(stmt, 2);
+	row.data.count = sql_uint(stmt, 3);
+	row.data.num_less_than_10us_from_start = sql_uint(stmt, 4);
+	row.data.num_less_than_20us_from_start = sql_uint(stmt, 5);
+	row.data.num_less_than_10us_from_end = sql_uint(stmt, 6);
+	row.data.num_less_than_20us_from_end = sql_uint(stmt, 7);
+	row.data.num_less_1us = sql_uint(stmt, 8);
+	row.data.num_less_5us = sql_uint(stmt, 9);
+	row.data.num_less_10us = sql_uint(stmt, 10);
+	row.data.num_less_20us = sql_uint(stmt, 11);
+	row.valid = read_struct(stmt, 12, row.data.below);
+}
+
+typedef struct __cached_enclave
+{
+	uint64_t eid;
+	uint64_t first_ecall_start;
+	uint64_t last_ecall_end;
+} cached_enclave_t;
+
+static void read_cached_enclave(sqlite3_stmt *stmt, cached_enclave_t &row)
+{
+	row.eid = sql_uint(stmt, 0);
+	row.first_ecall_start = sql_uint(stmt, 1);
+	row.last_ecall_end = sql_uint(stmt, 2);
+}
+
+typedef struct __cached_thread
+{
+	uint64_t id;
+	uint64_t pthread_id;
+	bool valid;
+	breakdown_t ecalls;
+	breakdown_t ocalls;
+} cached_thread_t;
+
+static void read_cached_thread(sqlite3_stmt *stmt, cached_thread_t &row)
+{
+	row.id = sql_uint(stmt, 0);
+	row.pthread_id = sql_uint(stmt, 1);
+	row.valid = read_struct(stmt, 2, row.ecalls);
+	row.valid = read_struct(stmt, 3, row.ocalls) && row.valid;
+}
+
+static void read_cached_snapshot(sqlite3_stmt *stmt, snapshot_row_t &row)
+{
+	row.thread = sql_uint(stmt, 0);
+	row.age = sql_uint(stmt, 1);
+	row.type = sql_uint(stmt, 2);
+	row.call_id = sql_uint(stmt, 3);
+	row.eid = sql_uint(stmt, 4);
+	row.rip = sql_uint(stmt, 5);
+	row.stack = sql_text(stmt, 6);
+}
+
+/**
+ * @brief Restores the results of the call phase: the statistics, percentiles, sketches, time breakdowns and parent relations of every ECall/OCall,
+ * the active time of every enclave, the time breakdown of every thread and the watchdog snapshots.
+ * Expects the ECall/OCall symbols to be loaded.
+ * @param snapshots Set to the cached snapshots
+ * @return false, if the cache holds no results for the current options. Nothing is changed then.
+ */
+bool load_cached_calls(std::vector<snapshot_row_t> &snapshots)
+{
+	if (cache == nullptr || !meta_is("calls", calls_params()))
+	{
+		return false;
+	}
+
+	// Everything is read before anything is restored, so an unreadable cache changes nothing
+	std::stringstream ss;
+	std::vector<cached_call_t> calls;
+	std::vector<cached_parent_t> parents;
+	std::vector<cached_thread_t> cached_threads;
+	std::vector<cached_enclave_t> cached_encls;
+	std::vector<snapshot_row_t> cached_snapshots;
+	bool ok = true;
+	ss << "select idx, type, eid, call_id, count, from_ocalls, all_stats, aex_stats, stats_95th, corrected_stats, quantiles, corrected_quantiles, sketch, breakdown from calls order by idx asc;";
+	ok = ok && cache_load<cached_call_t>(cache, ss, read_cached_call, [&calls](cached_call_t const &row) { calls.push_back(row); });
+	ss.str(std::string());
+	ss << "select idx, direct, parent, count, start_10us, start_20us, end_10us, end_20us, less_1us, less_5us, less_10us, less_20us, below from parents order by rowid asc;";
+	ok = ok && cache_load<cached_parent_t>(cache, ss, read_cached_parent, [&parents](cached_parent_t const &row) { parents.push_back(row); });
+	ss.str(std::string());
+	ss << "select id, pthread_id, ecalls, ocalls from threads order by id asc;";
+	ok = ok && cache_load<cached_thread_t>(cache, ss, read_cached_thread, [&cached_threads](cached_thread_t const &row) { cached_threads.push_back(row); });
+	ss.str(std::string());
+	ss << "select eid, first_ecall_start, last_ecall_end from enclaves;";
+	ok = ok && cache_load<cached_enclave_t>(cache, ss, read_cached_enclave, [&cached_encls](cached_enclave_t const &row) { cached_encls.push_back(row); });
+	ss.str(std::string());
+	ss << "select thread, age, type, call_id, eid, rip, stack from snapshots order by rowid asc;";
+	ok = ok && cache_load<snapshot_row_t>(cache, ss, read_cached_snapshot, [&cached_snapshots](snapshot_row_t const &row) { cached_snapshots.push_back(row); });
+	if (!ok)
+	{
+		cache_failed("read");
+		return false;
+	}
+
+	if (calls.size() != call_list.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < calls.size(); ++i)
+	{
+		auto c = call_list[i];
+		auto &row = calls[i];
+		if (!row.valid || row.idx != i || row.type != static_cast<uint64_t>(c->type) || row.call_id != c->call_id)
+		{
+			return false;
+		}
+	}
+
+	for (auto const &row : parents)
+	{
+		if (!row.valid || row.idx >= call_list.size() || row.parent >= call_list.size())
+		{
+			return false;
+		}
+	}
+
+	if (std::any_of(cached_threads.begin(), cached_threads.end(), [](cached_thread_t const &row) { return !row.valid; }))
+	{
+		return false;
+	}
+
+	for (auto c : call_list)
+	{
+		auto &row = calls[c->index].data;
+		c->count = row.count;
+		c->num_ecall_called_from_ocalls = row.num_ecall_called_from_ocalls;
+		c->all_stats = row.all_stats;
+		c->aex_stats = row.aex_stats;
+		c->stats_95th = row.stats_95th;
+		c->corrected_stats = row.corrected_stats;
+		c->quantiles = row.quantiles;
+		c->corrected_quantiles = row.corrected_quantiles;
+		c->sketch = std::move(row.sketch);
+		c->breakdown = row.breakdown;
+	}
+	for (auto const &row : parents)
+	{
+		auto c = call_list[row.idx];
+		auto parent = call_list[row.parent];
+		auto &pcd = parent_data(row.direct ? c->direct_parents_data : c->indirect_parents_data, parent);
+		pcd = row.data;
+		pcd.call_data = parent;
+		c->has_direct_parents = !c->direct_parents_data->empty();
+		c->has_indirect_parents = !c->indirect_parents_data->empty();
+	}
+
+	for (auto const &row : cached_encls)
+	{
+		auto it = encls.find(row.eid);
+		if (it != encls.end())
+		{
+			it->second.first_ecall_start = row.first_ecall_start;
+			it->second.last_ecall_end = row.last_ecall_end;
+		}
+	}
+
+	for (auto const &row : cached_threads)
+	{
+		auto &t = threads[row.id];
+		t = {};
+		t.id = row.id;
+		t.pthread_id = row.pthread_id;
+		t.ecalls = row.ecalls;
+		t.ocalls = row.ocalls;
+	}
+
+	snapshots.insert(snapshots.end(), cached_snapshots.begin(), cached_snapshots.end());
+	return true;
+}
+
+/**
+ * @brief Replaces the cached results of the call phase, see load_cached_calls().
+ * @param snapshots
+ */
+void store_cached_calls(std::vector<snapshot_row_t> const &snapshots)
+{
+	if (cache == nullptr)
+	{
+		return;
+	}
+	if (!cache_exec("begin; delete from calls; delete from parents; delete from enclaves; delete from threads; delete from snapshots; delete from meta where key = 'calls';"))
+	{
+		cache_failed("write");
+		return;
+	}
+
+	bool ok = true;
+	auto stmt = cache_prepare("insert into calls (idx, type, eid, call_id, name, count, from_ocalls, all_stats, aex_stats, stats_95th, corrected_stats, quantiles, corrected_quantiles, sketch, breakdown) values (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);");
+	for (auto &p : encls)
+	{
+		for (auto calls : {&p.second.ecalls, &p.second.ocalls})
+		{
+			for (auto c : *calls)
+			{
+				sqlite3_bind_int64(stmt, 1, c->index);
+				sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(c->type));
+				sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(p.first));
+				sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(c->call_id));
+				sqlite3_bind_text(stmt, 5, c->name->c_str(), static_cast<int>(c->name->size()), SQLITE_TRANSIENT);
+				sqlite3_bind_int64(stmt, 6, static_cast<sqlite3_int64>(c->count));
+				sqlite3_bind_int64(stmt, 7, static_cast<sqlite3_int64>(c->num_ecall_called_from_ocalls));
+				bind_struct(stmt, 8, c->all_stats);
+				bind_struct(stmt, 9, c->aex_stats);
+				bind_struct(stmt, 10, c->stats_95th);
+				bind_struct(stmt, 11, c->corrected_stats);
+				bind_struct(stmt, 12, c->quantiles);
+				bind_struct(stmt, 13, c->corrected_quantiles);
+				bind_sketch(stmt, 14, c->sketch);
+				bind_struct(stmt, 15, c->breakdown);
+				ok = ok && cache_insert(stmt);
+			}
+		}
+	}
+	sqlite3_finalize(stmt);
+
+	stmt = cache_prepare("insert into parents (idx, direct, parent, count, start_10us, start_20us, end_10us, end_20us, less_1us, less_5us, less_10us, less_20us, below) values (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);");
+	for (auto c : call_list)
+	{
+		for (auto direct : {true, false})
+		{
+			for (auto const &pcd : *(direct ? c->direct_parents_data : c->indirect_parents_data))
+			{
+				sqlite3_bind_int64(stmt, 1, c->index);
+				sqlite3_bind_int64(stmt, 2, direct);
+				sqlite3_bind_int64(stmt, 3, pcd.call_data->index);
+				sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(pcd.count));
+				sqlite3_bind_int64(stmt, 5, static_cast<sqlite3_int64>(pcd.num_less_than_10us_from_start));
+				sqlite3_bind_int64(stmt, 6, static_cast<sqlite3_int64>(pcd.num_less_than_20us_from_start));
+				sqlite3_bind_int64(stmt, 7, static_cast<sqlite3_int64>(pcd.num_less_than_10us_from_end));
+				sqlite3_bind_int64(stmt, 8, static_cast<sqlite3_int64>(pcd.num_less_than_20us_from_end));
+				sqlite3_bind_int64(stmt, 9, static_cast<sqlite3_int64>(pcd.num_less_1us));
+				sqlite3_bind_int64(stmt, 10, static_cast<sqlite3_int64>(pcd.num_less_5us));
+				sqlite3_bind_int64(stmt, 11, static_cast<sqlite3_int64>(pcd.num_less_10us));
+				sqlite3_bind_int64(stmt, 12, static_cast<sqlite3_int64>(pcd.num_less_20us));
+				bind_struct(stmt, 13, pcd.below);
+				ok = ok && cache_insert(stmt);
+			}
+		}
+	}
+	sqlite3_finalize(stmt);
+
+	stmt = cache_prepare("insert into enclaves (eid, first_ecall_start, last_ecall_end) values (?, ?, ?);");
+	for (auto const &p : encls)
+	{
+		sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(p.first));
+		sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(p.second.first_ecall_start));
+		sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(p.second.last_ecall_end));
+		ok = ok && cache_insert(stmt);
+	}
+	sqlite3_finalize(stmt);
+
+	stmt = cache_prepare("insert into threads (id, pthread_id, ecalls, ocalls) values (?, ?, ?, ?);");
+	for (auto const &p : threads)
+	{
+		sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(p.first));
+		sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(p.second.pthread_id));
+		bind_struct(stmt, 3, p.second.ecalls);
+		bind_struct(stmt, 4, p.second.ocalls);
+		ok = ok && cache_insert(stmt);
+	}
+	sqlite3_finalize(stmt);
+
+	stmt = cache_prepare("insert into snapshots (thread, age, type, call_id, eid, rip, stack) values (?, ?, ?, ?, ?, ?, ?);");
+	for (auto const &row : snapshots)
+	{
+		sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(row.thread));
+		sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(row.age));
+		sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(row.type));
+		sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(row.call_id));
+		sqlite3_bind_int64(stmt, 5, static_cast<sqlite3_int64>(row.eid));
+		sqlite3_bind_int64(stmt, 6, static_cast<sqlite3_int64>(row.rip));
+		sqlite3_bind_text(stmt, 7, row.stack.c_str(), static_cast<int>(row.stack.size()), SQLITE_TRANSIENT);
+		ok = ok && cache_insert(stmt);
+	}
+	sqlite3_finalize(stmt);
+
+	if (!ok || !write_meta("runtime", std::to_string(general_data.endtime - general_data.starttime)) || !write_meta("calls", calls_params()) || !cache_exec("commit;"))
+	{
+		cache_failed("write");
+	}
+}
+
+/**
+ * @brief Restores the results of the synchronisation phase.
+ * @param summary
+ * @return false, if the cache holds no results for the current options
+ */
+bool load_cached_sync(sync_summary_t &summary)
+{
+	if (cache == nullptr || !meta_is("sync", sync_params()))
+	{
+		return false;
+	}
+
+	bool found = false;
+	sync_summary_t cached = {};
+	std::stringstream ss;
+	ss << "select ocalls, wait_events, below from sync;";
+	if (!cache_load<sync_summary_t>(cache, ss, [&found](sqlite3_stmt *stmt, sync_summary_t &row) {
+		row.ocalls = sql_uint(stmt, 0);
+		row.wait_events = sql_uint(stmt, 1);
+		found = read_struct(stmt, 2, row.below);
+	}, [&cached](sync_summary_t const &row) { cached = row; }))
+	{
+		cache_failed("read");
+		return false;
+	}
+	if (found)
+	{
+		summary = cached;
+	}
+	return found;
+}
+
+void store_cached_sync(sync_summary_t const &summary)
+{
+	if (cache == nullptr)
+	{
+		return;
+	}
+	if (!cache_exec("begin; delete from sync; delete from meta where key = 'sync';"))
+	{
+		cache_failed("write");
+		return;
+	}
+
+	auto stmt = cache_prepare("insert into sync (ocalls, wait_events, below) values (?, ?, ?);");
+	sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(summary.ocalls));
+	sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(summary.wait_events));
+	bind_struct(stmt, 3, summary.below);
+	bool ok = cache_insert(stmt);
+	sqlite3_finalize(stmt);
+
+	if (!ok || !write_meta("sync", sync_params()) || !cache_exec("commit;"))
+	{
+		cache_failed("write");
+	}
+}
+
+static void read_cached_concurrency(sqlite3_stmt *stmt, std::pair<bool, concurrency_t> &row)
+{
+	auto &r = row.second;
+	r.eid = sql_uint(stmt, 0);
+	r.threads = sql_uint(stmt, 1);
+	r.ecalls = sql_uint(stmt, 2);
+	r.active = sql_uint(stmt, 3);
+	r.peak = sql_uint(stmt, 4);
+	row.first = read_vector(stmt, 5, r.time_at);
+	row.first = read_vector(stmt, 6, r.entered_at) && row.first;
+	r.handoffs = sql_uint(stmt, 7);
+	r.handoff_time = sql_uint(stmt, 8);
+	r.lift = sqlite3_column_double(stmt, 9);
+	r.out_of_tcs = sql_uint(stmt, 10);
+	r.saturated = sql_uint(stmt, 11) != 0;
+	r.recommended_tcs = sql_uint(stmt, 12);
+	// Printing indexes time_at and entered_at up to the peak
+	row.first = row.first && r.time_at.size() > r.peak && r.entered_at.size() > r.peak;
+}
+
+/**
+ * @brief Restores the enclave concurrency of the call phase.
+ * @param results
+ * @return false, if the cache holds no results for the current options
+ */
+bool load_cached_concurrency(std::vector<concurrency_t> &results)
+{
+	if (cache == nullptr || !meta_is("concurrency", concurrency_params()))
+	{
+		return false;
+	}
+
+	bool valid = true;
+	std::vector<concurrency_t> cached;
+	std::stringstream ss;
+	ss << "select eid, threads, ecalls, active, peak, time_at, entered_at, handoffs, handoff_time, lift, out_of_tcs, saturated, recommended_tcs from concurrency order by eid asc;";
+	if (!cache_load<std::pair<bool, concurrency_t>>(cache, ss, read_cached_concurrency, [&valid, &cached](std::pair<bool, concurrency_t> const &row) {
+		valid = valid && row.first;
+		cached.push_back(row.second);
+	}))
+	{
+		cache_failed("read");
+		return false;
+	}
+	if (valid)
+	{
+		results = cached;
+	}
+	return valid;
+}
+
+void store_cached_concurrency(std::vector<concurrency_t> const &results)
+{
+	if (cache == nullptr)
+	{
+		return;
+	}
+	if (!cache_exec("begin; delete from concurrency; delete from meta where key = 'concurrency';"))
+	{
+		cache_failed("write");
+		return;
+	}
+
+	bool ok = true;
+	auto stmt = cache_prepare("insert into concurrency (eid, threads, ecalls, active, peak, time_at, entered_at, handoffs, handoff_time, lift, out_of_tcs, saturated, recommended_tcs) values (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);");
+	for (auto const &r : results)
+	{
+		sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(r.eid));
+		sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(r.threads));
+		sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(r.ecalls));
+		sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(r.active));
+		sqlite3_bind_int64(stmt, 5, static_cast<sqlite3_int64>(r.peak));
+		bind_vector(stmt, 6, r.time_at);
+		bind_vector(stmt, 7, r.entered_at);
+		sqlite3_bind_int64(stmt, 8, static_cast<sqlite3_int64>(r.handoffs));
+		sqlite3_bind_int64(stmt, 9, static_cast<sqlite3_int64>(r.handoff_time));
+		sqlite3_bind_double(stmt, 10, r.lift);
+		sqlite3_bind_int64(stmt, 11, static_cast<sqlite3_int64>(r.out_of_tcs));
+		sqlite3_bind_int64(stmt, 12, r.saturated);
+		sqlite3_bind_int64(stmt, 13, static_cast<sqlite3_int64>(r.recommended_tcs));
+		ok = ok && cache_insert(stmt);
+	}
+	sqlite3_finalize(stmt);
+
+	if (!ok || !write_meta("concurrency", concurrency_params()) || !cache_exec("commit;"))
+	{
+		cache_failed("write");
+	}
+}
+
+static void read_call_summary(sqlite3_stmt *stmt, call_summary_t &row)
+{
+	row.type = static_cast<call_type_t>(sql_uint(stmt, 0));
+	row.eid = sql_uint(stmt, 1);
+	row.name = sql_text(stmt, 2);
+	row.valid = read_struct(stmt, 3, row.all_stats);
+	row.valid = read_struct(stmt, 4, row.aex_stats) && row.valid;
+	row.valid = read_struct(stmt, 5, row.quantiles) && row.valid;
+	read_sketch(stmt, 6, row.sketch);
+}
+
+/**
+ * @brief Reads the results of the call phase from the cache of a trace, without touching the state of the analyzer.
+ * @param trace Path of the trace database
+ * @param path Path of the cache
+ * @param runtime Set to the runtime of the trace in ns
+ * @param calls Set to the statistics of all ECalls/OCalls of the trace
+ * @return false, if the trace has no readable, up-to-date cache for the current options
+ */
+bool read_cache(std::string const &trace, std::string const &path, uint64_t &runtime, std::vector<call_summary_t> &calls)
+{
+	sqlite3 *conn = nullptr;
+	if (sqlite3_open_v2(path.c_str(), &conn, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+	{
+		sqlite3_close(conn);
+		return false;
+	}
+
+	uint64_t version = 0;
+	std::string cached_runtime;
+	bool valid = read_version(conn, version) && version == CACHE_VERSION && meta_is("trace", trace_key(trace), conn) && meta_is("calls", calls_params(), conn)
+	             && read_meta("runtime", cached_runtime, conn);
+	if (valid)
+	{
+		runtime = strtoull(cached_runtime.c_str(), nullptr, 10);
+		std::stringstream ss;
+		ss << "select type, eid, name, all_stats, aex_stats, quantiles, sketch from calls order by idx asc;";
+		valid = cache_load<call_summary_t>(conn, ss, read_call_summary, [&calls, &valid](call_summary_t const &row) {
+			valid = valid && row.valid;
+			calls.push_back(row);
+		}) && valid;
+	}
+	sqlite3_close(conn);
+	return valid;
+}
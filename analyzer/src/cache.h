@@ -0,0 +1,70 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_CACHE_H
+#define SGX_PERF_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "calls.h"
+#include "concurrency.h"
+
+/**
+ * @brief Version of the cache layout. Caches of other versions are discarded.
+ */
+#define CACHE_VERSION 6
+
+/**
+ * @brief Results of the synchronisation phase.
+ */
+typedef struct __sync_summary
+{
+	uint64_t ocalls; // Number of synchronisation OCalls
+	uint64_t wait_events;
+	uint64_t below[MAX_BUCKETS]; // Number of wait events resolved below each bucket bound
+} sync_summary_t;
+
+/**
+ * @brief Call that was stuck when the watchdog of the logger took a snapshot.
+ */
+typedef struct __snapshot_row
+{
+	uint64_t thread;
+	uint64_t age; // Time since the call started
+	uint64_t type; // Type of the call event
+	uint64_t call_id;
+	uint64_t eid;
+	uint64_t rip; // Enclave rip, 0 if unknown
+	std::string stack; // Untrusted stack, one frame per line
+} snapshot_row_t;
+
+/**
+ * @brief Cached statistics of an ECall/OCall, as read by read_cache().
+ */
+typedef struct __call_summary
+{
+	call_type_t type;
+	uint64_t eid;
+	std::string name;
+	bool valid; // All blobs have the expected size
+	stats_t all_stats;
+	stats_t aex_stats;
+	quantiles_t quantiles;
+	sketch_t sketch;
+} call_summary_t;
+
+void open_cache(std::string const &trace);
+void open_cache(std::string const &trace, std::string const &path);
+void close_cache();
+bool cache_enabled();
+bool load_cached_calls(std::vector<snapshot_row_t> &snapshots);
+void store_cached_calls(std::vector<snapshot_row_t> const &snapshots);
+bool load_cached_sync(sync_summary_t &summary);
+void store_cached_sync(sync_summary_t const &summary);
+bool load_cached_concurrency(std::vector<concurrency_t> &results);
+void store_cached_concurrency(std::vector<concurrency_t> const &results);
+bool read_cache(std::string const &trace, std::string const &path, uint64_t &runtime, std::vector<call_summary_t> &calls);
+
+#endif //SGX_PERF_CACHE_H
@@ -6,10 +6,11 @@
 #include <algorithm>
 #include <numeric>
 #include <map>
-#include <atomic>
 #include <cstring>
+#include <iomanip>
 #include <cassert>
 #include "main.h"
+#include "spill.h"
 
 #include <fstream>
 #include <sys/stat.h>
@@ -17,369 +18,974 @@
 std::map<uint64_t, enclave_data_t> encls;
 std::map<uint64_t, thread_t> threads;
 general_data_t general_data = {};
+call_store_t call_store;
+std::vector<call_data_t *> call_list;
 
-static int general_callback(void *arg, int count, char **data, char **columns)
+typedef struct __general_row
 {
-	(void)arg;
-	(void)count;
-	(void)columns;
+	std::string key;
+	uint64_t value;
+} general_row_t;
 
-	if (strcmp(data[0], "start_time") == 0)
+static void read_general_row(sqlite3_stmt *stmt, general_row_t &row)
+{
+	row.key = sql_text(stmt, 0);
+	row.value = sql_uint(stmt, 1);
+}
+
+static void general_callback(general_row_t const &row)
+{
+	if (row.key == "start_time")
+	{
+		general_data.starttime = row.value;
+	}
+	else if (row.key == "end_time")
+	{
+		general_data.endtime = row.value;
+	}
+	else if (row.key == "main_thread")
+	{
+		general_data.main_thread = row.value;
+	}
+	else if (row.key == "overhead_call")
+	{
+		general_data.overhead_call = row.value;
+	}
+	else if (row.key == "overhead_nested_call")
+	{
+		general_data.overhead_nested_call = row.value;
+	}
+	else if (row.key == "logger_events")
 	{
-		general_data.starttime = strtoul(data[1], nullptr, 10);
+		general_data.logger_events = row.value;
 	}
-	else if (strcmp(data[0], "end_time") == 0)
+	else if (row.key == "logger_bytes")
 	{
-		general_data.endtime = strtoul(data[1], nullptr, 10);
+		general_data.logger_bytes = row.value;
 	}
-	else if (strcmp(data[0], "main_thread") == 0)
+	else if (row.key == "logger_time")
 	{
-		general_data.main_thread = strtoul(data[1], nullptr, 10);
+		general_data.logger_time = row.value;
 	}
+	else if (row.key == "ecall_roundtrip")
+	{
+		general_data.ecall_roundtrip = row.value;
+	}
+	else if (row.key == "ocall_roundtrip")
+	{
+		general_data.ocall_roundtrip = row.value;
+	}
+}
+
+typedef struct __symbol_row
+{
+	uint64_t id;
+	uint64_t eid;
+	std::string name;
+} symbol_row_t;
 
-	return 0;
+static void read_symbol_row(sqlite3_stmt *stmt, symbol_row_t &row)
+{
+	row.id = sql_uint(stmt, 0);
+	row.eid = sql_uint(stmt, 1);
+	row.name = sql_text(stmt, 2);
 }
 
-static int ecalls_callback(void *arg, int count, char **data, char **columns)
+static void ecalls_callback(symbol_row_t const &row)
 {
-	(void)arg;
-	(void)count;
-	(void)columns;
-	uint64_t id = strtoul(data[0], nullptr, 10);
-	uint64_t eid = strtoul(data[1], nullptr, 10);
+	uint64_t id = row.id;
+	uint64_t eid = row.eid;
 
 	auto *c = new call_data_t;
 	c->type = call_type_t::ECALL;
 	c->call_id = id;
-	c->name = new std::string(data[2]);
+	c->name = new std::string(row.name);
+	c->index = static_cast<uint32_t>(call_list.size());
+	c->first = 0;
+	c->count = 0;
 	c->all_stats = {};
 	c->stats_95th = {};
-	c->exectimes = new std::vector<uint64_t>();
-	c->single_calls = new std::vector<single_call_data_t *>();
+	c->corrected_stats = {};
+	c->quantiles = {};
+	c->corrected_quantiles = {};
+	c->sketch = {};
+	c->breakdown = {};
 	c->has_direct_parents = false;
 	c->num_ecall_called_from_ocalls = 0;
-	c->direct_parents_data = nullptr;
+	c->direct_parents_data = new std::vector<parent_call_data_t>();
 	c->has_indirect_parents = false;
-	c->indirect_parents_data = nullptr;
-	c->aex_counts = new std::vector<uint64_t>();
+	c->indirect_parents_data = new std::vector<parent_call_data_t>();
+	call_list.push_back(c);
 	encls[eid].ecalls.push_back(c);
 	encls[eid].ecall_count = 0;
-
-	return 0;
 }
 
-static int ocalls_callback(void *arg, int count, char **data, char **columns)
+static void ocalls_callback(symbol_row_t const &row)
 {
-	(void)arg;
-	(void)count;
-	(void)columns;
-	uint64_t id = strtoul(data[0], nullptr, 10);
-	uint64_t eid = strtoul(data[1], nullptr, 10);
+	uint64_t id = row.id;
+	uint64_t eid = row.eid;
 
 	auto *c = new call_data_t;
 	c->type = call_type_t::OCALL;
 	c->call_id = id;
-	c->name = new std::string(data[2]);
+	c->name = new std::string(row.name);
+	c->index = static_cast<uint32_t>(call_list.size());
+	c->first = 0;
+	c->count = 0;
 	c->all_stats = {};
 	c->stats_95th = {};
-	c->exectimes = new std::vector<uint64_t>();
-	c->single_calls = new std::vector<single_call_data_t *>();
+	c->corrected_stats = {};
+	c->quantiles = {};
+	c->corrected_quantiles = {};
+	c->sketch = {};
+	c->breakdown = {};
 	c->has_direct_parents = false;
 	c->num_ecall_called_from_ocalls = 0;
-	c->direct_parents_data = nullptr;
+	c->direct_parents_data = new std::vector<parent_call_data_t>();
 	c->has_indirect_parents = false;
-	c->indirect_parents_data = nullptr;
-	c->aex_counts = nullptr;
+	c->indirect_parents_data = new std::vector<parent_call_data_t>();
+	call_list.push_back(c);
 	encls[eid].ocalls.push_back(c);
 	encls[eid].ocall_count = 0;
+}
 
-	return 0;
+typedef struct __thread_row
+{
+	uint64_t id;
+	uint64_t pthread_id;
+	uint64_t calls;
+} thread_row_t;
+
+static void read_thread_row(sqlite3_stmt *stmt, thread_row_t &row)
+{
+	row.id = sql_uint(stmt, 0);
+	row.pthread_id = sql_uint(stmt, 1);
+	row.calls = sql_uint(stmt, 2);
 }
 
-static int thread_callback(void *arg, int count, char **data, char **columns)
+static uint64_t calls_expected = 0;
+
+static void thread_callback(thread_row_t const &row)
 {
-	(void) arg;
-	(void) count;
-	(void) columns;
-	uint64_t id = strtoul(data[0], nullptr, 10);
-	uint64_t pthread_id = strtoul(data[1], nullptr, 10);
-	uint64_t events = strtoul(data[2], nullptr, 10);
+	uint64_t id = row.id;
+	uint64_t pthread_id = row.pthread_id;
 	threads[id].id = id;
 	threads[id].pthread_id = pthread_id;
-	threads[id].calls = new single_call_data_t[events];
-	threads[id].last_call = nullptr;
-	threads[id].next_call_index = 0;
-	return 0;
-}
-
-static int call_data_callback(void *arg, int count, char **data, char **columns)
-{
-	(void)arg;
-	(void)count;
-	(void)columns;
-	// 0 = internal id
-	// 1 = type
-	// 2 = thread
-	// 3 = call id
-	// 4 = eid
-	// 5 = exectime
-	// 6 = aex count
-	// 7 = parent call id
-	// 8 = start time
-	// 9 = end time
-	uint64_t iid = strtoul(data[0], nullptr, 10);
-	uint64_t type = strtoul(data[1], nullptr, 10);
-	uint64_t tid = strtoul(data[2], nullptr, 10);
-	uint64_t id = strtoul(data[3], nullptr, 10);
-	uint64_t eid = strtoul(data[4], nullptr, 10);
-	uint64_t exectime = strtoul(data[5], nullptr, 10);
-	uint64_t starttime = strtoul(data[8], nullptr, 10);
-	uint64_t endtime = strtoul(data[9], nullptr, 10);
-	if (type == 15) // FIXME: use event_map table to get event ids
+	threads[id].first = calls_expected;
+	threads[id].count = 0;
+	threads[id].expected = row.calls;
+	threads[id].open_calls = new std::vector<open_call_t>();
+	threads[id].last_sibling = new std::vector<sibling_t>();
+	threads[id].ecalls = {};
+	threads[id].ocalls = {};
+	calls_expected += row.calls;
+}
+
+typedef struct __call_row
+{
+	uint64_t id; // Internal id of the call event
+	uint64_t type; // Type of the call event
+	uint64_t thread;
+	uint64_t call_id;
+	uint64_t eid;
+	uint64_t exectime;
+	uint64_t aex_count;
+	uint64_t parent; // Internal id of the parent call event
+	uint64_t start;
+	uint64_t end;
+	bool has_aex_count;
+	bool has_parent;
+} call_row_t;
+
+static void read_call_row(sqlite3_stmt *stmt, call_row_t &row)
+{
+	row.id = sql_uint(stmt, 0);
+	row.type = sql_uint(stmt, 1);
+	row.thread = sql_uint(stmt, 2);
+	row.call_id = sql_uint(stmt, 3);
+	row.eid = sql_uint(stmt, 4);
+	row.exectime = sql_uint(stmt, 5);
+	row.has_aex_count = !sql_null(stmt, 6);
+	row.aex_count = sql_uint(stmt, 6);
+	row.has_parent = !sql_null(stmt, 7);
+	row.parent = sql_uint(stmt, 7);
+	row.start = sql_uint(stmt, 8);
+	row.end = sql_uint(stmt, 9);
+}
+
+/**
+ * @brief Returns the relation to the given parent, creates it if this parent has not been seen before.
+ * @param parents Direct or indirect parents of a call, sorted by call id
+ * @param parent The parent call
+ */
+parent_call_data_t &parent_data(std::vector<parent_call_data_t> *parents, call_data_t *parent)
+{
+	auto it = std::lower_bound(parents->begin(), parents->end(), parent->call_id, [](parent_call_data_t const &pcd, uint64_t call_id) {
+		return pcd.call_data->call_id < call_id;
+	});
+	if (it == parents->end() || it->call_data != parent)
 	{
-		// ecall
+		parent_call_data_t pcd = {};
+		pcd.call_data = parent;
+		it = parents->insert(it, pcd);
+	}
+	return *it;
+}
+
+/**
+ * @brief Looks up the relation to the parent with the given call id.
+ * @param parents Direct or indirect parents of a call, sorted by call id
+ * @param call_id Call id of the parent
+ * @return The relation, or nullptr if the call never had this parent
+ */
+parent_call_data_t *find_parent_data(std::vector<parent_call_data_t> *parents, uint64_t call_id)
+{
+	auto it = std::lower_bound(parents->begin(), parents->end(), call_id, [](parent_call_data_t const &pcd, uint64_t id) {
+		return pcd.call_data->call_id < id;
+	});
+	if (it == parents->end() || it->call_data->call_id != call_id)
+	{
+		return nullptr;
+	}
+	return &(*it);
+}
+
+/**
+ * @brief Counters of an ECall/OCall, collected by one loader and merged into its call_data_t afterwards.
+ * In out-of-core mode, they also hold the running statistics and sketches of the durations.
+ */
+typedef struct __call_aggregate
+{
+	uint64_t count;
+	uint64_t aexs;
+	uint64_t num_ecall_called_from_ocalls;
+	std::vector<parent_call_data_t> direct_parents_data; // Sorted by call id, like call_data_t::direct_parents_data
+	std::vector<parent_call_data_t> indirect_parents_data; // Sorted by call id, like call_data_t::indirect_parents_data
+	stats_acc_t durations;
+	stats_acc_t corrected_durations;
+	stats_acc_t aex_counts;
+	sketch_t sketch; // Empty until the first duration arrives
+	sketch_t corrected_sketch;
+	breakdown_t breakdown;
+} call_aggregate_t;
 
-		auto thiz = encls[eid].ecalls[id];
+/**
+ * @brief State of a loader, which loads the calls of some threads on its own database connection.
+ */
+typedef struct __load_state
+{
+	std::vector<uint64_t> threads; // Ids of the threads this loader loads
+	uint64_t calls; // Number of calls of these threads
+	std::vector<call_aggregate_t> aggregates; // Indexed like call_list
+	std::map<uint64_t, std::pair<uint64_t, uint64_t>> ecall_spans; // First ECall start and last ECall end per enclave
+	spill_t durations; // Out-of-core mode with exact percentiles only
+	spill_t corrected_durations;
+	flame_stacks_t flame; // Call stacks of these threads, only with "--flame"
+} load_state_t;
+
+/**
+ * @brief Result of placing a call in the call tree of its thread.
+ */
+typedef struct __placed_call
+{
+	uint64_t position; // Position among the calls of the thread
+	bool has_parent;
+	open_call_t parent; // The direct parent, if has_parent
+	sibling_t predecessor; // The previous call with the same parent, predecessor.call is NO_CALL if there is none
+} placed_call_t;
 
-		if (data[6] != nullptr)
+/**
+ * @brief Aggregates of all loaders in out-of-core mode, indexed like call_list.
+ */
+static std::vector<call_aggregate_t> streamed_calls;
+
+/**
+ * @brief Subtracts the calibrated logger overhead from a duration. A call is prolonged by its own instrumentation and by that of every call nested in it.
+ * @param duration
+ * @param descendants Number of calls nested in the call
+ */
+static uint64_t corrected_duration(uint64_t duration, uint64_t descendants)
+{
+	uint64_t overhead = general_data.overhead_call + descendants * general_data.overhead_nested_call;
+	return duration > overhead ? duration - overhead : 0;
+}
+
+/**
+ * @brief Adds a duration to the running statistics of a call in out-of-core mode, and to its sketch or the spilled runs for its percentiles.
+ */
+static void stream_duration(stats_acc_t &acc, sketch_t &sketch, spill_t &spill, uint32_t call, uint64_t duration)
+{
+	accumulate_stats(acc, &duration, 1);
+	if (config.sketch_percentiles)
+	{
+		if (sketch.buckets.empty())
 		{
-			uint64_t aex_count = strtoul(data[6], nullptr, 10);
-			thiz->aex_counts->push_back(aex_count);
-			thiz->all_stats.aexs += aex_count;
+			init_sketch(sketch);
 		}
+		add_to_sketch(sketch, &duration, 1);
+	}
+	else
+	{
+		spill_value(spill, call, duration);
+	}
+}
 
-		encls[eid].first_ecall_start = encls[eid].first_ecall_start > starttime ? starttime : encls[eid].first_ecall_start;
-		encls[eid].last_ecall_end = encls[eid].last_ecall_end < endtime ? endtime : encls[eid].last_ecall_end;
+/**
+ * @brief Stores a newly placed call: in its thread's part of the call store, or in out-of-core mode only in the running statistics of its ECall/OCall.
+ */
+static void store_call(load_state_t &state, thread_t &t, call_data_t *c, call_row_t const &row, placed_call_t const &placed)
+{
+	if (config.out_of_core)
+	{
+		auto &agg = state.aggregates[c->index];
+		uint64_t aex_count = static_cast<uint32_t>(row.aex_count);
+		stream_duration(agg.durations, agg.sketch, state.durations, c->index, row.exectime);
+		accumulate_stats(agg.aex_counts, &aex_count, 1);
+		return;
+	}
 
-		thiz->exectimes->push_back(exectime);
-		thiz->all_stats.sum += exectime;
+	auto &cs = call_store;
+	auto index = t.first + placed.position;
+	cs.start[index] = row.start;
+	cs.end[index] = row.end;
+	cs.duration[index] = row.exectime;
+	cs.call[index] = c->index;
+	cs.parent[index] = placed.has_parent ? static_cast<uint32_t>(t.first + placed.parent.position) : NO_CALL;
+	cs.subtree_end[index] = static_cast<uint32_t>(index + 1);
+	cs.aex_count[index] = static_cast<uint32_t>(row.aex_count);
+}
 
-		single_call_data_t scd = {};
-		scd.event_id = iid;
-		scd.call_id = id;
-		scd.type = call_type_t::ECALL;
-		scd.start = starttime;
-		scd.end = endtime;
-		scd.exec = exectime;
-		scd.parent = nullptr;
-		auto &t = threads[tid];
+void add_breakdown(breakdown_t &into, breakdown_t const &other)
+{
+	into.calls += other.calls;
+	into.total += other.total;
+	into.self += other.self;
+	into.in_ecalls += other.in_ecalls;
+	into.in_ocalls += other.in_ocalls;
+	into.ecall_transitions += other.ecall_transitions;
+	into.ocall_transitions += other.ocall_transitions;
+}
+
+/**
+ * @brief Estimates the time spent in the transitions of a breakdown from the transition cost calibrated by the logger.
+ * It is part of the self time of the ECalls and never exceeds it. Returns 0 if the trace contains no calibration.
+ */
+uint64_t transition_time(breakdown_t const &b)
+{
+	uint64_t transitions = b.ecall_transitions * general_data.ecall_roundtrip + b.ocall_transitions * general_data.ocall_roundtrip;
+	return std::min(transitions, b.self);
+}
+
+/**
+ * @brief Adds a call whose nested calls are all placed to the time breakdown of its ECall/OCall and its thread.
+ */
+static void account_call(load_state_t &state, thread_t &t, open_call_t const &oc)
+{
+	auto c = call_list[oc.call];
+	uint64_t duration = oc.end - oc.start;
+	uint64_t nested = oc.in_ecalls + oc.in_ocalls;
+	breakdown_t b = {1, duration, duration > nested ? duration - nested : 0, oc.in_ecalls, oc.in_ocalls, 0, 0};
+	if (c->type == call_type_t::ECALL)
+	{
+		b.ecall_transitions = 1;
+		b.ocall_transitions = oc.ocalls;
+		add_breakdown(t.ecalls, b);
+	}
+	else
+	{
+		add_breakdown(t.ocalls, b);
+	}
+	add_breakdown(state.aggregates[oc.call].breakdown, b);
+	if (!config.flame.empty())
+	{
+		auto &frame = state.flame.frames[oc.frame];
+		frame.calls++;
+		frame.inclusive += b.total;
+		frame.exclusive += b.self;
+	}
+}
 
-		if (data[7] != nullptr)
+/**
+ * @brief Closes a call once the first call after all its descendants is known.
+ * @param end_position Position of the first call after the descendants
+ */
+static void close_call(load_state_t &state, thread_t &t, open_call_t const &oc, uint64_t end_position)
+{
+	account_call(state, t, oc);
+	if (!config.out_of_core)
+	{
+		call_store.subtree_end[t.first + oc.position] = static_cast<uint32_t>(t.first + end_position);
+		return;
+	}
+	if (config.overhead_correction)
+	{
+		auto &agg = state.aggregates[oc.call];
+		auto duration = corrected_duration(oc.end - oc.start, end_position - oc.position - 1);
+		stream_duration(agg.corrected_durations, agg.corrected_sketch, state.corrected_durations, oc.call, duration);
+	}
+}
+
+/**
+ * @brief Places a call in the call tree of its thread and stores it.
+ * The calls of a thread arrive ordered by start time, so the parent of a call is on the stack of open calls and every call above it has already returned.
+ * The last call of every depth is remembered, which is the predecessor of the next call with the same parent.
+ * Only the open calls and the last call of every depth are kept, so the state does not grow with the length of the trace.
+ * @param state Loader of the thread
+ * @param t Thread of the call
+ * @param c The called ECall/OCall
+ * @param row Row the call was read from
+ */
+static placed_call_t place_call(load_state_t &state, thread_t &t, call_data_t *c, call_row_t const &row)
+{
+	auto &open_calls = *t.open_calls;
+	auto &last_sibling = *t.last_sibling;
+	placed_call_t placed = {};
+	placed.position = t.count++;
+	placed.predecessor.call = NO_CALL;
+	bool orphan = false;
+
+	// Every call above the parent has returned before this call started
+	size_t depth = 0;
+	if (row.has_parent)
+	{
+		depth = open_calls.size();
+		while (depth > 0 && open_calls[depth - 1].event_id != row.parent)
+		{
+			--depth;
+		}
+		if (depth == 0)
+		{
+			// The parent did not return before the trace ended, so it is not part of the tree
+			orphan = true;
+			depth = open_calls.size();
+		}
+		else
 		{
-			uint64_t parent_event_id = strtoul(data[7], nullptr, 10);
-			for (uint64_t i = t.next_call_index - 1; ; --i)
+			placed.has_parent = true;
+			placed.parent = open_calls[depth - 1];
+			auto &parent = open_calls[depth - 1];
+			if (c->type == call_type_t::ECALL)
 			{
-				if (t.calls[i].event_id == parent_event_id)
-				{
-					auto &p = t.calls[i];
-					//thiz->direct_parents->push_back(t.calls[i].call_id);
-					auto &dpcd = thiz->direct_parents_data->at(p.call_id);
-					thiz->has_direct_parents = true;
-					thiz->num_ecall_called_from_ocalls++;
-					dpcd.count++;
-					dpcd.call_data = encls[eid].ocalls[p.call_id];
-					auto timediff_start  = scd.start - p.start;
-					auto timediff_end = p.end - scd.end;
-					if (timediff_start < 10000)
-						dpcd.num_less_than_10us_from_start++;
-					else if (timediff_start < 20000)
-						dpcd.num_less_than_20us_from_start++;
-					if (timediff_end < 10000)
-						dpcd.num_less_than_10us_from_end++;
-					else if (timediff_end < 20000)
-						dpcd.num_less_than_20us_from_end++;
-
-					scd.parent = &(t.calls[i]);
-					break;
-				}
-				else
-				{
-					assert(i != 0); // If i == 0 then we did not find a parent
-				}
+				parent.in_ecalls += row.end - row.start;
+			}
+			else
+			{
+				parent.in_ocalls += row.end - row.start;
+				parent.ocalls++;
 			}
 		}
+	}
+	for (auto i = depth; i < open_calls.size(); ++i)
+	{
+		close_call(state, t, open_calls[i], placed.position);
+	}
+	open_calls.resize(depth);
 
-		if (t.next_call_index != 0)
+	store_call(state, t, c, row, placed);
+
+	open_call_t oc = {row.id, placed.position, row.start, row.end, c->index, 0, 0, 0, 0};
+	if (!config.flame.empty())
+	{
+		oc.frame = flame_frame(state.flame, placed.has_parent ? placed.parent.frame : flame_root(state.flame, t.id), c->index);
+	}
+	if (orphan)
+	{
+		// Nothing can be nested in an orphan
+		close_call(state, t, oc, placed.position + 1);
+	}
+	else
+	{
+		if (last_sibling.size() < depth + 2)
 		{
-			// Find the next ecall that is on the same level
-			auto c = &(t.calls[t.next_call_index - 1]);
-			while (c && c > scd.parent)
-			{
-				if (c->type == call_type_t::ECALL)
-				{
-					if (c->parent == scd.parent)
-					{
-						// scd:  single_call_data of this call
-						// thiz: call_data of this call
-						// c:    single_call_data of the indirect parent (predecessor call of same type on same level)
-						// ipcd: parent_call_data of the indirect parent (but referenced by this call)
-						uint64_t timediff = scd.start - c->end;
-						auto &ipcd = thiz->indirect_parents_data->at(c->call_id);
-
-						thiz->has_indirect_parents = true;
-						ipcd.call_data = encls[eid].ecalls[c->call_id];
-						ipcd.count++;
-
-						if (timediff < 1000)
-							ipcd.num_less_1us++;
-						else if (timediff < 5000)
-							ipcd.num_less_5us++;
-						else if (timediff < 10000)
-							ipcd.num_less_10us++;
-						else if (timediff < 20000)
-							ipcd.num_less_20us++;
-						break;
-					}
-					c = c->parent ? c->parent - 1 : nullptr;
-					continue;
-				}
-				else if (c->type == call_type_t::OCALL)
-				{
-					c = c->parent;
-					continue;
-				}
-			}
+			last_sibling.resize(depth + 2, {0, NO_CALL});
 		}
+		placed.predecessor = last_sibling[depth];
+		last_sibling[depth] = {row.end, c->index};
+		last_sibling[depth + 1].call = NO_CALL;
+		open_calls.push_back(oc);
+	}
 
-		t.calls[t.next_call_index] = scd;
-		t.next_call_index++;
+	return placed;
+}
 
-		thiz->single_calls->push_back(&t.calls[t.next_call_index]);
+/**
+ * @brief Closes the calls of a thread that are still open after its last call and frees its loading state.
+ */
+static void finish_thread(load_state_t &state, thread_t &t)
+{
+	for (auto &oc : *t.open_calls)
+	{
+		close_call(state, t, oc, t.count);
 	}
-	else if (type == 17)
+	delete t.open_calls;
+	delete t.last_sibling;
+	t.open_calls = nullptr;
+	t.last_sibling = nullptr;
+}
+
+static void count_direct_parent(parent_call_data_t &dpcd, uint64_t timediff_start, uint64_t timediff_end)
+{
+	dpcd.count++;
+	if (timediff_start < 10000)
+		dpcd.num_less_than_10us_from_start++;
+	else if (timediff_start < 20000)
+		dpcd.num_less_than_20us_from_start++;
+	if (timediff_end < 10000)
+		dpcd.num_less_than_10us_from_end++;
+	else if (timediff_end < 20000)
+		dpcd.num_less_than_20us_from_end++;
+}
+
+static void count_indirect_parent(parent_call_data_t &ipcd, uint64_t timediff)
+{
+	ipcd.count++;
+	if (timediff < 1000)
+		ipcd.num_less_1us++;
+	else if (timediff < 5000)
+		ipcd.num_less_5us++;
+	else if (timediff < 10000)
+		ipcd.num_less_10us++;
+	else if (timediff < 20000)
+		ipcd.num_less_20us++;
+	count_bucket(ipcd.below, timediff);
+}
+
+static void load_call(load_state_t &state, call_row_t const &row)
+{
+	uint64_t type = row.type;
+	uint64_t id = row.call_id;
+	uint64_t eid = row.eid;
+	uint64_t starttime = row.start;
+	uint64_t endtime = row.end;
+	if (type == EnclaveECallEventId)
+	{
+		// ecall
+		auto thiz = encls.at(eid).ecalls[id];
+		auto &agg = state.aggregates[thiz->index];
+
+		agg.aexs += row.aex_count;
+
+		auto span = state.ecall_spans.emplace(eid, std::make_pair(UINT64_MAX, (uint64_t)0)).first;
+		span->second.first = span->second.first > starttime ? starttime : span->second.first;
+		span->second.second = span->second.second < endtime ? endtime : span->second.second;
+
+		auto &t = threads.at(row.thread);
+		auto placed = place_call(state, t, thiz, row);
+		agg.count++;
+
+		if (placed.has_parent)
+		{
+			auto &p = placed.parent;
+			auto pcd = call_list[p.call];
+			auto &dpcd = parent_data(&agg.direct_parents_data, pcd);
+			agg.num_ecall_called_from_ocalls++;
+			count_direct_parent(dpcd, starttime - p.start, p.end - endtime);
+		}
+
+		if (placed.predecessor.call != NO_CALL)
+		{
+			// thiz: call_data of this call
+			// c:    the indirect parent (predecessor call on the same level)
+			// ipcd: parent_call_data of the indirect parent (but referenced by this call)
+			auto &c = placed.predecessor;
+			uint64_t timediff = starttime - c.end;
+			auto &ipcd = parent_data(&agg.indirect_parents_data, call_list[c.call]);
+			count_indirect_parent(ipcd, timediff);
+		}
+	}
+	else if (type == EnclaveOCallEventId)
 	{
 		// ocall
-		auto thiz = encls[eid].ocalls[id];
-		thiz->exectimes->push_back(exectime);
-		thiz->all_stats.sum += exectime;
-
-		single_call_data_t scd = {};
-		scd.event_id = iid;
-		scd.call_id = id;
-		scd.type = call_type_t::OCALL;
-		scd.start = starttime;
-		scd.end = endtime;
-		scd.exec = exectime;
-		scd.parent = nullptr;
-		auto &t = threads[tid];
-
-		if (data[7] != nullptr)
-		{
-			uint64_t parent_event_id = strtoul(data[7], nullptr, 10);
-			for (uint64_t i = t.next_call_index - 1; ; --i)
-			{
-				if (t.calls[i].event_id == parent_event_id)
-				{
-					auto &p = t.calls[i];
-					//thiz->direct_parents->push_back(t.calls[i].call_id);
-					auto &dpcd = thiz->direct_parents_data->at(p.call_id);
-					thiz->has_direct_parents = true;
-					dpcd.count++;
-					dpcd.call_data = encls[eid].ecalls[p.call_id];
-					auto timediff_start  = scd.start - p.start;
-					auto timediff_end = p.end - scd.end;
-					if (timediff_start < 10000)
-						dpcd.num_less_than_10us_from_start++;
-					else if (timediff_start < 20000)
-						dpcd.num_less_than_20us_from_start++;
-					if (timediff_end < 10000)
-						dpcd.num_less_than_10us_from_end++;
-					else if (timediff_end < 20000)
-						dpcd.num_less_than_20us_from_end++;
-
-					scd.parent = &(t.calls[i]);
-					break;
-				}
-				else
-				{
-					assert(i != 0); // If i == 0 then we did not find a parent
-				}
-			}
+		auto thiz = encls.at(eid).ocalls[id];
+		auto &agg = state.aggregates[thiz->index];
+		auto &t = threads.at(row.thread);
+		auto placed = place_call(state, t, thiz, row);
+		agg.count++;
+
+		if (placed.has_parent)
+		{
+			auto &p = placed.parent;
+			auto pcd = call_list[p.call];
+			auto &dpcd = parent_data(&agg.direct_parents_data, pcd);
+			count_direct_parent(dpcd, starttime - p.start, p.end - endtime);
+		}
+
+		if (placed.predecessor.call != NO_CALL)
+		{
+			auto &c = placed.predecessor;
+			uint64_t timediff = starttime - c.end;
+			auto &pcd = parent_data(&agg.indirect_parents_data, call_list[c.call]);
+			count_indirect_parent(pcd, timediff);
 		}
+	}
+}
 
-		if (t.next_call_index != 0)
+/**
+ * @brief Adds the parent relations one loader observed to those of a call.
+ * @param parents Relations of the call, sorted by call id
+ * @param observed Relations observed by the loader, sorted by call id
+ */
+static void merge_parent_data(std::vector<parent_call_data_t> *parents, std::vector<parent_call_data_t> const &observed)
+{
+	for (auto const &o : observed)
+	{
+		auto &pcd = parent_data(parents, o.call_data);
+		pcd.count += o.count;
+		pcd.num_less_than_10us_from_start += o.num_less_than_10us_from_start;
+		pcd.num_less_than_20us_from_start += o.num_less_than_20us_from_start;
+		pcd.num_less_than_10us_from_end += o.num_less_than_10us_from_end;
+		pcd.num_less_than_20us_from_end += o.num_less_than_20us_from_end;
+		pcd.num_less_1us += o.num_less_1us;
+		pcd.num_less_5us += o.num_less_5us;
+		pcd.num_less_10us += o.num_less_10us;
+		pcd.num_less_20us += o.num_less_20us;
+		for (size_t b = 0; b < MAX_BUCKETS; ++b)
 		{
-			// Find the next ocall that is on the same level
-			auto c = &(t.calls[t.next_call_index - 1]);
-			while (c && c > scd.parent)
+			pcd.below[b] += o.below[b];
+		}
+	}
+}
+
+static void merge_streamed_sketch(sketch_t &into, sketch_t const &other)
+{
+	if (other.buckets.empty())
+	{
+		return;
+	}
+	if (into.buckets.empty())
+	{
+		init_sketch(into);
+	}
+	merge_sketch(into, other);
+}
+
+static void init_aggregates(std::vector<call_aggregate_t> &aggregates)
+{
+	aggregates.resize(call_list.size());
+	for (auto &agg : aggregates)
+	{
+		init_stats_acc(agg.durations);
+		init_stats_acc(agg.corrected_durations);
+		init_stats_acc(agg.aex_counts);
+	}
+}
+
+/**
+ * @brief Merges the counters of a loader into the call data and the enclaves.
+ * @param state
+ */
+static void merge_load_state(load_state_t &state)
+{
+	for (auto c : call_list)
+	{
+		auto &agg = state.aggregates[c->index];
+		if (agg.count == 0)
+		{
+			continue;
+		}
+		c->count += agg.count;
+		c->all_stats.aexs += agg.aexs;
+		c->num_ecall_called_from_ocalls += agg.num_ecall_called_from_ocalls;
+		add_breakdown(c->breakdown, agg.breakdown);
+		merge_parent_data(c->direct_parents_data, agg.direct_parents_data);
+		merge_parent_data(c->indirect_parents_data, agg.indirect_parents_data);
+		c->has_direct_parents = !c->direct_parents_data->empty();
+		c->has_indirect_parents = !c->indirect_parents_data->empty();
+		if (config.out_of_core)
+		{
+			auto &total = streamed_calls[c->index];
+			merge_stats_acc(total.durations, agg.durations);
+			merge_stats_acc(total.corrected_durations, agg.corrected_durations);
+			merge_stats_acc(total.aex_counts, agg.aex_counts);
+			merge_streamed_sketch(total.sketch, agg.sketch);
+			merge_streamed_sketch(total.corrected_sketch, agg.corrected_sketch);
+		}
+	}
+	for (auto const &span : state.ecall_spans)
+	{
+		auto &e = encls.at(span.first);
+		e.first_ecall_start = std::min(e.first_ecall_start, span.second.first);
+		e.last_ecall_end = std::max(e.last_ecall_end, span.second.second);
+	}
+	state.aggregates.clear();
+	state.aggregates.shrink_to_fit();
+}
+
+/**
+ * @brief Distributes the threads over the given number of loaders, the thread with the most calls goes to the loader with the fewest.
+ * @param loaders
+ */
+static std::vector<load_state_t> plan_loaders(size_t loaders)
+{
+	std::vector<thread_t *> by_calls;
+	for (auto &p : threads)
+	{
+		by_calls.push_back(&p.second);
+	}
+	std::stable_sort(by_calls.begin(), by_calls.end(), [](thread_t *a, thread_t *b) { return a->expected > b->expected; });
+
+	std::vector<load_state_t> states(std::max((size_t)1, std::min(loaders, by_calls.size())));
+	for (auto t : by_calls)
+	{
+		auto &state = *std::min_element(states.begin(), states.end(), [](load_state_t const &a, load_state_t const &b) { return a.calls < b.calls; });
+		state.threads.push_back(t->id);
+		state.calls += t->expected;
+	}
+	for (auto &state : states)
+	{
+		std::sort(state.threads.begin(), state.threads.end());
+		init_aggregates(state.aggregates);
+		state.durations.fd = -1;
+		state.corrected_durations.fd = -1;
+		if (config.out_of_core && !config.sketch_percentiles)
+		{
+			open_spill(state.durations, config.spill_dir, call_list.size());
+			if (config.overhead_correction)
 			{
-				if (c->type == call_type_t::OCALL)
-				{
-					if (c->parent == scd.parent)
-					{
-						uint64_t timediff = scd.start - c->end;
-						auto &pcd = thiz->indirect_parents_data->at(c->call_id);
-						thiz->has_indirect_parents = true;
-						pcd.call_data = encls[eid].ocalls[c->call_id];
-						pcd.count++;
-						if (timediff < 1000)
-							pcd.num_less_1us++;
-						else if (timediff < 5000)
-							pcd.num_less_5us++;
-						else if (timediff < 10000)
-							pcd.num_less_10us++;
-						else if (timediff < 20000)
-							pcd.num_less_20us++;
-						break;
-					}
-					c = c->parent ? c->parent - 1 : nullptr;
-					continue;
-				}
-				else if (c->type == call_type_t::ECALL)
-				{
-					c = c->parent;
-					continue;
-				}
+				open_spill(state.corrected_durations, config.spill_dir, call_list.size());
 			}
 		}
+	}
+	return states;
+}
+
+/**
+ * @brief Finishes loading the call store: groups all calls by ECall/OCall.
+ * Also subtracts the calibrated logger overhead if requested, see corrected_duration().
+ */
+static void group_calls()
+{
+	auto &cs = call_store;
+	uint64_t offset = 0;
+	for (auto c : call_list)
+	{
+		c->first = offset;
+		offset += c->count;
+	}
+
+	std::vector<uint64_t> next(call_list.size());
+	std::transform(call_list.begin(), call_list.end(), next.begin(), [](call_data_t *c) { return c->first; });
+	cs.by_call.resize(cs.start.size());
+	for (uint32_t i = 0; i < cs.start.size(); ++i)
+	{
+		cs.by_call[next[cs.call[i]]++] = i;
+	}
 
-		t.calls[t.next_call_index] = scd;
-		t.next_call_index++;
+	cs.sorted_duration.resize(cs.by_call.size());
+	parallel_for(0, cs.by_call.size(), 0, [&cs](size_t begin, size_t end) {
+		std::transform(cs.by_call.begin() + begin, cs.by_call.begin() + end, cs.sorted_duration.begin() + begin, [&cs](uint32_t i) { return cs.duration[i]; });
+	});
 
-		thiz->single_calls->push_back(&t.calls[t.next_call_index]);
+	if (config.overhead_correction)
+	{
+		cs.corrected_duration.resize(cs.by_call.size());
+		parallel_for(0, cs.by_call.size(), 0, [&cs](size_t begin, size_t end) {
+			std::transform(cs.by_call.begin() + begin, cs.by_call.begin() + end, cs.corrected_duration.begin() + begin, [&cs](uint32_t i) {
+				return corrected_duration(cs.duration[i], cs.subtree_end[i] - i - 1);
+			});
+		});
 	}
+}
 
-	return 0;
+/**
+ * @brief Durations of all calls to the given ECall/OCall.
+ * With exact percentiles, they are partitioned at every quantile rank once the statistics are generated, see exact_quantiles().
+ */
+column_range_t<uint64_t> exectimes(call_data_t *c)
+{
+	auto first = call_store.sorted_duration.data() + c->first;
+	return {first, first + c->count};
 }
 
-static void calc_stats(stats_t &s, call_data_t *c)
+/**
+ * @brief Durations without logger overhead of all calls to the given ECall/OCall. Empty unless overhead correction is enabled.
+ */
+column_range_t<uint64_t> corrected_exectimes(call_data_t *c)
 {
-	if (s.calls > 0)
+	if (call_store.corrected_duration.empty())
 	{
-		s.avg = s.sum / s.calls;
+		return {nullptr, nullptr};
+	}
+	auto first = call_store.corrected_duration.data() + c->first;
+	return {first, first + c->count};
+}
 
-		std::vector<int64_t> diff(s.calls);
-		std::transform(c->exectimes->begin(), c->exectimes->begin() + s.calls, diff.begin(), [&s](uint64_t x) { return x - s.avg; });
-		s.sq_sum = (uint64_t)std::inner_product(diff.begin(), diff.end(), diff.begin(), 0L);
+/**
+ * @brief Indices of all calls to the given ECall/OCall in the call store, in the order they were loaded.
+ */
+column_range_t<uint32_t> invocations(call_data_t *c)
+{
+	auto first = call_store.by_call.data() + c->first;
+	return {first, first + c->count};
+}
 
-		s.num_less_1us = static_cast<uint64_t>(std::count_if(c->exectimes->begin(), c->exectimes->begin() + s.calls, [](uint64_t val) { return val < 1000;}));
-		s.num_less_5us = static_cast<uint64_t>(std::count_if(c->exectimes->begin(), c->exectimes->begin() + s.calls, [](uint64_t val) { return val < 5000;}));
-		s.num_less_10us = static_cast<uint64_t>(std::count_if(c->exectimes->begin(), c->exectimes->begin() + s.calls, [](uint64_t val) { return val < 10000;}));
+/**
+ * @brief Computes all percentiles of the given durations, either exactly or with a sketch, see config.sketch_percentiles.
+ * @param q
+ * @param times Reordered in exact mode
+ * @param keep Set to the sketch of the durations, which is also built in exact mode then. May be nullptr.
+ */
+static void calc_quantiles(quantiles_t &q, column_range_t<uint64_t> times, sketch_t *keep = nullptr)
+{
+	sketch_t s;
+	auto &sketch = keep != nullptr ? *keep : s;
+	if (config.sketch_percentiles || keep != nullptr)
+	{
+		sketch_values(sketch, times.begin(), times.size());
+	}
+	if (config.sketch_percentiles)
+	{
+		sketch_quantiles(q, sketch);
+	}
+	else
+	{
+		exact_quantiles(q, times.begin(), times.size());
+	}
+}
 
-		s.std = (uint64_t)std::sqrt(s.sq_sum / s.calls);
+static void calc_corrected_stats(call_data_t *c)
+{
+	if (!config.overhead_correction)
+	{
+		return;
 	}
+
+	auto corrected = corrected_exectimes(c);
+	calc_stats(c->corrected_stats, corrected.begin(), corrected.size());
+	calc_quantiles(c->corrected_quantiles, corrected);
 }
 
 static void calc_aex_stats(stats_t &s, call_data_t *c)
 {
-	s.calls = c->aex_counts->size();
-	if (s.calls == 0)
+	if (config.out_of_core)
+	{
+		finish_stats(s, streamed_calls[c->index].aex_counts);
+		return;
+	}
+	auto calls = invocations(c);
+	std::vector<uint64_t> aex_counts(calls.size());
+	std::transform(calls.begin(), calls.end(), aex_counts.begin(), [](uint32_t i) { return call_store.aex_count[i]; });
+	calc_stats(s, aex_counts.data(), aex_counts.size());
+}
+
+/**
+ * @brief Sorted runs of all loaders in out-of-core mode with exact percentiles.
+ */
+static std::vector<spill_t *> duration_spills;
+static std::vector<spill_t *> corrected_duration_spills;
+
+/**
+ * @brief Computes exact percentiles by merging the sorted runs of a call. On the way, the statistics of the fastest 95% are computed like in calc_call_stats().
+ * @param q
+ * @param fastest Set to the statistics of the fastest 95%, may be nullptr
+ * @param keep Set to the sketch of the values, may be nullptr
+ * @param spills
+ * @param c
+ */
+static void calc_spilled_quantiles(quantiles_t &q, stats_t *fastest, sketch_t *keep, std::vector<spill_t *> const &spills, call_data_t *c)
+{
+	q = {};
+	if (c->count == 0)
 	{
 		return;
 	}
+	uint64_t fastest_count = quantile_rank(quantile_levels[QUANTILE_95TH], c->count);
+	stats_acc_t acc;
+	init_stats_acc(acc);
+	if (keep != nullptr)
+	{
+		init_sketch(*keep);
+	}
+
+	uint64_t seen = 0;
+	size_t i = 0;
+	merge_runs(spills, c->index, config.spill_dir, [&](uint64_t const *values, size_t count) {
+		if (seen < fastest_count)
+		{
+			accumulate_stats(acc, values, std::min((uint64_t)count, fastest_count - seen));
+		}
+		if (keep != nullptr)
+		{
+			add_to_sketch(*keep, values, count);
+		}
+		while (i < QUANTILE_COUNT && quantile_rank(quantile_levels[i], c->count) < seen + count)
+		{
+			q.value[i] = values[quantile_rank(quantile_levels[i], c->count) - seen];
+			++i;
+		}
+		seen += count;
+	});
+
+	if (fastest != nullptr)
+	{
+		finish_stats(*fastest, acc);
+	}
+}
+
+/**
+ * @brief Computes the statistics and percentiles of an ECall/OCall in out-of-core mode, from the running statistics and either the sketches or the sorted runs.
+ * With exact percentiles, the results are the same as in memory. With sketches, the statistics of the fastest 95% are estimated from the sketch, too.
+ * @param c
+ */
+static void calc_streamed_call_stats(call_data_t *c)
+{
+	auto &agg = streamed_calls[c->index];
+	finish_stats(c->all_stats, agg.durations);
+	if (config.sketch_percentiles)
+	{
+		stats_acc_t fastest;
+		sketch_quantiles(c->quantiles, agg.sketch);
+		sketch_stats(fastest, agg.sketch, c->quantiles.value[QUANTILE_95TH]);
+		finish_stats(c->stats_95th, fastest);
+		if (cache_enabled())
+		{
+			c->sketch = agg.sketch;
+		}
+	}
+	else
+	{
+		calc_spilled_quantiles(c->quantiles, &c->stats_95th, cache_enabled() ? &c->sketch : nullptr, duration_spills, c);
+	}
 
-	s.sum = std::accumulate(c->aex_counts->begin(), c->aex_counts->begin() + s.calls, 0UL);
-	s.min = *std::min_element(c->aex_counts->begin(), c->aex_counts->begin() + s.calls);
-	s.max = *std::max_element(c->aex_counts->begin(), c->aex_counts->begin() + s.calls);
+	if (config.overhead_correction)
+	{
+		finish_stats(c->corrected_stats, agg.corrected_durations);
+		if (config.sketch_percentiles)
+		{
+			sketch_quantiles(c->corrected_quantiles, agg.corrected_sketch);
+		}
+		else
+		{
+			calc_spilled_quantiles(c->corrected_quantiles, nullptr, nullptr, corrected_duration_spills, c);
+		}
+	}
+}
+
+/**
+ * @brief Computes the statistics and percentiles of an ECall/OCall.
+ * The statistics of the fastest 95% cover the values up to the 95% quantile, which is approximated in sketch mode.
+ * @param c
+ */
+static void calc_call_stats(call_data_t *c)
+{
+	if (config.out_of_core)
+	{
+		calc_streamed_call_stats(c);
+		return;
+	}
 
-	if (c->aex_counts != nullptr)
+	auto times = exectimes(c);
+	calc_stats(c->all_stats, times.begin(), times.size());
+	calc_quantiles(c->quantiles, times, cache_enabled() ? &c->sketch : nullptr);
+	if (config.sketch_percentiles)
 	{
-		s.avg = s.sum / s.calls;
-		std::vector<int64_t> diff(s.calls);
-		std::transform(c->aex_counts->begin(), c->aex_counts->begin() + s.calls, diff.begin(), [&s](uint64_t x) { return x - s.avg; });
-		s.sq_sum = (uint64_t)std::inner_product(diff.begin(), diff.end(), diff.begin(), 0L);
-		s.std = (uint64_t)std::sqrt(s.sq_sum / s.calls);
+		calc_stats(c->stats_95th, times.begin(), times.size(), c->quantiles.value[QUANTILE_95TH]);
 	}
+	else
+	{
+		calc_stats(c->stats_95th, times.begin(), quantile_rank(quantile_levels[QUANTILE_95TH], times.size()));
+	}
+	calc_corrected_stats(c);
 }
 
 static bool batch_opportunity(parent_call_data_t &pcd)
@@ -428,31 +1034,245 @@ static bool merge_opportunity(parent_call_data_t &pcd, call_data_t *c)
 	return w > config.merging_weights.epsilon;
 }
 
-static bool duplication_or_move_opportunity(call_data_t *c)
+static bool duplication_or_move_opportunity(call_data_t *c)
+{
+	auto r = (c->stats_95th.num_less_1us / (double) c->stats_95th.calls) > config.duplication_weights.alpha;
+	r = r || (c->stats_95th.num_less_5us / (double) c->stats_95th.calls) > config.duplication_weights.beta;
+	r = r || (c->stats_95th.num_less_10us / (double) c->stats_95th.calls) > config.duplication_weights.gamma;
+
+	return r;
+}
+
+static bool reorder_start_opportunity(parent_call_data_t &pcd)
+{
+	auto w = 0.0;
+	w += (pcd.num_less_than_10us_from_start / (double)pcd.count) * config.reordering_weights.alpha;
+	w += (pcd.num_less_than_20us_from_start / (double)pcd.count) * config.reordering_weights.beta;
+
+	return w > config.reordering_weights.gamma;
+}
+
+static bool reorder_end_opportunity(parent_call_data_t &pcd)
+{
+	auto w = 0.0;
+	w += (pcd.num_less_than_10us_from_end / (double)pcd.count) * config.reordering_weights.alpha;
+	w += (pcd.num_less_than_20us_from_end / (double)pcd.count) * config.reordering_weights.beta;
+
+	return w > config.reordering_weights.gamma;
+}
+
+/**
+ * Estimates the time saved by avoiding @p transitions calls of the given type, using the transition cost calibrated by the logger.
+ * Returns 0 if the trace contains no calibration.
+ */
+static uint64_t transition_savings(call_type_t type, uint64_t transitions)
+{
+	return transitions * (type == call_type_t::ECALL ? general_data.ecall_roundtrip : general_data.ocall_roundtrip);
+}
+
+static std::string savingsformat(call_type_t type, uint64_t transitions)
+{
+	std::stringstream ss;
+	ss << " (" << transitions << " transitions";
+	auto saved = transition_savings(type, transitions);
+	if (saved > 0)
+	{
+		ss << ", saves ~" << timeformat(saved);
+	}
+	ss << ")";
+	return ss.str();
+}
+
+static std::string errorformat(quantiles_t const &q)
+{
+	if (q.error == 0)
+	{
+		return "";
+	}
+	std::stringstream ss;
+	ss.precision(2);
+	ss << " (± " << q.error * 100 << "%)";
+	return ss.str();
+}
+
+static std::string callname(call_data_t *c)
+{
+	std::stringstream ss;
+	ss << (c->type == call_type_t::ECALL ? "ECall [" : "OCall [") << c->call_id << "] " << *c->name;
+	return ss.str();
+}
+
+/**
+ * Collects the recommendations of all calls that are printed, ranked by the estimated time they save.
+ * Without a transition calibration in the trace, they are ranked by the number of transitions they avoid.
+ */
+static std::vector<recommendation_t> collect_recommendations()
+{
+	std::vector<recommendation_t> recommendations;
+	for (auto &p : encls)
+	{
+		auto eid = p.first;
+		auto add = [&recommendations, eid](call_data_t *c, std::string const &text, uint64_t transitions) {
+			recommendations.push_back({eid, c, text, transitions, transition_savings(c->type, transitions)});
+		};
+
+		for (auto calls : {&p.second.ecalls, &p.second.ocalls})
+		{
+			for (auto c : *calls)
+			{
+				auto print_min = c->type == call_type_t::ECALL ? config.ecall_call_minimum : config.ocall_call_minimum;
+				if (c->all_stats.calls == 0 || c->all_stats.calls < print_min)
+				{
+					continue;
+				}
+
+				if (c->type == call_type_t::OCALL && duplication_or_move_opportunity(c))
+				{
+					add(c, "Duplicate or move " + callname(c) + " into the enclave", c->all_stats.calls);
+				}
+
+				if (c->type == call_type_t::OCALL || c->num_ecall_called_from_ocalls > 0)
+				{
+					for (auto &pc : *c->direct_parents_data)
+					{
+						if (reorder_start_opportunity(pc))
+						{
+							add(c, "Reorder " + callname(c) + " to execute before " + callname(pc.call_data), pc.count);
+						}
+						else if (reorder_end_opportunity(pc))
+						{
+							add(c, "Reorder " + callname(c) + " to execute after " + callname(pc.call_data), pc.count);
+						}
+					}
+				}
+
+				if (c->has_indirect_parents)
+				{
+					for (auto &pc : *c->indirect_parents_data)
+					{
+						if (pc.call_data == c && batch_opportunity(pc))
+						{
+							add(c, "Batch calls to " + callname(c), pc.count);
+						}
+						else if (pc.call_data != c && merge_opportunity(pc, c))
+						{
+							add(c, "Merge " + callname(c) + " with " + callname(pc.call_data), pc.count);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	std::stable_sort(recommendations.begin(), recommendations.end(), [](recommendation_t const &a, recommendation_t const &b) {
+		return a.saved != b.saved ? a.saved > b.saved : a.transitions > b.transitions;
+	});
+	return recommendations;
+}
+
+/**
+ * @brief Prints how many calls of the given ECalls/OCalls fall below each bucket bound.
+ * @param calls
+ * @param total Number of all calls to them
+ */
+static void print_buckets(std::vector<call_data_t *> &calls, uint64_t total)
+{
+	for (size_t b = 0; b < config.buckets.count; ++b)
+	{
+		uint64_t below = std::accumulate(calls.begin(), calls.end(), (uint64_t)0, [b](uint64_t a, call_data_t *c) { return a + c->all_stats.below[b]; });
+		std::cout << "| # < " << bucketname(b) << ": " << countformat(below, total, true) << std::endl;
+	}
+}
+
+/**
+ * @brief Formats a part of a time together with its share, e.g. "3 ms (25%)".
+ */
+static std::string shareformat(uint64_t part, uint64_t whole)
+{
+	std::stringstream ss;
+	ss << timeformat(part) << " (" << std::setprecision(3) << (whole > 0 ? part * 100.0 / whole : 0.0) << "%)";
+	return ss.str();
+}
+
+/**
+ * @brief Prints the average self time of an ECall/OCall, i.e. without the calls nested in it.
+ * For ECalls, the self time is split into the estimated transitions and the work inside the enclave.
+ */
+static void print_call_breakdown(call_data_t *c)
 {
-	auto r = (c->stats_95th.num_less_1us / (double) c->stats_95th.calls) > config.duplication_weights.alpha;
-	r = r || (c->stats_95th.num_less_5us / (double) c->stats_95th.calls) > config.duplication_weights.beta;
-	r = r || (c->stats_95th.num_less_10us / (double) c->stats_95th.calls) > config.duplication_weights.gamma;
-
-	return r;
+	auto &b = c->breakdown;
+	if (b.calls == 0)
+	{
+		return;
+	}
+	auto avg = [&b](uint64_t t) { return t / b.calls; };
+	if (c->type == call_type_t::ECALL)
+	{
+		std::cout << "| | Ø self time: " << shareformat(avg(b.self), avg(b.total)) << ", Ø in nested OCalls: " << shareformat(avg(b.in_ocalls), avg(b.total)) << std::endl;
+		if (general_data.ecall_roundtrip > 0)
+		{
+			auto transitions = transition_time(b);
+			std::cout << "| | | Ø round trips: " << (b.ecall_transitions + b.ocall_transitions) / (double)b.calls << " (~" << timeformat(avg(transitions))
+			          << "), Ø work in the enclave: ~" << timeformat(avg(b.self - transitions)) << std::endl;
+		}
+	}
+	else if (b.in_ecalls > 0)
+	{
+		std::cout << "| | Ø self time: " << shareformat(avg(b.self), avg(b.total)) << ", Ø in nested ECalls: " << shareformat(avg(b.in_ecalls), avg(b.total)) << std::endl;
+	}
 }
 
-static bool reorder_start_opportunity(parent_call_data_t &pcd)
+/**
+ * @brief Prints where the time of a thread or an enclave went: work inside the enclave, transitions and untrusted code in OCalls.
+ * Every call only counts its self time, so nothing is counted twice.
+ * @param ecalls Breakdown of all ECalls
+ * @param ocalls Breakdown of all OCalls
+ */
+static void print_time_totals(breakdown_t const &ecalls, breakdown_t const &ocalls)
 {
-	auto w = 0.0;
-	w += (pcd.num_less_than_10us_from_start / (double)pcd.count) * config.reordering_weights.alpha;
-	w += (pcd.num_less_than_20us_from_start / (double)pcd.count) * config.reordering_weights.beta;
-
-	return w > config.reordering_weights.gamma;
+	auto total = ecalls.self + ocalls.self;
+	auto transitions = transition_time(ecalls);
+	std::cout << "| Time in calls: " << timeformat(total, true) << " (" << ecalls.calls << " ECalls, " << ocalls.calls << " OCalls)" << std::endl;
+	std::cout << "| | In the enclave: " << shareformat(ecalls.self, total) << std::endl;
+	if (general_data.ecall_roundtrip > 0)
+	{
+		std::cout << "| | | Useful work: ~" << shareformat(ecalls.self - transitions, total) << std::endl;
+		std::cout << "| | | Transitions: ~" << shareformat(transitions, total);
+	}
+	else
+	{
+		std::cout << "| | | Transitions: ?";
+	}
+	std::cout << ", " << ecalls.ecall_transitions << " ECall and " << ecalls.ocall_transitions << " OCall round trips" << std::endl;
+	std::cout << "| | In OCalls: " << shareformat(ocalls.self, total) << std::endl;
 }
 
-static bool reorder_end_opportunity(parent_call_data_t &pcd)
+/**
+ * @brief Prints the time breakdown of every enclave and thread.
+ */
+static void print_breakdowns()
 {
-	auto w = 0.0;
-	w += (pcd.num_less_than_10us_from_end / (double)pcd.count) * config.reordering_weights.alpha;
-	w += (pcd.num_less_than_20us_from_end / (double)pcd.count) * config.reordering_weights.beta;
-
-	return w > config.reordering_weights.gamma;
+	if (general_data.ecall_roundtrip == 0)
+	{
+		std::cout << YELLOW() << "/!\\ Trace contains no transition calibration, the time in the enclave includes the transitions" << NORMAL() << std::endl;
+	}
+	for (auto &p : encls)
+	{
+		std::cout << "/ Enclave " << p.first << std::endl;
+		print_time_totals(p.second.ecall_breakdown, p.second.ocall_breakdown);
+		std::cout << "\\ ___" << std::endl;
+	}
+	for (auto &p : threads)
+	{
+		auto &t = p.second;
+		if (t.ecalls.calls + t.ocalls.calls == 0)
+		{
+			continue;
+		}
+		std::cout << "/ Thread " << t.id << " (pthread " << t.pthread_id << ")" << std::endl;
+		print_time_totals(t.ecalls, t.ocalls);
+		std::cout << "\\ ___" << std::endl;
+	}
 }
 
 void print_call_data(enclave_data_t &e, call_data_t *c, uint64_t print_min)
@@ -471,8 +1291,17 @@ void print_call_data(enclave_data_t &e, call_data_t *c, uint64_t print_min)
 		std::cout << "| | Overall duration: " << timeformat(c->all_stats.sum, true) << std::endl;
 		std::cout << "| | Ø duration: " << timeformat(c->all_stats.avg, true) << " ± "
 		          << timeformat(c->all_stats.std, true) << std::endl;
-		std::cout << "| | Longest call took " << timeformat(c->exectimes->at(c->exectimes->size() - 1), true)
+		std::cout << "| | Longest call took " << timeformat(c->all_stats.max, true)
 		          << std::endl;
+		print_call_breakdown(c);
+		if (config.overhead_correction && general_data.overhead_call > 0)
+		{
+			std::cout << "| | Ø duration without logger overhead: " << timeformat(c->corrected_stats.avg, true) << " ± "
+			          << timeformat(c->corrected_stats.std, true) << std::endl;
+			std::cout << "| | | 50% / 95% of calls are faster than "
+			          << timeformat(c->corrected_quantiles.value[0]) << " / "
+			          << timeformat(c->corrected_quantiles.value[QUANTILE_95TH]) << errorformat(c->corrected_quantiles) << std::endl;
+		}
 		if (c->type == call_type_t::ECALL)
 		{
 			std::cout << "| | # called directly: " << countformat(c->all_stats.calls - c->num_ecall_called_from_ocalls, c->all_stats.calls) << std::endl;
@@ -482,59 +1311,54 @@ void print_call_data(enclave_data_t &e, call_data_t *c, uint64_t print_min)
 				std::cout << "| | \\ " << YELLOW() << "/!\\ Call can be made private." << NORMAL() << std::endl;
 			}
 		}
-		if (c->type == call_type_t::OCALL)
-			std::cout << "| | # < 1µs: " << countformat(c->all_stats.num_less_1us, c->all_stats.calls, true) << std::endl;
-		std::cout << "| | # < 5µs: " << countformat(c->all_stats.num_less_5us, c->all_stats.calls, true) << std::endl;
-		std::cout << "| | # < 10µs: " << countformat(c->all_stats.num_less_10us, c->all_stats.calls, true) << std::endl;
+		for (size_t b = 0; b < config.buckets.count; ++b)
+			std::cout << "| | # < " << bucketname(b) << ": " << countformat(c->all_stats.below[b], c->all_stats.calls, true) << std::endl;
 		if (c->type == call_type_t::OCALL)
 		{
 			auto w = duplication_or_move_opportunity(c);
 			if (w)
 			{
-				std::cout << "| | " << YELLOW() << "/!\\ Duplicate or move this OCall into the enclave" << NORMAL() << std::endl;
+				std::cout << "| | " << YELLOW() << "/!\\ Duplicate or move this OCall into the enclave" << savingsformat(c->type, c->all_stats.calls) << NORMAL() << std::endl;
 			}
 		}
 		std::cout << "| |" << std::endl;
-		std::cout << "| | 50% of calls are faster than "
-		          << timeformat(c->exectimes->at(percentile_idx(50 / 100.0, c->exectimes))) << std::endl;
-		std::cout << "| | 75% of calls are faster than "
-		          << timeformat(c->exectimes->at(percentile_idx(75 / 100.0, c->exectimes))) << std::endl;
-		std::cout << "| | 95% of calls are faster than "
-		          << timeformat(c->exectimes->at(percentile_idx(95 / 100.0, c->exectimes))) << std::endl;
-		std::cout << "| | | Ø duration: " << timeformat(c->stats_95th.avg, true) << " ± "
-		          << timeformat(c->stats_95th.std, true) << std::endl;
-		if (c->type == call_type_t::OCALL)
-			std::cout << "| | | # < 1µs: " << countformat(c->stats_95th.num_less_1us, c->stats_95th.calls, true) << std::endl;
-		std::cout << "| | | # < 5µs: " << countformat(c->stats_95th.num_less_5us, c->stats_95th.calls, true) << std::endl;
-		std::cout << "| | | # < 10µs: " << countformat(c->stats_95th.num_less_10us, c->stats_95th.calls, true) << std::endl;
+		for (size_t i = 0; i < QUANTILE_COUNT; ++i)
+		{
+			std::cout << "| | " << quantile_levels[i] * 100 << "% of calls are faster than "
+			          << timeformat(c->quantiles.value[i]) << errorformat(c->quantiles) << std::endl;
+			if (i != QUANTILE_95TH)
+			{
+				continue;
+			}
+			std::cout << "| | | Ø duration: " << timeformat(c->stats_95th.avg, true) << " ± "
+			          << timeformat(c->stats_95th.std, true) << std::endl;
+			for (size_t b = 0; b < config.buckets.count; ++b)
+				std::cout << "| | | # < " << bucketname(b) << ": " << countformat(c->stats_95th.below[b], c->stats_95th.calls, true) << std::endl;
+		}
 		if (c->type == call_type_t::OCALL || c->num_ecall_called_from_ocalls > 0)
 		{
 			std::cout << "| |" << std::endl;
 			std::cout << "| | Direct successor of" << std::endl;
 			std::for_each(c->direct_parents_data->begin(), c->direct_parents_data->end(), [c](parent_call_data_t &pc) {
-				if (pc.call_data == nullptr)
-				{
-					return;
-				}
 				std::cout << "| | | " << WHITE() << "[" << pc.call_data->call_id << "] " << *pc.call_data->name
 				          << NORMAL() << " " << countformat(pc.count, c->all_stats.calls) << std::endl;
 				std::cout << "| | | | # < 10µs from start: " << countformat(pc.num_less_than_10us_from_start, pc.count) << std::endl;
 				std::cout << "| | | | # < 20µs from start: " << countformat(pc.num_less_than_20us_from_start, pc.count) << std::endl;
 				if (reorder_start_opportunity(pc))
 				{
-					std::cout << "| | | | " << YELLOW() << "/!\\ Reorder [" << c->call_id << "] to execute before call to [" << pc.call_data->call_id << "]" << NORMAL() << std::endl;
+					std::cout << "| | | | " << YELLOW() << "/!\\ Reorder [" << c->call_id << "] to execute before call to [" << pc.call_data->call_id << "]" << savingsformat(c->type, pc.count) << NORMAL() << std::endl;
 				}
 				std::cout << "| | | | # < 10µs from end: " << countformat(pc.num_less_than_10us_from_end, pc.count) << std::endl;
 				std::cout << "| | | | # < 20µs from end: " << countformat(pc.num_less_than_20us_from_end, pc.count) << std::endl;
 				if (reorder_end_opportunity(pc))
 				{
-					std::cout << "| | | | " << YELLOW() << "/!\\ Reorder [" << c->call_id << "] to execute after call to [" << pc.call_data->call_id << "]" << NORMAL() << std::endl;
+					std::cout << "| | | | " << YELLOW() << "/!\\ Reorder [" << c->call_id << "] to execute after call to [" << pc.call_data->call_id << "]" << savingsformat(c->type, pc.count) << NORMAL() << std::endl;
 				}
 				std::cout << "| | |" << std::endl;
 			});
 		}
 
-		if (c->type == call_type_t::ECALL && !c->aex_counts->empty())
+		if (c->type == call_type_t::ECALL && c->aex_stats.calls > 0)
 		{
 			std::cout << "| |" << std::endl;
 			std::cout << "| | # AEX during all calls: " << c->aex_stats.sum << std::endl;
@@ -548,28 +1372,22 @@ void print_call_data(enclave_data_t &e, call_data_t *c, uint64_t print_min)
 			std::cout << "| |" << std::endl;
 			std::cout << "| | Indirect successor of" << std::endl;
 			std::for_each(c->indirect_parents_data->begin(), c->indirect_parents_data->end(), [c](parent_call_data_t &pc) {
-				if (pc.call_data == nullptr)
-				{
-					return;
-				}
 				std::cout << "| | | " << ((pc.call_data == c) ? CYAN() : WHITE()) << "[" << pc.call_data->call_id << "] " << *pc.call_data->name
 				          << NORMAL() << " " << countformat(pc.count, c->all_stats.calls) << std::endl;
-				std::cout << "| | | | # < 1µs: " << countformat(pc.num_less_1us, pc.count) << std::endl;
-				std::cout << "| | | | # < 5µs: " << countformat(pc.num_less_5us, pc.count) << std::endl;
-				std::cout << "| | | | # < 10µs: " << countformat(pc.num_less_10us, pc.count) << std::endl;
-				std::cout << "| | | | # < 20µs: " << countformat(pc.num_less_20us, pc.count) << std::endl;
+				for (size_t b = 0; b < config.buckets.count; ++b)
+					std::cout << "| | | | # < " << bucketname(b) << ": " << countformat(pc.below[b], pc.count) << std::endl;
 				if (pc.call_data == c)
 				{
 					// This is the same call
 					if (batch_opportunity(pc))
 						// If the weight is more than 0.5 than we think batching is good
-						std::cout << "| | | | " << YELLOW() << "/!\\ Batching opportunity" << NORMAL() << std::endl;
+						std::cout << "| | | | " << YELLOW() << "/!\\ Batching opportunity" << savingsformat(c->type, pc.count) << NORMAL() << std::endl;
 				}
 				else
 				{
 					// This is a different call
 					if (merge_opportunity(pc, c))
-						std::cout << "| | | | " << YELLOW() << "/!\\ Merging opportunity" << NORMAL() << std::endl;
+						std::cout << "| | | | " << YELLOW() << "/!\\ Merging opportunity" << savingsformat(c->type, pc.count) << NORMAL() << std::endl;
 				}
 
 				std::cout << "| | |" << std::endl;
@@ -580,6 +1398,17 @@ void print_call_data(enclave_data_t &e, call_data_t *c, uint64_t print_min)
 	std::cout << "|" << std::endl;
 }
 
+/**
+ * @brief Moves the fastest calls up to the given percentile to the front of the durations.
+ * @return Number of these calls
+ */
+static uint64_t fastest_calls(column_range_t<uint64_t> times, uint8_t percentile)
+{
+	uint64_t size = percentile_idx(percentile / 100.0f, times);
+	std::nth_element(times.begin(), times.begin() + size, times.end());
+	return size;
+}
+
 void export_call_data_histogram(call_data_t *c, uint8_t percentile)
 {
 	if (config.call_data_filename.empty())
@@ -617,10 +1446,11 @@ void export_call_data_histogram(call_data_t *c, uint8_t percentile)
 	ss << "_hist.dat";
 	std::ofstream datafile(ss.str());
 
-	uint64_t size = percentile_idx(percentile / 100.0f, c->exectimes);
-	auto maxit = std::max_element(c->exectimes->begin(), c->exectimes->begin() + size);
+	auto times = exectimes(c);
+	uint64_t size = fastest_calls(times, percentile);
+	auto maxit = std::max_element(times.begin(), times.begin() + size);
 	auto max = *maxit;
-	auto minit = std::min_element(c->exectimes->begin(), c->exectimes->begin() + size);
+	auto minit = std::min_element(times.begin(), times.begin() + size);
 	auto min = *minit;
 
 	// we want 100 bins from min to max
@@ -634,7 +1464,7 @@ void export_call_data_histogram(call_data_t *c, uint8_t percentile)
 
 	for (uint64_t i = 0; i < size; ++i)
 	{
-		auto val = (*(c->exectimes))[i];
+		auto val = times[i];
 		assert(val <= max);
 		auto n = (val - min) / binwidth;
 		assert (n < bins+1);
@@ -686,116 +1516,398 @@ void export_call_data_scatter(call_data_t *c, uint8_t percentile)
 	ss << "_scatter.dat";
 	std::ofstream datafile(ss.str());
 
-	uint64_t size = percentile_idx(percentile / 100.0f, c->exectimes);
-	auto maxit = std::max_element(c->exectimes->begin(), c->exectimes->begin() + size);
+	auto times = exectimes(c);
+	uint64_t size = fastest_calls(times, percentile);
+	auto maxit = std::max_element(times.begin(), times.begin() + size);
 	auto max = *maxit;
-	auto minit = std::min_element(c->exectimes->begin(), c->exectimes->begin() + size);
+	auto minit = std::min_element(times.begin(), times.begin() + size);
 	auto min = *minit;
 
-	auto it = c->single_calls->begin();
-
-	while (it != c->single_calls->end())
+	auto &cs = call_store;
+	for (auto i : invocations(c))
 	{
-		auto scd = *it;
-		if (scd->exec > max || scd->exec < min)
+		if (cs.duration[i] > max || cs.duration[i] < min)
 		{
-			++it;
 			continue;
 		}
 
 		// we want csv with "timestamp,exectime" format
-		datafile << scd->end - general_data.starttime << "," << scd->exec << std::endl;
-
-		++it;
+		datafile << cs.end[i] - general_data.starttime << "," << cs.duration[i] << std::endl;
 	}
 
 	datafile.close();
 }
 
-void analyze_calls()
+/**
+ * @brief Writes the raw call data files of an ECall/OCall. Every call writes its own files, so they can be exported in parallel.
+ * @param c
+ */
+static void export_call_data(call_data_t *c)
 {
-	std::stringstream ss;
+	export_call_data_histogram(c, 100);
+	export_call_data_histogram(c, 99);
+	export_call_data_histogram(c, 95);
+	export_call_data_scatter(c, 100);
+	export_call_data_scatter(c, 99);
+	export_call_data_scatter(c, 95);
+}
 
-	ss << "select key, value from general order by key asc;";
-	sql_exec(ss, general_callback);
+static void read_snapshot_row(sqlite3_stmt *stmt, snapshot_row_t &row)
+{
+	row.thread = sql_uint(stmt, 0);
+	row.age = sql_uint(stmt, 1);
+	row.type = sql_uint(stmt, 2);
+	row.call_id = sql_uint(stmt, 3);
+	row.eid = sql_uint(stmt, 4);
+	row.rip = sql_uint(stmt, 5);
+	row.stack = sql_text(stmt, 6);
+}
 
-	std::cout << "=== General Info" << std::endl;
+static void print_snapshot(snapshot_row_t const &row)
+{
+	uint64_t thread = row.thread;
+	uint64_t age = row.age;
+	uint64_t type = row.type;
+	uint64_t call_id = row.call_id;
+	uint64_t eid = row.eid;
+	uint64_t rip = row.rip;
+
+	bool is_ecall = type != EnclaveOCallEventId;
+	// The enclave is unknown if none of its calls completed
+	std::string name = std::to_string(call_id);
+	auto e = encls.find(eid);
+	if (e != encls.end())
+	{
+		auto &calls = is_ecall ? e->second.ecalls : e->second.ocalls;
+		auto it = std::find_if(calls.begin(), calls.end(), [call_id](call_data_t *c) { return c->call_id == call_id; });
+		if (it != calls.end())
+		{
+			name = *(*it)->name;
+		}
+	}
 
-	std::cout << "Runtime: " << timeformat(general_data.endtime - general_data.starttime, true);
-	std::cout << std::endl;
+	std::cout << "/ Thread " << thread << " stuck in " << (is_ecall ? "ECall " : "OCall ") << name << " (" << call_id << ") of enclave " << eid << " for " << timeformat(age, true) << std::endl;
+	if (rip != 0)
+	{
+		std::cout << "| Enclave rip: 0x" << std::hex << rip << std::dec << std::endl;
+	}
+	if (!row.stack.empty())
+	{
+		std::stringstream stack(row.stack);
+		std::string frame;
+		while (std::getline(stack, frame))
+		{
+			std::cout << "| " << frame << std::endl;
+		}
+	}
+	std::cout << "\\ ___" << std::endl;
+}
 
-	std::cout << "=== Analyzing ECalls/OCalls" << std::endl;
+static uint64_t trace_runtime = 0; // Runtime of the whole trace, general_data is restricted to the window
 
-	std::cout << "iii Loading ecall symbols" << std::endl << std::flush;
+static bool has_window()
+{
+	return config.window_start > 0 || config.window_end != UINT64_MAX;
+}
 
-	ss << "select id, eid, symbol_name from ecalls order by id asc;";
-	sql_exec(ss, ecalls_callback);
+/**
+ * @brief Restricts the runtime to the window given with "--window", so rates and offsets refer to it.
+ */
+static void apply_window()
+{
+	auto runtime = general_data.endtime - general_data.starttime;
+	auto start = std::min(config.window_start, runtime);
+	auto end = std::max(start, std::min(config.window_end, runtime));
+	general_data.endtime = general_data.starttime + end;
+	general_data.starttime += start;
+}
 
-	std::cout << "iii Loading ocall symbols" << std::endl << std::flush;
+/**
+ * @brief Loads the general info of the trace and restricts it to the window given with "--window". Only loaded once, as every phase that filters by the window needs it.
+ */
+void load_general_data()
+{
+	static bool loaded = false;
+	if (loaded)
+	{
+		return;
+	}
+	loaded = true;
 
-	ss << "select id, eid, symbol_name from ocalls order by id asc;";
-	sql_exec(ss, ocalls_callback);
+	std::stringstream ss;
+	ss << "select key, value from general order by key asc;";
+	sql_load<general_row_t>(ss, read_general_row, general_callback);
+	trace_runtime = general_data.endtime - general_data.starttime;
+	if (has_window())
+	{
+		apply_window();
+	}
+}
 
-	parallel_for_each(encls.begin(), encls.end(), [] (std::pair<const uint64_t, enclave_data_t> &p) {
-		auto &e = encls[p.first];
-		std::for_each(e.ecalls.begin(), e.ecalls.end(), [&e] (call_data_t *c) {
-			c->direct_parents_data = new std::vector<parent_call_data_t>(e.ocalls.size());
-			c->indirect_parents_data = new std::vector<parent_call_data_t>(e.ecalls.size());
-		});
-		std::for_each(e.ocalls.begin(), e.ocalls.end(), [&e] (call_data_t *c) {
-			c->direct_parents_data = new std::vector<parent_call_data_t>(e.ecalls.size());
-			c->indirect_parents_data = new std::vector<parent_call_data_t>(e.ocalls.size());
-		});
-	});
+/**
+ * @brief SQL condition that keeps the calls starting inside the window, empty without a window. Needs load_general_data().
+ * @param column Start time column of the calls
+ * @param prefix " where " or " and "
+ */
+std::string window_filter(char const *column, char const *prefix)
+{
+	if (!has_window())
+	{
+		return "";
+	}
+	std::stringstream ss;
+	ss << prefix << column << " >= " << general_data.starttime;
+	if (config.window_end != UINT64_MAX)
+	{
+		ss << " and " << column << " < " << general_data.endtime;
+	}
+	return ss.str();
+}
+
+/**
+ * @brief Loads all calls of the trace, in memory into the call store or out of core into the running statistics and spills.
+ * @return The loaders, which hold the spills in out-of-core mode
+ */
+static std::vector<load_state_t> load_calls()
+{
+	std::stringstream ss;
 
 	std::cout << "iii Loading threads" << std::endl << std::flush;
 
-	// processing threads
-	ss << "select t.id, t.pthread_id, count(e.id) as events from events as e inner join threads as t on e.involved_thread = t.id inner join events as s on e.call_event = s.id group by t.id order by t.id asc";
-	sql_exec(ss, thread_callback);
+	// Since version 2, the logger writes every completed call into the calls table, older databases need a join
+	bool has_calls_table = table_exists("calls");
+	auto call_table = event_table("call_events");
+	auto return_table = event_table("return_events");
+
+	// processing threads, counting exactly the calls that are loaded below
+	if (has_calls_table)
+	{
+		ss << "select t.id, t.pthread_id, count(c.id) as calls from threads as t inner join calls as c on c.thread = t.id" << window_filter("c.start_time", " where ") << " group by t.id order by t.id asc";
+	}
+	else
+	{
+		ss << "select t.id, t.pthread_id, count(e.id) as events from " << return_table << " as e inner join " << call_table << " as s on e.call_event = s.id inner join threads as t on s.involved_thread = t.id where (e.type = " << EnclaveECallReturnEventId << " or e.type = " << EnclaveOCallReturnEventId << ")" << window_filter("s.time", " and ") << " group by t.id order by t.id asc";
+	}
+	sql_load<thread_row_t>(ss, read_thread_row, thread_callback);
 
 	std::cout << "iii Loading calls" << std::endl << std::flush;
 
-	// Processing calls
-	ss << "select s.id, e.type, s.involved_thread as thread, s.call_id, s.eid, e.time-s.time as exectime, e.aex_count, s.call_event as parent_call, s.time as starttime, e.time as endtime from events as e inner join events as s on s.id = e.call_event where e.type = 15 or e.type = 17 order by s.involved_thread, s.time asc;";
-	sql_exec(ss, call_data_callback);
+	// Processing calls. Every thread gets its part of the call store up front, so the loaders can fill them in parallel.
+	// In out-of-core mode, there is no call store, the calls are only streamed through the running statistics.
+	if (config.out_of_core)
+	{
+		init_aggregates(streamed_calls);
+	}
+	else
+	{
+		// The columns index calls with 32 bits, NO_CALL marks a missing call
+		if (calls_expected >= NO_CALL)
+		{
+			std::cout << "/!\\ The trace has " << calls_expected << " calls, more than the in-memory analysis can index. Use \"-m dir\" to analyse it out of core." << std::endl;
+			exit(-1);
+		}
+		call_store.start.resize(calls_expected);
+		call_store.end.resize(calls_expected);
+		call_store.duration.resize(calls_expected);
+		call_store.call.resize(calls_expected);
+		call_store.parent.resize(calls_expected);
+		call_store.subtree_end.resize(calls_expected);
+		call_store.aex_count.resize(calls_expected);
+	}
+
+	auto loaders = plan_loaders(task_pool::instance().size());
+	parallel_for_each(loaders.begin(), loaders.end(), [has_calls_table, &call_table, &return_table](load_state_t &state) {
+		if (state.threads.empty())
+		{
+			return;
+		}
+
+		std::stringstream ids;
+		for (size_t i = 0; i < state.threads.size(); ++i)
+		{
+			ids << (i > 0 ? "," : "") << state.threads[i];
+		}
+
+		std::stringstream q;
+		if (has_calls_table)
+		{
+			q << "select id, type, thread, call_id, eid, duration, aex_count, parent_call, start_time, end_time from calls where thread in (" << ids.str() << ")" << window_filter("start_time", " and ") << " order by thread, start_time asc;";
+		}
+		else
+		{
+			q << "select s.id, s.type, s.involved_thread as thread, s.call_id, s.eid, e.time-s.time as exectime, e.aex_count, s.call_event as parent_call, s.time as starttime, e.time as endtime from " << return_table << " as e inner join " << call_table << " as s on s.id = e.call_event where (e.type = " << EnclaveECallReturnEventId << " or e.type = " << EnclaveOCallReturnEventId << ") and s.involved_thread in (" << ids.str() << ")" << window_filter("s.time", " and ") << " order by s.involved_thread, s.time asc;";
+		}
+
+		auto conn = sql_connect();
+		sql_load<call_row_t>(conn, q, read_call_row, [&state](call_row_t const &row) { load_call(state, row); });
+		sqlite3_close(conn);
+
+		for (auto id : state.threads)
+		{
+			finish_thread(state, threads.at(id));
+		}
+		if (state.durations.fd >= 0)
+			flush_spill(state.durations);
+		if (state.corrected_durations.fd >= 0)
+			flush_spill(state.corrected_durations);
+	});
+	std::for_each(loaders.begin(), loaders.end(), merge_load_state);
+
+	if (config.overhead_correction)
+	{
+		std::cout << "iii Correcting logger overhead" << std::endl << std::flush;
+	}
+	if (config.out_of_core)
+	{
+		for (auto &state : loaders)
+		{
+			duration_spills.push_back(&state.durations);
+			corrected_duration_spills.push_back(&state.corrected_durations);
+		}
+	}
+	else
+	{
+		group_calls();
+	}
+
+	return loaders;
+}
 
+/**
+ * @brief Generates the statistics and percentiles of all ECalls/OCalls and releases the spills of the loaders.
+ * @param loaders
+ */
+static void generate_statistics(std::vector<load_state_t> &loaders)
+{
 	std::cout << "iii Generating statistics" << std::endl << std::flush;
 
 	parallel_for_each(encls.begin(), encls.end(), [](std::pair<const uint64_t, enclave_data_t> &p) {
 		auto &e = encls[p.first];
 		//auto e = p.second;
-		std::atomic<uint64_t> ecall_count(0);
-		parallel_for_each(e.ecalls.begin(), e.ecalls.end(), [&ecall_count] (call_data_t *c) {
-			c->all_stats.calls = c->exectimes->size();
-			ecall_count += c->all_stats.calls;
-
-			std::sort(c->exectimes->begin(), c->exectimes->end());
-			calc_stats(c->all_stats, c);
+		parallel_for_each(e.ecalls.begin(), e.ecalls.end(), [] (call_data_t *c) {
+			calc_call_stats(c);
 			calc_aex_stats(c->aex_stats, c);
-
-			c->stats_95th.calls = percentile_idx(95 / 100.0, c->exectimes);
-			c->stats_95th.sum = std::accumulate(c->exectimes->begin(), c->exectimes->begin() + c->stats_95th.calls, 0UL);
-			calc_stats(c->stats_95th, c);
 		});
-		e.ecall_count = ecall_count;
+		parallel_for_each(e.ocalls.begin(), e.ocalls.end(), calc_call_stats);
+	});
 
-		std::atomic<uint64_t> ocall_count(0);
-		parallel_for_each(e.ocalls.begin(), e.ocalls.end(), [&ocall_count] (call_data_t *c) {
-			c->all_stats.calls = c->exectimes->size();
-			ocall_count += c->all_stats.calls;
+	if (config.out_of_core)
+	{
+		for (auto &state : loaders)
+		{
+			if (state.durations.fd >= 0)
+				close_spill(state.durations);
+			if (state.corrected_durations.fd >= 0)
+				close_spill(state.corrected_durations);
+		}
+		duration_spills.clear();
+		corrected_duration_spills.clear();
+	}
+}
 
-			std::sort(c->exectimes->begin(), c->exectimes->end());
-			calc_stats(c->all_stats, c);
+/**
+ * @brief Sums up the calls and time breakdowns of every enclave.
+ */
+static void count_calls()
+{
+	for (auto &p : encls)
+	{
+		auto &e = p.second;
+		e.ecall_count = std::accumulate(e.ecalls.begin(), e.ecalls.end(), (uint64_t)0, [](uint64_t a, call_data_t *c) { return a + c->all_stats.calls; });
+		e.ocall_count = std::accumulate(e.ocalls.begin(), e.ocalls.end(), (uint64_t)0, [](uint64_t a, call_data_t *c) { return a + c->all_stats.calls; });
+		e.ecall_breakdown = {};
+		e.ocall_breakdown = {};
+		for (auto c : e.ecalls)
+			add_breakdown(e.ecall_breakdown, c->breakdown);
+		for (auto c : e.ocalls)
+			add_breakdown(e.ocall_breakdown, c->breakdown);
+	}
+}
 
-			c->stats_95th.calls = percentile_idx(95 / 100.0, c->exectimes);
-			c->stats_95th.sum = std::accumulate(c->exectimes->begin(), c->exectimes->begin() + c->stats_95th.calls, 0UL);
-			calc_stats(c->stats_95th, c);
-		});
-		e.ocall_count = ocall_count;
+/**
+ * @brief Loads the snapshots of calls the watchdog of the logger found stuck.
+ * @param snapshots
+ */
+static void load_snapshots(std::vector<snapshot_row_t> &snapshots)
+{
+	std::stringstream ss;
+	ss << "select w.involved_thread, w.time-s.time, s.type, s.call_id, s.eid, w.arg, w.name from events as w inner join events as s on s.id = w.call_event inner join event_map as m on m.id = w.type where m.name = 'EnclaveCallSnapshotEvent'" << window_filter("w.time", " and ") << " order by w.involved_thread, w.time asc;";
+	sql_load<snapshot_row_t>(ss, read_snapshot_row, [&snapshots](snapshot_row_t const &row) { snapshots.push_back(row); });
+}
+
+void analyze_calls()
+{
+	std::stringstream ss;
 
+	load_general_data();
 
-	});
+	std::cout << "=== General Info" << std::endl;
+
+	std::cout << "Runtime: " << timeformat(trace_runtime, true);
+	std::cout << std::endl;
+
+	if (has_window())
+	{
+		std::cout << "Window: " << timeformat(config.window_start) << " to " << timeformat(general_data.endtime - general_data.starttime + config.window_start)
+		          << " after the start, " << timeformat(general_data.endtime - general_data.starttime, true) << std::endl;
+	}
+
+	if (general_data.logger_events > 0)
+	{
+		auto runtime = general_data.endtime - general_data.starttime;
+		std::cout << "Logged events: " << general_data.logger_events << " (" << (general_data.logger_bytes / 1024) << " KiB)" << std::endl;
+		std::cout << "Time spent in logger: " << timeformat(general_data.logger_time, true);
+		if (runtime > 0)
+		{
+			std::cout << " (" << (general_data.logger_time * 100.0 / runtime) << "% of runtime)";
+		}
+		std::cout << std::endl;
+	}
+	if (general_data.ecall_roundtrip > 0)
+	{
+		std::cout << "Calibrated transition cost: " << timeformat(general_data.ecall_roundtrip, true) << " per ECall, " << timeformat(general_data.ocall_roundtrip, true) << " per OCall" << std::endl;
+	}
+	if (general_data.overhead_call > 0)
+	{
+		std::cout << "Calibrated logger overhead: " << timeformat(general_data.overhead_call, true) << " per call, " << timeformat(general_data.overhead_nested_call, true) << " per nested call" << std::endl;
+	}
+	else if (config.overhead_correction)
+	{
+		std::cout << "/!\\ Trace contains no logger overhead calibration, durations are not corrected" << std::endl;
+	}
+
+	std::cout << "=== Analyzing ECalls/OCalls" << std::endl;
+
+	std::cout << "iii Loading ecall symbols" << std::endl << std::flush;
+
+	ss << "select id, eid, symbol_name from ecalls order by id asc;";
+	sql_load<symbol_row_t>(ss, read_symbol_row, ecalls_callback);
+
+	std::cout << "iii Loading ocall symbols" << std::endl << std::flush;
+
+	ss << "select id, eid, symbol_name from ocalls order by id asc;";
+	sql_load<symbol_row_t>(ss, read_symbol_row, ocalls_callback);
+
+	// Thresholds, graphs and exports do not change the statistics, so they can come from the cache. Raw call data, time series and call stacks need the calls themselves.
+	std::vector<snapshot_row_t> snapshots;
+	if (config.call_data_filename.empty() && config.time_bucket == 0 && config.flame.empty() && load_cached_calls(snapshots))
+	{
+		std::cout << "iii Loaded statistics from cache" << std::endl << std::flush;
+	}
+	else
+	{
+		auto loaders = load_calls();
+		generate_statistics(loaders);
+		if (!config.flame.empty())
+		{
+			std::vector<flame_stacks_t const *> stacks;
+			std::transform(loaders.begin(), loaders.end(), std::back_inserter(stacks), [](load_state_t const &state) { return &state.flame; });
+			write_flame_stacks(stacks);
+		}
+		load_snapshots(snapshots);
+		store_cached_calls(snapshots);
+	}
+	count_calls();
 
 	std::cout << "iii Sorting" << std::endl << std::flush;
 
@@ -828,24 +1940,14 @@ void analyze_calls()
 		auto &e = encls[p.first];
 		std::cout << "/ Enclave " << eid << std::endl;
 
-		uint64_t all_less_5us = std::accumulate(e.ecalls_sorted.begin(), e.ecalls_sorted.end(), (uint64_t)0, [](uint64_t a, call_data_t *c) { return a + c->all_stats.num_less_5us; });
-		uint64_t all_less_10us = std::accumulate(e.ecalls_sorted.begin(), e.ecalls_sorted.end(), (uint64_t)0, [](uint64_t a, call_data_t *c) { return a + c->all_stats.num_less_10us; });
-
 		std::cout << "| " << std::endl;
-
-		std::cout << "| # < 5µs: " << countformat(all_less_5us, e.ecall_count, true) << std::endl;
-		std::cout << "| # < 10µs: " << countformat(all_less_10us, e.ecall_count, true) << std::endl;
+		print_buckets(e.ecalls_sorted, e.ecall_count);
 		std::cout << "| " << std::endl;
 
 		std::for_each(e.ecalls_sorted.begin(), e.ecalls_sorted.end(), [&e] (call_data_t *c) {
 			print_call_data(e, c, config.ecall_call_minimum);
-			export_call_data_histogram(c, 100);
-			export_call_data_histogram(c, 99);
-			export_call_data_histogram(c, 95);
-			export_call_data_scatter(c, 100);
-			export_call_data_scatter(c, 99);
-			export_call_data_scatter(c, 95);
 		});
+		parallel_for_each(e.ecalls_sorted.begin(), e.ecalls_sorted.end(), export_call_data);
 		std::cout << "\\ ___" << std::endl;
 	});
 	std::cout << std::endl;
@@ -857,26 +1959,58 @@ void analyze_calls()
 		auto &e = encls[p.first];
 		std::cout << "/ Enclave " << eid << std::endl;
 
-		uint64_t all_less_1us = std::accumulate(e.ocalls_sorted.begin(), e.ocalls_sorted.end(), (uint64_t)0, [](uint64_t a, call_data_t *c) { return a + c->all_stats.num_less_1us; });
-		uint64_t all_less_5us = std::accumulate(e.ocalls_sorted.begin(), e.ocalls_sorted.end(), (uint64_t)0, [](uint64_t a, call_data_t *c) { return a + c->all_stats.num_less_5us; });
-		uint64_t all_less_10us = std::accumulate(e.ocalls_sorted.begin(), e.ocalls_sorted.end(), (uint64_t)0, [](uint64_t a, call_data_t *c) { return a + c->all_stats.num_less_10us; });
-
 		std::cout << "| " << std::endl;
-		std::cout << "| # < 1µs: " << countformat(all_less_1us, e.ocall_count, true) << std::endl;
-		std::cout << "| # < 5µs: " << countformat(all_less_5us, e.ocall_count, true) << std::endl;
-		std::cout << "| # < 10µs: " << countformat(all_less_10us, e.ocall_count, true) << std::endl;
+		print_buckets(e.ocalls_sorted, e.ocall_count);
 		std::cout << "| " << std::endl;
 
 		std::for_each(e.ocalls_sorted.begin(), e.ocalls_sorted.end(), [&e] (call_data_t *c) {
 			print_call_data(e, c, config.ocall_call_minimum);
-			export_call_data_histogram(c, 100);
-			export_call_data_histogram(c, 99);
-			export_call_data_histogram(c, 95);
-			export_call_data_scatter(c, 100);
-			export_call_data_scatter(c, 99);
-			export_call_data_scatter(c, 95);
 		});
+		parallel_for_each(e.ocalls_sorted.begin(), e.ocalls_sorted.end(), export_call_data);
 		std::cout << "\\ ___" << std::endl;
 	});
 	std::cout << std::endl;
+
+	std::cout << "(i) Time breakdown" << std::endl;
+	print_breakdowns();
+	std::cout << std::endl;
+
+	std::cout << "(i) Recommendations" << std::endl;
+	auto recommendations = collect_recommendations();
+	if (recommendations.empty())
+	{
+		std::cout << "No recommendations" << std::endl;
+	}
+	else if (general_data.ecall_roundtrip == 0)
+	{
+		std::cout << YELLOW() << "/!\\ Trace contains no transition calibration, ranking by avoided transitions" << NORMAL() << std::endl;
+	}
+	for (size_t i = 0; i < recommendations.size(); ++i)
+	{
+		auto &r = recommendations[i];
+		std::cout << (i + 1) << ". ";
+		if (r.saved > 0)
+		{
+			std::cout << "~" << timeformat(r.saved) << ", ";
+		}
+		std::cout << r.transitions << " transitions: " << r.text << " (Enclave " << r.eid << ")" << std::endl;
+	}
+	std::cout << std::endl;
+
+	// Snapshots taken by the watchdog of the logger
+	std::cout << "(i) Watchdog snapshots" << std::endl;
+	std::for_each(snapshots.begin(), snapshots.end(), print_snapshot);
+	if (snapshots.empty())
+	{
+		std::cout << "No calls have been stuck" << std::endl;
+	}
+	std::cout << std::endl;
+
+	analyze_concurrency();
+
+	if (config.time_bucket > 0)
+		analyze_timeline();
+
+	if (!config.report.empty())
+		report_calls(recommendations, snapshots);
 }
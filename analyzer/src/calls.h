@@ -7,6 +7,8 @@
 
 #include <cstdint>
 #include <vector>
+#include <string>
+#include "stats.h"
 
 typedef enum class __call_type
 {
@@ -15,42 +17,92 @@ typedef enum class __call_type
 	OCALL = 2,
 } call_type_t;
 
-typedef struct __single_call_data
+/**
+ * @brief Index marking a missing call in the columns of the call store
+ */
+#define NO_CALL UINT32_MAX
+
+/**
+ * @brief Contiguous range inside a column of the call store.
+ */
+template<typename T> struct column_range_t
+{
+	T *first;
+	T *last;
+	T *begin() const { return first; }
+	T *end() const { return last; }
+	size_t size() const { return static_cast<size_t>(last - first); }
+	bool empty() const { return first == last; }
+	T &at(size_t i) const { return first[i]; }
+	T &operator[](size_t i) const { return first[i]; }
+};
+
+/**
+ * @brief Columnar store of all calls in the trace.
+ * Calls are stored thread by thread in order of their start time, so the descendants of call i are exactly the calls i+1 to subtree_end[i]-1.
+ */
+typedef struct __call_store
+{
+	std::vector<uint64_t> start;
+	std::vector<uint64_t> end;
+	std::vector<uint64_t> duration;
+	std::vector<uint32_t> call; // Index of the ECall/OCall in call_list
+	std::vector<uint32_t> parent; // Index of the parent call, NO_CALL if the call has no parent
+	std::vector<uint32_t> subtree_end; // Index after the last descendant
+	std::vector<uint32_t> aex_count;
+	std::vector<uint32_t> by_call; // Indices of all calls, grouped by ECall/OCall, see call_data_t::first
+	std::vector<uint64_t> sorted_duration; // Durations grouped like by_call, sorted within every group
+	std::vector<uint64_t> corrected_duration; // Durations without logger overhead, grouped and sorted like sorted_duration
+} call_store_t;
+
+/**
+ * @brief Where the time of calls went: their own code, directly nested calls and enclave transitions.
+ * The duration of an ECall includes its EENTER/EEXIT and those of the OCalls it makes, the duration of an OCall only the untrusted code.
+ * So the transitions of a call tree are counted by its ECalls.
+ */
+typedef struct __time_breakdown
+{
+	uint64_t calls;
+	uint64_t total; // Sum of the durations
+	uint64_t self; // Without the directly nested calls
+	uint64_t in_ecalls; // Spent in directly nested ECalls
+	uint64_t in_ocalls; // Spent in directly nested OCalls
+	uint64_t ecall_transitions; // Round trips into the enclave, one per ECall
+	uint64_t ocall_transitions; // Round trips out of the enclave, one per OCall nested in an ECall
+} breakdown_t;
+
+typedef struct __open_call
 {
 	uint64_t event_id;
-	uint64_t call_id;
-	call_type_t type;
+	uint64_t position; // Position among the calls of the thread
 	uint64_t start;
 	uint64_t end;
-	uint64_t exec;
-	struct __single_call_data *parent;
-} single_call_data_t;
+	uint32_t call; // Index of the ECall/OCall in call_list
+	uint64_t in_ecalls; // Time in the directly nested ECalls placed so far
+	uint64_t in_ocalls;
+	uint64_t ocalls; // Number of directly nested OCalls placed so far
+	uint32_t frame; // Frame of the call stack in the folded stacks of the loader, only used with "--flame"
+} open_call_t;
+
+typedef struct __sibling
+{
+	uint64_t end;
+	uint32_t call; // Index of the ECall/OCall in call_list, NO_CALL if there is no call on this depth
+} sibling_t;
 
 typedef struct __thread_data
 {
 	uint64_t id;
 	pthread_t pthread_id;
-	single_call_data_t *last_call;
-	uint64_t next_call_index;
-	single_call_data_t *calls;
+	uint64_t first; // Index of the first call of this thread in the call store
+	uint64_t count; // Number of calls of this thread
+	uint64_t expected; // Number of calls counted before loading, the space reserved for this thread in the call store
+	std::vector<open_call_t> *open_calls; // Calls that have not returned yet, innermost last. Only used while loading.
+	std::vector<sibling_t> *last_sibling; // Last call on each depth, the predecessor of the next call on that depth. Only used while loading.
+	breakdown_t ecalls; // Time breakdown of all ECalls of this thread
+	breakdown_t ocalls;
 } thread_t;
 
-typedef struct __stats_data
-{
-	uint64_t sum;
-	uint64_t sq_sum;
-	uint64_t avg;
-	uint64_t calls;
-	uint64_t median;
-	uint64_t std;
-	uint64_t aexs;
-	uint64_t min;
-	uint64_t max;
-	uint64_t num_less_1us;
-	uint64_t num_less_5us;
-	uint64_t num_less_10us;
-} stats_t;
-
 struct __call_data;
 
 typedef struct __parent_call_data
@@ -67,6 +119,7 @@ typedef struct __parent_call_data
 	uint64_t num_less_5us;
 	uint64_t num_less_10us;
 	uint64_t num_less_20us;
+	uint64_t below[MAX_BUCKETS]; // Number of calls that started less than each bucket bound after the indirect parent ended
 } parent_call_data_t;
 
 typedef struct __call_data
@@ -74,23 +127,28 @@ typedef struct __call_data
 	call_type_t type;
 	uint64_t call_id;
 	std::string *name;
-	std::vector<uint64_t> *exectimes;
-	std::vector<single_call_data_t *> *single_calls;
-	std::vector<uint64_t> *aex_counts;
+	uint32_t index; // Index in call_list
+	uint64_t first; // Offset of the calls of this ECall/OCall in by_call and sorted_duration
+	uint64_t count; // Number of calls of this ECall/OCall
 	//std::vector<uint64_t> *direct_parents;
 	bool has_direct_parents;
 	uint64_t num_ecall_called_from_ocalls;
-	std::vector<parent_call_data_t> *direct_parents_data;
+	std::vector<parent_call_data_t> *direct_parents_data; // Only observed parents, sorted by call id
 	bool has_indirect_parents;
-	std::vector<parent_call_data_t> *indirect_parents_data;
+	std::vector<parent_call_data_t> *indirect_parents_data; // Only observed parents, sorted by call id
 	stats_t all_stats;
 	stats_t aex_stats;
 	stats_t stats_95th;
+	stats_t corrected_stats;
+	quantiles_t quantiles;
+	quantiles_t corrected_quantiles;
+	sketch_t sketch; // Histogram of the durations, only kept for the analysis cache
+	breakdown_t breakdown;
 } call_data_t;
 
 typedef struct __enclave_data
 {
-	__enclave_data() : eid(0), ecall_count(0), ocall_count(0), first_ecall_start(UINT64_MAX), last_ecall_end(0) {}
+	__enclave_data() : eid(0), ecall_count(0), ocall_count(0), first_ecall_start(UINT64_MAX), last_ecall_end(0), ecall_breakdown(), ocall_breakdown() {}
 	uint64_t eid;
 	std::vector<call_data_t *> ecalls;
 	std::vector<call_data_t *> ecalls_sorted;
@@ -100,6 +158,8 @@ typedef struct __enclave_data
 	uint64_t ocall_count;
 	uint64_t first_ecall_start;
 	uint64_t last_ecall_end;
+	breakdown_t ecall_breakdown; // Sum of the breakdowns of all ECalls
+	breakdown_t ocall_breakdown;
 } enclave_data_t;
 
 typedef struct __general_data
@@ -107,8 +167,33 @@ typedef struct __general_data
 	uint64_t starttime;
 	uint64_t endtime;
 	uint64_t main_thread;
+	uint64_t overhead_call;
+	uint64_t overhead_nested_call;
+	uint64_t logger_events;
+	uint64_t logger_bytes;
+	uint64_t logger_time;
+	uint64_t ecall_roundtrip;
+	uint64_t ocall_roundtrip;
 } general_data_t;
 
+typedef struct __recommendation
+{
+	uint64_t eid;
+	call_data_t *call;
+	std::string text;
+	uint64_t transitions; // Number of transitions the recommendation avoids
+	uint64_t saved; // Estimated time saved in ns, 0 if the transition cost is unknown
+} recommendation_t;
+
+parent_call_data_t &parent_data(std::vector<parent_call_data_t> *parents, call_data_t *parent);
+parent_call_data_t *find_parent_data(std::vector<parent_call_data_t> *parents, uint64_t call_id);
+void add_breakdown(breakdown_t &into, breakdown_t const &other);
+uint64_t transition_time(breakdown_t const &b);
+column_range_t<uint64_t> exectimes(call_data_t *c);
+column_range_t<uint64_t> corrected_exectimes(call_data_t *c);
+column_range_t<uint32_t> invocations(call_data_t *c);
+void load_general_data();
+std::string window_filter(char const *column, char const *prefix);
 void analyze_calls();
 
 #endif //SGX_PERF_CALLS_H
@@ -0,0 +1,384 @@
+/**
+ * @author weichbr
+ */
+
+#include "main.h"
+#include "chrome.h"
+
+#include <fstream>
+
+/**
+ * Timeline export
+ *
+ * Writes the trace in the Chrome Trace Event format, which chrome://tracing and Perfetto (ui.perfetto.dev) open.
+ * Every ECall/OCall becomes a slice on the track of its thread, AEXs, paging and sync events become instants,
+ * and every sync wait is connected to the set event that resolved it by a flow arrow.
+ * The events are streamed from the database into the file in batches, so the export needs constant memory no matter how long the trace is.
+ * Timestamps are in µs after the start of the trace, with ns precision.
+ */
+
+typedef struct __chrome_call_row
+{
+	uint64_t thread;
+	uint64_t start;
+	uint64_t end;
+	uint64_t eid;
+	uint64_t type;
+	uint64_t call_id;
+	uint64_t aex_count;
+	bool has_aex_count;
+} chrome_call_row_t;
+
+static void read_chrome_call_row(sqlite3_stmt *stmt, chrome_call_row_t &row)
+{
+	row.thread = sql_uint(stmt, 0);
+	row.start = sql_uint(stmt, 1);
+	row.end = sql_uint(stmt, 2);
+	row.eid = sql_uint(stmt, 3);
+	row.type = sql_uint(stmt, 4);
+	row.call_id = sql_uint(stmt, 5);
+	row.has_aex_count = !sql_null(stmt, 6);
+	row.aex_count = sql_uint(stmt, 6);
+}
+
+typedef struct __chrome_instant_row
+{
+	uint64_t id;
+	uint64_t type;
+	uint64_t time;
+	uint64_t thread;
+	uint64_t eid;
+	uint64_t arg;
+} chrome_instant_row_t;
+
+static void read_chrome_instant_row(sqlite3_stmt *stmt, chrome_instant_row_t &row)
+{
+	row.id = sql_uint(stmt, 0);
+	row.type = sql_uint(stmt, 1);
+	row.time = sql_uint(stmt, 2);
+	row.thread = sql_uint(stmt, 3);
+	row.eid = sql_uint(stmt, 4);
+	row.arg = sql_uint(stmt, 5);
+}
+
+typedef struct __chrome_flow_row
+{
+	uint64_t id; // Id of the wait event
+	uint64_t wait_time;
+	uint64_t wait_thread;
+	uint64_t set_time;
+	uint64_t set_thread;
+} chrome_flow_row_t;
+
+static void read_chrome_flow_row(sqlite3_stmt *stmt, chrome_flow_row_t &row)
+{
+	row.id = sql_uint(stmt, 0);
+	row.wait_time = sql_uint(stmt, 1);
+	row.wait_thread = sql_uint(stmt, 2);
+	row.set_time = sql_uint(stmt, 3);
+	row.set_thread = sql_uint(stmt, 4);
+}
+
+typedef struct __chrome_thread_row
+{
+	uint64_t id;
+	uint64_t pthread_id;
+	std::string name;
+} chrome_thread_row_t;
+
+typedef struct __chrome_symbol_row
+{
+	uint64_t id;
+	uint64_t eid;
+	std::string name;
+} chrome_symbol_row_t;
+
+/**
+ * @brief State of the export: the open file and what is needed to turn rows into events.
+ */
+typedef struct __chrome_trace
+{
+	std::ofstream out;
+	uint64_t events; // Number of events written so far
+	uint64_t starttime; // Start of the trace, timestamps are relative to it
+	uint64_t range_start; // Only events in this range are written, absolute times
+	uint64_t range_end;
+	std::map<std::string, uint64_t> event_ids; // Event types by name
+	std::map<std::pair<uint64_t, uint64_t>, std::string> ecall_names; // JSON strings of the ECall names by eid and call id
+	std::map<std::pair<uint64_t, uint64_t>, std::string> ocall_names;
+} chrome_trace_t;
+
+static uint64_t event_id(chrome_trace_t const &trace, char const *name)
+{
+	auto it = trace.event_ids.find(name);
+	return it != trace.event_ids.end() ? it->second : UINT64_MAX;
+}
+
+/**
+ * @brief Writes a duration in ns as µs with three decimals, e.g. 1234.567, without going through floating point.
+ */
+static void write_us(std::ostream &out, uint64_t ns)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%lu.%03lu", static_cast<unsigned long>(ns / 1000), static_cast<unsigned long>(ns % 1000));
+	out << buf;
+}
+
+/**
+ * @brief Writes a time as µs after the start of the trace.
+ */
+static void write_ts(chrome_trace_t &trace, uint64_t time)
+{
+	write_us(trace.out, time > trace.starttime ? time - trace.starttime : 0);
+}
+
+/**
+ * @brief Starts the next event, separated from the previous one.
+ */
+static std::ostream &next_event(chrome_trace_t &trace)
+{
+	trace.out << (trace.events++ > 0 ? ",\n" : "\n");
+	return trace.out;
+}
+
+/**
+ * @brief Condition for the time column of events inside the time range, empty for the whole trace.
+ */
+static std::string range_filter(chrome_trace_t const &trace, char const *column)
+{
+	std::stringstream ss;
+	if (trace.range_start > trace.starttime)
+	{
+		ss << " and " << column << " >= " << trace.range_start;
+	}
+	if (trace.range_end != UINT64_MAX)
+	{
+		ss << " and " << column << " < " << trace.range_end;
+	}
+	return ss.str();
+}
+
+static std::string call_name(chrome_trace_t const &trace, bool ecall, uint64_t eid, uint64_t call_id)
+{
+	auto &names = ecall ? trace.ecall_names : trace.ocall_names;
+	auto it = names.find(std::make_pair(eid, call_id));
+	if (it != names.end())
+	{
+		return it->second;
+	}
+	return jsonstring((ecall ? "ECall " : "OCall ") + std::to_string(call_id));
+}
+
+static void load_names(chrome_trace_t &trace)
+{
+	std::stringstream ss;
+	ss << "select id, name from event_map;";
+	sql_load<id_name_row_t>(ss, read_id_name_row, [&trace](id_name_row_t const &row) { trace.event_ids[row.name] = row.id; });
+
+	for (auto ecall : {true, false})
+	{
+		auto &names = ecall ? trace.ecall_names : trace.ocall_names;
+		ss << "select id, eid, symbol_name from " << (ecall ? "ecalls" : "ocalls") << ";";
+		sql_load<chrome_symbol_row_t>(ss, [](sqlite3_stmt *stmt, chrome_symbol_row_t &row) {
+			row.id = sql_uint(stmt, 0);
+			row.eid = sql_uint(stmt, 1);
+			row.name = sql_text(stmt, 2);
+		}, [&names](chrome_symbol_row_t const &row) {
+			if (!row.name.empty())
+				names[std::make_pair(row.eid, row.id)] = jsonstring(row.name);
+		});
+	}
+}
+
+/**
+ * @brief Names the process and the thread tracks.
+ */
+static void write_metadata(chrome_trace_t &trace, std::string const &trace_name)
+{
+	next_event(trace) << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << CHROME_TRACE_PID << ", \"args\": {\"name\": " << jsonstring(trace_name) << "}}";
+
+	std::stringstream ss;
+	ss << "select id, pthread_id, name from threads order by id asc;";
+	sql_load<chrome_thread_row_t>(ss, [](sqlite3_stmt *stmt, chrome_thread_row_t &row) {
+		row.id = sql_uint(stmt, 0);
+		row.pthread_id = sql_uint(stmt, 1);
+		row.name = sql_text(stmt, 2);
+	}, [&trace](chrome_thread_row_t const &row) {
+		std::stringstream name;
+		name << (row.name.empty() ? "Thread " + std::to_string(row.id) : row.name) << " (pthread " << row.pthread_id << ")";
+		next_event(trace) << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << CHROME_TRACE_PID << ", \"tid\": " << row.id << ", \"args\": {\"name\": " << jsonstring(name.str()) << "}}";
+		next_event(trace) << "{\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": " << CHROME_TRACE_PID << ", \"tid\": " << row.id << ", \"args\": {\"sort_index\": " << row.id << "}}";
+	});
+}
+
+/**
+ * @brief Writes every ECall/OCall that overlaps the time range as a complete slice.
+ */
+static void write_calls(chrome_trace_t &trace)
+{
+	auto ecall_type = event_id(trace, "EnclaveECallEvent");
+	std::stringstream ss;
+	std::stringstream overlap;
+	if (trace.range_start > trace.starttime)
+		overlap << " and end_time >= " << trace.range_start;
+	if (trace.range_end != UINT64_MAX)
+		overlap << " and start_time < " << trace.range_end;
+
+	if (table_exists("calls"))
+	{
+		ss << "select thread, start_time, end_time, eid, type, call_id, aex_count from calls where 1" << overlap.str() << ";";
+	}
+	else
+	{
+		auto call_table = event_table("call_events");
+		auto return_table = event_table("return_events");
+		ss << "select * from (select s.involved_thread, s.time as start_time, e.time as end_time, s.eid, s.type, s.call_id, e.aex_count from " << return_table << " as e inner join " << call_table << " as s on e.call_event = s.id"
+		   << " where (e.type = " << event_id(trace, "EnclaveECallReturnEvent") << " or e.type = " << event_id(trace, "EnclaveOCallReturnEvent") << ")) where 1" << overlap.str() << ";";
+	}
+
+	sql_load<chrome_call_row_t>(ss, read_chrome_call_row, [&trace, ecall_type](chrome_call_row_t const &row) {
+		bool ecall = row.type == ecall_type;
+		auto &out = next_event(trace);
+		out << "{\"name\": " << call_name(trace, ecall, row.eid, row.call_id) << ", \"cat\": \"" << (ecall ? "ECall" : "OCall") << "\", \"ph\": \"X\", \"ts\": ";
+		write_ts(trace, row.start);
+		out << ", \"dur\": ";
+		write_us(out, row.end > row.start ? row.end - row.start : 0);
+		out << ", \"pid\": " << CHROME_TRACE_PID << ", \"tid\": " << row.thread << ", \"args\": {\"eid\": " << row.eid << ", \"call_id\": " << row.call_id;
+		if (row.has_aex_count)
+		{
+			out << ", \"aex\": " << row.aex_count;
+		}
+		out << "}}";
+	});
+}
+
+/**
+ * @brief Writes AEXs, page-ins and page-outs, and sync wait/set events as instants on the track of their thread.
+ */
+static void write_instants(chrome_trace_t &trace)
+{
+	std::map<uint64_t, char const *> names;
+	for (auto name : {"EnclaveAEXEvent", "EnclavePageInEvent", "EnclavePageOutEvent", "EnclaveSyncWaitEvent", "EnclaveSyncSetEvent"})
+	{
+		auto id = event_id(trace, name);
+		if (id != UINT64_MAX)
+			names[id] = name;
+	}
+	auto aex_type = event_id(trace, "EnclaveAEXEvent");
+	auto sync_set_type = event_id(trace, "EnclaveSyncSetEvent");
+
+	if (names.empty())
+	{
+		return;
+	}
+
+	auto instant = [&trace, &names, aex_type, sync_set_type](chrome_instant_row_t const &row) {
+		auto name = names[row.type];
+		auto &out = next_event(trace);
+		char const *label = row.type == aex_type ? "AEX" : hasEnding(name, "PageInEvent") ? "Page in" : hasEnding(name, "PageOutEvent") ? "Page out" : row.type == sync_set_type ? "Sync set" : "Sync wait";
+		char const *cat = row.type == aex_type ? "AEX" : hasEnding(name, "SyncWaitEvent") || row.type == sync_set_type ? "Sync" : "Paging";
+		out << "{\"name\": \"" << label << "\", \"cat\": \"" << cat << "\", \"ph\": \"i\", \"s\": \"t\", \"ts\": ";
+		write_ts(trace, row.time);
+		out << ", \"pid\": " << CHROME_TRACE_PID << ", \"tid\": " << row.thread << ", \"args\": {\"eid\": " << row.eid;
+		if (std::string(cat) == "Paging")
+		{
+			out << ", \"address\": \"0x" << std::hex << row.arg << std::dec << "\"";
+		}
+		out << "}}";
+	};
+
+	// The per-type tables of version 2, or the events table of older databases
+	std::stringstream ss;
+	if (table_exists("aex_events"))
+	{
+		ss << "select id, " << aex_type << ", time, involved_thread, eid, 0 from aex_events where 1" << range_filter(trace, "time") << ";";
+		sql_load<chrome_instant_row_t>(ss, read_chrome_instant_row, instant);
+		ss << "select id, type, time, involved_thread, eid, arg from paging_events where 1" << range_filter(trace, "time") << ";";
+		sql_load<chrome_instant_row_t>(ss, read_chrome_instant_row, instant);
+		ss << "select id, type, time, involved_thread, eid, arg from sync_events where 1" << range_filter(trace, "time") << ";";
+		sql_load<chrome_instant_row_t>(ss, read_chrome_instant_row, instant);
+	}
+	else
+	{
+		ss << "select id, type, time, involved_thread, eid, arg from events where type in (";
+		for (auto it = names.begin(); it != names.end(); ++it)
+		{
+			ss << (it != names.begin() ? ", " : "") << it->first;
+		}
+		ss << ")" << range_filter(trace, "time") << ";";
+		sql_load<chrome_instant_row_t>(ss, read_chrome_instant_row, instant);
+	}
+}
+
+/**
+ * @brief Connects every sync wait event to the set event that resolved it, if one of them is inside the time range.
+ */
+static void write_flows(chrome_trace_t &trace)
+{
+	auto wait_type = event_id(trace, "EnclaveSyncWaitEvent");
+	auto set_type = event_id(trace, "EnclaveSyncSetEvent");
+	if (wait_type == UINT64_MAX || set_type == UINT64_MAX)
+	{
+		return;
+	}
+
+	auto sync_table = event_table("sync_events");
+	std::stringstream ss;
+	ss << "select w.id, w.time, w.involved_thread, s.time, s.involved_thread from " << sync_table << " as s inner join " << sync_table << " as w on s.arg = w.id"
+	   << " where s.type = " << set_type << " and w.type = " << wait_type;
+	if (trace.range_start > trace.starttime)
+		ss << " and s.time >= " << trace.range_start;
+	if (trace.range_end != UINT64_MAX)
+		ss << " and w.time < " << trace.range_end;
+	ss << ";";
+
+	sql_load<chrome_flow_row_t>(ss, read_chrome_flow_row, [&trace](chrome_flow_row_t const &row) {
+		next_event(trace) << "{\"name\": \"Sync\", \"cat\": \"Sync\", \"ph\": \"s\", \"id\": " << row.id << ", \"ts\": ";
+		write_ts(trace, row.wait_time);
+		trace.out << ", \"pid\": " << CHROME_TRACE_PID << ", \"tid\": " << row.wait_thread << "}";
+		next_event(trace) << "{\"name\": \"Sync\", \"cat\": \"Sync\", \"ph\": \"f\", \"bp\": \"e\", \"id\": " << row.id << ", \"ts\": ";
+		write_ts(trace, row.set_time);
+		trace.out << ", \"pid\": " << CHROME_TRACE_PID << ", \"tid\": " << row.set_thread << "}";
+	});
+}
+
+/**
+ * @brief Exports the trace as a timeline in the Chrome Trace Event format to the given file.
+ * With "--window", only the events inside the window are written, together with the calls that overlap it. Exits on errors.
+ * @param path
+ * @param trace_name Path of the trace database, names the process
+ */
+void export_chrome_trace(std::string const &path, std::string const &trace_name)
+{
+	std::cout << "=== Exporting timeline" << std::endl;
+
+	chrome_trace_t trace;
+	trace.out.open(path);
+	if (!trace.out)
+	{
+		std::cout << "/!\\ Could not write timeline " << path << std::endl;
+		exit(1);
+	}
+	trace.events = 0;
+	trace.starttime = 0;
+
+	std::stringstream ss;
+	ss << "select value from general where key = 'start_time';";
+	sql_load<uint64_t>(ss, read_uint_row, [&trace](uint64_t row) { trace.starttime = row; });
+	trace.range_start = trace.starttime + config.window_start;
+	trace.range_end = config.window_end == UINT64_MAX ? UINT64_MAX : trace.starttime + config.window_end;
+
+	load_names(trace);
+
+	trace.out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+	write_metadata(trace, trace_name);
+	std::cout << "iii Exporting calls" << std::endl << std::flush;
+	write_calls(trace);
+	std::cout << "iii Exporting AEX, paging and sync events" << std::endl << std::flush;
+	write_instants(trace);
+	write_flows(trace);
+	trace.out << "\n]}" << std::endl;
+	trace.out.close();
+
+	std::cout << "(i) Wrote " << trace.events << " timeline events to " << path << std::endl;
+}
@@ -0,0 +1,17 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_CHROME_H
+#define SGX_PERF_CHROME_H
+
+#include <string>
+
+/**
+ * @brief Process id of all events in the timeline, the trace covers one process
+ */
+#define CHROME_TRACE_PID 1
+
+void export_chrome_trace(std::string const &path, std::string const &trace_name);
+
+#endif //SGX_PERF_CHROME_H
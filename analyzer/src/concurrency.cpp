@@ -0,0 +1,299 @@
+/**
+ * @author weichbr
+ */
+
+#include "main.h"
+#include "concurrency.h"
+
+#include <iomanip>
+#include <numeric>
+#include <queue>
+
+/**
+ * Enclave concurrency
+ *
+ * Sweeps over the ECalls of all threads in order of their start time and keeps the threads that are inside every enclave, i.e. that occupy one of its TCS.
+ * This gives the time spent with each number of threads inside and the peak, which is a lower bound for the TCSNum the enclave needs.
+ * Threads that find no free TCS either fail with SGX_ERROR_OUT_OF_TCS or wait and retry. Waiting shows as ECalls that start right after another
+ * thread left the enclave at peak occupancy, much more often than the time covered by these moments explains.
+ * Only the threads currently inside are kept, so the sweep needs constant memory no matter how long the trace is.
+ * The sweep reads every ECall, so its results are kept in the analysis cache like the call statistics.
+ */
+
+typedef struct __concurrency_row
+{
+	uint64_t eid;
+	uint64_t thread;
+	uint64_t start;
+	uint64_t end;
+} concurrency_row_t;
+
+static void read_concurrency_row(sqlite3_stmt *stmt, concurrency_row_t &row)
+{
+	row.eid = sql_uint(stmt, 0);
+	row.thread = sql_uint(stmt, 1);
+	row.start = sql_uint(stmt, 2);
+	row.end = sql_uint(stmt, 3);
+}
+
+typedef std::pair<uint64_t, uint64_t> occupant_t; // End of the outermost ECall and thread
+
+/**
+ * @brief State of the sweep over the ECalls of one enclave.
+ */
+typedef struct __sweep
+{
+	concurrency_t result;
+	std::priority_queue<occupant_t, std::vector<occupant_t>, std::greater<occupant_t>> inside; // Threads inside, the next to leave first
+	std::map<uint64_t, uint64_t> occupied; // End of the outermost ECall by thread, for the threads inside
+	std::set<uint64_t> threads;
+	uint64_t time; // Time up to which time_at is counted
+	bool left; // A thread has left the enclave
+	uint64_t left_time; // When the last thread left
+	uint64_t left_thread;
+	size_t left_level; // Threads inside before it left
+	std::vector<uint64_t> handoffs; // ECalls that started after a thread left at i threads inside, see concurrency_t::handoffs
+	std::vector<uint64_t> handoff_time;
+	std::vector<uint64_t> handoff_end; // End of the last hand-off interval at i threads inside
+} sweep_t;
+
+static void grow(sweep_t &s, size_t level)
+{
+	if (s.result.time_at.size() > level)
+	{
+		return;
+	}
+	s.result.time_at.resize(level + 1, 0);
+	s.result.entered_at.resize(level + 1, 0);
+	s.handoffs.resize(level + 1, 0);
+	s.handoff_time.resize(level + 1, 0);
+	s.handoff_end.resize(level + 1, 0);
+}
+
+/**
+ * @brief Counts the time until the given time at the current number of threads inside.
+ */
+static void advance(sweep_t &s, uint64_t time)
+{
+	if (time > s.time)
+	{
+		s.result.time_at[s.inside.size()] += time - s.time;
+		s.time = time;
+	}
+}
+
+/**
+ * @brief Lets every thread whose ECall returned until the given time leave the enclave.
+ */
+static void leave(sweep_t &s, uint64_t until)
+{
+	while (!s.inside.empty() && s.inside.top().first <= until)
+	{
+		auto occupant = s.inside.top();
+		auto level = s.inside.size();
+		advance(s, occupant.first);
+
+		// Hand-off intervals of the same level are added up without overlaps
+		auto end = occupant.first + TCS_HANDOFF_TIME;
+		s.handoff_time[level] += end - std::max(occupant.first, std::min(end, s.handoff_end[level]));
+		s.handoff_end[level] = end;
+		s.left = true;
+		s.left_time = occupant.first;
+		s.left_thread = occupant.second;
+		s.left_level = level;
+
+		s.occupied.erase(occupant.second);
+		s.inside.pop();
+	}
+}
+
+/**
+ * @brief Lets the thread of an ECall enter the enclave, unless it is already inside, i.e. the ECall is nested in one of its OCalls.
+ */
+static void enter(sweep_t &s, concurrency_row_t const &row)
+{
+	leave(s, row.start);
+	auto it = s.occupied.find(row.thread);
+	if (it != s.occupied.end() && row.start < it->second)
+	{
+		return;
+	}
+
+	if (s.result.ecalls == 0)
+	{
+		s.time = row.start;
+	}
+	advance(s, row.start);
+	auto level = s.inside.size();
+	grow(s, level + 1);
+	s.result.entered_at[level]++;
+	if (s.left && row.thread != s.left_thread && row.start - s.left_time < TCS_HANDOFF_TIME)
+	{
+		s.handoffs[s.left_level]++;
+	}
+
+	s.inside.emplace(row.end, row.thread);
+	s.occupied[row.thread] = row.end;
+	s.threads.insert(row.thread);
+	s.result.ecalls++;
+	s.result.peak = std::max(s.result.peak, static_cast<uint64_t>(s.inside.size()));
+}
+
+/**
+ * @brief Lets the remaining threads leave and decides whether threads waited for a TCS.
+ */
+static void finish(sweep_t &s)
+{
+	leave(s, UINT64_MAX);
+	auto &r = s.result;
+	r.threads = s.threads.size();
+	r.active = std::accumulate(r.time_at.begin(), r.time_at.end(), (uint64_t)0);
+	if (r.peak > 0)
+	{
+		r.handoffs = s.handoffs[r.peak];
+		r.handoff_time = std::min(s.handoff_time[r.peak], r.active);
+	}
+	// Share of the ECalls starting in the hand-off intervals compared to the share of time they cover
+	if (r.ecalls > 0 && r.handoff_time > 0)
+	{
+		r.lift = (r.handoffs / (double)r.ecalls) / (r.handoff_time / (double)r.active);
+	}
+	r.saturated = r.threads > r.peak && (r.out_of_tcs > 0 || (r.handoffs >= TCS_MIN_HANDOFFS && r.lift >= TCS_HANDOFF_LIFT));
+	// Every thread occupies at most one TCS, so a TCS per thread removes all waiting
+	r.recommended_tcs = r.saturated ? r.threads : r.peak;
+}
+
+/**
+ * @brief Counts the ECalls that failed because no TCS was free, by enclave. Like the calls, they belong to the window they started in.
+ */
+static std::map<uint64_t, uint64_t> count_out_of_tcs()
+{
+	std::map<uint64_t, uint64_t> failed;
+	std::stringstream ss;
+	ss << "select e.eid, count(*) from " << event_table("return_events") << " as e inner join " << event_table("call_events") << " as s on s.id = e.call_event"
+	   << " where e.type = " << EnclaveECallReturnEventId << " and e.return_value = " << SGX_STATUS_OUT_OF_TCS
+	   << window_filter("s.time", " and ") << " group by e.eid;";
+	sql_load<std::pair<uint64_t, uint64_t>>(ss, [](sqlite3_stmt *stmt, std::pair<uint64_t, uint64_t> &row) {
+		row.first = sql_uint(stmt, 0);
+		row.second = sql_uint(stmt, 1);
+	}, [&failed](std::pair<uint64_t, uint64_t> const &row) { failed[row.first] = row.second; });
+	return failed;
+}
+
+static std::string sharetext(uint64_t part, uint64_t whole)
+{
+	std::stringstream ss;
+	ss << std::setprecision(3) << (whole > 0 ? part * 100.0 / whole : 0.0) << "%";
+	return ss.str();
+}
+
+static void print_concurrency(concurrency_t const &r)
+{
+	std::cout << "/ Enclave " << r.eid << std::endl;
+	std::cout << "| " << r.threads << (r.threads == 1 ? " thread" : " threads") << " entered the enclave with " << r.ecalls << " ECalls, at most "
+	          << r.peak << " at the same time for " << timeformat(r.time_at[r.peak]) << " (" << sharetext(r.time_at[r.peak], r.active) << " of " << timeformat(r.active) << ")" << std::endl;
+	std::cout << "| Threads inside:" << std::endl;
+	for (size_t level = 0; level <= r.peak; ++level)
+	{
+		std::cout << "| | " << std::setw(3) << level << ": " << timeformat(r.time_at[level]) << " (" << sharetext(r.time_at[level], r.active) << "), "
+		          << r.entered_at[level] << " ECalls entered" << std::endl;
+	}
+	if (r.out_of_tcs > 0)
+	{
+		std::cout << "| " << YELLOW() << r.out_of_tcs << " ECalls failed because no TCS was free" << NORMAL() << std::endl;
+	}
+	if (r.peak > 0 && r.threads > r.peak)
+	{
+		std::cout << "| " << (r.saturated && r.out_of_tcs == 0 ? YELLOW() : "") << r.handoffs << " ECalls (" << sharetext(r.handoffs, r.ecalls) << ") started less than "
+		          << timeformat(TCS_HANDOFF_TIME) << " after another thread left at " << r.peak << " threads inside, " << std::setprecision(3) << r.lift
+		          << "x as often as by chance" << std::setprecision(6) << NORMAL() << std::endl;
+	}
+	if (r.saturated)
+	{
+		std::cout << "| " << YELLOW() << "Threads waited for a TCS, set TCSNum to at least " << r.recommended_tcs << ", one per thread" << NORMAL() << std::endl;
+	}
+	else
+	{
+		std::cout << "| TCSNum " << r.recommended_tcs << " suffices, no thread waited for a TCS" << std::endl;
+	}
+	std::cout << "\\ ___" << std::endl;
+}
+
+/**
+ * @brief Sweeps over the ECalls of the trace, see above.
+ * Reads the ECalls from the trace, so it works the same in out-of-core mode and when the call statistics come from the cache.
+ * @return The concurrency of every enclave with ECalls
+ */
+static std::vector<concurrency_t> sweep_concurrency()
+{
+	std::cout << "iii Sweeping ECalls" << std::endl << std::flush;
+
+	auto failed = count_out_of_tcs();
+	std::map<uint64_t, sweep_t> sweeps;
+
+	// Failed ECalls never entered the enclave
+	std::stringstream ss;
+	if (table_exists("calls"))
+	{
+		ss << "select eid, thread, start_time, end_time from calls where type = " << EnclaveECallEventId;
+		if (!failed.empty())
+		{
+			ss << " and id not in (select call_event from " << event_table("return_events") << " where type = " << EnclaveECallReturnEventId << " and return_value = " << SGX_STATUS_OUT_OF_TCS << ")";
+		}
+		ss << window_filter("start_time", " and ") << " order by start_time, thread asc;";
+	}
+	else
+	{
+		ss << "select s.eid, s.involved_thread, s.time, e.time from " << event_table("return_events") << " as e inner join " << event_table("call_events") << " as s on s.id = e.call_event"
+		   << " where e.type = " << EnclaveECallReturnEventId << " and (e.return_value is null or e.return_value != " << SGX_STATUS_OUT_OF_TCS << ")"
+		   << window_filter("s.time", " and ") << " order by s.time, s.involved_thread asc;";
+	}
+	sql_load<concurrency_row_t>(ss, read_concurrency_row, [&sweeps](concurrency_row_t const &row) {
+		auto it = sweeps.find(row.eid);
+		if (it == sweeps.end())
+		{
+			it = sweeps.emplace(row.eid, sweep_t()).first;
+			it->second.result.eid = row.eid;
+			grow(it->second, 0);
+		}
+		enter(it->second, row);
+	});
+
+	std::vector<concurrency_t> results;
+	for (auto &p : sweeps)
+	{
+		auto f = failed.find(p.first);
+		p.second.result.out_of_tcs = f != failed.end() ? f->second : 0;
+		finish(p.second);
+		results.push_back(p.second.result);
+	}
+	return results;
+}
+
+/**
+ * @brief Prints how many threads were inside every enclave at the same time and recommends a TCSNum.
+ */
+void analyze_concurrency()
+{
+	std::vector<concurrency_t> results;
+	if (load_cached_concurrency(results))
+	{
+		std::cout << "iii Loaded enclave concurrency from cache" << std::endl << std::flush;
+	}
+	else
+	{
+		results = sweep_concurrency();
+		store_cached_concurrency(results);
+	}
+
+	std::cout << "(i) Enclave concurrency" << std::endl;
+	std::for_each(results.begin(), results.end(), print_concurrency);
+	if (results.empty())
+	{
+		std::cout << "No ECalls" << std::endl;
+	}
+	std::cout << std::endl;
+
+	if (!config.report.empty())
+		report_concurrency(results);
+}
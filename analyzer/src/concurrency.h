@@ -0,0 +1,54 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_CONCURRENCY_H
+#define SGX_PERF_CONCURRENCY_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief SGX_ERROR_OUT_OF_TCS of the SGX SDK, returned by an ECall when no TCS of the enclave is free
+ */
+#define SGX_STATUS_OUT_OF_TCS 0x1003
+
+/**
+ * @brief An ECall of another thread that starts less than this many ns after a thread left the enclave may have waited for its TCS
+ */
+#define TCS_HANDOFF_TIME 10000
+
+/**
+ * @brief Threads wait for a TCS when ECalls start after a thread left at peak occupancy this many times more often than by chance
+ */
+#define TCS_HANDOFF_LIFT 2.0
+
+/**
+ * @brief Minimum number of hand-offs at peak occupancy to consider the enclave saturated
+ */
+#define TCS_MIN_HANDOFFS 20
+
+/**
+ * @brief How many threads were inside an enclave at the same time.
+ * A thread occupies a TCS from the start of its outermost ECall until it returns, ECalls nested in its OCalls reuse that TCS.
+ */
+typedef struct __concurrency
+{
+	uint64_t eid;
+	uint64_t threads; // Threads that entered the enclave
+	uint64_t ecalls; // ECalls that occupied a TCS
+	uint64_t active; // Time from the first entry to the last exit
+	uint64_t peak; // Most threads inside at the same time
+	std::vector<uint64_t> time_at; // Time with exactly i threads inside
+	std::vector<uint64_t> entered_at; // ECalls that entered while i other threads were inside
+	uint64_t handoffs; // ECalls that started less than TCS_HANDOFF_TIME after another thread left at peak occupancy
+	uint64_t handoff_time; // Time covered by these TCS_HANDOFF_TIME intervals
+	double lift; // How many times more often ECalls started in these intervals than by chance
+	uint64_t out_of_tcs; // ECalls that failed because no TCS was free
+	bool saturated; // Threads waited for a TCS
+	uint64_t recommended_tcs;
+} concurrency_t;
+
+void analyze_concurrency();
+
+#endif //SGX_PERF_CONCURRENCY_H
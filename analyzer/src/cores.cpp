@@ -0,0 +1,410 @@
+/**
+ * @author weichbr
+ */
+
+#include "main.h"
+#include "cores.h"
+
+#include <iomanip>
+
+/**
+ * Core placement
+ *
+ * Every event records the core it happened on. An ECall whose return happened on another core than its entry was migrated while it ran:
+ * the thread left the enclave with an AEX and was resumed on another core, which costs the transition and a cold cache and TLB.
+ * The durations of migrated and non-migrated calls are compared per ECall, so short and long ECalls are not mixed up.
+ * Together with the cores every thread ran on and the cores the AEXs happened on, this shows which threads to pin and which cores to isolate.
+ * The calls are streamed, only counters and a sketch per ECall are kept.
+ */
+
+typedef struct __core_call_row
+{
+	uint64_t thread;
+	uint64_t eid;
+	uint64_t type;
+	uint64_t call_id;
+	uint64_t entry_core;
+	uint64_t return_core;
+	uint64_t duration;
+} core_call_row_t;
+
+static void read_core_call_row(sqlite3_stmt *stmt, core_call_row_t &row)
+{
+	row.thread = sql_uint(stmt, 0);
+	row.eid = sql_uint(stmt, 1);
+	row.type = sql_uint(stmt, 2);
+	row.call_id = sql_uint(stmt, 3);
+	row.entry_core = sql_uint(stmt, 4);
+	row.return_core = sql_uint(stmt, 5);
+	row.duration = sql_uint(stmt, 6);
+}
+
+/**
+ * @brief Running durations of an ECall, split by whether the calls stayed on their core.
+ */
+typedef struct __migration_acc
+{
+	stats_acc_t stayed;
+	stats_acc_t migrated;
+	sketch_t stayed_sketch;
+	sketch_t migrated_sketch;
+} migration_acc_t;
+
+typedef struct __thread_acc
+{
+	std::map<uint64_t, uint64_t> events; // Events by core
+	uint64_t ecalls;
+	uint64_t migrated;
+} thread_acc_t;
+
+static std::string ecall_name(uint64_t eid, uint64_t call_id)
+{
+	std::string name;
+	std::stringstream ss;
+	ss << "select symbol_name from ecalls where eid = " << eid << " and id = " << call_id << ";";
+	sql_load<std::string>(ss, [](sqlite3_stmt *stmt, std::string &row) { row = sql_text(stmt, 0); }, [&name](std::string const &row) { name = row; });
+	return name.empty() ? "ECall " + std::to_string(call_id) : name;
+}
+
+/**
+ * @brief Streams the entry and return of every ECall/OCall and counts the cores and migrations.
+ */
+static void load_core_calls(core_summary_t &summary, std::map<uint64_t, thread_acc_t> &threads, std::map<std::pair<uint64_t, uint64_t>, migration_acc_t> &ecalls,
+                            std::map<uint64_t, uint64_t> &entries)
+{
+	std::stringstream ss;
+	ss << "select s.involved_thread, s.eid, s.type, s.call_id, s.core, e.core, e.time - s.time from " << event_table("return_events") << " as e inner join " << event_table("call_events")
+	   << " as s on s.id = e.call_event where (e.type = " << EnclaveECallReturnEventId << " or e.type = " << EnclaveOCallReturnEventId << ")" << window_filter("s.time", " and ") << ";";
+
+	sql_load<core_call_row_t>(ss, read_core_call_row, [&summary, &threads, &ecalls, &entries](core_call_row_t const &row) {
+		auto &t = threads[row.thread];
+		t.events[row.entry_core]++;
+		t.events[row.return_core]++;
+		if (row.type != EnclaveECallEventId)
+		{
+			return;
+		}
+
+		bool migrated = row.entry_core != row.return_core;
+		auto key = std::make_pair(row.eid, row.call_id);
+		auto it = ecalls.find(key);
+		if (it == ecalls.end())
+		{
+			it = ecalls.emplace(key, migration_acc_t()).first;
+			init_stats_acc(it->second.stayed);
+			init_stats_acc(it->second.migrated);
+			init_sketch(it->second.stayed_sketch);
+			init_sketch(it->second.migrated_sketch);
+		}
+		auto &acc = it->second;
+		accumulate_stats(migrated ? acc.migrated : acc.stayed, &row.duration, 1);
+		add_to_sketch(migrated ? acc.migrated_sketch : acc.stayed_sketch, &row.duration, 1);
+
+		entries[row.entry_core]++;
+		t.ecalls++;
+		summary.ecalls++;
+		if (migrated)
+		{
+			t.migrated++;
+			summary.migrated++;
+		}
+	});
+}
+
+/**
+ * @brief Compares the durations of migrated and non-migrated calls of every ECall, the ECalls with the largest penalty first.
+ */
+static void compare_ecalls(core_summary_t &summary, std::map<std::pair<uint64_t, uint64_t>, migration_acc_t> const &ecalls)
+{
+	uint64_t weighted_stayed = 0;
+	uint64_t weighted_migrated = 0;
+	for (auto &p : ecalls)
+	{
+		auto &acc = p.second;
+		ecall_migration_t m = {};
+		m.eid = p.first.first;
+		m.call_id = p.first.second;
+		finish_stats(m.stayed_stats, acc.stayed);
+		finish_stats(m.migrated_stats, acc.migrated);
+		sketch_quantiles(m.stayed_quantiles, acc.stayed_sketch);
+		sketch_quantiles(m.migrated_quantiles, acc.migrated_sketch);
+		m.calls = acc.stayed.count + acc.migrated.count;
+		m.migrated = acc.migrated.count;
+		if (m.migrated == 0)
+		{
+			continue;
+		}
+		m.name = ecall_name(m.eid, m.call_id);
+		m.compared = acc.stayed.count >= MIGRATION_MIN_CALLS && acc.migrated.count >= MIGRATION_MIN_CALLS;
+		if (m.compared)
+		{
+			weighted_stayed += m.migrated * m.stayed_quantiles.value[0];
+			weighted_migrated += m.migrated * m.migrated_quantiles.value[0];
+		}
+		summary.ecalls_by_penalty.push_back(m);
+	}
+	summary.penalty = weighted_migrated > weighted_stayed ? weighted_migrated - weighted_stayed : 0;
+	summary.slowdown = weighted_stayed > 0 ? weighted_migrated / (double)weighted_stayed : 0;
+
+	auto penalty = [](ecall_migration_t const &m) -> uint64_t {
+		auto stayed = m.stayed_quantiles.value[0];
+		auto migrated = m.migrated_quantiles.value[0];
+		return m.compared && migrated > stayed ? m.migrated * (migrated - stayed) : 0;
+	};
+	std::stable_sort(summary.ecalls_by_penalty.begin(), summary.ecalls_by_penalty.end(), [&penalty](ecall_migration_t const &a, ecall_migration_t const &b) {
+		return penalty(a) != penalty(b) ? penalty(a) > penalty(b) : a.migrated > b.migrated;
+	});
+}
+
+/**
+ * @brief Counts the AEXs per core and marks the cores that take far more AEXs than ECall entries.
+ */
+static void count_core_aexs(core_summary_t &summary, std::map<uint64_t, uint64_t> const &entries)
+{
+	std::map<uint64_t, uint64_t> aexs;
+	std::stringstream ss;
+	if (table_exists("aex_events"))
+	{
+		ss << "select core, count(*) from aex_events where 1" << window_filter("time", " and ") << " group by core;";
+	}
+	else
+	{
+		ss << "select e.core, count(*) from events as e inner join event_map as m on m.id = e.type where m.name = 'EnclaveAEXEvent'" << window_filter("e.time", " and ") << " group by e.core;";
+	}
+	sql_load<std::pair<uint64_t, uint64_t>>(ss, [](sqlite3_stmt *stmt, std::pair<uint64_t, uint64_t> &row) {
+		row.first = sql_uint(stmt, 0);
+		row.second = sql_uint(stmt, 1);
+	}, [&aexs](std::pair<uint64_t, uint64_t> const &row) { aexs[row.first] = row.second; });
+
+	uint64_t total_aexs = 0;
+	for (auto &p : aexs)
+		total_aexs += p.second;
+	std::map<uint64_t, core_aexs_t> cores;
+	for (auto &p : entries)
+		cores[p.first] = {p.first, p.second, 0, false};
+	for (auto &p : aexs)
+		cores.emplace(p.first, core_aexs_t{p.first, 0, 0, false}).first->second.aexs = p.second;
+
+	for (auto &p : cores)
+	{
+		auto &c = p.second;
+		double aex_share = total_aexs > 0 ? c.aexs / (double)total_aexs : 0;
+		double entry_share = summary.ecalls > 0 ? c.entries / (double)summary.ecalls : 0;
+		c.hotspot = cores.size() > 1 && c.aexs >= CORE_MIN_AEXS && aex_share >= CORE_AEX_HOTSPOT * entry_share;
+		summary.cores.push_back(c);
+	}
+	std::stable_sort(summary.cores.begin(), summary.cores.end(), [](core_aexs_t const &a, core_aexs_t const &b) { return a.aexs > b.aexs; });
+}
+
+/**
+ * @brief Sums up the cores of every thread and picks a core for every thread whose ECalls migrate, avoiding AEX hotspots and the cores of other pinned threads.
+ * Pinning is only recommended if migrated ECalls are slower, or if no ECall had enough calls to tell.
+ */
+static void place_threads(core_summary_t &summary, std::map<uint64_t, thread_acc_t> const &threads)
+{
+	std::map<uint64_t, uint64_t> pthread_ids;
+	std::stringstream ss;
+	ss << "select id, pthread_id from threads;";
+	sql_load<std::pair<uint64_t, uint64_t>>(ss, [](sqlite3_stmt *stmt, std::pair<uint64_t, uint64_t> &row) {
+		row.first = sql_uint(stmt, 0);
+		row.second = sql_uint(stmt, 1);
+	}, [&pthread_ids](std::pair<uint64_t, uint64_t> const &row) { pthread_ids[row.first] = row.second; });
+
+	std::set<uint64_t> taken;
+	for (auto &c : summary.cores)
+	{
+		if (c.hotspot)
+			taken.insert(c.core);
+	}
+	bool slower = summary.slowdown == 0 || summary.slowdown >= MIGRATION_PENALTY;
+
+	std::vector<std::pair<thread_cores_t, std::vector<std::pair<uint64_t, uint64_t>>>> placed;
+	for (auto &p : threads)
+	{
+		auto &acc = p.second;
+		thread_cores_t t = {};
+		t.thread = p.first;
+		auto pt = pthread_ids.find(p.first);
+		t.pthread_id = pt != pthread_ids.end() ? pt->second : 0;
+		t.cores = acc.events.size();
+		t.ecalls = acc.ecalls;
+		t.migrated = acc.migrated;
+		// Cores by events, most used first
+		std::vector<std::pair<uint64_t, uint64_t>> by_events;
+		for (auto &e : acc.events)
+		{
+			t.events += e.second;
+			by_events.emplace_back(e.second, e.first);
+		}
+		std::stable_sort(by_events.begin(), by_events.end(), [](std::pair<uint64_t, uint64_t> const &a, std::pair<uint64_t, uint64_t> const &b) { return a.first > b.first; });
+		if (!by_events.empty())
+		{
+			t.main_core = by_events[0].second;
+			t.on_main_core = by_events[0].first;
+		}
+		t.pin = slower && t.ecalls >= MIGRATION_MIN_CALLS && t.migrated >= t.ecalls * MIGRATION_MIN_SHARE && t.migrated > 0;
+		placed.emplace_back(t, by_events);
+	}
+
+	// The busiest threads keep their main core first, then the others get the free core they used most, or any free core
+	std::stable_sort(placed.begin(), placed.end(), [](decltype(placed)::value_type const &a, decltype(placed)::value_type const &b) { return a.first.ecalls > b.first.ecalls; });
+	for (auto &p : placed)
+	{
+		auto &t = p.first;
+		t.pin_core = t.main_core;
+		if (t.pin && taken.insert(t.main_core).second)
+		{
+			t.main_core_kept = true;
+		}
+	}
+	for (auto &p : placed)
+	{
+		auto &t = p.first;
+		if (!t.pin || t.main_core_kept)
+		{
+			continue;
+		}
+		auto free_core = std::find_if(p.second.begin(), p.second.end(), [&taken](std::pair<uint64_t, uint64_t> const &c) { return taken.count(c.second) == 0; });
+		if (free_core != p.second.end())
+		{
+			t.pin_core = free_core->second;
+		}
+		else
+		{
+			auto other = std::find_if(summary.cores.begin(), summary.cores.end(), [&taken](core_aexs_t const &c) { return taken.count(c.core) == 0; });
+			if (other != summary.cores.end())
+				t.pin_core = other->core;
+			else
+				t.pin_shared = true;
+		}
+		taken.insert(t.pin_core);
+	}
+
+	std::stable_sort(placed.begin(), placed.end(), [](decltype(placed)::value_type const &a, decltype(placed)::value_type const &b) { return a.first.thread < b.first.thread; });
+	for (auto &p : placed)
+		summary.threads.push_back(p.first);
+}
+
+static std::string sharetext(uint64_t part, uint64_t whole)
+{
+	std::stringstream ss;
+	ss << std::setprecision(3) << (whole > 0 ? part * 100.0 / whole : 0.0) << "%";
+	return ss.str();
+}
+
+static void print_migrations(core_summary_t const &summary)
+{
+	std::cout << "(i) Core migrations" << std::endl;
+	std::cout << summary.migrated << " of " << summary.ecalls << " ECalls (" << sharetext(summary.migrated, summary.ecalls) << ") returned on another core than they entered on" << std::endl;
+	if (summary.slowdown > 0)
+	{
+		std::cout << (summary.slowdown >= MIGRATION_PENALTY ? YELLOW() : "") << "Migrated ECalls took " << std::setprecision(3) << summary.slowdown << std::setprecision(6)
+		          << "x the median of those that stayed, ~" << timeformat(summary.penalty) << " in total" << NORMAL() << std::endl;
+	}
+	for (auto &m : summary.ecalls_by_penalty)
+	{
+		std::cout << "/ " << WHITE() << m.name << NORMAL() << " (Enclave " << m.eid << ")" << std::endl;
+		std::cout << "| Migrated: " << m.migrated << " of " << m.calls << " (" << sharetext(m.migrated, m.calls) << ")" << std::endl;
+		if (m.compared)
+		{
+			auto stayed = m.stayed_quantiles.value[0];
+			auto migrated = m.migrated_quantiles.value[0];
+			std::cout << "| " << (migrated >= stayed * MIGRATION_PENALTY ? YELLOW() : "") << "Median: ~" << timeformat(migrated) << " migrated vs. ~" << timeformat(stayed) << " stayed" << NORMAL()
+			          << ", Ø " << timeformat(m.migrated_stats.avg) << " vs. " << timeformat(m.stayed_stats.avg) << std::endl;
+		}
+		else
+		{
+			std::cout << "| Too few calls to compare the durations" << std::endl;
+		}
+		std::cout << "\\ ___" << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+static void print_threads(core_summary_t const &summary)
+{
+	std::cout << "(i) Thread placement" << std::endl;
+	for (auto &t : summary.threads)
+	{
+		std::cout << "/ Thread " << t.thread << " (pthread " << t.pthread_id << ")" << std::endl;
+		std::cout << "| " << t.cores << (t.cores == 1 ? " core" : " cores") << ", " << sharetext(t.on_main_core, t.events) << " of the calls and returns on core " << t.main_core << std::endl;
+		if (t.ecalls > 0)
+		{
+			std::cout << "| " << (t.pin ? YELLOW() : "") << t.migrated << " of " << t.ecalls << " ECalls migrated (" << sharetext(t.migrated, t.ecalls) << ")" << NORMAL() << std::endl;
+		}
+		std::cout << "\\ ___" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "(i) AEXs by core" << std::endl;
+	uint64_t total = 0;
+	for (auto &c : summary.cores)
+		total += c.aexs;
+	for (auto &c : summary.cores)
+	{
+		std::cout << (c.hotspot ? YELLOW() : "") << "Core " << std::setw(3) << c.core << ": " << c.aexs << " AEXs (" << sharetext(c.aexs, total) << "), "
+		          << c.entries << " ECall entries (" << sharetext(c.entries, summary.ecalls) << ")" << NORMAL() << std::endl;
+	}
+	if (summary.cores.empty())
+	{
+		std::cout << "No ECalls or AEXs" << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+static void print_core_recommendations(core_summary_t const &summary)
+{
+	std::cout << "(i) Placement recommendations" << std::endl;
+	size_t n = 0;
+	for (auto &t : summary.threads)
+	{
+		if (t.pin)
+		{
+			std::cout << ++n << ". Pin thread " << t.thread << " (pthread " << t.pthread_id << ") to core " << t.pin_core << ", " << sharetext(t.migrated, t.ecalls)
+			          << " of its ECalls migrated" << (t.pin_shared ? ". No core of the trace is free, rather pick an unused one" : "") << std::endl;
+		}
+	}
+	uint64_t total = 0;
+	for (auto &c : summary.cores)
+		total += c.aexs;
+	for (auto &c : summary.cores)
+	{
+		if (c.hotspot)
+		{
+			std::cout << ++n << ". Isolate core " << c.core << " from interrupts (isolcpus, IRQ affinity) or keep enclave threads off it, it takes "
+			          << sharetext(c.aexs, total) << " of the AEXs but only " << sharetext(c.entries, summary.ecalls) << " of the ECall entries" << std::endl;
+		}
+	}
+	if (n == 0)
+	{
+		std::cout << "No recommendations" << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+void analyze_cores()
+{
+	std::cout << "=== Analyzing core placement" << std::endl;
+	// The window is relative to the start of the trace, also without the call phase
+	load_general_data();
+	std::cout << "iii Loading calls" << std::endl << std::flush;
+
+	core_summary_t summary = {};
+	std::map<uint64_t, thread_acc_t> threads;
+	std::map<std::pair<uint64_t, uint64_t>, migration_acc_t> ecalls;
+	std::map<uint64_t, uint64_t> entries;
+	load_core_calls(summary, threads, ecalls, entries);
+	compare_ecalls(summary, ecalls);
+	ecalls.clear();
+
+	std::cout << "iii Counting AEXs" << std::endl << std::flush;
+	count_core_aexs(summary, entries);
+	place_threads(summary, threads);
+
+	print_migrations(summary);
+	print_threads(summary);
+	print_core_recommendations(summary);
+
+	if (!config.report.empty())
+		report_cores(summary);
+}
@@ -0,0 +1,95 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_CORES_H
+#define SGX_PERF_CORES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "stats.h"
+
+/**
+ * @brief Minimum number of migrated and of non-migrated calls of an ECall to compare their durations
+ */
+#define MIGRATION_MIN_CALLS 20
+
+/**
+ * @brief Migrated ECalls are slower when their median is at least this factor above that of the ECalls that stayed on their core
+ */
+#define MIGRATION_PENALTY 1.2
+
+/**
+ * @brief Threads whose ECalls migrate at least this often are recommended for pinning
+ */
+#define MIGRATION_MIN_SHARE 0.01
+
+/**
+ * @brief A core is an AEX hotspot when its share of the AEXs is this many times its share of the ECall entries
+ */
+#define CORE_AEX_HOTSPOT 2.0
+
+/**
+ * @brief Minimum number of AEXs on a core to call it a hotspot
+ */
+#define CORE_MIN_AEXS 100
+
+/**
+ * @brief Durations of an ECall that returned on the core it entered on, and of one that returned on another core.
+ */
+typedef struct __ecall_migration
+{
+	uint64_t eid;
+	uint64_t call_id;
+	std::string name;
+	uint64_t calls;
+	uint64_t migrated;
+	stats_t stayed_stats;
+	stats_t migrated_stats;
+	quantiles_t stayed_quantiles; // Estimated from a sketch
+	quantiles_t migrated_quantiles;
+	bool compared; // Both have at least MIGRATION_MIN_CALLS calls
+} ecall_migration_t;
+
+/**
+ * @brief Cores a thread ran on, counted at the entry and return of its ECalls/OCalls.
+ */
+typedef struct __thread_cores
+{
+	uint64_t thread;
+	uint64_t pthread_id;
+	uint64_t events;
+	uint64_t cores; // Number of cores the thread ran on
+	uint64_t main_core; // Core the thread ran on most often
+	uint64_t on_main_core;
+	uint64_t ecalls;
+	uint64_t migrated; // ECalls that returned on another core than they entered on
+	bool pin;
+	uint64_t pin_core; // Recommended core, if pin
+	bool main_core_kept; // pin_core is the main core
+	bool pin_shared; // Every core seen in the trace is taken by a hotspot or another pinned thread, so pin_core is shared
+} thread_cores_t;
+
+typedef struct __core_aexs
+{
+	uint64_t core;
+	uint64_t entries; // ECalls that entered on this core
+	uint64_t aexs;
+	bool hotspot;
+} core_aexs_t;
+
+typedef struct __core_summary
+{
+	uint64_t ecalls;
+	uint64_t migrated;
+	uint64_t penalty; // Estimated extra time of the migrated ECalls, from the medians of the compared ECalls
+	double slowdown; // Median of the migrated ECalls relative to the ones that stayed, weighted by migrated calls of the compared ECalls, 0 if none was compared
+	std::vector<ecall_migration_t> ecalls_by_penalty;
+	std::vector<thread_cores_t> threads;
+	std::vector<core_aexs_t> cores;
+} core_summary_t;
+
+void analyze_cores();
+
+#endif //SGX_PERF_CORES_H
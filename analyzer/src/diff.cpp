@@ -0,0 +1,415 @@
+/**
+ * @author weichbr
+ */
+
+#include "main.h"
+#include "diff.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/**
+ * Diff mode
+ *
+ * Compares the ECalls/OCalls of two traces, e.g. of two builds, by their symbol names, as the ids shift between builds.
+ * Both traces are analysed like in a normal run, the comparison only reads their analysis caches.
+ * If the cache next to a trace cannot be written, e.g. because its folder is read-only, a temporary cache is used instead.
+ */
+
+typedef struct __diff_trace
+{
+	char const *path;
+	uint64_t runtime; // ns
+	std::vector<call_summary_t> calls;
+} diff_trace_t;
+
+/**
+ * @brief Comparison of an ECall/OCall in both traces.
+ */
+typedef struct __call_diff
+{
+	call_summary_t const *base;
+	call_summary_t const *next;
+	double rate[2]; // Calls per second in base and new
+	double rate_p; // Significance of the change in the call rate
+	double duration_p; // Significance of the change in the durations (Mann-Whitney U)
+	bool slower; // Durations tend to be longer in the new trace
+	double regression; // Largest significant relative increase, 0 if there is none
+	double improvement; // Largest significant relative decrease, 0 if there is none
+} call_diff_t;
+
+/**
+ * @brief Analyses a trace in a child process with all output suppressed, so that its analysis cache is up to date.
+ * The analyzer keeps its state in globals, so every trace gets a fresh process.
+ * @param trace
+ * @param cache Path of the analysis cache to write
+ * @return false, if the analysis failed or the cache could not be written
+ */
+static bool analyze_quietly(char const *trace, std::string const &cache)
+{
+	std::cout << "iii Analysing " << trace << std::endl << std::flush;
+	auto pid = fork();
+	if (pid < 0)
+	{
+		std::cout << "/!\\ Could not fork: " << strerror(errno) << std::endl;
+		return false;
+	}
+	if (pid == 0)
+	{
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		open_trace(trace);
+		get_event_ids();
+		open_cache(trace, cache);
+		if (!cache_enabled())
+		{
+			exit(1);
+		}
+		analyze_calls();
+		if (!cache_enabled())
+		{
+			// Storing the results failed
+			exit(1);
+		}
+		close_cache();
+		sqlite3_close(db);
+		exit(0);
+	}
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * @brief Analyses a trace whose own cache cannot be written into a temporary cache, which is removed after reading it.
+ * @param t
+ * @return false, if the analysis failed
+ */
+static bool analyze_with_temporary_cache(diff_trace_t &t)
+{
+	auto tmpdir = getenv("TMPDIR");
+	auto cache = std::string(tmpdir != nullptr && *tmpdir != '\0' ? tmpdir : "/tmp") + "/sgxperf-cache-XXXXXX";
+	int fd = mkstemp(&cache[0]);
+	if (fd == -1)
+	{
+		std::cout << "/!\\ Could not create a temporary analysis cache: " << strerror(errno) << std::endl;
+		return false;
+	}
+	close(fd);
+
+	std::cout << "(i) Could not write the analysis cache of " << t.path << ", using the temporary cache " << cache << std::endl;
+	bool ok = analyze_quietly(t.path, cache) && read_cache(t.path, cache, t.runtime, t.calls);
+	unlink(cache.c_str());
+	unlink((cache + "-journal").c_str());
+	return ok;
+}
+
+/**
+ * @brief Relative change from a to b, infinite if a value appears.
+ */
+static double relative_change(double a, double b)
+{
+	if (a == b)
+	{
+		return 0;
+	}
+	if (a == 0)
+	{
+		return std::numeric_limits<double>::infinity();
+	}
+	return (b - a) / a;
+}
+
+/**
+ * @brief Two-sided p-value of a standard normal test statistic.
+ */
+static double normal_p(double z)
+{
+	return std::erfc(std::fabs(z) / std::sqrt(2.0));
+}
+
+/**
+ * @brief Mann-Whitney U test of the durations of two traces, computed from their sketches.
+ * Durations in the same sketch bucket count as ties, which makes the test slightly conservative.
+ * @param base
+ * @param next
+ * @param slower Set if the durations of next tend to be longer
+ * @return Two-sided p-value with the normal approximation and tie correction
+ */
+static double mann_whitney(sketch_t const &base, sketch_t const &next, bool &slower)
+{
+	slower = false;
+	if (base.buckets.empty() || next.buckets.empty() || base.count == 0 || next.count == 0)
+	{
+		return 1;
+	}
+
+	double n1 = base.count, n2 = next.count, n = n1 + n2;
+	double u = 0, below = 0, ties = 0;
+	for (size_t b = 0; b < SKETCH_BUCKETS; ++b)
+	{
+		double a = base.buckets[b], c = next.buckets[b], t = a + c;
+		u += c * (below + a / 2);
+		below += a;
+		ties += t * t * t - t;
+	}
+
+	double mean = n1 * n2 / 2;
+	double variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+	slower = u > mean;
+	if (variance <= 0)
+	{
+		return 1;
+	}
+	return normal_p((u - mean) / std::sqrt(variance));
+}
+
+/**
+ * @brief Tests whether the call rates of two traces differ, taking the call counts as Poisson distributed.
+ */
+static double rate_test(uint64_t count_base, double seconds_base, uint64_t count_next, double seconds_next)
+{
+	double variance = count_base / (seconds_base * seconds_base) + count_next / (seconds_next * seconds_next);
+	if (variance <= 0)
+	{
+		return 1;
+	}
+	return normal_p((count_next / seconds_next - count_base / seconds_base) / std::sqrt(variance));
+}
+
+static std::string diff_key(call_summary_t const &c)
+{
+	return (c.type == call_type_t::ECALL ? "ECall " : "OCall ") + c.name;
+}
+
+static std::string changeformat(double change)
+{
+	std::stringstream ss;
+	ss.precision(3);
+	if (std::isinf(change))
+	{
+		ss << "new";
+	}
+	else
+	{
+		ss << (change >= 0 ? "+" : "") << change * 100 << "%";
+	}
+	return ss.str();
+}
+
+static std::string pformat(double p)
+{
+	std::stringstream ss;
+	if (p < 0.0001)
+	{
+		ss << "p < 0.0001";
+	}
+	else
+	{
+		ss.precision(2);
+		ss << "p = " << p;
+	}
+	return ss.str();
+}
+
+/**
+ * @brief Compares an ECall/OCall in both traces and finds its largest significant regression and improvement.
+ * Longer durations are judged by the mean and the 50%, 95% and 99% percentiles, more calls per second by the call rate.
+ */
+static call_diff_t compare_call(call_summary_t const &base, call_summary_t const &next, double seconds_base, double seconds_next)
+{
+	call_diff_t d = {};
+	d.base = &base;
+	d.next = &next;
+	d.rate[0] = base.all_stats.calls / seconds_base;
+	d.rate[1] = next.all_stats.calls / seconds_next;
+	d.rate_p = rate_test(base.all_stats.calls, seconds_base, next.all_stats.calls, seconds_next);
+	d.duration_p = mann_whitney(base.sketch, next.sketch, d.slower);
+
+	if (d.duration_p < DIFF_ALPHA)
+	{
+		double changes[] = {
+			relative_change(base.all_stats.avg, next.all_stats.avg),
+			relative_change(base.quantiles.value[0], next.quantiles.value[0]),
+			relative_change(base.quantiles.value[QUANTILE_95TH], next.quantiles.value[QUANTILE_95TH]),
+			relative_change(base.quantiles.value[QUANTILE_99TH], next.quantiles.value[QUANTILE_99TH]),
+		};
+		for (auto change : changes)
+		{
+			if (d.slower)
+				d.regression = std::max(d.regression, change);
+			else
+				d.improvement = std::min(d.improvement, change);
+		}
+	}
+	if (d.rate_p < DIFF_ALPHA)
+	{
+		auto change = relative_change(d.rate[0], d.rate[1]);
+		d.regression = std::max(d.regression, change);
+		d.improvement = std::min(d.improvement, change);
+	}
+	return d;
+}
+
+static void print_call_diff(size_t rank, call_diff_t const &d, double change, bool exceeds)
+{
+	auto &b = *d.base;
+	auto &n = *d.next;
+	std::cout << "/ " << rank << ". " << WHITE() << diff_key(b) << NORMAL() << ": " << (change > 0 ? RED() : GREEN()) << changeformat(change) << NORMAL() << std::endl;
+	std::cout << "| Calls: " << b.all_stats.calls << " -> " << n.all_stats.calls << ", "
+	          << std::setprecision(5) << d.rate[0] << "/s -> " << d.rate[1] << "/s (" << changeformat(relative_change(d.rate[0], d.rate[1])) << ", " << pformat(d.rate_p) << ")" << std::endl;
+	std::cout << "| Ø duration: " << timeformat(b.all_stats.avg) << " -> " << timeformat(n.all_stats.avg) << " (" << changeformat(relative_change(b.all_stats.avg, n.all_stats.avg)) << ")" << std::endl;
+	for (size_t i : {(size_t)0, (size_t)QUANTILE_95TH, (size_t)3})
+	{
+		std::cout << "| " << quantile_levels[i] * 100 << "%: " << timeformat(b.quantiles.value[i]) << " -> " << timeformat(n.quantiles.value[i])
+		          << " (" << changeformat(relative_change(b.quantiles.value[i], n.quantiles.value[i])) << ")" << std::endl;
+	}
+	std::cout << "| Durations " << (d.duration_p < DIFF_ALPHA ? (d.slower ? "longer" : "shorter") : "unchanged") << " (Mann-Whitney, " << pformat(d.duration_p) << ")" << std::endl;
+	if (b.type == call_type_t::ECALL && (b.aex_stats.calls > 0 || n.aex_stats.calls > 0))
+	{
+		double aex_base = b.aex_stats.calls > 0 ? b.aex_stats.sum / (double)b.aex_stats.calls : 0;
+		double aex_next = n.aex_stats.calls > 0 ? n.aex_stats.sum / (double)n.aex_stats.calls : 0;
+		std::cout << "| AEX per call: " << aex_base << " -> " << aex_next << " (" << changeformat(relative_change(aex_base, aex_next)) << ")" << std::endl;
+	}
+	if (exceeds)
+	{
+		std::cout << "| " << RED() << "/!\\ Exceeds the threshold of " << config.diff_threshold << "%" << NORMAL() << std::endl;
+	}
+	std::cout << "\\ ___" << std::endl;
+}
+
+/**
+ * @brief Compares two traces and prints their regressions and improvements, ranked by their largest significant relative change.
+ * @param base Trace of the baseline
+ * @param next Trace of the new run
+ * @return DIFF_REGRESSION_EXIT if a significant regression exceeds config.diff_threshold, 0 otherwise
+ */
+int diff_traces(char const *base, char const *next)
+{
+	diff_trace_t traces[2] = {{base, 0, {}}, {next, 0, {}}};
+	for (auto &t : traces)
+	{
+		auto cache = std::string(t.path) + ".cache";
+		if (analyze_quietly(t.path, cache) && read_cache(t.path, cache, t.runtime, t.calls))
+		{
+			continue;
+		}
+
+		t.calls.clear();
+		if (!analyze_with_temporary_cache(t))
+		{
+			std::cout << "/!\\ Could not analyse " << t.path << ", run the analyzer on it for details" << std::endl;
+			exit(-1);
+		}
+	}
+
+	// Ids shift between builds, so calls are matched by their type and symbol name
+	std::map<std::string, call_summary_t const *> by_name[2];
+	for (size_t i = 0; i < 2; ++i)
+	{
+		for (auto const &c : traces[i].calls)
+		{
+			if (!by_name[i].emplace(diff_key(c), &c).second && c.all_stats.calls > 0)
+			{
+				std::cout << "/!\\ " << diff_key(c) << " exists in several enclaves of " << traces[i].path << ", only the first one is compared" << std::endl;
+			}
+		}
+	}
+
+	double seconds[2];
+	for (size_t i = 0; i < 2; ++i)
+	{
+		seconds[i] = traces[i].runtime > 0 ? traces[i].runtime / 1e9 : 1;
+	}
+
+	std::vector<call_diff_t> diffs;
+	std::vector<std::string> added, removed;
+	for (auto const &p : by_name[1])
+	{
+		auto c = p.second;
+		auto minimum = c->type == call_type_t::ECALL ? config.ecall_call_minimum : config.ocall_call_minimum;
+		auto it = by_name[0].find(p.first);
+		auto calls_base = it != by_name[0].end() ? it->second->all_stats.calls : 0;
+		if (std::max(calls_base, c->all_stats.calls) < std::max(minimum, (uint64_t)1))
+		{
+			continue;
+		}
+		if (calls_base == 0)
+		{
+			added.push_back(p.first);
+		}
+		else if (c->all_stats.calls == 0)
+		{
+			removed.push_back(p.first);
+		}
+		else
+		{
+			diffs.push_back(compare_call(*it->second, *c, seconds[0], seconds[1]));
+		}
+	}
+	for (auto const &p : by_name[0])
+	{
+		auto minimum = p.second->type == call_type_t::ECALL ? config.ecall_call_minimum : config.ocall_call_minimum;
+		if (by_name[1].find(p.first) == by_name[1].end() && p.second->all_stats.calls >= std::max(minimum, (uint64_t)1))
+		{
+			removed.push_back(p.first);
+		}
+	}
+
+	std::cout << "=== Comparing " << base << " (" << timeformat(traces[0].runtime) << ") with " << next << " (" << timeformat(traces[1].runtime) << ")" << std::endl;
+
+	std::vector<call_diff_t> regressions, improvements;
+	std::copy_if(diffs.begin(), diffs.end(), std::back_inserter(regressions), [](call_diff_t const &d) { return d.regression > 0; });
+	std::copy_if(diffs.begin(), diffs.end(), std::back_inserter(improvements), [](call_diff_t const &d) { return d.improvement < 0; });
+	std::stable_sort(regressions.begin(), regressions.end(), [](call_diff_t const &a, call_diff_t const &b) { return a.regression > b.regression; });
+	std::stable_sort(improvements.begin(), improvements.end(), [](call_diff_t const &a, call_diff_t const &b) { return a.improvement < b.improvement; });
+
+	bool failed = false;
+	std::cout << "(i) Regressions" << std::endl;
+	if (regressions.empty())
+	{
+		std::cout << "No significant regressions" << std::endl;
+	}
+	for (size_t i = 0; i < regressions.size(); ++i)
+	{
+		auto exceeds = regressions[i].regression * 100 > config.diff_threshold;
+		failed = failed || exceeds;
+		print_call_diff(i + 1, regressions[i], regressions[i].regression, exceeds);
+	}
+	std::cout << std::endl;
+
+	std::cout << "(i) Improvements" << std::endl;
+	if (improvements.empty())
+	{
+		std::cout << "No significant improvements" << std::endl;
+	}
+	for (size_t i = 0; i < improvements.size(); ++i)
+	{
+		print_call_diff(i + 1, improvements[i], improvements[i].improvement, false);
+	}
+	std::cout << std::endl;
+
+	for (auto only : {std::make_pair(next, &added), std::make_pair(base, &removed)})
+	{
+		if (only.second->empty())
+		{
+			continue;
+		}
+		std::cout << "(i) Calls only in " << only.first << std::endl;
+		std::for_each(only.second->begin(), only.second->end(), [](std::string const &name) { std::cout << "| " << name << std::endl; });
+		std::cout << std::endl;
+	}
+
+	if (failed)
+	{
+		std::cout << RED() << "/!\\ Significant regressions exceed the threshold of " << config.diff_threshold << "%" << NORMAL() << std::endl;
+		return DIFF_REGRESSION_EXIT;
+	}
+	return 0;
+}
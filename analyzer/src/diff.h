@@ -0,0 +1,20 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_DIFF_H
+#define SGX_PERF_DIFF_H
+
+/**
+ * @brief Significance level of the tests in diff mode
+ */
+#define DIFF_ALPHA 0.01
+
+/**
+ * @brief Exit code of the analyzer if a significant regression exceeds the threshold of the diff
+ */
+#define DIFF_REGRESSION_EXIT 2
+
+int diff_traces(char const *base, char const *next);
+
+#endif //SGX_PERF_DIFF_H
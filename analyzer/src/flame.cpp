@@ -0,0 +1,168 @@
+/**
+ * @author weichbr
+ */
+
+#include "main.h"
+#include "flame.h"
+
+#include <fstream>
+
+extern std::vector<call_data_t *> call_list;
+
+/**
+ * Folded stacks
+ *
+ * While the calls are loaded, every call is added to the frame of its call stack: the thread, the ECalls and OCalls it is nested in and the call itself.
+ * The frames are written as folded stacks, one line "thread_1;ecall_a;ocall_b;ecall_c value" per stack, as read by flame graph tools like flamegraph.pl.
+ * With a base file, every line gets the value of the base and of this trace, "stack base value", like the output of difffolded.pl.
+ */
+
+uint32_t flame_root(flame_stacks_t &stacks, uint64_t thread)
+{
+	auto it = stacks.roots.find(thread);
+	if (it != stacks.roots.end())
+	{
+		return it->second;
+	}
+	auto index = static_cast<uint32_t>(stacks.frames.size());
+	stacks.frames.push_back({NO_CALL, NO_CALL, thread, 0, 0, 0});
+	stacks.roots[thread] = index;
+	return index;
+}
+
+/**
+ * @brief Returns the frame of a call inside the given frame, creates it if this stack has not been seen before.
+ * @param stacks
+ * @param parent Frame of the enclosing call or of the thread
+ * @param call Index of the ECall/OCall in call_list
+ */
+uint32_t flame_frame(flame_stacks_t &stacks, uint32_t parent, uint32_t call)
+{
+	auto key = static_cast<uint64_t>(parent) << 32 | call;
+	auto it = stacks.children.find(key);
+	if (it != stacks.children.end())
+	{
+		return it->second;
+	}
+	auto index = static_cast<uint32_t>(stacks.frames.size());
+	stacks.frames.push_back({parent, call, stacks.frames[parent].thread, 0, 0, 0});
+	stacks.children[key] = index;
+	return index;
+}
+
+static uint64_t flame_value(flame_frame_t const &frame)
+{
+	switch (config.flame_weight)
+	{
+		case flame_weight_t::INCLUSIVE:
+			return frame.inclusive;
+		case flame_weight_t::COUNT:
+			return frame.calls;
+		case flame_weight_t::EXCLUSIVE:
+		default:
+			return frame.exclusive;
+	}
+}
+
+/**
+ * @brief Reads folded stacks, e.g. of the base trace for a differential flame graph. Exits on errors.
+ * @param path
+ * @param folded Values by stack, values of repeated stacks are added up
+ */
+static void read_folded(std::string const &path, std::map<std::string, uint64_t> &folded)
+{
+	std::ifstream in(path);
+	if (!in)
+	{
+		std::cout << "/!\\ Could not read folded stacks " << path << std::endl;
+		exit(1);
+	}
+	std::string line;
+	size_t number = 0;
+	while (std::getline(in, line))
+	{
+		++number;
+		if (line.empty())
+		{
+			continue;
+		}
+		auto space = line.rfind(' ');
+		char *end = nullptr;
+		uint64_t value = space == std::string::npos ? 0 : strtoull(line.c_str() + space + 1, &end, 10);
+		if (space == std::string::npos || space == 0 || end == line.c_str() + space + 1 || *end != '\0')
+		{
+			std::cout << "/!\\ " << path << ":" << number << ": expected \"stack value\"" << std::endl;
+			exit(1);
+		}
+		folded[line.substr(0, space)] += value;
+	}
+}
+
+/**
+ * @brief Writes the call stacks of all loaders as folded stacks to the file given with "--flame", weighted as given with "--flame-weight".
+ * Stacks with a value of 0 are left out, unless they are in the base.
+ * @param stacks
+ */
+void write_flame_stacks(std::vector<flame_stacks_t const *> const &stacks)
+{
+	std::map<std::string, uint64_t> folded;
+	for (auto s : stacks)
+	{
+		// A frame is always created after the frame it is nested in
+		std::vector<std::string> names(s->frames.size());
+		for (size_t i = 0; i < s->frames.size(); ++i)
+		{
+			auto &frame = s->frames[i];
+			if (frame.call == NO_CALL)
+			{
+				names[i] = "thread_" + std::to_string(frame.thread);
+				continue;
+			}
+			names[i] = names[frame.parent] + ";" + *call_list[frame.call]->name;
+			auto value = flame_value(frame);
+			if (value > 0)
+			{
+				folded[names[i]] += value;
+			}
+		}
+	}
+
+	std::map<std::string, uint64_t> base;
+	bool differential = !config.flame_base.empty();
+	if (differential)
+	{
+		read_folded(config.flame_base, base);
+	}
+
+	std::ofstream out(config.flame);
+	if (!out)
+	{
+		std::cout << "/!\\ Could not write folded stacks " << config.flame << std::endl;
+		exit(1);
+	}
+	size_t lines = 0;
+	if (differential)
+	{
+		for (auto const &p : folded)
+		{
+			base.emplace(p.first, 0);
+		}
+		for (auto const &p : base)
+		{
+			auto it = folded.find(p.first);
+			out << p.first << " " << p.second << " " << (it != folded.end() ? it->second : 0) << std::endl;
+			++lines;
+		}
+	}
+	else
+	{
+		for (auto const &p : folded)
+		{
+			out << p.first << " " << p.second << std::endl;
+			++lines;
+		}
+	}
+	out.close();
+
+	std::cout << "(i) Wrote " << lines << (differential ? " differential" : "") << " folded stacks to " << config.flame << std::endl;
+}
@@ -0,0 +1,48 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_FLAME_H
+#define SGX_PERF_FLAME_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef enum class __flame_weight
+{
+	EXCLUSIVE = 0, // Self time of the calls, what flame graph tools expect
+	INCLUSIVE = 1, // Duration of the calls including their nested calls
+	COUNT = 2, // Number of calls
+} flame_weight_t;
+
+/**
+ * @brief A call stack, i.e. a call together with the calls it is nested in, and the calls made with exactly this stack.
+ */
+typedef struct __flame_frame
+{
+	uint32_t parent; // Index of the frame of the enclosing call, NO_CALL for the frame of a thread
+	uint32_t call; // Index of the ECall/OCall in call_list, NO_CALL for the frame of a thread
+	uint64_t thread;
+	uint64_t calls;
+	uint64_t inclusive;
+	uint64_t exclusive;
+} flame_frame_t;
+
+/**
+ * @brief Tree of the call stacks seen by one loader.
+ */
+typedef struct __flame_stacks
+{
+	std::vector<flame_frame_t> frames;
+	std::unordered_map<uint64_t, uint32_t> children; // Frame of a call inside a frame, by frame index << 32 | call index
+	std::map<uint64_t, uint32_t> roots; // Frame of every thread
+} flame_stacks_t;
+
+uint32_t flame_frame(flame_stacks_t &stacks, uint32_t parent, uint32_t call);
+uint32_t flame_root(flame_stacks_t &stacks, uint64_t thread);
+void write_flame_stacks(std::vector<flame_stacks_t const *> const &stacks);
+
+#endif //SGX_PERF_FLAME_H
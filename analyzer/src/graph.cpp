@@ -12,8 +12,17 @@ void draw_graphs()
 {
 	std::cout << "=== DOT graph descriptions" << std::endl;
 	std::ofstream dotfile(config.graph);
-	std::for_each(encls.begin(), encls.end(), [&dotfile](std::pair<const uint64_t, enclave_data_t> &p) {
-		auto eid = p.first;
+	// Describe all enclaves in parallel, but write them in order
+	std::vector<std::string> graphs(encls.size());
+	std::vector<uint64_t> eids;
+	std::transform(encls.begin(), encls.end(), std::back_inserter(eids), [](std::pair<const uint64_t, enclave_data_t> &p) { return p.first; });
+	parallel_for(0, eids.size(), 1, [&eids, &graphs](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i)
+		{
+			graphs[i] = dot_graph(eids[i]);
+		}
+	});
+	std::for_each(graphs.begin(), graphs.end(), [&dotfile](std::string const &graph) {
 		/*
 		std::for_each(config.ecall_graphs.begin(), config.ecall_graphs.end(), [eid](uint64_t cid) {
 			std::cout << "/--" << std::endl;
@@ -23,7 +32,7 @@ void draw_graphs()
 		*/
 
 //		std::cout << "/--" << std::endl;
-		dotfile << dot_graph(eid) << std::endl;
+		dotfile << graph << std::endl;
 //		std::cout << "\\--" << std::endl;
 	});
 	dotfile.close();
@@ -35,7 +44,7 @@ std::string dot_graph(uint64_t eid)
 
 	ss << "digraph Enclave_" << eid << " {" << std::endl;
 
-	std::for_each(encls[eid].ecalls.begin(), encls[eid].ecalls.end(), [&ss] (call_data_t *cd) {
+	std::for_each(encls.at(eid).ecalls.begin(), encls.at(eid).ecalls.end(), [&ss] (call_data_t *cd) {
 		if (skip_call(cd, config.ecall_set))
 		{
 			return;
@@ -44,9 +53,8 @@ std::string dot_graph(uint64_t eid)
 		ss << "\t" << *cd->name << " [shape=box,label=\"[" << cd->call_id << "] " << *cd->name << "\"];" << std::endl;
 
 
-		for (uint64_t i = 0; i < cd->indirect_parents_data->size(); ++i)
+		for (auto &ipcd : *cd->indirect_parents_data)
 		{
-			auto &ipcd = cd->indirect_parents_data->at(i);
 			if (skip_call(ipcd.call_data, config.ecall_set))
 			{
 				continue;
@@ -54,9 +62,8 @@ std::string dot_graph(uint64_t eid)
 			ss << "\t" << *ipcd.call_data->name << " -> " << *cd->name << " [label=\"" << ipcd.count << "\",style=dashed];" << std::endl;
 		}
 
-		for (uint64_t i = 0; i < cd->direct_parents_data->size(); ++i)
+		for (auto &dpcd : *cd->direct_parents_data)
 		{
-			auto &dpcd = cd->direct_parents_data->at(i);
 			if (skip_call(dpcd.call_data, config.ocall_set))
 			{
 				continue;
@@ -65,7 +72,7 @@ std::string dot_graph(uint64_t eid)
 		}
 	});
 
-	std::for_each(encls[eid].ocalls.begin(), encls[eid].ocalls.end(), [&ss] (call_data_t *cd) {
+	std::for_each(encls.at(eid).ocalls.begin(), encls.at(eid).ocalls.end(), [&ss] (call_data_t *cd) {
 		if (skip_call(cd, config.ocall_set))
 		{
 			return;
@@ -73,9 +80,8 @@ std::string dot_graph(uint64_t eid)
 
 		ss << "\t" << *cd->name << " [label=\"[" << cd->call_id << "] " << *cd->name << "\"];" << std::endl;
 
-		for (uint64_t i = 0; i < cd->indirect_parents_data->size(); ++i)
+		for (auto &ipcd : *cd->indirect_parents_data)
 		{
-			auto &ipcd = cd->indirect_parents_data->at(i);
 			if (skip_call(ipcd.call_data, config.ocall_set))
 			{
 				continue;
@@ -83,9 +89,8 @@ std::string dot_graph(uint64_t eid)
 			ss << "\t" << *ipcd.call_data->name << " -> " << *cd->name << " [label=\"" << ipcd.count << "\",style=dashed];" << std::endl;
 		}
 
-		for (uint64_t i = 0; i < cd->direct_parents_data->size(); ++i)
+		for (auto &dpcd : *cd->direct_parents_data)
 		{
-			auto &dpcd = cd->direct_parents_data->at(i);
 			if (skip_call(dpcd.call_data, config.ecall_set))
 			{
 				continue;
@@ -125,33 +130,23 @@ std::string dot_ecall_graph(uint64_t eid, uint64_t start_id)
 
 		ss << "\t" << *cd->name << " [shape=box];";
 
-		for (uint64_t i = 0; i < cd->indirect_parents_data->size(); ++i)
+		for (auto &ipcd : *cd->indirect_parents_data)
 		{
-			auto &ipcd = cd->indirect_parents_data->at(i);
-			if (ipcd.count == 0)
-			{
-				continue;
-			}
 			ss << "\t" << *ipcd.call_data->name << " -> " << *cd->name << " [label=\"" << countformat(ipcd.count, cd->all_stats.calls) << "\",style=dashed];" << std::endl;
-			auto d = done_ecalls.find(i);
+			auto d = done_ecalls.find(ipcd.call_data->call_id);
 			if (d == done_ecalls.end())
 			{
-				todo_ecalls.insert(i);
+				todo_ecalls.insert(ipcd.call_data->call_id);
 			}
 		}
 
-		for (uint64_t i = 0; i < cd->direct_parents_data->size(); ++i)
+		for (auto &dpcd : *cd->direct_parents_data)
 		{
-			auto &dpcd = cd->direct_parents_data->at(i);
-			if (dpcd.count == 0)
-			{
-				continue;
-			}
 			ss << "\t" << *dpcd.call_data->name << " -> " << *cd->name << " [label=\"" << countformat(dpcd.count, cd->all_stats.calls) << "\"];" << std::endl;
-			auto d = done_ocalls.find(i);
+			auto d = done_ocalls.find(dpcd.call_data->call_id);
 			if (d == done_ocalls.end())
 			{
-				todo_ocalls.insert(i);
+				todo_ocalls.insert(dpcd.call_data->call_id);
 			}
 		}
 
@@ -170,33 +165,23 @@ std::string dot_ecall_graph(uint64_t eid, uint64_t start_id)
 				continue;
 			}
 
-			for (uint64_t i = 0; i < ocd->indirect_parents_data->size(); ++i)
+			for (auto &ipcd : *ocd->indirect_parents_data)
 			{
-				auto &ipcd = ocd->indirect_parents_data->at(i);
-				if (ipcd.count == 0)
-				{
-					continue;
-				}
 				ss << "\t" << *ipcd.call_data->name << " -> " << *ocd->name << " [label=\"" << countformat(ipcd.count, ocd->all_stats.calls) << "\",style=dashed];" << std::endl;
-				auto d = done_ocalls.find(i);
+				auto d = done_ocalls.find(ipcd.call_data->call_id);
 				if (d == done_ocalls.end())
 				{
-					todo_ocalls.insert(i);
+					todo_ocalls.insert(ipcd.call_data->call_id);
 				}
 			}
 
-			for (uint64_t i = 0; i < ocd->direct_parents_data->size(); ++i)
+			for (auto &dpcd : *ocd->direct_parents_data)
 			{
-				auto &dpcd = ocd->direct_parents_data->at(i);
-				if (dpcd.count == 0)
-				{
-					continue;
-				}
 				ss << "\t" << *dpcd.call_data->name << " -> " << *ocd->name << " [label=\"" << countformat(dpcd.count, cd->all_stats.calls) << "\"];" << std::endl;
-				auto d = done_ecalls.find(i);
+				auto d = done_ecalls.find(dpcd.call_data->call_id);
 				if (d == done_ecalls.end())
 				{
-					todo_ecalls.insert(i);
+					todo_ecalls.insert(dpcd.call_data->call_id);
 				}
 			}
 
@@ -1,10 +1,12 @@
 #include "main.h"
 
 #include <unistd.h>
+#include <getopt.h>
 
 void usage(char *exe)
 {
 	std::cout << exe << " [args] out-pid.db" << std::endl;
+	std::cout << exe << " [args] --diff base.db new.db" << std::endl;
 	std::cout << std::endl;
 	std::cout << "Arguments, defaults in []:" << std::endl;
 	std::cout << "-e num\t\t[num = 0] Discard all ecalls which have less than <num> calls" << std::endl;
@@ -13,12 +15,38 @@ void usage(char *exe)
 	std::cout << "\t\tc - Analyse ecalls/ocalls" << std::endl;
 	std::cout << "\t\ts - Analyse synchronisation calls" << std::endl;
 	std::cout << "\t\ti - Analyse enclave interface. Implies -p c" << std::endl;
+	std::cout << "\t\tt - Export the timeline, see --chrome-trace" << std::endl;
+	std::cout << "\t\tm - Analyse core migrations of ECalls, the cores of every thread and AEXs by core" << std::endl;
 	std::cout << "-g ids\t\t[ids = \"\"] Create DOT graph descriptions for the given ids" << std::endl;
 	std::cout << "\t\tExample: e1,e19,e54, will create graphs for ecalls 1, 19 and 54" << std::endl;
 	std::cout << "-f\t\tDOT graph file name. Implies \"-p c\". Disables \"-d\"." << std::endl;
 	std::cout << "-d\t\tRaw call data folder name. Implies \"-p c\". Disables \"-f\"" << std::endl;
 	std::cout << "-l\t\tPath to EDL for \"-p i\". Optional." << std::endl;
 	std::cout << "-s\t\tEDL Search Path for EDL imports. Optional." << std::endl;
+	std::cout << "-c\t\tAlso report call durations without the calibrated logger overhead. Implies \"-p c\"." << std::endl;
+	std::cout << "-b bounds\t[bounds = 1,5,10,20,100] Latency bucket bounds in µs, used by all call, parent and sync reports" << std::endl;
+	std::cout << "-q mode\t\t[mode = exact] How percentiles are computed" << std::endl;
+	std::cout << "\t\texact - Select the exact values" << std::endl;
+	std::cout << "\t\tsketch - Estimate them from a histogram in a single pass. For very large traces." << std::endl;
+	std::cout << "-m dir\t\tAnalyse out of core for traces larger than memory. Streams the calls and spills sorted runs to <dir> for exact percentiles. Implies \"-p c\", disables \"-d\"." << std::endl;
+	std::cout << "-j file\t\tAlso write the results of all phases as JSON to <file> and as CSV, one file per table, next to it" << std::endl;
+	std::cout << "-n\t\tDo not use the analysis cache <db>.cache, which keeps the results of the last run for the same trace and options" << std::endl;
+	std::cout << "--diff\t\tCompare the ECalls/OCalls of two traces by name and rank their significant regressions and improvements." << std::endl;
+	std::cout << "\t\tExits with " << DIFF_REGRESSION_EXIT << " if a regression exceeds the threshold. Uses -b, -c, -e, -o, -q and -m." << std::endl;
+	std::cout << "--threshold pct\t[pct = 10] Largest tolerated regression in diff mode, in percent of the mean, a percentile or the call rate" << std::endl;
+	std::cout << "--window start:end\tOnly analyse calls that start in this time span after the start of the trace, e.g. 5s:60s. Either end may be left out." << std::endl;
+	std::cout << "--bucket length\tPrint call rates, percentiles and AEX rates per time window of <length>, e.g. 1s, and detect phases. Implies \"-p c\"." << std::endl;
+	std::cout << "--flame file\tWrite the ECall/OCall call stacks of every thread as folded stacks for flame graph tools to <file>. Implies \"-p c\"." << std::endl;
+	std::cout << "--flame-weight w\t[w = exclusive] Weight of the stacks" << std::endl;
+	std::cout << "\t\texclusive - Self time of the calls, without nested calls" << std::endl;
+	std::cout << "\t\tinclusive - Duration of the calls" << std::endl;
+	std::cout << "\t\tcount - Number of calls" << std::endl;
+	std::cout << "--flame-base file\tWrite differential folded stacks \"stack base new\" against the folded stacks of a base trace in <file>" << std::endl;
+	std::cout << "--chrome-trace file\tExport ECalls/OCalls, AEXs, paging and sync events as timeline for chrome://tracing or Perfetto to <file>. Implies \"-p t\"." << std::endl;
+	std::cout << "\t\tWith --window, only the events in the window and the calls overlapping it are exported." << std::endl;
+	std::cout << "--budget file\tCheck the ECalls/OCalls against the latency budgets in <file>. Implies \"-p c\"." << std::endl;
+	std::cout << "\t\tExits with " << BUDGET_EXIT << " if a budget is violated." << std::endl;
+	std::cout << "--budget-report file\tWrite the result of --budget as JSON to <file>" << std::endl;
 	std::cout << std::endl;
 }
 
@@ -30,24 +58,29 @@ config_t config;
  * General queries
  */
 
+uint64_t EnclaveECallEventId = 0;
 uint64_t EnclaveOCallEventId = 0;
+uint64_t EnclaveECallReturnEventId = 0;
 uint64_t EnclaveOCallReturnEventId = 0;
 
-int event_callback(void *arg, int count, char **data, char **columns)
+static void event_callback(id_name_row_t const &row)
 {
-	(void)arg;
-	(void)count;
-	(void)columns;
-	if (std::string(data[1]) == "EnclaveOCallEvent")
+	if (row.name == "EnclaveECallEvent")
 	{
-		EnclaveOCallEventId = strtoul(data[0], nullptr, 10);
+		EnclaveECallEventId = row.id;
 	}
-	else if (std::string(data[1]) == "EnclaveOCallReturnEvent")
+	else if (row.name == "EnclaveOCallEvent")
 	{
-		EnclaveOCallReturnEventId = strtoul(data[0], nullptr, 10);
+		EnclaveOCallEventId = row.id;
+	}
+	else if (row.name == "EnclaveECallReturnEvent")
+	{
+		EnclaveECallReturnEventId = row.id;
+	}
+	else if (row.name == "EnclaveOCallReturnEvent")
+	{
+		EnclaveOCallReturnEventId = row.id;
 	}
-
-	return 0;
 }
 
 
@@ -56,7 +89,49 @@ void get_event_ids()
 	std::stringstream ss;
 	ss << "select id, name from event_map;";
 
-	sql_exec(ss, event_callback);
+	sql_load<id_name_row_t>(ss, read_id_name_row, event_callback);
+}
+
+/**
+ * @brief Opens the trace database read-only as the main database connection. Exits on errors.
+ * @param dbfile
+ */
+void open_trace(char const *dbfile)
+{
+	std::cout << "Opening database " << dbfile << std::endl;
+
+	int rc = sqlite3_open_v2(dbfile, &db, SQLITE_OPEN_READONLY, nullptr);
+	if (rc)
+	{
+		std::cout << "/!\\ Could not open database: " << sqlite3_errmsg(db) << std::endl;
+		sqlite3_close(db);
+		exit(-1);
+	}
+
+	std::cout << "(i) Opened database file " << dbfile << std::endl;
+}
+
+/**
+ * @brief Parses a time window "start:end" of durations after the start of the trace. An empty start or end leaves the window open on that side.
+ * @return false, if a duration is malformed or the window is empty
+ */
+static bool parse_window(std::string const &text, uint64_t &start, uint64_t &end)
+{
+	auto colon = text.find(':');
+	if (colon == std::string::npos)
+	{
+		return false;
+	}
+	auto first = text.substr(0, colon);
+	auto last = text.substr(colon + 1);
+	uint64_t s = 0, e = UINT64_MAX;
+	if ((!first.empty() && !parse_duration(first, s)) || (!last.empty() && !parse_duration(last, e)) || e <= s)
+	{
+		return false;
+	}
+	start = s;
+	end = e;
+	return true;
 }
 
 /**
@@ -74,7 +149,7 @@ int main(int argc, char** argv)
 	// Default config
 	config.ecall_call_minimum = 0;
 	config.ocall_call_minimum = 0;
-	config.phases = {true, true, true};
+	config.phases = {true, true, true, false, false};
 
 	config.duplication_weights.alpha = 0.35;
 	config.duplication_weights.beta = 0.50;
@@ -100,10 +175,55 @@ int main(int argc, char** argv)
 
 	config.graph = "";
 	config.call_data_filename = "";
+	config.overhead_correction = false;
+	parse_buckets("1,5,10,20,100", config.buckets);
+	config.sketch_percentiles = false;
+	config.out_of_core = false;
+	config.spill_dir = "";
+	config.use_cache = true;
+	config.diff = false;
+	config.diff_threshold = 10;
+	config.budget_file = "";
+	config.budget_report = "";
+	config.report = "";
+	config.window_start = 0;
+	config.window_end = UINT64_MAX;
+	config.time_bucket = 0;
+	config.flame = "";
+	config.flame_weight = flame_weight_t::EXCLUSIVE;
+	config.flame_base = "";
+	config.chrome_trace = "";
+
+	enum
+	{
+		OPT_DIFF = 256,
+		OPT_THRESHOLD,
+		OPT_BUDGET,
+		OPT_BUDGET_REPORT,
+		OPT_WINDOW,
+		OPT_BUCKET,
+		OPT_FLAME,
+		OPT_FLAME_WEIGHT,
+		OPT_FLAME_BASE,
+		OPT_CHROME_TRACE,
+	};
+	static struct option long_options[] = {
+		{"diff", no_argument, nullptr, OPT_DIFF},
+		{"threshold", required_argument, nullptr, OPT_THRESHOLD},
+		{"budget", required_argument, nullptr, OPT_BUDGET},
+		{"budget-report", required_argument, nullptr, OPT_BUDGET_REPORT},
+		{"window", required_argument, nullptr, OPT_WINDOW},
+		{"bucket", required_argument, nullptr, OPT_BUCKET},
+		{"flame", required_argument, nullptr, OPT_FLAME},
+		{"flame-weight", required_argument, nullptr, OPT_FLAME_WEIGHT},
+		{"flame-base", required_argument, nullptr, OPT_FLAME_BASE},
+		{"chrome-trace", required_argument, nullptr, OPT_CHROME_TRACE},
+		{nullptr, 0, nullptr, 0}
+	};
 
 	int ch;
 
-	while ((ch = getopt(argc, argv, "e:o:p:g:f:d:il:")) != -1) {
+	while ((ch = getopt_long(argc, argv, "e:o:p:g:f:d:il:cb:q:m:nj:", long_options, nullptr)) != -1) {
 		switch (ch) {
 			case 'e':
 			{
@@ -129,21 +249,29 @@ int main(int argc, char** argv)
 			}
 			case 'p':
 			{
-				config.phases = {false, false, false};
+				config.phases = {false, false, false, false, false};
 				auto s = std::string(optarg);
 				if (s.find("c") != std::string::npos)
 				{
 					config.phases.calls = true;
 				}
-				else if (s.find("s") != std::string::npos)
+				if (s.find("s") != std::string::npos)
 				{
 					config.phases.sync = true;
 				}
-				else if (s.find("i") != std::string::npos)
+				if (s.find("i") != std::string::npos)
 				{
 					config.phases.calls = true;
 					config.phases.sec = true;
 				}
+				if (s.find("t") != std::string::npos)
+				{
+					config.phases.trace = true;
+				}
+				if (s.find("m") != std::string::npos)
+				{
+					config.phases.cores = true;
+				}
 				break;
 			}
 			case 'g':
@@ -194,34 +322,219 @@ int main(int argc, char** argv)
 				config.phases.sec = true;
 				break;
 			}
+			case 'c':
+			{
+				config.overhead_correction = true;
+				config.phases.calls = true;
+				break;
+			}
+			case 'b':
+			{
+				if (!parse_buckets(optarg, config.buckets))
+				{
+					std::cout << "Bucket bounds must be positive, ascending and at most " << MAX_BUCKETS << "!" << std::endl;
+					exit(1);
+				}
+				break;
+			}
+			case 'q':
+			{
+				auto s = std::string(optarg);
+				if (s != "exact" && s != "sketch")
+				{
+					std::cout << "Percentile mode must be exact or sketch!" << std::endl;
+					exit(1);
+				}
+				config.sketch_percentiles = s == "sketch";
+				break;
+			}
+			case 'm':
+			{
+				config.out_of_core = true;
+				config.spill_dir = std::string(optarg);
+				config.phases.calls = true;
+				break;
+			}
+			case 'n':
+			{
+				config.use_cache = false;
+				break;
+			}
+			case 'j':
+			{
+				config.report = std::string(optarg);
+				break;
+			}
+			case OPT_DIFF:
+			{
+				config.diff = true;
+				break;
+			}
+			case OPT_THRESHOLD:
+			{
+				config.diff_threshold = strtod(optarg, nullptr);
+				if (config.diff_threshold < 0)
+				{
+					std::cout << "Threshold must be positive!" << std::endl;
+					exit(1);
+				}
+				break;
+			}
+			case OPT_BUDGET:
+			{
+				config.budget_file = std::string(optarg);
+				config.phases.calls = true;
+				break;
+			}
+			case OPT_BUDGET_REPORT:
+			{
+				config.budget_report = std::string(optarg);
+				break;
+			}
+			case OPT_WINDOW:
+			{
+				if (!parse_window(optarg, config.window_start, config.window_end))
+				{
+					std::cout << "Window must be start:end with durations like 5s or 250ms and end after start!" << std::endl;
+					exit(1);
+				}
+				config.phases.calls = true;
+				break;
+			}
+			case OPT_BUCKET:
+			{
+				if (!parse_duration(optarg, config.time_bucket) || config.time_bucket == 0)
+				{
+					std::cout << "Time window length must be a positive duration like 1s or 100ms!" << std::endl;
+					exit(1);
+				}
+				config.phases.calls = true;
+				break;
+			}
+			case OPT_FLAME:
+			{
+				config.flame = std::string(optarg);
+				config.phases.calls = true;
+				break;
+			}
+			case OPT_FLAME_WEIGHT:
+			{
+				auto s = std::string(optarg);
+				if (s == "exclusive")
+					config.flame_weight = flame_weight_t::EXCLUSIVE;
+				else if (s == "inclusive")
+					config.flame_weight = flame_weight_t::INCLUSIVE;
+				else if (s == "count")
+					config.flame_weight = flame_weight_t::COUNT;
+				else
+				{
+					std::cout << "Flame graph weight must be exclusive, inclusive or count!" << std::endl;
+					exit(1);
+				}
+				break;
+			}
+			case OPT_FLAME_BASE:
+			{
+				config.flame_base = std::string(optarg);
+				break;
+			}
+			case OPT_CHROME_TRACE:
+			{
+				config.chrome_trace = std::string(optarg);
+				config.phases.trace = true;
+				break;
+			}
 			case '?':
 			default:
 				break;
 		}
 	}
+	char *exe = argv[0];
 	argc -= optind;
 	argv += optind;
 
-	char *dbfile = argv[0];
+	if (config.out_of_core && !config.call_data_filename.empty())
+	{
+		std::cout << "/!\\ Raw call data needs all calls in memory, \"-d\" is ignored in out-of-core mode" << std::endl;
+		config.call_data_filename = "";
+	}
+	if (config.out_of_core && config.time_bucket > 0)
+	{
+		std::cout << "/!\\ Time series need all calls in memory, \"--bucket\" is ignored in out-of-core mode" << std::endl;
+		config.time_bucket = 0;
+	}
 
-	std::cout << "Opening database " << dbfile << std::endl;
+	if (config.diff)
+	{
+		if (argc < 2)
+		{
+			usage(exe);
+			exit(-1);
+		}
+		if (!config.use_cache)
+		{
+			std::cout << "/!\\ The diff compares the analysis caches of both traces, \"-n\" is ignored" << std::endl;
+			config.use_cache = true;
+		}
+		if (!config.budget_file.empty())
+		{
+			std::cout << "/!\\ Budgets are checked against a single trace, \"--budget\" is ignored in diff mode" << std::endl;
+		}
+		if (!config.report.empty())
+		{
+			std::cout << "/!\\ The report describes a single trace, \"-j\" is ignored in diff mode" << std::endl;
+		}
+		if (!config.flame.empty() || !config.flame_base.empty())
+		{
+			std::cout << "/!\\ The diff works on the analysis caches, which have no call stacks, \"--flame\" and \"--flame-base\" are ignored in diff mode."
+			          << " Diff the call stacks with \"--flame\" and \"--flame-base\" on the new trace instead." << std::endl;
+			config.flame = "";
+			config.flame_base = "";
+		}
+		if (!config.chrome_trace.empty())
+		{
+			std::cout << "/!\\ The timeline shows a single trace, \"--chrome-trace\" is ignored in diff mode" << std::endl;
+		}
+		config.graph = "";
+		config.call_data_filename = "";
+		config.time_bucket = 0;
+		return diff_traces(argv[0], argv[1]);
+	}
 
-	int rc = sqlite3_open_v2(dbfile, &db, SQLITE_OPEN_READONLY, nullptr);
-	if (rc)
+	if (argc < 1)
 	{
-		std::cout << "/!\\ Could not open database: " << sqlite3_errmsg(db) << std::endl;
-		sqlite3_close(db);
+		usage(exe);
 		exit(-1);
 	}
 
-	std::cout << "(i) Opened database file " << dbfile << std::endl;
+	char *dbfile = argv[0];
+
+	open_trace(dbfile);
+
+	if (config.use_cache)
+		open_cache(dbfile);
 
 	get_event_ids();
 
 	std::cout << "(i) Starting Analysis " << std::endl;
 
+	if (!config.flame_base.empty() && config.flame.empty())
+	{
+		std::cout << "/!\\ \"--flame-base\" needs an output file, use \"--flame\"" << std::endl;
+	}
+
+	if (!config.budget_report.empty() && config.budget_file.empty())
+	{
+		std::cout << "/!\\ \"--budget-report\" needs a budget file, use \"--budget\"" << std::endl;
+	}
+
+	bool budgets_met = true;
 	if (config.phases.calls)
+	{
 		analyze_calls();
+		if (!config.budget_file.empty())
+			budgets_met = check_budgets(config.budget_file, config.budget_report, dbfile);
+	}
 
 	if (config.phases.sync)
 		analyze_synchro();
@@ -229,8 +542,24 @@ int main(int argc, char** argv)
 	if (config.phases.sec)
 		analyze_security();
 
+	if (config.phases.cores)
+		analyze_cores();
+
+	if (config.phases.trace)
+	{
+		if (config.chrome_trace.empty())
+			std::cout << "/!\\ The timeline needs an output file, use \"--chrome-trace\"" << std::endl;
+		else
+			export_chrome_trace(config.chrome_trace, dbfile);
+	}
+
 	if (!config.graph.empty())
 		draw_graphs();
 
+	if (!config.report.empty())
+		write_report(config.report, dbfile);
+
+	close_cache();
 	sqlite3_close(db);
+	return budgets_met ? 0 : BUDGET_EXIT;
 }
@@ -10,6 +10,15 @@
 #include "calls.h"
 #include "graph.h"
 #include "security.h"
+#include "cache.h"
+#include "diff.h"
+#include "budget.h"
+#include "report.h"
+#include "timeline.h"
+#include "concurrency.h"
+#include "flame.h"
+#include "chrome.h"
+#include "cores.h"
 #include "sqlite3.h"
 #include <set>
 
@@ -32,6 +41,8 @@ typedef struct __config
 		bool calls;
 		bool sync;
 		bool sec;
+		bool trace;
+		bool cores;
 	} phases;
 	weights_t duplication_weights;
 	weights_t reordering_weights;
@@ -42,11 +53,34 @@ typedef struct __config
 	std::string graph;
 	std::string call_data_filename;
 	std::string edl_path;
+	bool overhead_correction;
+	buckets_t buckets;
+	bool sketch_percentiles;
+	bool out_of_core;
+	std::string spill_dir;
+	bool use_cache;
+	bool diff;
+	double diff_threshold; // Percent
+	std::string budget_file;
+	std::string budget_report; // Path of the JSON report of the budget check
+	std::string report; // Path of the JSON report of all phases, empty for none
+	uint64_t window_start; // Only calls starting in the window are analysed, in ns after the start of the trace
+	uint64_t window_end; // UINT64_MAX for the end of the trace
+	uint64_t time_bucket; // Length of the time series windows in ns, 0 for no time series
+	std::string flame; // Path of the folded stacks, empty for none
+	flame_weight_t flame_weight;
+	std::string flame_base; // Folded stacks of a base trace for differential folded stacks, empty for none
+	std::string chrome_trace; // Path of the exported timeline
 } config_t;
 
 extern sqlite3 *db;
 extern config_t config;
+extern uint64_t EnclaveECallEventId;
 extern uint64_t EnclaveOCallEventId;
+extern uint64_t EnclaveECallReturnEventId;
 extern uint64_t EnclaveOCallReturnEventId;
 
+void open_trace(char const *dbfile);
+void get_event_ids();
+
 #endif //SGX_PERF_MAIN_H
@@ -0,0 +1,116 @@
+/**
+ * @author weichbr
+ */
+
+#include "pool.h"
+
+/**
+ * @brief Queue of the current thread. Threads outside the pool use the shared last queue.
+ */
+static thread_local size_t current_queue = SIZE_MAX;
+
+/**
+ * @brief Returns the pool, which is started on first use.
+ * The pool is never destroyed: tasks exit the process on fatal errors, and a destructor run by exit() would try to join the worker that called it.
+ * @return The pool
+ */
+task_pool &task_pool::instance()
+{
+	static auto pool = new task_pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	return *pool;
+}
+
+task_pool::task_pool(size_t threads) : queues(threads + 1), workers(), sleep_lock(), wakeup(), queued(0)
+{
+	workers.reserve(threads);
+	for (size_t i = 0; i < threads; ++i)
+	{
+		workers.emplace_back(&task_pool::worker, this, i);
+	}
+}
+
+/**
+ * @brief Queues a task of the given group on the queue of the current thread.
+ * @param group
+ * @param task
+ */
+void task_pool::submit(task_group_t &group, std::function<void()> task)
+{
+	group.pending++;
+	auto &q = queues[current_queue == SIZE_MAX ? workers.size() : current_queue];
+	{
+		std::lock_guard<std::mutex> lock(q.lock);
+		q.tasks.push_back({&group, std::move(task)});
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleep_lock);
+		queued++;
+	}
+	wakeup.notify_one();
+}
+
+/**
+ * @brief Runs the newest task of the own queue or steals the oldest task of another queue.
+ * @return false, if all queues are empty
+ */
+bool task_pool::run_one()
+{
+	auto self = current_queue == SIZE_MAX ? workers.size() : current_queue;
+	task_t task = {nullptr, nullptr};
+	for (size_t i = 0; i < queues.size() && task.group == nullptr; ++i)
+	{
+		auto &q = queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(q.lock);
+		if (q.tasks.empty())
+		{
+			continue;
+		}
+		if (i == 0)
+		{
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+		}
+		else
+		{
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+		}
+	}
+	if (task.group == nullptr)
+	{
+		return false;
+	}
+	queued--;
+	task.run();
+	task.group->pending--;
+	return true;
+}
+
+/**
+ * @brief Runs tasks until all tasks of the group are done.
+ * @param group
+ */
+void task_pool::wait(task_group_t &group)
+{
+	while (group.pending > 0)
+	{
+		if (!run_one())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void task_pool::worker(size_t self)
+{
+	current_queue = self;
+	while (true)
+	{
+		if (run_one())
+		{
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleep_lock);
+		wakeup.wait(lock, [this]() { return queued > 0; });
+	}
+}
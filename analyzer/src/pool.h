@@ -0,0 +1,118 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_POOL_H
+#define SGX_PERF_POOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+
+/**
+ * @brief Tasks that are waited for together, see task_pool::wait().
+ */
+typedef struct __task_group
+{
+	std::atomic<uint64_t> pending;
+} task_group_t;
+
+/**
+ * @brief Persistent pool of worker threads with one task queue per thread.
+ * Workers take their newest task first and steal the oldest task of another queue when theirs is empty.
+ * Threads waiting for a group run tasks themselves, so nested parallel loops neither block nor start more threads.
+ */
+class task_pool
+{
+public:
+	static task_pool &instance();
+	void submit(task_group_t &group, std::function<void()> task);
+	void wait(task_group_t &group);
+	/**
+	 * @brief Number of threads that run tasks, including the waiting thread
+	 */
+	size_t size() const { return workers.size() + 1; }
+private:
+	typedef struct __task
+	{
+		task_group_t *group;
+		std::function<void()> run;
+	} task_t;
+
+	typedef struct __task_queue
+	{
+		std::mutex lock;
+		std::deque<task_t> tasks;
+	} task_queue_t;
+
+	explicit task_pool(size_t threads);
+	bool run_one();
+	void worker(size_t self);
+
+	std::vector<task_queue_t> queues; ///< One queue per worker, the last one is shared by all other threads
+	std::vector<std::thread> workers;
+	std::mutex sleep_lock;
+	std::condition_variable wakeup; ///< Signalled when a task is submitted
+	std::atomic<uint64_t> queued; ///< Number of tasks in all queues
+};
+
+/**
+ * @brief Calls body(begin, end) for chunks of [first, last) on the task pool.
+ * The range is split in halves until a chunk is no larger than grain. The halves are left for other threads to steal, so busy threads split their work further.
+ * @param first
+ * @param last
+ * @param grain Largest chunk, 0 picks a grain that gives every thread about eight chunks
+ * @param body
+ */
+template <typename F>
+void parallel_for(size_t first, size_t last, size_t grain, F const &body)
+{
+	if (first >= last)
+		return;
+	auto &pool = task_pool::instance();
+	if (grain == 0)
+		grain = std::max((size_t)1, (last - first) / (pool.size() * 8));
+
+	task_group_t group;
+	group.pending = 0;
+	std::function<void(size_t, size_t)> split = [&](size_t begin, size_t end) {
+		while (end - begin > grain)
+		{
+			auto mid = begin + (end - begin) / 2;
+			pool.submit(group, [&split, mid, end]() { split(mid, end); });
+			end = mid;
+		}
+		body(begin, end);
+	};
+	split(first, last);
+	pool.wait(group);
+}
+
+/**
+ * @brief Calls f on every element of [first, last) on the task pool. Each element is a task of its own, as the work per element is usually skewed.
+ * @param first
+ * @param last
+ * @param f
+ */
+template <typename Iterator, typename F>
+void parallel_for_each(Iterator first, Iterator last, F f)
+{
+	std::vector<Iterator> items;
+	for (auto it = first; it != last; ++it)
+		items.push_back(it);
+
+	parallel_for(0, items.size(), 1, [&items, &f](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i)
+			f(*items[i]);
+	});
+}
+
+#endif //SGX_PERF_POOL_H
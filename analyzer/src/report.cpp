@@ -0,0 +1,965 @@
+/**
+ * @author weichbr
+ */
+
+#include "main.h"
+#include "report.h"
+
+#include <fstream>
+#include <iomanip>
+
+extern std::map<uint64_t, enclave_data_t> encls;
+extern std::map<uint64_t, thread_t> threads;
+extern general_data_t general_data;
+extern std::vector<call_data_t *> call_list;
+
+/**
+ * Machine-readable report
+ *
+ * The phases hand over what they only keep locally (recommendations, snapshots, time series, sync buckets, interface hints),
+ * everything else is read from the call data at the end of the run.
+ * The report is written as one JSON file and one CSV file per table next to it. Durations are in ns.
+ * Bucket counts are arrays in the order of "buckets_ns" in JSON and columns named after their bound in CSV.
+ */
+
+static struct
+{
+	bool calls;
+	std::vector<recommendation_t> recommendations;
+	std::vector<snapshot_row_t> snapshots;
+	bool timeline;
+	timeline_t time_series;
+	std::vector<concurrency_t> concurrency;
+	bool sync;
+	sync_summary_t sync_summary;
+	bool security;
+	std::vector<security_hint_t> security_hints;
+	bool cores;
+	core_summary_t core_summary;
+} report = {};
+
+void report_calls(std::vector<recommendation_t> const &recommendations, std::vector<snapshot_row_t> const &snapshots)
+{
+	report.calls = true;
+	report.recommendations = recommendations;
+	report.snapshots = snapshots;
+}
+
+void report_timeline(timeline_t const &timeline)
+{
+	report.timeline = true;
+	report.time_series = timeline;
+}
+
+void report_concurrency(std::vector<concurrency_t> const &concurrency)
+{
+	report.concurrency = concurrency;
+}
+
+void report_sync(sync_summary_t const &summary)
+{
+	report.sync = true;
+	report.sync_summary = summary;
+}
+
+void report_security(std::vector<security_hint_t> const &hints)
+{
+	report.security = true;
+	report.security_hints = hints;
+}
+
+void report_cores(core_summary_t const &summary)
+{
+	report.cores = true;
+	report.core_summary = summary;
+}
+
+/**
+ * @brief Enclave of an ECall/OCall, which the call data itself does not know.
+ */
+static uint64_t call_eid(call_data_t *c)
+{
+	static std::map<call_data_t *, uint64_t> eids;
+	if (eids.empty())
+	{
+		for (auto &p : encls)
+		{
+			for (auto calls : {&p.second.ecalls, &p.second.ocalls})
+			{
+				for (auto cd : *calls)
+					eids[cd] = p.first;
+			}
+		}
+	}
+	return eids[c];
+}
+
+static char const *typename_of(call_type_t type)
+{
+	return type == call_type_t::ECALL ? "ECall" : "OCall";
+}
+
+/**
+ * @brief Key of a percentile, e.g. "p50" or "p99_9".
+ */
+static std::string quantilekey(size_t i)
+{
+	std::stringstream ss;
+	ss << "p" << quantile_levels[i] * 100;
+	auto key = ss.str();
+	std::replace(key.begin(), key.end(), '.', '_');
+	return key;
+}
+
+static bool corrected_durations()
+{
+	return config.overhead_correction && general_data.overhead_call > 0;
+}
+
+/**
+ * @brief AEX counts are only recorded for ECalls, and only if the logger counted AEXs.
+ */
+static bool has_aex_stats(call_data_t *c)
+{
+	return c->type == call_type_t::ECALL && c->aex_stats.calls > 0;
+}
+
+/**
+ * @brief Calls of an enclave that the text report prints, i.e. those above the "-e"/"-o" minimum.
+ */
+static std::vector<call_data_t *> reported_calls(enclave_data_t &e)
+{
+	std::vector<call_data_t *> calls;
+	for (auto c : e.ecalls)
+	{
+		if (c->all_stats.calls >= config.ecall_call_minimum)
+			calls.push_back(c);
+	}
+	for (auto c : e.ocalls)
+	{
+		if (c->all_stats.calls >= config.ocall_call_minimum)
+			calls.push_back(c);
+	}
+	return calls;
+}
+
+static std::string snapshot_name(snapshot_row_t const &row, bool &is_ecall)
+{
+	is_ecall = row.type != EnclaveOCallEventId;
+	// The enclave is unknown if none of its calls completed
+	auto e = encls.find(row.eid);
+	if (e == encls.end())
+	{
+		return "?";
+	}
+	auto &calls = is_ecall ? e->second.ecalls : e->second.ocalls;
+	auto it = std::find_if(calls.begin(), calls.end(), [&row](call_data_t *c) { return c->call_id == row.call_id; });
+	return it != calls.end() ? *(*it)->name : "?";
+}
+
+/*
+ * JSON
+ */
+
+static void json_below(std::ostream &out, uint64_t const *below)
+{
+	out << "[";
+	for (size_t b = 0; b < config.buckets.count; ++b)
+	{
+		out << (b > 0 ? ", " : "") << below[b];
+	}
+	out << "]";
+}
+
+static void json_counts(std::ostream &out, std::vector<uint64_t> const &counts)
+{
+	out << "[";
+	for (size_t i = 0; i < counts.size(); ++i)
+	{
+		out << (i > 0 ? ", " : "") << counts[i];
+	}
+	out << "]";
+}
+
+static void json_quantiles(std::ostream &out, quantiles_t const &q)
+{
+	out << "{";
+	for (size_t i = 0; i < QUANTILE_COUNT; ++i)
+	{
+		out << jsonstring(quantilekey(i)) << ": " << q.value[i] << ", ";
+	}
+	out << "\"error\": " << q.error << "}";
+}
+
+static void json_strings(std::ostream &out, std::vector<std::string> const &strings)
+{
+	out << "[";
+	for (size_t i = 0; i < strings.size(); ++i)
+	{
+		out << (i > 0 ? ", " : "") << jsonstring(strings[i]);
+	}
+	out << "]";
+}
+
+static void json_breakdown(std::ostream &out, breakdown_t const &b)
+{
+	out << "{\"self\": " << b.self << ", \"in_ecalls\": " << b.in_ecalls << ", \"in_ocalls\": " << b.in_ocalls
+	    << ", \"ecall_transitions\": " << b.ecall_transitions << ", \"ocall_transitions\": " << b.ocall_transitions << ", \"transition_time\": " << transition_time(b) << "}";
+}
+
+/**
+ * @brief Time of an enclave or thread in the enclave, split into work and transitions, and in OCalls.
+ */
+static void json_time_totals(std::ostream &out, breakdown_t const &ecalls, breakdown_t const &ocalls)
+{
+	auto transitions = transition_time(ecalls);
+	out << "{\"in_enclave\": " << ecalls.self << ", \"work\": " << ecalls.self - transitions << ", \"transitions\": " << transitions
+	    << ", \"ecall_transitions\": " << ecalls.ecall_transitions << ", \"ocall_transitions\": " << ecalls.ocall_transitions << ", \"in_ocalls\": " << ocalls.self << "}";
+}
+
+static void json_call(std::ostream &out, uint64_t eid, call_data_t *c)
+{
+	auto &s = c->all_stats;
+	out << "{\"eid\": " << eid << ", \"type\": " << jsonstring(typename_of(c->type)) << ", \"call_id\": " << c->call_id
+	    << ", \"name\": " << jsonstring(*c->name) << ", \"calls\": " << s.calls;
+	out << ", \"called_from_ocalls\": " << (c->type == call_type_t::ECALL ? c->num_ecall_called_from_ocalls : 0);
+
+	out << ", \"duration\": {\"sum\": " << s.sum << ", \"avg\": " << s.avg << ", \"std\": " << s.std << ", \"min\": " << (s.calls > 0 ? s.min : 0)
+	    << ", \"max\": " << s.max << ", \"below\": ";
+	json_below(out, s.below);
+	out << "}";
+
+	out << ", \"percentiles\": ";
+	json_quantiles(out, c->quantiles);
+
+	out << ", \"breakdown\": ";
+	json_breakdown(out, c->breakdown);
+
+	auto &f = c->stats_95th;
+	out << ", \"fastest_95\": {\"calls\": " << f.calls << ", \"avg\": " << f.avg << ", \"std\": " << f.std << ", \"below\": ";
+	json_below(out, f.below);
+	out << "}";
+
+	out << ", \"corrected\": ";
+	if (corrected_durations())
+	{
+		out << "{\"avg\": " << c->corrected_stats.avg << ", \"std\": " << c->corrected_stats.std << ", \"percentiles\": ";
+		json_quantiles(out, c->corrected_quantiles);
+		out << "}";
+	}
+	else
+	{
+		out << "null";
+	}
+
+	auto &a = c->aex_stats;
+	out << ", \"aex\": ";
+	if (has_aex_stats(c))
+	{
+		out << "{\"sum\": " << a.sum << ", \"avg\": " << a.avg << ", \"std\": " << a.std << ", \"min\": " << a.min << ", \"max\": " << a.max << "}";
+	}
+	else
+	{
+		out << "null";
+	}
+
+	out << ", \"direct_parents\": [";
+	if (c->direct_parents_data != nullptr)
+	{
+		bool first = true;
+		for (auto &pc : *c->direct_parents_data)
+		{
+			out << (first ? "" : ", ") << "{\"type\": " << jsonstring(typename_of(pc.call_data->type)) << ", \"call_id\": " << pc.call_data->call_id
+			    << ", \"name\": " << jsonstring(*pc.call_data->name) << ", \"count\": " << pc.count
+			    << ", \"less_than_10us_from_start\": " << pc.num_less_than_10us_from_start << ", \"less_than_20us_from_start\": " << pc.num_less_than_20us_from_start
+			    << ", \"less_than_10us_from_end\": " << pc.num_less_than_10us_from_end << ", \"less_than_20us_from_end\": " << pc.num_less_than_20us_from_end << "}";
+			first = false;
+		}
+	}
+	out << "]";
+
+	out << ", \"indirect_parents\": [";
+	if (c->has_indirect_parents)
+	{
+		bool first = true;
+		for (auto &pc : *c->indirect_parents_data)
+		{
+			out << (first ? "" : ", ") << "{\"type\": " << jsonstring(typename_of(pc.call_data->type)) << ", \"call_id\": " << pc.call_data->call_id
+			    << ", \"name\": " << jsonstring(*pc.call_data->name) << ", \"count\": " << pc.count << ", \"below\": ";
+			json_below(out, pc.below);
+			out << "}";
+			first = false;
+		}
+	}
+	out << "]}";
+}
+
+static void json_timeline(std::ostream &out)
+{
+	auto &timeline = report.time_series;
+	out << "{\"width\": " << timeline.width << ", \"windows\": [";
+	for (size_t w = 0; w < timeline.windows.size(); ++w)
+	{
+		auto &tw = timeline.windows[w];
+		out << (w > 0 ? "," : "") << std::endl;
+		out << "    {\"start\": " << tw.start << ", \"length\": " << tw.length << ", \"ecalls\": " << tw.ecalls << ", \"ocalls\": " << tw.ocalls << ", \"aexs\": " << tw.aexs
+		    << ", \"ecall_percentiles\": ";
+		json_quantiles(out, tw.ecall_quantiles);
+		out << ", \"calls\": [";
+		for (size_t i = 0; i < tw.calls.size(); ++i)
+		{
+			auto &wc = tw.calls[i];
+			auto c = call_list[wc.call];
+			out << (i > 0 ? ", " : "") << "{\"eid\": " << call_eid(c) << ", \"type\": " << jsonstring(typename_of(c->type)) << ", \"call_id\": " << c->call_id
+			    << ", \"name\": " << jsonstring(*c->name) << ", \"calls\": " << wc.calls << ", \"aexs\": " << wc.aexs << ", \"percentiles\": ";
+			json_quantiles(out, wc.quantiles);
+			out << "}";
+		}
+		out << "]}";
+	}
+	out << std::endl << "  ], \"phases\": [";
+	for (size_t p = 0; p < timeline.phases.size(); ++p)
+	{
+		auto &phase = timeline.phases[p];
+		std::vector<std::string> changes;
+		if (phase.mix_changed)
+			changes.emplace_back("mix");
+		if (phase.rate_changed)
+			changes.emplace_back("rate");
+		if (phase.latency_changed)
+			changes.emplace_back("latency");
+		out << (p > 0 ? "," : "") << std::endl;
+		out << "    {\"start\": " << phase.start << ", \"length\": " << phase.length << ", \"first_window\": " << phase.first << ", \"windows\": " << (phase.last - phase.first)
+		    << ", \"ecalls\": " << phase.ecalls << ", \"ocalls\": " << phase.ocalls << ", \"aexs\": " << phase.aexs << ", \"steady\": " << (p == timeline.steady ? "true" : "false")
+		    << ", \"changes\": ";
+		json_strings(out, changes);
+		out << ", \"ecall_percentiles\": ";
+		json_quantiles(out, phase.ecall_quantiles);
+		out << ", \"mix\": [";
+		for (size_t m = 0; m < phase.mix.size(); ++m)
+		{
+			auto c = call_list[phase.mix[m].first];
+			out << (m > 0 ? ", " : "") << "{\"call_id\": " << c->call_id << ", \"name\": " << jsonstring(*c->name) << ", \"calls\": " << phase.mix[m].second << "}";
+		}
+		out << "]}";
+	}
+	out << std::endl << "  ]}";
+}
+
+static void json_cores(std::ostream &out)
+{
+	auto &s = report.core_summary;
+	out << "{\"ecalls\": " << s.ecalls << ", \"migrated\": " << s.migrated << ", \"penalty\": " << s.penalty << ", \"slowdown\": " << s.slowdown << "," << std::endl;
+	out << "    \"migrations\": [";
+	for (size_t i = 0; i < s.ecalls_by_penalty.size(); ++i)
+	{
+		auto &m = s.ecalls_by_penalty[i];
+		out << (i > 0 ? "," : "") << std::endl;
+		out << "      {\"eid\": " << m.eid << ", \"call_id\": " << m.call_id << ", \"name\": " << jsonstring(m.name) << ", \"calls\": " << m.calls << ", \"migrated\": " << m.migrated
+		    << ", \"compared\": " << (m.compared ? "true" : "false") << ", \"stayed_avg\": " << m.stayed_stats.avg << ", \"migrated_avg\": " << m.migrated_stats.avg << ", \"stayed_quantiles\": ";
+		json_quantiles(out, m.stayed_quantiles);
+		out << ", \"migrated_quantiles\": ";
+		json_quantiles(out, m.migrated_quantiles);
+		out << "}";
+	}
+	out << std::endl << "    ]," << std::endl;
+	out << "    \"threads\": [";
+	for (size_t i = 0; i < s.threads.size(); ++i)
+	{
+		auto &t = s.threads[i];
+		out << (i > 0 ? "," : "") << std::endl;
+		out << "      {\"id\": " << t.thread << ", \"pthread_id\": " << t.pthread_id << ", \"events\": " << t.events << ", \"cores\": " << t.cores << ", \"main_core\": " << t.main_core
+		    << ", \"on_main_core\": " << t.on_main_core << ", \"ecalls\": " << t.ecalls << ", \"migrated\": " << t.migrated << ", \"pin_core\": ";
+		if (t.pin)
+			out << t.pin_core;
+		else
+			out << "null";
+		out << "}";
+	}
+	out << std::endl << "    ]," << std::endl;
+	out << "    \"cores\": [";
+	for (size_t i = 0; i < s.cores.size(); ++i)
+	{
+		auto &c = s.cores[i];
+		out << (i > 0 ? "," : "") << std::endl;
+		out << "      {\"core\": " << c.core << ", \"ecall_entries\": " << c.entries << ", \"aexs\": " << c.aexs << ", \"hotspot\": " << (c.hotspot ? "true" : "false") << "}";
+	}
+	out << std::endl << "    ]}";
+}
+
+static void json_calls_phase(std::ostream &out)
+{
+	auto runtime = general_data.endtime - general_data.starttime;
+	out << "  \"general\": {\"runtime\": " << runtime << ", \"logger_events\": " << general_data.logger_events << ", \"logger_bytes\": " << general_data.logger_bytes
+	    << ", \"logger_time\": " << general_data.logger_time << ", \"ecall_roundtrip\": " << general_data.ecall_roundtrip << ", \"ocall_roundtrip\": " << general_data.ocall_roundtrip
+	    << ", \"overhead_call\": " << general_data.overhead_call << ", \"overhead_nested_call\": " << general_data.overhead_nested_call << "}," << std::endl;
+
+	out << "  \"enclaves\": [";
+	bool first = true;
+	for (auto &p : encls)
+	{
+		auto &e = p.second;
+		auto called = [](std::vector<call_data_t *> const &calls) {
+			return std::count_if(calls.begin(), calls.end(), [](call_data_t *c) { return c->all_stats.calls > 0; });
+		};
+		bool active = e.last_ecall_end >= e.first_ecall_start;
+		out << (first ? "" : ",") << std::endl;
+		out << "    {\"eid\": " << p.first << ", \"ecalls\": " << e.ecalls.size() << ", \"ocalls\": " << e.ocalls.size()
+		    << ", \"ecalls_called\": " << called(e.ecalls) << ", \"ocalls_called\": " << called(e.ocalls)
+		    << ", \"ecall_count\": " << e.ecall_count << ", \"ocall_count\": " << e.ocall_count
+		    << ", \"active_time\": " << (active ? e.last_ecall_end - e.first_ecall_start : 0)
+		    << ", \"first_ecall_start\": " << (active ? e.first_ecall_start - general_data.starttime : 0)
+		    << ", \"last_ecall_end\": " << (active ? e.last_ecall_end - general_data.starttime : 0) << ", \"time\": ";
+		json_time_totals(out, e.ecall_breakdown, e.ocall_breakdown);
+		out << "}";
+		first = false;
+	}
+	out << std::endl << "  ]," << std::endl;
+
+	out << "  \"threads\": [";
+	first = true;
+	for (auto &p : threads)
+	{
+		auto &t = p.second;
+		if (t.ecalls.calls + t.ocalls.calls == 0)
+			continue;
+		out << (first ? "" : ",") << std::endl;
+		out << "    {\"thread\": " << t.id << ", \"pthread_id\": " << t.pthread_id << ", \"ecalls\": " << t.ecalls.calls << ", \"ocalls\": " << t.ocalls.calls << ", \"time\": ";
+		json_time_totals(out, t.ecalls, t.ocalls);
+		out << "}";
+		first = false;
+	}
+	out << std::endl << "  ]," << std::endl;
+
+	out << "  \"calls\": [";
+	first = true;
+	for (auto &p : encls)
+	{
+		for (auto c : reported_calls(p.second))
+		{
+			out << (first ? "" : ",") << std::endl << "    ";
+			json_call(out, p.first, c);
+			first = false;
+		}
+	}
+	out << std::endl << "  ]," << std::endl;
+
+	out << "  \"recommendations\": [";
+	for (size_t i = 0; i < report.recommendations.size(); ++i)
+	{
+		auto &r = report.recommendations[i];
+		out << (i > 0 ? "," : "") << std::endl;
+		out << "    {\"rank\": " << (i + 1) << ", \"eid\": " << r.eid << ", \"type\": " << jsonstring(typename_of(r.call->type)) << ", \"call_id\": " << r.call->call_id
+		    << ", \"name\": " << jsonstring(*r.call->name) << ", \"transitions\": " << r.transitions << ", \"saved\": " << r.saved << ", \"text\": " << jsonstring(r.text) << "}";
+	}
+	out << std::endl << "  ]," << std::endl;
+
+	out << "  \"snapshots\": [";
+	for (size_t i = 0; i < report.snapshots.size(); ++i)
+	{
+		auto &row = report.snapshots[i];
+		bool is_ecall;
+		auto name = snapshot_name(row, is_ecall);
+		std::vector<std::string> frames;
+		std::stringstream stack(row.stack);
+		std::string frame;
+		while (std::getline(stack, frame))
+		{
+			frames.push_back(frame);
+		}
+		out << (i > 0 ? "," : "") << std::endl;
+		out << "    {\"thread\": " << row.thread << ", \"eid\": " << row.eid << ", \"type\": " << jsonstring(is_ecall ? "ECall" : "OCall") << ", \"call_id\": " << row.call_id
+		    << ", \"name\": " << jsonstring(name) << ", \"age\": " << row.age << ", \"rip\": " << row.rip << ", \"stack\": ";
+		json_strings(out, frames);
+		out << "}";
+	}
+	out << std::endl << "  ]," << std::endl;
+
+	out << "  \"timeline\": ";
+	if (report.timeline)
+		json_timeline(out);
+	else
+		out << "null";
+	out << "," << std::endl;
+
+	out << "  \"concurrency\": [";
+	for (size_t i = 0; i < report.concurrency.size(); ++i)
+	{
+		auto &r = report.concurrency[i];
+		out << (i > 0 ? "," : "") << std::endl;
+		out << "    {\"eid\": " << r.eid << ", \"threads\": " << r.threads << ", \"ecalls\": " << r.ecalls << ", \"active\": " << r.active << ", \"peak\": " << r.peak
+		    << ", \"time_at\": ";
+		json_counts(out, r.time_at);
+		out << ", \"entered_at\": ";
+		json_counts(out, r.entered_at);
+		out << ", \"handoffs\": " << r.handoffs << ", \"handoff_time\": " << r.handoff_time << ", \"lift\": " << r.lift << ", \"out_of_tcs\": " << r.out_of_tcs
+		    << ", \"saturated\": " << (r.saturated ? "true" : "false") << ", \"recommended_tcs\": " << r.recommended_tcs << "}";
+	}
+	out << std::endl << "  ]," << std::endl;
+}
+
+/*
+ * CSV
+ */
+
+static std::string csvstring(std::string const &s)
+{
+	if (s.find_first_of(",\"\n\r") == std::string::npos)
+	{
+		return s;
+	}
+	std::string quoted = "\"";
+	for (auto ch : s)
+	{
+		if (ch == '"')
+			quoted += '"';
+		quoted += ch;
+	}
+	return quoted + "\"";
+}
+
+static void csv_below_header(std::ostream &out, std::string const &prefix)
+{
+	for (size_t b = 0; b < config.buckets.count; ++b)
+	{
+		out << "," << prefix << "below_" << config.buckets.bounds[b];
+	}
+}
+
+static void csv_below(std::ostream &out, uint64_t const *below)
+{
+	for (size_t b = 0; b < config.buckets.count; ++b)
+	{
+		out << "," << below[b];
+	}
+}
+
+static void csv_quantiles_header(std::ostream &out, std::string const &prefix)
+{
+	for (size_t i = 0; i < QUANTILE_COUNT; ++i)
+	{
+		out << "," << prefix << quantilekey(i);
+	}
+	out << "," << prefix << "percentile_error";
+}
+
+static void csv_quantiles(std::ostream &out, quantiles_t const &q)
+{
+	for (size_t i = 0; i < QUANTILE_COUNT; ++i)
+	{
+		out << "," << q.value[i];
+	}
+	out << "," << q.error;
+}
+
+static void csv_time_totals_header(std::ostream &out)
+{
+	out << ",in_enclave,work,transitions,ecall_transitions,ocall_transitions,in_ocalls";
+}
+
+/**
+ * @brief CSV columns of json_time_totals().
+ */
+static void csv_time_totals(std::ostream &out, breakdown_t const &ecalls, breakdown_t const &ocalls)
+{
+	auto transitions = transition_time(ecalls);
+	out << "," << ecalls.self << "," << ecalls.self - transitions << "," << transitions << "," << ecalls.ecall_transitions << "," << ecalls.ocall_transitions << "," << ocalls.self;
+}
+
+/**
+ * @brief Opens the CSV file of a table next to the JSON report, e.g. report-calls.csv for report.json. Exits on errors.
+ */
+static void open_csv(std::ofstream &out, std::string const &base, char const *table)
+{
+	auto path = base + "-" + table + ".csv";
+	out.open(path);
+	if (!out)
+	{
+		std::cout << "/!\\ Could not write report " << path << std::endl;
+		exit(1);
+	}
+	out << std::setprecision(15);
+}
+
+static void csv_calls_phase(std::string const &base)
+{
+	std::ofstream out;
+
+	open_csv(out, base, "enclaves");
+	out << "eid,ecalls,ocalls,ecall_count,ocall_count,active_time,first_ecall_start,last_ecall_end";
+	csv_time_totals_header(out);
+	out << std::endl;
+	for (auto &p : encls)
+	{
+		auto &e = p.second;
+		bool active = e.last_ecall_end >= e.first_ecall_start;
+		out << p.first << "," << e.ecalls.size() << "," << e.ocalls.size() << "," << e.ecall_count << "," << e.ocall_count
+		    << "," << (active ? e.last_ecall_end - e.first_ecall_start : 0)
+		    << "," << (active ? e.first_ecall_start - general_data.starttime : 0)
+		    << "," << (active ? e.last_ecall_end - general_data.starttime : 0);
+		csv_time_totals(out, e.ecall_breakdown, e.ocall_breakdown);
+		out << std::endl;
+	}
+	out.close();
+
+	open_csv(out, base, "threads");
+	out << "thread,pthread_id,ecalls,ocalls";
+	csv_time_totals_header(out);
+	out << std::endl;
+	for (auto &p : threads)
+	{
+		auto &t = p.second;
+		if (t.ecalls.calls + t.ocalls.calls == 0)
+			continue;
+		out << t.id << "," << t.pthread_id << "," << t.ecalls.calls << "," << t.ocalls.calls;
+		csv_time_totals(out, t.ecalls, t.ocalls);
+		out << std::endl;
+	}
+	out.close();
+
+	open_csv(out, base, "calls");
+	out << "eid,type,call_id,name,calls,called_from_ocalls,sum,avg,std,min,max";
+	csv_below_header(out, "");
+	csv_quantiles_header(out, "");
+	out << ",self,in_ecalls,in_ocalls,ecall_transitions,ocall_transitions,transition_time";
+	out << ",fastest_95_calls,fastest_95_avg,fastest_95_std";
+	csv_below_header(out, "fastest_95_");
+	out << ",corrected_avg,corrected_std";
+	csv_quantiles_header(out, "corrected_");
+	out << ",aex_sum,aex_avg,aex_std,aex_min,aex_max" << std::endl;
+	for (auto &p : encls)
+	{
+		for (auto c : reported_calls(p.second))
+		{
+			auto &s = c->all_stats;
+			out << p.first << "," << typename_of(c->type) << "," << c->call_id << "," << csvstring(*c->name) << "," << s.calls
+			    << "," << (c->type == call_type_t::ECALL ? c->num_ecall_called_from_ocalls : 0)
+			    << "," << s.sum << "," << s.avg << "," << s.std << "," << (s.calls > 0 ? s.min : 0) << "," << s.max;
+			csv_below(out, s.below);
+			csv_quantiles(out, c->quantiles);
+			auto &b = c->breakdown;
+			out << "," << b.self << "," << b.in_ecalls << "," << b.in_ocalls << "," << b.ecall_transitions << "," << b.ocall_transitions << "," << transition_time(b);
+			out << "," << c->stats_95th.calls << "," << c->stats_95th.avg << "," << c->stats_95th.std;
+			csv_below(out, c->stats_95th.below);
+			if (corrected_durations())
+			{
+				out << "," << c->corrected_stats.avg << "," << c->corrected_stats.std;
+				csv_quantiles(out, c->corrected_quantiles);
+			}
+			else
+			{
+				out << ",,";
+				for (size_t i = 0; i <= QUANTILE_COUNT; ++i)
+					out << ",";
+			}
+			auto &a = c->aex_stats;
+			if (has_aex_stats(c))
+				out << "," << a.sum << "," << a.avg << "," << a.std << "," << a.min << "," << a.max << std::endl;
+			else
+				out << ",,,,," << std::endl;
+		}
+	}
+	out.close();
+
+	open_csv(out, base, "direct_parents");
+	out << "eid,type,call_id,name,parent_type,parent_call_id,parent_name,count,less_than_10us_from_start,less_than_20us_from_start,less_than_10us_from_end,less_than_20us_from_end" << std::endl;
+	for (auto &p : encls)
+	{
+		for (auto c : reported_calls(p.second))
+		{
+			if (c->direct_parents_data == nullptr)
+				continue;
+			for (auto &pc : *c->direct_parents_data)
+			{
+				out << p.first << "," << typename_of(c->type) << "," << c->call_id << "," << csvstring(*c->name)
+				    << "," << typename_of(pc.call_data->type) << "," << pc.call_data->call_id << "," << csvstring(*pc.call_data->name) << "," << pc.count
+				    << "," << pc.num_less_than_10us_from_start << "," << pc.num_less_than_20us_from_start
+				    << "," << pc.num_less_than_10us_from_end << "," << pc.num_less_than_20us_from_end << std::endl;
+			}
+		}
+	}
+	out.close();
+
+	open_csv(out, base, "indirect_parents");
+	out << "eid,type,call_id,name,parent_type,parent_call_id,parent_name,count";
+	csv_below_header(out, "");
+	out << std::endl;
+	for (auto &p : encls)
+	{
+		for (auto c : reported_calls(p.second))
+		{
+			if (!c->has_indirect_parents)
+				continue;
+			for (auto &pc : *c->indirect_parents_data)
+			{
+				out << p.first << "," << typename_of(c->type) << "," << c->call_id << "," << csvstring(*c->name)
+				    << "," << typename_of(pc.call_data->type) << "," << pc.call_data->call_id << "," << csvstring(*pc.call_data->name) << "," << pc.count;
+				csv_below(out, pc.below);
+				out << std::endl;
+			}
+		}
+	}
+	out.close();
+
+	open_csv(out, base, "recommendations");
+	out << "rank,eid,type,call_id,name,transitions,saved,text" << std::endl;
+	for (size_t i = 0; i < report.recommendations.size(); ++i)
+	{
+		auto &r = report.recommendations[i];
+		out << (i + 1) << "," << r.eid << "," << typename_of(r.call->type) << "," << r.call->call_id << "," << csvstring(*r.call->name)
+		    << "," << r.transitions << "," << r.saved << "," << csvstring(r.text) << std::endl;
+	}
+	out.close();
+
+	open_csv(out, base, "snapshots");
+	out << "thread,eid,type,call_id,name,age,rip,stack" << std::endl;
+	for (auto &row : report.snapshots)
+	{
+		bool is_ecall;
+		auto name = snapshot_name(row, is_ecall);
+		out << row.thread << "," << row.eid << "," << (is_ecall ? "ECall" : "OCall") << "," << row.call_id << "," << csvstring(name)
+		    << "," << row.age << "," << row.rip << "," << csvstring(row.stack) << std::endl;
+	}
+	out.close();
+}
+
+static void csv_timeline(std::string const &base)
+{
+	auto &timeline = report.time_series;
+	std::ofstream out;
+
+	open_csv(out, base, "windows");
+	out << "start,length,ecalls,ocalls,aexs";
+	csv_quantiles_header(out, "ecall_");
+	out << std::endl;
+	for (auto &tw : timeline.windows)
+	{
+		out << tw.start << "," << tw.length << "," << tw.ecalls << "," << tw.ocalls << "," << tw.aexs;
+		csv_quantiles(out, tw.ecall_quantiles);
+		out << std::endl;
+	}
+	out.close();
+
+	open_csv(out, base, "window_calls");
+	out << "start,eid,type,call_id,name,calls,aexs";
+	csv_quantiles_header(out, "");
+	out << std::endl;
+	for (auto &tw : timeline.windows)
+	{
+		for (auto &wc : tw.calls)
+		{
+			auto c = call_list[wc.call];
+			out << tw.start << "," << call_eid(c) << "," << typename_of(c->type) << "," << c->call_id << "," << csvstring(*c->name) << "," << wc.calls << "," << wc.aexs;
+			csv_quantiles(out, wc.quantiles);
+			out << std::endl;
+		}
+	}
+	out.close();
+
+	open_csv(out, base, "phases");
+	out << "phase,start,length,windows,ecalls,ocalls,aexs,steady,mix_changed,rate_changed,latency_changed";
+	csv_quantiles_header(out, "ecall_");
+	out << std::endl;
+	for (size_t p = 0; p < timeline.phases.size(); ++p)
+	{
+		auto &phase = timeline.phases[p];
+		out << (p + 1) << "," << phase.start << "," << phase.length << "," << (phase.last - phase.first) << "," << phase.ecalls << "," << phase.ocalls << "," << phase.aexs
+		    << "," << (p == timeline.steady) << "," << phase.mix_changed << "," << phase.rate_changed << "," << phase.latency_changed;
+		csv_quantiles(out, phase.ecall_quantiles);
+		out << std::endl;
+	}
+	out.close();
+}
+
+static void csv_concurrency(std::string const &base)
+{
+	std::ofstream out;
+
+	open_csv(out, base, "concurrency");
+	out << "eid,threads,ecalls,active,peak,time_at_peak,handoffs,handoff_time,lift,out_of_tcs,saturated,recommended_tcs" << std::endl;
+	for (auto &r : report.concurrency)
+	{
+		out << r.eid << "," << r.threads << "," << r.ecalls << "," << r.active << "," << r.peak << "," << r.time_at[r.peak] << "," << r.handoffs << "," << r.handoff_time
+		    << "," << r.lift << "," << r.out_of_tcs << "," << r.saturated << "," << r.recommended_tcs << std::endl;
+	}
+	out.close();
+
+	open_csv(out, base, "occupancy");
+	out << "eid,threads_inside,time,entered" << std::endl;
+	for (auto &r : report.concurrency)
+	{
+		for (size_t level = 0; level <= r.peak; ++level)
+		{
+			out << r.eid << "," << level << "," << r.time_at[level] << "," << r.entered_at[level] << std::endl;
+		}
+	}
+	out.close();
+}
+
+static void csv_cores(std::string const &base)
+{
+	auto &s = report.core_summary;
+	std::ofstream out;
+
+	open_csv(out, base, "migrations");
+	out << "eid,call_id,name,calls,migrated,compared,stayed_avg,migrated_avg";
+	csv_quantiles_header(out, "stayed_");
+	csv_quantiles_header(out, "migrated_");
+	out << std::endl;
+	for (auto &m : s.ecalls_by_penalty)
+	{
+		out << m.eid << "," << m.call_id << "," << csvstring(m.name) << "," << m.calls << "," << m.migrated << "," << m.compared << "," << m.stayed_stats.avg << "," << m.migrated_stats.avg;
+		csv_quantiles(out, m.stayed_quantiles);
+		csv_quantiles(out, m.migrated_quantiles);
+		out << std::endl;
+	}
+	out.close();
+
+	open_csv(out, base, "thread_cores");
+	out << "id,pthread_id,events,cores,main_core,on_main_core,ecalls,migrated,pin,pin_core" << std::endl;
+	for (auto &t : s.threads)
+	{
+		out << t.thread << "," << t.pthread_id << "," << t.events << "," << t.cores << "," << t.main_core << "," << t.on_main_core << "," << t.ecalls << "," << t.migrated << "," << t.pin << ",";
+		if (t.pin)
+			out << t.pin_core;
+		out << std::endl;
+	}
+	out.close();
+
+	open_csv(out, base, "core_aexs");
+	out << "core,ecall_entries,aexs,hotspot" << std::endl;
+	for (auto &c : s.cores)
+	{
+		out << c.core << "," << c.entries << "," << c.aexs << "," << c.hotspot << std::endl;
+	}
+	out.close();
+}
+
+/**
+ * @brief Writes the report of all phases that ran.
+ * Phases that did not run are null in JSON and have no CSV files.
+ * @param path Path of the JSON file. The CSV files are named after it without ".json", e.g. report-calls.csv.
+ * @param trace Path of the trace
+ */
+void write_report(std::string const &path, std::string const &trace)
+{
+	std::ofstream out(path);
+	if (!out)
+	{
+		std::cout << "/!\\ Could not write report " << path << std::endl;
+		exit(1);
+	}
+	out << std::setprecision(15);
+
+	out << "{" << std::endl;
+	out << "  \"version\": " << REPORT_VERSION << "," << std::endl;
+	out << "  \"trace\": " << jsonstring(trace) << "," << std::endl;
+	out << "  \"buckets_ns\": [";
+	for (size_t b = 0; b < config.buckets.count; ++b)
+	{
+		out << (b > 0 ? ", " : "") << config.buckets.bounds[b];
+	}
+	out << "]," << std::endl;
+	out << "  \"percentiles\": " << jsonstring(config.sketch_percentiles ? "sketch" : "exact") << "," << std::endl;
+	out << "  \"overhead_correction\": " << (corrected_durations() ? "true" : "false") << "," << std::endl;
+	out << "  \"window\": {\"start\": " << config.window_start << ", \"end\": ";
+	if (config.window_end == UINT64_MAX)
+		out << "null";
+	else
+		out << config.window_end;
+	out << "}," << std::endl;
+
+	if (report.calls)
+	{
+		json_calls_phase(out);
+	}
+	else
+	{
+		for (auto key : {"general", "enclaves", "threads", "calls", "recommendations", "snapshots", "timeline", "concurrency"})
+		{
+			out << "  \"" << key << "\": null," << std::endl;
+		}
+	}
+
+	out << "  \"sync\": ";
+	if (report.sync)
+	{
+		auto &s = report.sync_summary;
+		out << "{\"ocalls\": " << s.ocalls << ", \"wait_events\": " << s.wait_events << ", \"below\": ";
+		json_below(out, s.below);
+		out << "}";
+	}
+	else
+	{
+		out << "null";
+	}
+	out << "," << std::endl;
+
+	out << "  \"security\": ";
+	if (report.security)
+	{
+		out << "[";
+		for (size_t i = 0; i < report.security_hints.size(); ++i)
+		{
+			auto &h = report.security_hints[i];
+			out << (i > 0 ? "," : "") << std::endl;
+			out << "    {\"eid\": " << h.eid << ", \"ocall\": " << jsonstring(h.ocall) << ", " << (h.from_edl ? "\"remove\": " : "\"allow\": ");
+			json_strings(out, h.ecalls);
+			out << "}";
+		}
+		out << std::endl << "  ]";
+	}
+	else
+	{
+		out << "null";
+	}
+	out << "," << std::endl;
+
+	out << "  \"cores\": ";
+	if (report.cores)
+		json_cores(out);
+	else
+		out << "null";
+	out << std::endl << "}" << std::endl;
+	out.close();
+
+	auto base = hasEnding(path, ".json") ? path.substr(0, path.size() - 5) : path;
+	if (report.calls)
+	{
+		csv_calls_phase(base);
+		csv_concurrency(base);
+	}
+	if (report.timeline)
+	{
+		csv_timeline(base);
+	}
+	if (report.sync)
+	{
+		std::ofstream csv;
+		open_csv(csv, base, "sync");
+		csv << "bound,wait_events,below" << std::endl;
+		for (size_t b = 0; b < config.buckets.count; ++b)
+		{
+			csv << config.buckets.bounds[b] << "," << report.sync_summary.wait_events << "," << report.sync_summary.below[b] << std::endl;
+		}
+	}
+	if (report.cores)
+	{
+		csv_cores(base);
+	}
+	if (report.security)
+	{
+		std::ofstream csv;
+		open_csv(csv, base, "security");
+		csv << "eid,ocall,kind,ecall" << std::endl;
+		for (auto &h : report.security_hints)
+		{
+			for (auto &ecall : h.ecalls)
+			{
+				csv << h.eid << "," << csvstring(h.ocall) << "," << (h.from_edl ? "remove" : "allow") << "," << csvstring(ecall) << std::endl;
+			}
+		}
+	}
+
+	std::cout << "(i) Wrote report to " << path << std::endl;
+}
@@ -0,0 +1,41 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_REPORT_H
+#define SGX_PERF_REPORT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "calls.h"
+#include "cache.h"
+#include "timeline.h"
+#include "concurrency.h"
+#include "cores.h"
+
+/**
+ * @brief Version of the layout of the JSON report. Raised whenever a key changes or disappears.
+ */
+#define REPORT_VERSION 1
+
+/**
+ * @brief Interface hint of the security phase for an OCall.
+ */
+typedef struct __security_hint
+{
+	uint64_t eid;
+	std::string ocall;
+	bool from_edl; // ecalls are functions to remove from the allow list in the EDL, otherwise the narrowest allow list
+	std::vector<std::string> ecalls;
+} security_hint_t;
+
+void report_calls(std::vector<recommendation_t> const &recommendations, std::vector<snapshot_row_t> const &snapshots);
+void report_sync(sync_summary_t const &summary);
+void report_security(std::vector<security_hint_t> const &hints);
+void report_cores(core_summary_t const &summary);
+void report_timeline(timeline_t const &timeline);
+void report_concurrency(std::vector<concurrency_t> const &concurrency);
+void write_report(std::string const &path, std::string const &trace);
+
+#endif //SGX_PERF_REPORT_H
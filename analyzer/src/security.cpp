@@ -50,21 +50,23 @@ static inline void remove_comments(std::string &s)
 void analyze_security()
 {
 	std::cout << "=== OCall interface security hints" << std::endl;
+	std::vector<security_hint_t> hints;
 	if (config.edl_path.empty())
 	{
 		std::cout << "(i) No EDL specified, printing narrowest interface for each OCall." << std::endl;
 
-		std::for_each(encls.begin(), encls.end(), [](std::pair<const uint64_t, enclave_data_t> &p) {
+		std::for_each(encls.begin(), encls.end(), [&hints](std::pair<const uint64_t, enclave_data_t> &p) {
 			auto eid = p.first;
 			std::stringstream ss;
-			std::for_each(encls[eid].ocalls.begin(), encls[eid].ocalls.end(), [eid, &ss](call_data_t *ocd) {
+			std::for_each(encls[eid].ocalls.begin(), encls[eid].ocalls.end(), [eid, &ss, &hints](call_data_t *ocd) {
 				ss << *ocd->name;
 
 				bool first = true;
-				std::for_each(encls[eid].ecalls.begin(), encls[eid].ecalls.end(), [ocd, &first, &ss](call_data_t *ecd) {
-					auto &od = ecd->direct_parents_data->at(ocd->call_id);
-					if (od.count == 0)
+				security_hint_t hint = {eid, *ocd->name, false, {}};
+				std::for_each(encls[eid].ecalls.begin(), encls[eid].ecalls.end(), [ocd, &first, &ss, &hint](call_data_t *ecd) {
+					if (find_parent_data(ecd->direct_parents_data, ocd->call_id) == nullptr)
 						return;
+					hint.ecalls.push_back(*ecd->name);
 					if (first)
 					{
 						ss << " allow (" << *ecd->name;
@@ -84,11 +86,13 @@ void analyze_security()
 				if (s[s.length()-2] == ')')
 				{
 					std::cout << s << std::endl;
+					hints.push_back(hint);
 				}
 
 			});
 		});
 
+		report_security(hints);
 		return;
 	}
 
@@ -184,15 +188,14 @@ void analyze_security()
 		}
 	}
 
-	std::for_each(encls.begin(), encls.end(), [&ocalls](std::pair<const uint64_t, enclave_data_t> &p) {
+	std::for_each(encls.begin(), encls.end(), [&ocalls, &hints](std::pair<const uint64_t, enclave_data_t> &p) {
 		auto eid = p.first;
-		std::for_each(encls[eid].ocalls.begin(), encls[eid].ocalls.end(), [eid, &ocalls](call_data_t *ocd) {
+		std::for_each(encls[eid].ocalls.begin(), encls[eid].ocalls.end(), [eid, &ocalls, &hints](call_data_t *ocd) {
 			std::set<std::string> edlallowed;
 
 			bool first = true;
 			std::for_each(encls[eid].ecalls.begin(), encls[eid].ecalls.end(), [ocd, &first, &edlallowed](call_data_t *ecd) {
-				auto &od = ecd->direct_parents_data->at(ocd->call_id);
-				if (od.count == 0)
+				if (find_parent_data(ecd->direct_parents_data, ocd->call_id) == nullptr)
 					return;
 				if (first)
 				{
@@ -218,7 +221,9 @@ void analyze_security()
 					std::cout << "\t" << *it << std::endl;
 					it++;
 				}
+				hints.push_back({eid, *ocd->name, true, std::vector<std::string>(in_edl.begin(), in_edl.end())});
 			}
 		});
 	});
+	report_security(hints);
 }
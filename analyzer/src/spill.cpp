@@ -0,0 +1,257 @@
+/**
+ * @author weichbr
+ */
+
+#include "spill.h"
+
+#include <algorithm>
+#include <queue>
+#include <iterator>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+/**
+ * @brief Creates a temporary file in the given folder. It is unlinked right away, so it disappears with the analyzer. Exits on errors.
+ * @param dir
+ * @return The file descriptor
+ */
+static int create_spill_file(std::string const &dir)
+{
+	std::string path = dir + "/sgx-perf-XXXXXX";
+	std::vector<char> name(path.begin(), path.end());
+	name.push_back('\0');
+	int fd = mkstemp(name.data());
+	if (fd < 0)
+	{
+		printf("/!\\ Could not create spill file in %s: %s\n", dir.c_str(), strerror(errno));
+		exit(-1);
+	}
+	unlink(name.data());
+	return fd;
+}
+
+/**
+ * @brief Writes values to a spill file at the given byte offset. Exits on errors.
+ * @param fd
+ * @param offset
+ * @param values
+ * @param count
+ */
+static void write_values(int fd, uint64_t offset, uint64_t const *values, size_t count)
+{
+	auto bytes = count * sizeof(uint64_t);
+	auto data = reinterpret_cast<const char *>(values);
+	for (size_t done = 0; done < bytes;)
+	{
+		auto n = pwrite(fd, data + done, bytes - done, static_cast<off_t>(offset + done));
+		if (n < 0)
+		{
+			printf("/!\\ Could not write spill file: %s\n", strerror(errno));
+			exit(-1);
+		}
+		done += static_cast<size_t>(n);
+	}
+}
+
+/**
+ * @brief Creates the temporary file of a spill in the given folder. Exits on errors.
+ * @param s
+ * @param dir
+ * @param calls Number of ECalls/OCalls
+ */
+void open_spill(spill_t &s, std::string const &dir, size_t calls)
+{
+	s.fd = create_spill_file(dir);
+	s.size = 0;
+	s.buffer.reserve(SPILL_BUFFER_VALUES);
+	s.segments.assign(calls, std::vector<spill_segment_t>());
+}
+
+void spill_value(spill_t &s, uint32_t call, uint64_t value)
+{
+	s.buffer.emplace_back(call, value);
+	if (s.buffer.size() == SPILL_BUFFER_VALUES)
+	{
+		flush_spill(s);
+	}
+}
+
+/**
+ * @brief Sorts the buffered values and appends them as one run, a segment per call. Exits on errors.
+ * @param s
+ */
+void flush_spill(spill_t &s)
+{
+	if (s.buffer.empty())
+	{
+		return;
+	}
+	std::sort(s.buffer.begin(), s.buffer.end());
+
+	std::vector<uint64_t> values(s.buffer.size());
+	std::transform(s.buffer.begin(), s.buffer.end(), values.begin(), [](std::pair<uint32_t, uint64_t> const &p) { return p.second; });
+	for (size_t i = 0; i < s.buffer.size();)
+	{
+		auto call = s.buffer[i].first;
+		size_t j = i;
+		while (j < s.buffer.size() && s.buffer[j].first == call)
+		{
+			++j;
+		}
+		s.segments[call].push_back({s.size + i * sizeof(uint64_t), j - i});
+		i = j;
+	}
+
+	write_values(s.fd, s.size, values.data(), values.size());
+	s.size += values.size() * sizeof(uint64_t);
+	s.buffer.clear();
+}
+
+void close_spill(spill_t &s)
+{
+	close(s.fd);
+	s.fd = -1;
+	s.buffer.clear();
+	s.buffer.shrink_to_fit();
+	s.segments.clear();
+}
+
+typedef struct __run_reader
+{
+	int fd;
+	uint64_t offset; // Byte offset of the next value that is not in values
+	uint64_t remaining; // Values that are not in values yet
+	std::vector<uint64_t> values;
+	size_t next; // Next value in values
+} run_reader_t;
+
+/**
+ * @brief Refills the buffer of a reader. Exits on errors.
+ * @return false, if the run is exhausted
+ */
+static bool refill(run_reader_t &r)
+{
+	if (r.remaining == 0)
+	{
+		return false;
+	}
+	auto count = std::min(r.remaining, (uint64_t)SPILL_READ_VALUES);
+	r.values.resize(count);
+	auto bytes = count * sizeof(uint64_t);
+	auto data = reinterpret_cast<char *>(r.values.data());
+	for (size_t done = 0; done < bytes;)
+	{
+		auto n = pread(r.fd, data + done, bytes - done, static_cast<off_t>(r.offset + done));
+		if (n <= 0)
+		{
+			printf("/!\\ Could not read spill file: %s\n", n < 0 ? strerror(errno) : "unexpected end");
+			exit(-1);
+		}
+		done += static_cast<size_t>(n);
+	}
+	r.offset += bytes;
+	r.remaining -= count;
+	r.next = 0;
+	return true;
+}
+
+/**
+ * @brief Merges the given runs and hands the values to consume(values, count) in ascending order, in blocks of up to SPILL_READ_VALUES.
+ * @param readers Readers of the runs, their buffers are filled here
+ * @param consume
+ */
+static void merge_readers(std::vector<run_reader_t> &readers, std::function<void(uint64_t const *, size_t)> const &consume)
+{
+	auto greater = [&readers](size_t a, size_t b) { return readers[a].values[readers[a].next] > readers[b].values[readers[b].next]; };
+	std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+	for (size_t i = 0; i < readers.size(); ++i)
+	{
+		if (refill(readers[i]))
+		{
+			heap.push(i);
+		}
+	}
+
+	std::vector<uint64_t> block;
+	block.reserve(SPILL_READ_VALUES);
+	while (!heap.empty())
+	{
+		auto i = heap.top();
+		heap.pop();
+		auto &r = readers[i];
+		block.push_back(r.values[r.next++]);
+		if (block.size() == SPILL_READ_VALUES)
+		{
+			consume(block.data(), block.size());
+			block.clear();
+		}
+		if (r.next < r.values.size() || refill(r))
+		{
+			heap.push(i);
+		}
+	}
+	if (!block.empty())
+	{
+		consume(block.data(), block.size());
+	}
+}
+
+/**
+ * @brief Merges all sorted runs of a call from the given spills and hands the values to consume(values, count) in ascending order, in blocks of up to SPILL_READ_VALUES.
+ * At most SPILL_MERGE_RUNS runs are merged at once, so the read buffers stay bounded however long the trace is. Calls with more runs are merged in several passes,
+ * each pass merges groups of runs into longer runs in a temporary file in @p dir.
+ * Only reads the spills, so several calls can be merged in parallel. The spills must be flushed.
+ * @param spills The spills holding the runs, e.g. one per loader thread
+ * @param call Index of the call
+ * @param dir Folder for the temporary file of the intermediate runs
+ * @param consume Called with every block of merged values
+ */
+void merge_runs(std::vector<spill_t *> const &spills, uint32_t call, std::string const &dir, std::function<void(uint64_t const *, size_t)> const &consume)
+{
+	std::vector<run_reader_t> readers;
+	for (auto s : spills)
+	{
+		for (auto const &segment : s->segments[call])
+		{
+			readers.push_back({s->fd, segment.offset, segment.count, std::vector<uint64_t>(), 0});
+		}
+	}
+
+	int fd = -1;
+	uint64_t size = 0;
+	while (readers.size() > SPILL_MERGE_RUNS)
+	{
+		if (fd < 0)
+		{
+			fd = create_spill_file(dir);
+		}
+		std::vector<run_reader_t> merged;
+		for (size_t first = 0; first < readers.size(); first += SPILL_MERGE_RUNS)
+		{
+			auto last = std::min(readers.size(), first + SPILL_MERGE_RUNS);
+			if (last - first == 1)
+			{
+				merged.push_back(std::move(readers[first]));
+				continue;
+			}
+			std::vector<run_reader_t> group(std::make_move_iterator(readers.begin() + first), std::make_move_iterator(readers.begin() + last));
+			run_reader_t run = {fd, size, 0, std::vector<uint64_t>(), 0};
+			merge_readers(group, [&](uint64_t const *values, size_t count) {
+				write_values(fd, size, values, count);
+				size += count * sizeof(uint64_t);
+				run.remaining += count;
+			});
+			merged.push_back(std::move(run));
+		}
+		readers.swap(merged);
+	}
+
+	merge_readers(readers, consume);
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+}
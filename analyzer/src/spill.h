@@ -0,0 +1,54 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_SPILL_H
+#define SGX_PERF_SPILL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+
+/**
+ * @brief Number of values a spill buffers before it writes them as a sorted run
+ */
+#define SPILL_BUFFER_VALUES (1 << 20)
+
+/**
+ * @brief Number of values read at once from every run while merging
+ */
+#define SPILL_READ_VALUES 4096
+
+/**
+ * @brief Largest number of runs that are merged at once, each with a read buffer of SPILL_READ_VALUES
+ */
+#define SPILL_MERGE_RUNS 64
+
+typedef struct __spill_segment
+{
+	uint64_t offset; // Byte offset of the values in the spill file
+	uint64_t count; // Number of values
+} spill_segment_t;
+
+/**
+ * @brief Values of many ECalls/OCalls that are kept in sorted runs in a temporary file.
+ * Values are buffered until SPILL_BUFFER_VALUES are reached, then sorted by call and value and appended to the file as one run.
+ */
+typedef struct __spill
+{
+	int fd; // Temporary file, already unlinked
+	uint64_t size; // Bytes written to the file
+	std::vector<std::pair<uint32_t, uint64_t>> buffer; // Values that have not been written yet, with the index of their call
+	std::vector<std::vector<spill_segment_t>> segments; // Sorted segments of every call, indexed like call_list
+} spill_t;
+
+void open_spill(spill_t &s, std::string const &dir, size_t calls);
+void spill_value(spill_t &s, uint32_t call, uint64_t value);
+void flush_spill(spill_t &s);
+void close_spill(spill_t &s);
+void merge_runs(std::vector<spill_t *> const &spills, uint32_t call, std::string const &dir, std::function<void(uint64_t const *, size_t)> const &consume);
+
+#endif //SGX_PERF_SPILL_H
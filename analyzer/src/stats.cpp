@@ -0,0 +1,392 @@
+/**
+ * @author weichbr
+ */
+
+#include "main.h"
+
+#include <cmath>
+
+void init_stats_acc(stats_acc_t &acc)
+{
+	acc = {};
+	acc.min = UINT64_MAX;
+}
+
+/**
+ * @brief Adds the given values to the sums of an accumulator in a single pass: count, sum, sum of squares, min, max and the counts below every bucket bound
+ * and below the fixed thresholds of the recommendations.
+ * @param acc
+ * @param values
+ * @param n Number of values
+ * @param limit Only values up to this limit are included
+ */
+void accumulate_stats(stats_acc_t &acc, uint64_t const *values, size_t n, uint64_t limit)
+{
+	auto &buckets = config.buckets;
+	uint64_t count = 0, sum = 0, min = acc.min, max = acc.max;
+	uint64_t less_1us = 0, less_5us = 0, less_10us = 0;
+	unsigned __int128 sq_sum = 0;
+	uint64_t below[MAX_BUCKETS] = {};
+
+	for (size_t i = 0; i < n; ++i)
+	{
+		uint64_t v = values[i];
+		uint64_t in = v <= limit;
+		uint64_t w = in ? v : 0;
+		count += in;
+		sum += w;
+		sq_sum += (unsigned __int128)w * w;
+		min = in && v < min ? v : min;
+		max = w > max ? w : max;
+		less_1us += in & (v < 1000);
+		less_5us += in & (v < 5000);
+		less_10us += in & (v < 10000);
+		for (size_t b = 0; b < buckets.count; ++b)
+		{
+			below[b] += in & (v < buckets.bounds[b]);
+		}
+	}
+
+	acc.count += count;
+	acc.sum += sum;
+	acc.sq_sum += sq_sum;
+	acc.min = min;
+	acc.max = max;
+	acc.num_less_1us += less_1us;
+	acc.num_less_5us += less_5us;
+	acc.num_less_10us += less_10us;
+	for (size_t b = 0; b < MAX_BUCKETS; ++b)
+	{
+		acc.below[b] += below[b];
+	}
+}
+
+void merge_stats_acc(stats_acc_t &into, stats_acc_t const &other)
+{
+	into.count += other.count;
+	into.sum += other.sum;
+	into.sq_sum += other.sq_sum;
+	into.min = std::min(into.min, other.min);
+	into.max = std::max(into.max, other.max);
+	into.num_less_1us += other.num_less_1us;
+	into.num_less_5us += other.num_less_5us;
+	into.num_less_10us += other.num_less_10us;
+	for (size_t b = 0; b < MAX_BUCKETS; ++b)
+	{
+		into.below[b] += other.below[b];
+	}
+}
+
+/**
+ * @brief Derives the statistics from the sums of an accumulator. Only s.aexs is left untouched.
+ * @param s
+ * @param acc
+ */
+void finish_stats(stats_t &s, stats_acc_t const &acc)
+{
+	s.calls = acc.count;
+	s.sum = acc.sum;
+	s.min = acc.count > 0 ? acc.min : 0;
+	s.max = acc.max;
+	std::copy(acc.below, acc.below + MAX_BUCKETS, s.below);
+	s.num_less_1us = acc.num_less_1us;
+	s.num_less_5us = acc.num_less_5us;
+	s.num_less_10us = acc.num_less_10us;
+	if (acc.count == 0)
+	{
+		s.avg = 0;
+		s.sq_sum = 0;
+		s.std = 0;
+		return;
+	}
+
+	// Squared deviation from the (integer) average: sum((v - avg)^2) = sum(v^2) - 2 * avg * sum(v) + n * avg^2
+	s.avg = acc.sum / acc.count;
+	unsigned __int128 avg = s.avg;
+	s.sq_sum = (uint64_t)(acc.sq_sum - 2 * avg * acc.sum + acc.count * avg * avg);
+	s.std = (uint64_t)std::sqrt(s.sq_sum / s.calls);
+}
+
+/**
+ * @brief Computes the statistics of the given values in a single pass, see accumulate_stats(). Only s.aexs is left untouched.
+ * @param s
+ * @param values
+ * @param n Number of values
+ * @param limit Only values up to this limit are included
+ */
+void calc_stats(stats_t &s, uint64_t const *values, size_t n, uint64_t limit)
+{
+	stats_acc_t acc;
+	init_stats_acc(acc);
+	accumulate_stats(acc, values, n, limit);
+	finish_stats(s, acc);
+}
+
+/**
+ * @brief Counts a single value into the counts below every bucket bound.
+ * @param below
+ * @param value
+ */
+void count_bucket(uint64_t *below, uint64_t value)
+{
+	auto &buckets = config.buckets;
+	for (size_t b = 0; b < buckets.count; ++b)
+	{
+		below[b] += value < buckets.bounds[b];
+	}
+}
+
+/**
+ * @brief Returns the bound of a bucket for printing, e.g. "5µs"
+ * @param bucket
+ */
+std::string bucketname(size_t bucket)
+{
+	auto ns = config.buckets.bounds[bucket];
+	std::stringstream ss;
+	if (ns % 1000 == 0)
+	{
+		ss << ns / 1000 << "µs";
+	}
+	else
+	{
+		ss << ns << "ns";
+	}
+	return ss.str();
+}
+
+/**
+ * @brief Parses a comma separated list of bucket bounds in µs, e.g. "1,5,10,20,100".
+ * @param list
+ * @param buckets
+ * @return false, if the list is empty, too long or not ascending
+ */
+bool parse_buckets(std::string const &list, buckets_t &buckets)
+{
+	buckets_t parsed = {};
+	std::stringstream ss(list);
+	std::string token;
+	while (std::getline(ss, token, ','))
+	{
+		if (token.empty())
+		{
+			continue;
+		}
+		if (parsed.count == MAX_BUCKETS)
+		{
+			return false;
+		}
+		auto us = strtod(token.c_str(), nullptr);
+		if (us <= 0)
+		{
+			return false;
+		}
+		auto ns = static_cast<uint64_t>(std::llround(us * 1000));
+		if (ns == 0 || (parsed.count > 0 && ns <= parsed.bounds[parsed.count - 1]))
+		{
+			return false;
+		}
+		parsed.bounds[parsed.count++] = ns;
+	}
+	if (parsed.count == 0)
+	{
+		return false;
+	}
+	buckets = parsed;
+	return true;
+}
+
+double const quantile_levels[QUANTILE_COUNT] = {0.50, 0.75, 0.95, 0.99, 0.999};
+
+/**
+ * @brief Index of the value at the given quantile level in n sorted values, see percentile_idx().
+ * @param level
+ * @param n
+ */
+uint64_t quantile_rank(double level, size_t n)
+{
+	return static_cast<uint64_t>(std::min(std::ceil(level * n), (double)(n - 1)));
+}
+
+/**
+ * @brief Selects the exact values at all quantile levels with a chain of nth_element() calls, each on the part above the previous one.
+ * Afterwards the values are partitioned at every quantile rank and the largest value is last, so the first quantile_rank() values are the smallest ones.
+ * @param q
+ * @param values Reordered in place
+ * @param n
+ */
+void exact_quantiles(quantiles_t &q, uint64_t *values, size_t n)
+{
+	q = {};
+	if (n == 0)
+	{
+		return;
+	}
+
+	auto first = values;
+	for (size_t i = 0; i < QUANTILE_COUNT; ++i)
+	{
+		auto nth = values + quantile_rank(quantile_levels[i], n);
+		if (nth >= first)
+		{
+			std::nth_element(first, nth, values + n);
+			first = nth + 1;
+		}
+		q.value[i] = *nth;
+	}
+	if (first < values + n)
+	{
+		std::iter_swap(std::max_element(first, values + n), values + n - 1);
+	}
+}
+
+/**
+ * @brief Maps a value to its sketch bucket. Values below 2^(SKETCH_SUB_BITS+1) get their own bucket, larger ones share a bucket with values that have the same SKETCH_SUB_BITS+1 leading bits.
+ */
+static inline uint64_t sketch_bucket(uint64_t value)
+{
+	uint64_t e = 63 - __builtin_clzll(value | 1);
+	uint64_t shift = e > SKETCH_SUB_BITS ? e - SKETCH_SUB_BITS : 0;
+	return (shift << SKETCH_SUB_BITS) + (value >> shift);
+}
+
+/**
+ * @brief Returns the midpoint of the values in a sketch bucket.
+ */
+static uint64_t sketch_value(uint64_t bucket)
+{
+	uint64_t shift = bucket < (2 << SKETCH_SUB_BITS) ? 0 : (bucket >> SKETCH_SUB_BITS) - 1;
+	uint64_t low = (bucket - (shift << SKETCH_SUB_BITS)) << shift;
+	return low + (((uint64_t)1 << shift) - 1) / 2;
+}
+
+void init_sketch(sketch_t &s)
+{
+	s.count = 0;
+	s.min = UINT64_MAX;
+	s.max = 0;
+	s.buckets.assign(SKETCH_BUCKETS, 0);
+}
+
+void add_to_sketch(sketch_t &s, uint64_t const *values, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		uint64_t v = values[i];
+		s.buckets[sketch_bucket(v)]++;
+		s.min = v < s.min ? v : s.min;
+		s.max = v > s.max ? v : s.max;
+	}
+	s.count += n;
+}
+
+void merge_sketch(sketch_t &into, sketch_t const &other)
+{
+	for (size_t b = 0; b < SKETCH_BUCKETS; ++b)
+	{
+		into.buckets[b] += other.buckets[b];
+	}
+	into.count += other.count;
+	into.min = std::min(into.min, other.min);
+	into.max = std::max(into.max, other.max);
+}
+
+/**
+ * @brief Number of values above which sketch_values() splits the values into chunks that are sketched in parallel and merged.
+ */
+#define SKETCH_CHUNK (1 << 22)
+
+/**
+ * @brief Builds the sketch of the given values. Large inputs are split into chunks that are sketched in parallel and merged afterwards.
+ * @param s
+ * @param values
+ * @param n
+ */
+void sketch_values(sketch_t &s, uint64_t const *values, size_t n)
+{
+	init_sketch(s);
+	if (n <= SKETCH_CHUNK)
+	{
+		add_to_sketch(s, values, n);
+		return;
+	}
+
+	std::vector<sketch_t> chunks((n + SKETCH_CHUNK - 1) / SKETCH_CHUNK);
+	parallel_for(0, chunks.size(), 1, [&chunks, values, n](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i)
+		{
+			auto offset = i * SKETCH_CHUNK;
+			init_sketch(chunks[i]);
+			add_to_sketch(chunks[i], values + offset, std::min((size_t)SKETCH_CHUNK, n - offset));
+		}
+	});
+	for (auto const &chunk : chunks)
+	{
+		merge_sketch(s, chunk);
+	}
+}
+
+/**
+ * @brief Reads all quantiles from a sketch in a single walk over its buckets.
+ * Every value is the midpoint of its bucket, clamped to the observed minimum and maximum, so it is off by at most half a bucket width.
+ * @param q
+ * @param s
+ */
+void sketch_quantiles(quantiles_t &q, sketch_t const &s)
+{
+	q = {};
+	q.error = 1.0 / (2 << SKETCH_SUB_BITS);
+	if (s.count == 0)
+	{
+		return;
+	}
+
+	uint64_t seen = 0;
+	size_t i = 0;
+	for (size_t b = 0; b < SKETCH_BUCKETS && i < QUANTILE_COUNT; ++b)
+	{
+		seen += s.buckets[b];
+		while (i < QUANTILE_COUNT && quantile_rank(quantile_levels[i], s.count) < seen)
+		{
+			q.value[i++] = std::min(std::max(sketch_value(b), s.min), s.max);
+		}
+	}
+}
+
+/**
+ * @brief Estimates the running sums of the values up to the given limit from a sketch, taking every value as the midpoint of its bucket.
+ * Used where the values themselves are not kept, like in out-of-core mode.
+ * @param acc
+ * @param s
+ * @param limit
+ */
+void sketch_stats(stats_acc_t &acc, sketch_t const &s, uint64_t limit)
+{
+	init_stats_acc(acc);
+	auto &buckets = config.buckets;
+	for (size_t b = 0; b < s.buckets.size(); ++b)
+	{
+		auto n = s.buckets[b];
+		if (n == 0)
+		{
+			continue;
+		}
+		auto v = std::min(std::max(sketch_value(b), s.min), s.max);
+		if (v > limit)
+		{
+			break;
+		}
+		acc.count += n;
+		acc.sum += n * v;
+		acc.sq_sum += (unsigned __int128)n * v * v;
+		acc.min = std::min(acc.min, v);
+		acc.max = std::max(acc.max, v);
+		acc.num_less_1us += v < 1000 ? n : 0;
+		acc.num_less_5us += v < 5000 ? n : 0;
+		acc.num_less_10us += v < 10000 ? n : 0;
+		for (size_t k = 0; k < buckets.count; ++k)
+		{
+			acc.below[k] += v < buckets.bounds[k] ? n : 0;
+		}
+	}
+}
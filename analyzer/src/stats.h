@@ -0,0 +1,118 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_STATS_H
+#define SGX_PERF_STATS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Maximum number of latency buckets
+ */
+#define MAX_BUCKETS 16
+
+/**
+ * @brief Latency buckets, given by their upper bounds in ns in ascending order.
+ */
+typedef struct __buckets
+{
+	size_t count;
+	uint64_t bounds[MAX_BUCKETS];
+} buckets_t;
+
+typedef struct __stats_data
+{
+	uint64_t sum;
+	uint64_t sq_sum;
+	uint64_t avg;
+	uint64_t calls;
+	uint64_t median;
+	uint64_t std;
+	uint64_t aexs;
+	uint64_t min;
+	uint64_t max;
+	uint64_t below[MAX_BUCKETS]; // Number of values below each bucket bound
+	// Fixed thresholds of the recommendations, independent of the buckets
+	uint64_t num_less_1us;
+	uint64_t num_less_5us;
+	uint64_t num_less_10us;
+} stats_t;
+
+/**
+ * @brief Running sums from which stats_t is derived. Accumulators of disjoint values can be merged.
+ */
+typedef struct __stats_acc
+{
+	uint64_t count;
+	uint64_t sum;
+	unsigned __int128 sq_sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t below[MAX_BUCKETS];
+	uint64_t num_less_1us;
+	uint64_t num_less_5us;
+	uint64_t num_less_10us;
+} stats_acc_t;
+
+/**
+ * @brief Number of percentiles reported per call
+ */
+#define QUANTILE_COUNT 5
+
+/**
+ * @brief Sub-buckets per power of two in a percentile sketch. 128 sub-buckets bound the relative error to 1/256.
+ */
+#define SKETCH_SUB_BITS 7
+#define SKETCH_BUCKETS ((64 - SKETCH_SUB_BITS + 1) << SKETCH_SUB_BITS)
+
+/**
+ * @brief Index of the 95% level in quantile_levels
+ */
+#define QUANTILE_95TH 2
+
+/**
+ * @brief Index of the 99% level in quantile_levels
+ */
+#define QUANTILE_99TH 3
+
+extern double const quantile_levels[QUANTILE_COUNT]; // 50%, 75%, 95%, 99% and 99.9%
+
+typedef struct __quantiles
+{
+	uint64_t value[QUANTILE_COUNT]; // Values at quantile_levels
+	double error; // Maximum relative error of the values, 0 if they are exact
+} quantiles_t;
+
+/**
+ * @brief Mergeable log-linear histogram of durations, used to approximate percentiles in a single pass.
+ */
+typedef struct __sketch
+{
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	std::vector<uint64_t> buckets;
+} sketch_t;
+
+void init_stats_acc(stats_acc_t &acc);
+void accumulate_stats(stats_acc_t &acc, uint64_t const *values, size_t n, uint64_t limit = UINT64_MAX);
+void merge_stats_acc(stats_acc_t &into, stats_acc_t const &other);
+void finish_stats(stats_t &s, stats_acc_t const &acc);
+void calc_stats(stats_t &s, uint64_t const *values, size_t n, uint64_t limit = UINT64_MAX);
+void count_bucket(uint64_t *below, uint64_t value);
+std::string bucketname(size_t bucket);
+bool parse_buckets(std::string const &list, buckets_t &buckets);
+uint64_t quantile_rank(double level, size_t n);
+void exact_quantiles(quantiles_t &q, uint64_t *values, size_t n);
+void init_sketch(sketch_t &s);
+void add_to_sketch(sketch_t &s, uint64_t const *values, size_t n);
+void merge_sketch(sketch_t &into, sketch_t const &other);
+void sketch_values(sketch_t &s, uint64_t const *values, size_t n);
+void sketch_quantiles(quantiles_t &q, sketch_t const &s);
+void sketch_stats(stats_acc_t &acc, sketch_t const &s, uint64_t limit);
+
+#endif //SGX_PERF_STATS_H
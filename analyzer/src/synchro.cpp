@@ -6,6 +6,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <iomanip>
 
 extern std::map<uint64_t, enclave_data_t> encls;
 
@@ -23,83 +24,58 @@ uint64_t EnclaveSyncSetEventId = 0;
 
 bool has_sync_ocalls = false;
 
-int ocall_id_callback(void *arg, int count, char **data, char **columns)
+static void ocall_id_callback(id_name_row_t const &row)
 {
-	(void)arg;
-	(void)count;
-	(void)columns;
-	if (hasEnding(std::string(data[1]), "sgx_thread_wait_untrusted_event_ocall"))
+	if (hasEnding(row.name, "sgx_thread_wait_untrusted_event_ocall"))
 	{
-		SgxThreadWaitUntrustedEventOcallId = strtoul(data[0], nullptr, 10);
+		SgxThreadWaitUntrustedEventOcallId = row.id;
 	}
-	else if (hasEnding(std::string(data[1]), "sgx_thread_set_untrusted_event_ocall"))
+	else if (hasEnding(row.name, "sgx_thread_set_untrusted_event_ocall"))
 	{
-		SgxThreadSetUntrustedEventOcallId = strtoul(data[0], nullptr, 10);
+		SgxThreadSetUntrustedEventOcallId = row.id;
 	}
-	else if (hasEnding(std::string(data[1]), "sgx_thread_setwait_untrusted_events_ocall"))
+	else if (hasEnding(row.name, "sgx_thread_setwait_untrusted_events_ocall"))
 	{
-		SgxThreadSetWaitUntrustedEventsOcallId = strtoul(data[0], nullptr, 10);
+		SgxThreadSetWaitUntrustedEventsOcallId = row.id;
 	}
-	else if (hasEnding(std::string(data[1]), "sgx_thread_set_multiple_untrusted_events_ocall"))
+	else if (hasEnding(row.name, "sgx_thread_set_multiple_untrusted_events_ocall"))
 	{
-		SgxThreadSetMultipleUntrustedEventsOcallId = strtoul(data[0], nullptr, 10);
+		SgxThreadSetMultipleUntrustedEventsOcallId = row.id;
 	}
 
 	has_sync_ocalls = true;
-
-	return 0;
 }
 
-int event_id_callback(void *arg, int count, char **data, char **columns)
+static void event_id_callback(id_name_row_t const &row)
 {
-	(void)arg;
-	(void)count;
-	(void)columns;
-	if (hasEnding(std::string(data[1]), "EnclaveSyncWaitEvent"))
+	if (hasEnding(row.name, "EnclaveSyncWaitEvent"))
 	{
-		EnclaveSyncWaitEventId = strtoul(data[0], nullptr, 10);
+		EnclaveSyncWaitEventId = row.id;
 	}
-	else if (hasEnding(std::string(data[1]), "EnclaveSyncSetEvent"))
+	else if (hasEnding(row.name, "EnclaveSyncSetEvent"))
 	{
-		EnclaveSyncSetEventId = strtoul(data[0], nullptr, 10);
+		EnclaveSyncSetEventId = row.id;
 	}
-
-	return 0;
 }
 
 uint64_t found_sync_ocalls = 0;
 
-int found_sync_ocalls_callback(void *arg, int count, char **data, char **columns)
-{
-	(void)arg;
-	(void)count;
-	(void)columns;
-	found_sync_ocalls = strtoul(data[0], nullptr, 10);
-	return 0;
-}
-
 std::vector<sync_event_t> sync_events;
 
-int wait_event_callback(void *arg, int count, char **data, char **columns)
+static void read_wait_event(sqlite3_stmt *stmt, sync_event_t &se)
 {
-	(void) arg;
-	(void) count;
-	(void) columns;
-
-	sync_event_t se = {};
-	se.wait_parent_id = strtoul(data[2], nullptr, 10);
-	se.wait_thread_id = strtoul(data[0], nullptr, 10);
-	se.wait_eid = strtoul(data[1], nullptr, 10);
-	se.has_set = data[3] != nullptr;
+	se = {};
+	se.wait_parent_id = sql_uint(stmt, 2);
+	se.wait_thread_id = sql_uint(stmt, 0);
+	se.wait_eid = sql_uint(stmt, 1);
+	se.has_set = !sql_null(stmt, 3);
 	if (se.has_set)
 	{
-		se.set_parent_id = strtoul(data[5], nullptr, 10);
-		se.set_thread_id = strtoul(data[3], nullptr, 10);
-		se.set_eid = strtoul(data[4], nullptr, 10);
-		se.time = strtoul(data[6], nullptr, 10);
+		se.set_parent_id = sql_uint(stmt, 5);
+		se.set_thread_id = sql_uint(stmt, 3);
+		se.set_eid = sql_uint(stmt, 4);
+		se.time = sql_uint(stmt, 6);
 	}
-	sync_events.push_back(se);
-	return 0;
 }
 
 uint64_t ocall_percentile(double percentile, std::vector<sync_ocall_t *> &vec)
@@ -114,31 +90,27 @@ void print_ocall_percentile(uint8_t percentile, std::vector<sync_ocall_t *> &vec
 	std::cout << "(i) " << (int)percentile << "th percentile:  " << percentile_ns << "ns / " << percentile_us << "µs" << std::endl;
 }
 
-void analyze_synchro()
+/**
+ * @brief Counts the synchronisation OCalls and how fast their wait events were resolved.
+ * @param summary
+ */
+static void collect_synchro(sync_summary_t &summary)
 {
 	std::stringstream ss;
-	std::cout << "=== Analyzing synchronization OCalls" << std::endl;
-
-	ss << "select id, symbol_name from ocalls as oc where symbol_name like \"%sgx_thread%untrusted_event%_ocall\";";
+	summary = {};
 
-	sql_exec(ss, ocall_id_callback);
+	auto call_table = event_table("call_events");
+	auto sync_table = event_table("sync_events");
 
-	if (!has_sync_ocalls)
-	{
-		std::cout << "(i) No sync ocalls found." << std::endl;
-		return;
-	}
-
-	ss << "select COUNT(*) from events as e "
+	ss << "select COUNT(*) from " << call_table << " as e "
 			"where e.type = " << EnclaveOCallEventId << " "
 			   "and e.call_id in (" << SgxThreadWaitUntrustedEventOcallId << ", "
 	   << SgxThreadSetUntrustedEventOcallId << ", "
 	   << SgxThreadSetWaitUntrustedEventsOcallId << ", "
 	   << SgxThreadSetMultipleUntrustedEventsOcallId << ");";
 
-	sql_exec(ss, found_sync_ocalls_callback);
-
-	std::cout << "(i) Found " << found_sync_ocalls << " synchronization OCalls" << std::endl;
+	sql_load<uint64_t>(ss, read_uint_row, [](uint64_t row) { found_sync_ocalls = row; });
+	summary.ocalls = found_sync_ocalls;
 
 	if (found_sync_ocalls == 0)
 	{
@@ -146,23 +118,20 @@ void analyze_synchro()
 	}
 
 	ss << "select id, name from event_map;";
-	sql_exec(ss, event_id_callback);
-
-	ss << "select waitevent.involved_thread as wait_thread, waitevent.eid as wait_eid, ecallwait.call_id as wait_parent_id, ocallset.involved_thread as set_thread, ecallset.eid as set_eid, ecallset.call_id as set_parent_id, (setevent.time - waitevent.time) as resolvetime from events as waitevent\n"
-			"join events as ocallwait on waitevent.call_event = ocallwait.id\n"
-			"join events as ecallwait on ecallwait.id = ocallwait.call_event\n"
-			"left join events as setevent on setevent.arg = waitevent.id\n"
-			"left join events as ocallset on setevent.call_event = ocallset.id\n"
-			"left join events as ecallset on ecallset.id = ocallset.call_event\n"
+	sql_load<id_name_row_t>(ss, read_id_name_row, event_id_callback);
+
+	ss << "select waitevent.involved_thread as wait_thread, waitevent.eid as wait_eid, ecallwait.call_id as wait_parent_id, ocallset.involved_thread as set_thread, ecallset.eid as set_eid, ecallset.call_id as set_parent_id, (setevent.time - waitevent.time) as resolvetime from " << sync_table << " as waitevent\n"
+			"join " << call_table << " as ocallwait on waitevent.call_event = ocallwait.id\n"
+			"join " << call_table << " as ecallwait on ecallwait.id = ocallwait.call_event\n"
+			"left join " << sync_table << " as setevent on setevent.arg = waitevent.id\n"
+			"left join " << call_table << " as ocallset on setevent.call_event = ocallset.id\n"
+			"left join " << call_table << " as ecallset on ecallset.id = ocallset.call_event\n"
 			"where waitevent.type = " << EnclaveSyncWaitEventId << ";";
 
-	sql_exec(ss, wait_event_callback);
-
-	std::cout << sync_events.size() << " wait events" << std::endl;
+	sql_load<sync_event_t>(ss, read_wait_event, [](sync_event_t const &se) { sync_events.push_back(se); });
+	summary.wait_events = sync_events.size();
 
-	uint64_t num_less_1us = 0, num_less_5us = 0, num_less_10us = 0, num_less_20us = 0, num_less_100us = 0;
-
-	std::for_each(sync_events.begin(), sync_events.end(), [&num_less_1us, &num_less_5us, &num_less_10us, &num_less_20us, &num_less_100us](sync_event_t &se) {
+	std::for_each(sync_events.begin(), sync_events.end(), [&summary](sync_event_t &se) {
 		auto wcd = encls[se.wait_eid].ecalls[se.wait_parent_id];
 		//std::cout << "{" << se.wait_thread_id << "} " << "[" << se.wait_parent_id << "] " << *wcd->name;
 		if (se.has_set)
@@ -170,28 +139,53 @@ void analyze_synchro()
 			auto scd = encls[se.wait_eid].ecalls[se.wait_parent_id];
 			//std::cout << " --(" << timeformat(se.time, true) << ")-> " << "{" << se.set_thread_id << "} " << "[" << se.set_parent_id << "] " << *scd->name;
 
-			if (se.time < 1000)
-			{
-				num_less_1us++;
-			}
-			else if (se.time < 5000)
-				num_less_5us++;
-			else if (se.time < 10000)
-				num_less_10us++;
-			else if (se.time < 20000)
-				num_less_20us++;
-			else if (se.time < 100000)
-				num_less_100us++;
-
+			count_bucket(summary.below, se.time);
 		}
 		//std::cout << std::endl;
 	});
+}
 
-	std::cout << "<   1µs : " << countformat(num_less_1us, sync_events.size(), true) << std::endl;
-	std::cout << "<   5µs : " << countformat(num_less_5us, sync_events.size(), true) << std::endl;
-	std::cout << "<  10µs : " << countformat(num_less_10us, sync_events.size(), true) << std::endl;
-	std::cout << "<  20µs : " << countformat(num_less_20us, sync_events.size(), true) << std::endl;
-	std::cout << "< 100µs : " << countformat(num_less_100us, sync_events.size(), true) << std::endl;
+void analyze_synchro()
+{
+	std::stringstream ss;
+	std::cout << "=== Analyzing synchronization OCalls" << std::endl;
+
+	ss << "select id, symbol_name from ocalls as oc where symbol_name like \"%sgx_thread%untrusted_event%_ocall\";";
+
+	sql_load<id_name_row_t>(ss, read_id_name_row, ocall_id_callback);
+
+	if (!has_sync_ocalls)
+	{
+		std::cout << "(i) No sync ocalls found." << std::endl;
+		report_sync({});
+		return;
+	}
+
+	sync_summary_t summary;
+	if (load_cached_sync(summary))
+	{
+		std::cout << "iii Loaded synchronization statistics from cache" << std::endl;
+	}
+	else
+	{
+		collect_synchro(summary);
+		store_cached_sync(summary);
+	}
+	report_sync(summary);
+
+	std::cout << "(i) Found " << summary.ocalls << " synchronization OCalls" << std::endl;
+
+	if (summary.ocalls == 0)
+	{
+		return;
+	}
+
+	std::cout << summary.wait_events << " wait events" << std::endl;
+
+	for (size_t b = 0; b < config.buckets.count; ++b)
+	{
+		std::cout << "< " << std::setw(6) << bucketname(b) << " : " << countformat(summary.below[b], summary.wait_events, true) << std::endl;
+	}
 
 
 }
@@ -0,0 +1,349 @@
+/**
+ * @author weichbr
+ */
+
+#include "main.h"
+#include "timeline.h"
+
+#include <iomanip>
+#include <numeric>
+
+extern std::map<uint64_t, enclave_data_t> encls;
+extern general_data_t general_data;
+extern call_store_t call_store;
+extern std::vector<call_data_t *> call_list;
+
+/**
+ * Time series
+ *
+ * Splits the calls into time windows of "--bucket" by their start time and computes rates, percentiles and AEX rates per window.
+ * Consecutive windows with a similar ECall mix, rate and latency form a phase, e.g. warm-up, steady state and shutdown.
+ */
+
+/**
+ * @brief Rate per second of a count over a time span.
+ */
+static double per_second(uint64_t count, uint64_t length)
+{
+	return length > 0 ? count * 1e9 / length : 0;
+}
+
+/**
+ * @brief Duration as an argument of "--window", e.g. "3s" or "250ms".
+ */
+static std::string durationarg(uint64_t ns)
+{
+	std::stringstream ss;
+	if (ns % 1000000000 == 0)
+		ss << ns / 1000000000 << "s";
+	else if (ns % 1000000 == 0)
+		ss << ns / 1000000 << "ms";
+	else if (ns % 1000 == 0)
+		ss << ns / 1000 << "us";
+	else
+		ss << ns;
+	return ss.str();
+}
+
+/**
+ * @brief Splits the calls of the call store into the time windows.
+ * @param timeline
+ * @param order Set to the indices of all calls, ordered by window and ECall/OCall
+ * @param bounds Set to the offset of every window in order, and the end of the last one
+ */
+static void fill_windows(timeline_t &timeline, std::vector<uint32_t> &order, std::vector<size_t> &bounds)
+{
+	auto &cs = call_store;
+	auto runtime = general_data.endtime > general_data.starttime ? general_data.endtime - general_data.starttime : 0;
+	size_t count = std::max((size_t)1, static_cast<size_t>((runtime + timeline.width - 1) / timeline.width));
+
+	std::vector<uint32_t> window(cs.start.size());
+	parallel_for(0, cs.start.size(), 65536, [&window, &cs, &timeline, count](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i)
+		{
+			auto offset = cs.start[i] > general_data.starttime ? cs.start[i] - general_data.starttime : 0;
+			window[i] = static_cast<uint32_t>(std::min(count - 1, static_cast<size_t>(offset / timeline.width)));
+		}
+	});
+
+	order.resize(cs.start.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&window, &cs](uint32_t a, uint32_t b) {
+		return window[a] != window[b] ? window[a] < window[b] : cs.call[a] < cs.call[b];
+	});
+
+	bounds.assign(count + 1, order.size());
+	for (size_t i = order.size(); i > 0; --i)
+	{
+		bounds[window[order[i - 1]]] = i - 1;
+	}
+	for (size_t w = count; w > 0; --w)
+	{
+		bounds[w - 1] = std::min(bounds[w - 1], bounds[w]);
+	}
+
+	timeline.windows.resize(count);
+	parallel_for(0, count, 1, [&timeline, &order, &bounds, &cs, runtime](size_t begin, size_t end) {
+		std::vector<uint64_t> ecall_durations;
+		std::vector<uint64_t> durations;
+		for (auto w = begin; w < end; ++w)
+		{
+			auto &tw = timeline.windows[w];
+			auto offset = w * timeline.width;
+			tw.start = config.window_start + offset;
+			tw.length = std::min(timeline.width, runtime > offset ? runtime - offset : 0);
+			ecall_durations.clear();
+
+			// The calls of every ECall/OCall are next to each other in order
+			for (auto i = bounds[w]; i < bounds[w + 1];)
+			{
+				auto call = cs.call[order[i]];
+				auto c = call_list[call];
+				window_call_t wc = {};
+				wc.call = call;
+				durations.clear();
+				for (; i < bounds[w + 1] && cs.call[order[i]] == call; ++i)
+				{
+					durations.push_back(cs.duration[order[i]]);
+					if (c->type == call_type_t::ECALL)
+					{
+						wc.aexs += cs.aex_count[order[i]];
+						ecall_durations.push_back(cs.duration[order[i]]);
+					}
+				}
+				wc.calls = durations.size();
+				exact_quantiles(wc.quantiles, durations.data(), durations.size());
+				if (c->type == call_type_t::ECALL)
+					tw.ecalls += wc.calls;
+				else
+					tw.ocalls += wc.calls;
+				tw.aexs += wc.aexs;
+				tw.calls.push_back(wc);
+			}
+			exact_quantiles(tw.ecall_quantiles, ecall_durations.data(), ecall_durations.size());
+		}
+	});
+}
+
+/**
+ * @brief Total variation distance between the ECall mix of a time window and the calls per ECall of a phase.
+ */
+static double mix_distance(time_window_t const &tw, std::vector<uint64_t> const &phase_mix, uint64_t phase_ecalls)
+{
+	double distance = 0;
+	std::vector<double> window_share(phase_mix.size(), 0);
+	for (auto &wc : tw.calls)
+	{
+		if (call_list[wc.call]->type == call_type_t::ECALL)
+			window_share[wc.call] = static_cast<double>(wc.calls) / tw.ecalls;
+	}
+	for (size_t c = 0; c < phase_mix.size(); ++c)
+	{
+		distance += std::fabs(window_share[c] - static_cast<double>(phase_mix[c]) / phase_ecalls);
+	}
+	return distance / 2;
+}
+
+static bool differs_by(double a, double b, double factor)
+{
+	return std::max(a, b) > factor * std::min(a, b);
+}
+
+/**
+ * @brief Fills in the totals, percentiles and ECall mix of a phase once its last window is known.
+ */
+static void finish_phase(timeline_t &timeline, phase_t &phase, std::vector<uint64_t> const &phase_mix, std::vector<uint32_t> const &order, std::vector<size_t> const &bounds)
+{
+	auto &first = timeline.windows[phase.first];
+	auto &last = timeline.windows[phase.last - 1];
+	phase.start = first.start;
+	phase.length = last.start + last.length - first.start;
+
+	std::vector<uint64_t> durations;
+	for (auto i = bounds[phase.first]; i < bounds[phase.last]; ++i)
+	{
+		if (call_list[call_store.call[order[i]]]->type == call_type_t::ECALL)
+			durations.push_back(call_store.duration[order[i]]);
+	}
+	exact_quantiles(phase.ecall_quantiles, durations.data(), durations.size());
+
+	for (size_t c = 0; c < phase_mix.size(); ++c)
+	{
+		if (phase_mix[c] > 0)
+			phase.mix.emplace_back(static_cast<uint32_t>(c), phase_mix[c]);
+	}
+	std::stable_sort(phase.mix.begin(), phase.mix.end(), [](std::pair<uint32_t, uint64_t> const &a, std::pair<uint32_t, uint64_t> const &b) { return a.second > b.second; });
+}
+
+/**
+ * @brief Groups the time windows into phases.
+ * Every window is compared with the phase so far. If its ECall mix, ECall rate or median ECall duration differ too much, it starts a new phase.
+ * Windows with few ECalls only start a new phase by their rate, so that sparse traces are not split by noise.
+ */
+static void detect_phases(timeline_t &timeline, std::vector<uint32_t> const &order, std::vector<size_t> const &bounds)
+{
+	std::vector<uint64_t> phase_mix(call_list.size(), 0);
+	phase_t phase = {};
+	double latency_sum = 0; // Median ECall duration of the windows, weighted by their ECalls
+
+	for (size_t w = 0; w < timeline.windows.size(); ++w)
+	{
+		auto &tw = timeline.windows[w];
+		if (w > phase.first)
+		{
+			auto length = tw.length > 0 ? tw.length : 1;
+			auto phase_length = timeline.windows[w - 1].start + timeline.windows[w - 1].length - timeline.windows[phase.first].start;
+			double rate = per_second(tw.ecalls, length);
+			double phase_rate = per_second(phase.ecalls, phase_length);
+			double expected = phase_rate * length / 1e9;
+			bool enough = tw.ecalls >= PHASE_MIN_CALLS && phase.ecalls >= PHASE_MIN_CALLS;
+
+			bool rate_changed = std::max((double)tw.ecalls, expected) >= PHASE_MIN_CALLS && differs_by(rate, phase_rate, PHASE_RATE_CHANGE);
+			bool mix_changed = enough && mix_distance(tw, phase_mix, phase.ecalls) > PHASE_MIX_CHANGE;
+			bool latency_changed = enough && differs_by(tw.ecall_quantiles.value[0], latency_sum / phase.ecalls, PHASE_LATENCY_CHANGE);
+
+			if (rate_changed || mix_changed || latency_changed)
+			{
+				phase.last = w;
+				finish_phase(timeline, phase, phase_mix, order, bounds);
+				timeline.phases.push_back(phase);
+
+				phase = {};
+				phase.first = w;
+				phase.rate_changed = rate_changed;
+				phase.mix_changed = mix_changed;
+				phase.latency_changed = latency_changed;
+				std::fill(phase_mix.begin(), phase_mix.end(), 0);
+				latency_sum = 0;
+			}
+		}
+
+		phase.ecalls += tw.ecalls;
+		phase.ocalls += tw.ocalls;
+		phase.aexs += tw.aexs;
+		latency_sum += static_cast<double>(tw.ecall_quantiles.value[0]) * tw.ecalls;
+		for (auto &wc : tw.calls)
+		{
+			if (call_list[wc.call]->type == call_type_t::ECALL)
+				phase_mix[wc.call] += wc.calls;
+		}
+	}
+	phase.last = timeline.windows.size();
+	finish_phase(timeline, phase, phase_mix, order, bounds);
+	timeline.phases.push_back(phase);
+
+	// The longest phase with ECalls is taken as steady state, the one with more ECalls on ties
+	timeline.steady = 0;
+	for (size_t p = 1; p < timeline.phases.size(); ++p)
+	{
+		auto &a = timeline.phases[p];
+		auto &b = timeline.phases[timeline.steady];
+		if ((a.ecalls > 0) != (b.ecalls > 0))
+		{
+			if (a.ecalls > 0)
+				timeline.steady = p;
+		}
+		else if (a.length > b.length || (a.length == b.length && a.ecalls > b.ecalls))
+		{
+			timeline.steady = p;
+		}
+	}
+}
+
+static void print_windows(timeline_t const &timeline)
+{
+	std::cout << "(i) Time series, " << timeformat(timeline.width) << " windows" << std::endl;
+	std::cout << "| " << std::setw(10) << "Start" << std::setw(12) << "ECalls/s" << std::setw(12) << "OCalls/s" << std::setw(12) << "AEX/s"
+	          << std::setw(12) << "ECall 50%" << std::setw(12) << "ECall 99%" << "  Top ECall" << std::endl;
+	for (auto &tw : timeline.windows)
+	{
+		std::string top = "-";
+		uint64_t top_calls = 0;
+		for (auto &wc : tw.calls)
+		{
+			if (call_list[wc.call]->type == call_type_t::ECALL && wc.calls > top_calls)
+			{
+				top_calls = wc.calls;
+				top = *call_list[wc.call]->name;
+			}
+		}
+		std::cout << "| " << std::setw(10) << timeformat(tw.start) << std::fixed << std::setprecision(0)
+		          << std::setw(12) << per_second(tw.ecalls, tw.length) << std::setw(12) << per_second(tw.ocalls, tw.length) << std::setw(12) << per_second(tw.aexs, tw.length)
+		          << std::defaultfloat << std::setprecision(6)
+		          << std::setw(12) << (tw.ecalls > 0 ? timeformat(tw.ecall_quantiles.value[0]) : "-")
+		          << std::setw(12) << (tw.ecalls > 0 ? timeformat(tw.ecall_quantiles.value[QUANTILE_99TH]) : "-")
+		          << "  " << top;
+		if (top_calls > 0)
+			std::cout << " (" << top_calls * 100 / tw.ecalls << "%)";
+		std::cout << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+static void print_phases(timeline_t const &timeline)
+{
+	std::cout << "(i) Phases" << std::endl;
+	for (size_t p = 0; p < timeline.phases.size(); ++p)
+	{
+		auto &phase = timeline.phases[p];
+		std::cout << "/ " << WHITE() << "Phase " << (p + 1) << NORMAL() << ": " << timeformat(phase.start) << " to " << timeformat(phase.start + phase.length)
+		          << " (" << (phase.last - phase.first) << (phase.last - phase.first == 1 ? " window)" : " windows)") << (p == timeline.steady ? " - steady state" : "") << std::endl;
+		if (p > 0)
+		{
+			std::vector<std::string> reasons;
+			if (phase.mix_changed)
+				reasons.emplace_back("ECall mix");
+			if (phase.rate_changed)
+				reasons.emplace_back("ECall rate");
+			if (phase.latency_changed)
+				reasons.emplace_back("ECall latency");
+			std::cout << "| " << YELLOW() << "Changed: ";
+			for (size_t r = 0; r < reasons.size(); ++r)
+				std::cout << (r > 0 ? ", " : "") << reasons[r];
+			std::cout << NORMAL() << std::endl;
+		}
+		std::cout << std::fixed << std::setprecision(0)
+		          << "| ECalls/s: " << per_second(phase.ecalls, phase.length) << ", OCalls/s: " << per_second(phase.ocalls, phase.length) << ", AEX/s: " << per_second(phase.aexs, phase.length)
+		          << std::defaultfloat << std::setprecision(6) << std::endl;
+		if (phase.ecalls > 0)
+		{
+			std::cout << "| ECall 50% / 99%: " << timeformat(phase.ecall_quantiles.value[0]) << " / " << timeformat(phase.ecall_quantiles.value[QUANTILE_99TH]) << std::endl;
+			std::cout << "| ECall mix:";
+			for (size_t m = 0; m < phase.mix.size() && m < 3; ++m)
+			{
+				std::cout << (m > 0 ? "," : "") << " " << *call_list[phase.mix[m].first]->name << " " << phase.mix[m].second * 100 / phase.ecalls << "%";
+			}
+			std::cout << std::endl;
+		}
+		std::cout << "\\ ___" << std::endl;
+	}
+	if (timeline.phases.size() > 1)
+	{
+		auto &steady = timeline.phases[timeline.steady];
+		// The last phase runs until the end of the trace, so its window is left open
+		std::cout << "Analyse the steady state alone with --window " << durationarg(steady.start) << ":"
+		          << (timeline.steady + 1 < timeline.phases.size() ? durationarg(steady.start + steady.length) : "") << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+/**
+ * @brief Prints the time series and phases of the calls. Needs the call store, so it is not available out of core.
+ */
+void analyze_timeline()
+{
+	std::cout << "iii Building time series" << std::endl << std::flush;
+
+	timeline_t timeline;
+	timeline.width = config.time_bucket;
+	std::vector<uint32_t> order;
+	std::vector<size_t> bounds;
+	fill_windows(timeline, order, bounds);
+	detect_phases(timeline, order, bounds);
+
+	print_windows(timeline);
+	print_phases(timeline);
+
+	if (!config.report.empty())
+		report_timeline(timeline);
+}
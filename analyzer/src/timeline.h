@@ -0,0 +1,83 @@
+/**
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_TIMELINE_H
+#define SGX_PERF_TIMELINE_H
+
+#include <cstdint>
+#include <vector>
+#include "stats.h"
+
+/**
+ * @brief A new phase starts when the ECall mix of a time window differs from that of the phase by more than this total variation distance
+ */
+#define PHASE_MIX_CHANGE 0.25
+
+/**
+ * @brief A new phase starts when the ECall rate of a time window differs from that of the phase by more than this factor
+ */
+#define PHASE_RATE_CHANGE 2.0
+
+/**
+ * @brief A new phase starts when the median ECall duration of a time window differs from that of the phase by more than this factor
+ */
+#define PHASE_LATENCY_CHANGE 2.0
+
+/**
+ * @brief Minimum number of ECalls in a time window and its phase to compare them
+ */
+#define PHASE_MIN_CALLS 20
+
+/**
+ * @brief Calls of an ECall/OCall inside a time window.
+ */
+typedef struct __window_call
+{
+	uint32_t call; // Index of the ECall/OCall in call_list
+	uint64_t calls;
+	uint64_t aexs;
+	quantiles_t quantiles;
+} window_call_t;
+
+typedef struct __time_window
+{
+	uint64_t start; // Time after the start of the trace
+	uint64_t length; // The last window may be shorter than the others
+	uint64_t ecalls;
+	uint64_t ocalls;
+	uint64_t aexs;
+	quantiles_t ecall_quantiles; // Durations of all ECalls in the window
+	std::vector<window_call_t> calls; // Only ECalls/OCalls that were called
+} time_window_t;
+
+/**
+ * @brief Consecutive time windows with a similar ECall mix, rate and latency.
+ */
+typedef struct __phase
+{
+	size_t first; // Index of the first time window
+	size_t last; // Index after the last time window
+	uint64_t start; // Time after the start of the trace
+	uint64_t length;
+	uint64_t ecalls;
+	uint64_t ocalls;
+	uint64_t aexs;
+	quantiles_t ecall_quantiles;
+	std::vector<std::pair<uint32_t, uint64_t>> mix; // ECalls by their index in call_list and number of calls, most frequent first
+	bool mix_changed; // The phase started because the ECall mix changed
+	bool rate_changed; // ... because the ECall rate changed
+	bool latency_changed; // ... because the ECall durations changed
+} phase_t;
+
+typedef struct __timeline
+{
+	uint64_t width; // Length of the time windows
+	std::vector<time_window_t> windows;
+	std::vector<phase_t> phases;
+	size_t steady; // Index of the longest phase with ECalls, taken as steady state
+} timeline_t;
+
+void analyze_timeline();
+
+#endif //SGX_PERF_TIMELINE_H
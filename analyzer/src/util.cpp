@@ -103,6 +103,194 @@ void sql_exec(std::stringstream &ss, int (*callback)(void*,int,char**,char**), v
 	ss.str(std::string());
 }
 
+/**
+ * @brief Opens another read-only connection to the analyzed database, e.g. for a worker thread. Exits on errors.
+ */
+sqlite3 *sql_connect()
+{
+	sqlite3 *conn = nullptr;
+	int rc = sqlite3_open_v2(sqlite3_db_filename(db, "main"), &conn, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+	if (rc != SQLITE_OK)
+	{
+		printf("/!\\ Could not open database: %s\n", sqlite3_errmsg(conn));
+		sqlite3_close(conn);
+		exit(-1);
+	}
+	return conn;
+}
+
+/**
+ * @brief Prepares the given SQL query. Exits on errors, like sql_exec().
+ * @param sql
+ */
+sqlite3_stmt *sql_prepare(std::string const &sql)
+{
+	return sql_prepare(db, sql);
+}
+
+/**
+ * @brief Prepares the given SQL query on the given connection. Exits on errors, like sql_exec().
+ * @param conn
+ * @param sql
+ */
+sqlite3_stmt *sql_prepare(sqlite3 *conn, std::string const &sql)
+{
+	sqlite3_stmt *stmt = nullptr;
+	int rc = sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr);
+	if (rc != SQLITE_OK)
+	{
+		printf("/!\\ Could not prepare statement: %s\n", sqlite3_errmsg(conn));
+		printf("Statement was: %s\n", sql.c_str());
+		exit(-1);
+	}
+	return stmt;
+}
+
+/**
+ * @brief Steps a prepared statement to its next row. Exits on errors.
+ * The statement may belong to the connection of a loader thread while other threads still use the main connection, so no connection is closed.
+ * @param stmt
+ * @return true, if a row is available, false if the statement is done
+ */
+bool sql_step(sqlite3_stmt *stmt)
+{
+	int rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW)
+	{
+		return true;
+	}
+	if (rc != SQLITE_DONE)
+	{
+		printf("/!\\ Could not execute statement: %s\n", sqlite3_errmsg(sqlite3_db_handle(stmt)));
+		printf("Statement was: %s\n", sqlite3_sql(stmt));
+		sqlite3_finalize(stmt);
+		exit(-1);
+	}
+	return false;
+}
+
+/**
+ * @brief Reads a text column of the current row, NULL is read as an empty string.
+ * @param stmt
+ * @param column
+ */
+std::string sql_text(sqlite3_stmt *stmt, int column)
+{
+	auto text = sqlite3_column_text(stmt, column);
+	if (text == nullptr)
+	{
+		return std::string();
+	}
+	return std::string(reinterpret_cast<const char *>(text), static_cast<size_t>(sqlite3_column_bytes(stmt, column)));
+}
+
+/**
+ * @brief Reads a row consisting of a single integer, e.g. a count.
+ * @param stmt
+ * @param row
+ */
+void read_uint_row(sqlite3_stmt *stmt, uint64_t &row)
+{
+	row = sql_uint(stmt, 0);
+}
+
+/**
+ * @brief Reads a row of the form (id, name).
+ * @param stmt
+ * @param row
+ */
+void read_id_name_row(sqlite3_stmt *stmt, id_name_row_t &row)
+{
+	row.id = sql_uint(stmt, 0);
+	row.name = sql_text(stmt, 1);
+}
+
+/**
+ * @brief Checks whether the database contains a table or view with the given name.
+ * @param name
+ */
+bool table_exists(const char *name)
+{
+	uint64_t count = 0;
+	std::stringstream ss;
+	ss << "select count(*) from sqlite_master where name = '" << name << "';";
+	sql_load<uint64_t>(ss, read_uint_row, [&count](uint64_t row) { count = row; });
+	return count > 0;
+}
+
+/**
+ * @brief Returns the per-type event table with the given name. Databases before version 2 only have the events table.
+ * @param name
+ */
+std::string event_table(const char *name)
+{
+	return table_exists(name) ? std::string(name) : std::string("events");
+}
+
+/**
+ * @brief Parses a duration with an optional unit (ns, us, µs, ms or s), e.g. "250us" or "1.5ms". Plain numbers are ns.
+ * @param text
+ * @param ns Set to the duration in ns
+ * @return false, if the text is not a non-negative duration
+ */
+bool parse_duration(std::string const &text, uint64_t &ns)
+{
+	char *end = nullptr;
+	double value = strtod(text.c_str(), &end);
+	if (end == text.c_str() || value < 0)
+	{
+		return false;
+	}
+	std::string unit(end);
+	unit.erase(std::remove(unit.begin(), unit.end(), ' '), unit.end());
+	double factor;
+	if (unit.empty() || unit == "ns")
+		factor = 1;
+	else if (unit == "us" || unit == "µs")
+		factor = 1e3;
+	else if (unit == "ms")
+		factor = 1e6;
+	else if (unit == "s")
+		factor = 1e9;
+	else
+		return false;
+	ns = static_cast<uint64_t>(std::llround(value * factor));
+	return true;
+}
+
+/**
+ * @brief Quotes and escapes a string for JSON output.
+ */
+std::string jsonstring(std::string const &s)
+{
+	std::stringstream ss;
+	ss << '"';
+	for (unsigned char ch : s)
+	{
+		switch (ch)
+		{
+			case '"': ss << "\\\""; break;
+			case '\\': ss << "\\\\"; break;
+			case '\n': ss << "\\n"; break;
+			case '\r': ss << "\\r"; break;
+			case '\t': ss << "\\t"; break;
+			default:
+				if (ch < 0x20)
+				{
+					char buf[8];
+					snprintf(buf, sizeof(buf), "\\u%04x", ch);
+					ss << buf;
+				}
+				else
+				{
+					ss << ch;
+				}
+		}
+	}
+	ss << '"';
+	return ss.str();
+}
+
 bool hasEnding (std::string const &fullString, std::string const &ending) {
 	if (fullString.length() >= ending.length()) {
 		return (0 == fullString.compare (fullString.length() - ending.length(), ending.length(), ending));
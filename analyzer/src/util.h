@@ -15,9 +15,11 @@
 #include <iostream>
 #include <set>
 #include "calls.h"
+#include "sqlite3.h"
+#include "pool.h"
 
 bool hasEnding (std::string const &fullString, std::string const &ending);
-template<typename T> uint64_t percentile_idx(double percentile, std::vector<T> &vec)
+template<typename C> uint64_t percentile_idx(double percentile, C const &vec)
 {
 	return static_cast<uint64_t>(std::min(std::ceil(percentile * vec.size()), (double)(vec.size() - 1)));
 }
@@ -29,6 +31,8 @@ template<typename T> uint64_t percentile_idx(double percentile, std::vector<T> *
 
 std::string timeformat(uint64_t ns, bool print_ns = false);
 std::string countformat(uint64_t c, uint64_t m, bool color = false);
+bool parse_duration(std::string const &text, uint64_t &ns);
+std::string jsonstring(std::string const &s);
 
 /*
 char *RED = "\x1b[31m";
@@ -50,54 +54,100 @@ void sql_exec(const char *sql, int (*callback)(void*,int,char**,char**) = nullpt
 void sql_exec(std::string const &sql, int (*callback)(void*,int,char**,char**) = nullptr, void *arg = nullptr);
 void sql_exec(std::stringstream &ss, int (*callback)(void*,int,char**,char**) = nullptr, void *arg = nullptr);
 
-bool skip_call(call_data_t *cd, std::set<uint64_t> &set);
+/**
+ * @brief Number of rows sql_load() fetches before handing them to the consumer.
+ */
+#define SQL_BATCH_ROWS 4096
 
-template <typename Iterator, typename F>
-class for_each_block
+typedef struct __id_name_row
 {
-public :
-	void operator()(Iterator start, Iterator end, F f) {
-		//std::cout << std::this_thread::get_id() << std::endl;
-		//std::this_thread::sleep_for(std::chrono::seconds(5));
-		std::for_each(start, end, [&](auto& x) { f(x); });
-	}
-};
+	uint64_t id;
+	std::string name;
+} id_name_row_t;
+
+sqlite3 *sql_connect();
+sqlite3_stmt *sql_prepare(std::string const &sql);
+sqlite3_stmt *sql_prepare(sqlite3 *conn, std::string const &sql);
+bool sql_step(sqlite3_stmt *stmt);
+std::string sql_text(sqlite3_stmt *stmt, int column);
+void read_uint_row(sqlite3_stmt *stmt, uint64_t &row);
+void read_id_name_row(sqlite3_stmt *stmt, id_name_row_t &row);
 
-template <typename Iterator, typename F>
-void parallel_for_each(Iterator first, Iterator last, F f)
+/**
+ * @brief Reads an integer column without going through its text representation.
+ */
+inline uint64_t sql_uint(sqlite3_stmt *stmt, int column)
 {
-	auto size = std::distance(first, last);
-	if (!size)
-		return;
-	auto min_per_thread = 1;
-	auto max_threads = (size + min_per_thread - 1) / min_per_thread;
-	auto hardware_threads = (long)std::thread::hardware_concurrency();
-
-	auto no_of_threads = std::min(max_threads, hardware_threads != 0 ? hardware_threads : 4);
+	return static_cast<uint64_t>(sqlite3_column_int64(stmt, column));
+}
 
-	auto block_size = size / no_of_threads;
+/**
+ * @brief Checks whether a column of the current row is NULL.
+ */
+inline bool sql_null(sqlite3_stmt *stmt, int column)
+{
+	return sqlite3_column_type(stmt, column) == SQLITE_NULL;
+}
 
-	std::vector<std::thread> vf;
-	vf.reserve(no_of_threads);
-	//Iterator block_start = first;
-	for (int i = 0; i < (no_of_threads - 1); i++)
-	{
-		Iterator end = first;
-		std::advance(end, block_size);
-		vf.push_back(std::move(std::thread(for_each_block<Iterator, F>(),first, end,f)));
-		first = end;
-	}
-	vf.emplace_back(for_each_block<Iterator, F>(), first, last, f);
-	//std::cout << std::endl;
-	//std::cout << vf.size() << std::endl;
-	for(auto& x: vf)
+/**
+ * @brief Executes a prepared statement and finalizes it.
+ * Every row is converted into a T by read(stmt, row). The rows are fetched in batches of SQL_BATCH_ROWS and then handed to consume(row) in order.
+ * @param stmt
+ * @param read
+ * @param consume
+ */
+template<typename T, typename R, typename C>
+void sql_load(sqlite3_stmt *stmt, R read, C consume)
+{
+	std::vector<T> batch;
+	batch.reserve(SQL_BATCH_ROWS);
+	auto flush = [&batch, &consume]() {
+		for (auto const &row : batch)
+		{
+			consume(row);
+		}
+		batch.clear();
+	};
+
+	while (sql_step(stmt))
 	{
-		if (x.joinable())
-			x.join();
-		else
-			std::cout << "threads not joinable " << std::endl;
+		batch.emplace_back();
+		read(stmt, batch.back());
+		if (batch.size() == SQL_BATCH_ROWS)
+		{
+			flush();
+		}
 	}
+	flush();
+
+	sqlite3_finalize(stmt);
+}
+
+/**
+ * @brief Executes the query inside the given string stream on the main database connection, see sql_load(sqlite3_stmt *, R, C).
+ */
+template<typename T, typename R, typename C>
+void sql_load(std::stringstream &ss, R read, C consume)
+{
+	auto stmt = sql_prepare(ss.str());
+	ss.str(std::string());
+	sql_load<T>(stmt, read, consume);
 }
 
+/**
+ * @brief Executes the query inside the given string stream on another connection, e.g. one of sql_connect().
+ */
+template<typename T, typename R, typename C>
+void sql_load(sqlite3 *conn, std::stringstream &ss, R read, C consume)
+{
+	auto stmt = sql_prepare(conn, ss.str());
+	ss.str(std::string());
+	sql_load<T>(stmt, read, consume);
+}
+
+bool table_exists(const char *name);
+std::string event_table(const char *name);
+
+bool skip_call(call_data_t *cd, std::set<uint64_t> &set);
 
 #endif //SGX_PERF_UTIL_H
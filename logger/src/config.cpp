@@ -4,6 +4,7 @@
  */
 
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include "config.h"
 
@@ -17,6 +18,48 @@
 #define TRACE_PAGING_NAME "TracePaging"
 #define USE_SAMPLING_NAME "UseSampling"
 #define BENCHMODE_NAME "Benchmode"
+#define FLIGHT_RECORDER_NAME "FlightRecorder"
+#define FLIGHT_RECORDER_WINDOW_NAME "FlightRecorderWindow"
+#define FLIGHT_RECORDER_THRESHOLD_NAME "FlightRecorderThreshold"
+#define FLIGHT_RECORDER_SIGNAL_NAME "FlightRecorderSignal"
+#define WATCHDOG_NAME "Watchdog"
+#define WATCHDOG_INTERVAL_NAME "WatchdogInterval"
+#define WATCHDOG_THRESHOLD_NAME "WatchdogThreshold"
+#define CALIBRATION_ENCLAVE_NAME "CalibrationEnclave"
+
+/**
+ * @brief Reads an unsigned integer property from the global section of the config file.
+ * @param ini The loaded config file
+ * @param name Name of the property
+ * @param name_length Length of @p name
+ * @param value Pointer to save the parsed value to. Untouched if the property is missing or malformed.
+ * @return true, if the property was found and parsed, false otherwise.
+ */
+static bool read_uint_property(ini_t *ini, char const *name, int name_length, uint64_t *value)
+{
+	int index = ini_find_property(ini, INI_GLOBAL_SECTION, name, name_length);
+	if (index == INI_NOT_FOUND)
+	{
+		return false;
+	}
+
+	char const *string = ini_property_value(ini, INI_GLOBAL_SECTION, index);
+	if (string == nullptr)
+	{
+		return false;
+	}
+
+	char *end = nullptr;
+	uint64_t v = strtoull(string, &end, 10);
+	if (end == string)
+	{
+		std::cout << "/!\\ Ignoring malformed value for " << name << std::endl;
+		return false;
+	}
+
+	*value = v;
+	return true;
+}
 
 /**
  * @brief Initializes config system.
@@ -112,4 +155,76 @@ void sgxperf::Config::init()
 			}
 		}
 	}
+
+	int flight_recorder_index = ini_find_property(ini, INI_GLOBAL_SECTION, FLIGHT_RECORDER_NAME, sizeof(FLIGHT_RECORDER_NAME));
+	if (flight_recorder_index != INI_NOT_FOUND)
+	{
+		char const *flight_recorder_string = ini_property_value(ini, INI_GLOBAL_SECTION, flight_recorder_index);
+		if (flight_recorder_string != nullptr)
+		{
+			if (strncmp("true", flight_recorder_string, 4) == 0)
+			{
+				flight_recorder = true;
+			}
+		}
+	}
+
+	if (flight_recorder)
+	{
+		uint64_t v = 0;
+		if (read_uint_property(ini, FLIGHT_RECORDER_WINDOW_NAME, sizeof(FLIGHT_RECORDER_WINDOW_NAME), &v) && v > 0)
+		{
+			// Window is given in seconds
+			flight_recorder_window = v * 1000000000UL;
+		}
+		if (read_uint_property(ini, FLIGHT_RECORDER_THRESHOLD_NAME, sizeof(FLIGHT_RECORDER_THRESHOLD_NAME), &v))
+		{
+			// Threshold is given in µs
+			flight_recorder_threshold = v * 1000UL;
+		}
+		if (read_uint_property(ini, FLIGHT_RECORDER_SIGNAL_NAME, sizeof(FLIGHT_RECORDER_SIGNAL_NAME), &v) && v > 0 && v < 32)
+		{
+			flight_recorder_signal = static_cast<int>(v);
+		}
+		std::cout << "(i) Enabled flight recorder, keeping the last " << flight_recorder_window / 1000000000UL << "s of events" << std::endl;
+	}
+
+	int watchdog_index = ini_find_property(ini, INI_GLOBAL_SECTION, WATCHDOG_NAME, sizeof(WATCHDOG_NAME));
+	if (watchdog_index != INI_NOT_FOUND)
+	{
+		char const *watchdog_string = ini_property_value(ini, INI_GLOBAL_SECTION, watchdog_index);
+		if (watchdog_string != nullptr)
+		{
+			if (strncmp("true", watchdog_string, 4) == 0)
+			{
+				watchdog = true;
+			}
+		}
+	}
+
+	if (watchdog)
+	{
+		uint64_t v = 0;
+		if (read_uint_property(ini, WATCHDOG_INTERVAL_NAME, sizeof(WATCHDOG_INTERVAL_NAME), &v) && v > 0)
+		{
+			// Interval is given in ms
+			watchdog_interval = v * 1000000UL;
+		}
+		if (read_uint_property(ini, WATCHDOG_THRESHOLD_NAME, sizeof(WATCHDOG_THRESHOLD_NAME), &v) && v > 0)
+		{
+			// Threshold is given in µs
+			watchdog_threshold = v * 1000UL;
+		}
+		std::cout << "(i) Enabled watchdog, snapshotting calls running longer than " << watchdog_threshold / 1000UL << "µs" << std::endl;
+	}
+
+	int calibration_enclave_index = ini_find_property(ini, INI_GLOBAL_SECTION, CALIBRATION_ENCLAVE_NAME, sizeof(CALIBRATION_ENCLAVE_NAME));
+	if (calibration_enclave_index != INI_NOT_FOUND)
+	{
+		char const *calibration_enclave_string = ini_property_value(ini, INI_GLOBAL_SECTION, calibration_enclave_index);
+		if (calibration_enclave_string != nullptr)
+		{
+			calibration_enclave = calibration_enclave_string;
+		}
+	}
 }
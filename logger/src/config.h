@@ -6,6 +6,9 @@
 #ifndef SGX_PERF_CONFIG_H
 #define SGX_PERF_CONFIG_H
 
+#include <cstdint>
+#include <string>
+
 namespace sgxperf
 {
 	/**
@@ -14,7 +17,10 @@ namespace sgxperf
 	class Config
 	{
 	public:
-		Config() : trace_paging(false), record_samples(false), count_aex(false), trace_aex(false), benchmode(false) {};
+		Config() : trace_paging(false), record_samples(false), count_aex(false), trace_aex(false), benchmode(false),
+		           flight_recorder(false), flight_recorder_window(10000000000UL), flight_recorder_threshold(0),
+		           flight_recorder_signal(12), watchdog(false), watchdog_interval(5000000UL),
+		           watchdog_threshold(100000000UL), calibration_enclave() {};
 		~Config() = default;
 		void init();
 
@@ -53,12 +59,63 @@ namespace sgxperf
 		 * @return true, if benchmark mode is enabled, false otherwise.
 		 */
 		bool is_benchmark_mode_enabled() { return benchmode; }
+
+		/**
+		 * @brief In flight recorder mode, every thread only keeps the events of the last window.
+		 * @return true, if flight recorder mode is enabled, false otherwise.
+		 */
+		bool is_flight_recorder_enabled() { return flight_recorder; }
+
+		/**
+		 * @return Length of the flight recorder window in ns.
+		 */
+		uint64_t get_flight_recorder_window() { return flight_recorder_window; }
+
+		/**
+		 * @return ECall duration in ns above which a flight recorder dump is triggered, 0 if disabled.
+		 */
+		uint64_t get_flight_recorder_threshold() { return flight_recorder_threshold; }
+
+		/**
+		 * @return Signal number that triggers a flight recorder dump.
+		 */
+		int get_flight_recorder_signal() { return flight_recorder_signal; }
+
+		/**
+		 * @brief The watchdog snapshots threads that are stuck in a call.
+		 * @return true, if the watchdog is enabled, false otherwise.
+		 */
+		bool is_watchdog_enabled() { return watchdog; }
+
+		/**
+		 * @return Time in ns between two scans of the watchdog.
+		 */
+		uint64_t get_watchdog_interval() { return watchdog_interval; }
+
+		/**
+		 * @return Call duration in ns after which the watchdog takes a snapshot.
+		 */
+		uint64_t get_watchdog_threshold() { return watchdog_threshold; }
+
+		/**
+		 * @brief The calibration enclave is used to measure the cost of empty ECalls and OCalls on startup.
+		 * @return Path to the calibration enclave, empty if calibration is disabled.
+		 */
+		std::string const &get_calibration_enclave() { return calibration_enclave; }
 	private:
 		bool trace_paging;
 		bool record_samples;
 		bool count_aex;
 		bool trace_aex;
 		bool benchmode;
+		bool flight_recorder;
+		uint64_t flight_recorder_window;
+		uint64_t flight_recorder_threshold;
+		int flight_recorder_signal;
+		bool watchdog;
+		uint64_t watchdog_interval;
+		uint64_t watchdog_threshold;
+		std::string calibration_enclave;
 	};
 }
 
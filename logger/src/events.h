@@ -10,6 +10,7 @@
 #include <sgx_eid.h>
 #include <sgx_error.h>
 #include <iostream>
+#include <dlfcn.h>
 
 #include "sqlite3.h"
 #include "urts_calls.h"
@@ -19,6 +20,7 @@
 
 namespace sgxperf
 {
+	class EventWriter;
 
 /**
  * @brief Event type enum. Maps integers to event types for use in database.
@@ -46,9 +48,11 @@ namespace sgxperf
 		EnclaveSyncWaitEvent,
 		EnclaveSyncSetEvent,
 		EnclaveAEXEvent,
+		MarkerEvent,
+		EnclaveCallSnapshotEvent,
 
 		First = (int) Event, ///< Not a real event type but a helper to get the first element. Allows writing code that references the first element even when new types are added.
-		Last = (int) EnclaveAEXEvent, ///< Not a real event type but a helper to get the last element. Allows writing code that references the last element even when new types are added.
+		Last = (int) EnclaveCallSnapshotEvent, ///< Not a real event type but a helper to get the last element. Allows writing code that references the last element even when new types are added.
 	} EventType;
 
 /**
@@ -121,10 +125,13 @@ namespace sgxperf
 			add_binds(stm);
 		}
 
-		virtual void pre_insert(sqlite3_stmt *event_stm_p, sqlite3 *db)
+		/**
+		 * @brief Inserts all events referenced by this event that have not been inserted yet, so their ids can be bound.
+		 * @param writer The writer this event is about to be written with.
+		 */
+		virtual void pre_insert(EventWriter *writer)
 		{
-			(void)event_stm_p;
-			(void)db;
+			(void)writer;
 		};
 
 		/**
@@ -145,6 +152,14 @@ namespace sgxperf
 			this->sql_id = sql_id;
 		}
 
+		/**
+		 * @brief Marks this event and all events it references as not inserted, so it can be serialized again.
+		 */
+		virtual void reset_sql_id()
+		{
+			this->sql_id = UINT64_MAX;
+		}
+
 		/**
 		 * @brief Sets the thread id of this event.
 		 * @param thread_id The new thread id.
@@ -160,6 +175,8 @@ namespace sgxperf
 		}
 
 	protected:
+		static void insert_reference(EventWriter *writer, Event *event);
+
 		/**
 		* @brief Binds all information of this event to the SQLite statement @p stm. This method must be implemented by derived classes.
 		* @param stm The sqlite statement onto which variables should be bound.
@@ -598,16 +615,20 @@ namespace sgxperf
 			}
 		}
 
-		void pre_insert(sqlite3_stmt *event_stm_p, sqlite3 *db) override
+		void pre_insert(EventWriter *writer) override
 		{
-			if (previous_call != nullptr && previous_call->get_sql_id() == UINT64_MAX)
+			if (previous_call != nullptr)
 			{
-				previous_call->pre_insert(event_stm_p, db);
+				insert_reference(writer, previous_call);
+			}
+		}
 
-				// Insert that first
-				previous_call->sql_bind(event_stm_p);
-				sqlite3_step(event_stm_p);
-				previous_call->set_sql_id(static_cast<uint64_t>(sqlite3_last_insert_rowid(db)));
+		void reset_sql_id() override
+		{
+			EnclaveEvent::reset_sql_id();
+			if (previous_call != nullptr)
+			{
+				previous_call->reset_sql_id();
 			}
 		}
 
@@ -621,6 +642,11 @@ namespace sgxperf
 			return previous_call;
 		}
 
+		int get_call_id()
+		{
+			return call_id;
+		}
+
 		void set_arg(void const *arg)
 		{
 			this->arg = arg;
@@ -672,17 +698,15 @@ namespace sgxperf
 			sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":aex_count"), static_cast<sqlite3_int64>(aex_count));
 		}
 
-		void pre_insert(sqlite3_stmt *event_stm_p, sqlite3 *db) override
+		void pre_insert(EventWriter *writer) override
 		{
-			if (ecall_event->get_sql_id() == UINT64_MAX)
-			{
-				ecall_event->pre_insert(event_stm_p, db);
+			insert_reference(writer, ecall_event);
+		}
 
-				// Insert inner event first
-				ecall_event->sql_bind(event_stm_p);
-				sqlite3_step(event_stm_p);
-				ecall_event->set_sql_id(static_cast<uint64_t>(sqlite3_last_insert_rowid(db)));
-			}
+		void reset_sql_id() override
+		{
+			EnclaveEvent::reset_sql_id();
+			ecall_event->reset_sql_id();
 		}
 
 		EventType get_type() override
@@ -699,6 +723,11 @@ namespace sgxperf
 			return ecall_event;
 		}
 
+		uint64_t get_aex_count()
+		{
+			return aex_count;
+		}
+
 	protected:
 		EnclaveECallEvent *ecall_event; ///< Corresponding EnclaveECallEvent.
 		sgx_status_t ret; ///< Return value of the ECall.
@@ -742,17 +771,15 @@ namespace sgxperf
 			sqlite3_bind_int(stm, sqlite3_bind_parameter_index(stm, ":return_value"), ret);
 		}
 
-		void pre_insert(sqlite3_stmt *event_stm_p, sqlite3 *db) override
+		void pre_insert(EventWriter *writer) override
 		{
-			if (ocall_event->get_sql_id() == UINT64_MAX)
-			{
-				ocall_event->pre_insert(event_stm_p, db);
+			insert_reference(writer, ocall_event);
+		}
 
-				// Insert inner event first
-				ocall_event->sql_bind(event_stm_p);
-				sqlite3_step(event_stm_p);
-				ocall_event->set_sql_id(static_cast<uint64_t>(sqlite3_last_insert_rowid(db)));
-			}
+		void reset_sql_id() override
+		{
+			EnclaveEvent::reset_sql_id();
+			ocall_event->reset_sql_id();
 		}
 
 		EventType get_type() override
@@ -777,25 +804,49 @@ namespace sgxperf
 	class EnclaveSyncWaitEvent : public EnclaveEvent
 	{
 	public:
-		explicit EnclaveSyncWaitEvent(EnclaveOCallEvent *ocall) : EnclaveEvent(ocall->get_eid()), ocall_event(ocall)
+		explicit EnclaveSyncWaitEvent(EnclaveOCallEvent *ocall) : EnclaveEvent(ocall->get_eid()), ocall_event(ocall), references(1)
 		{}
 
+		/**
+		 * @brief Adds a reference to this event. Used by the EnclaveSyncSetEvent that consumes it, which may live in another thread's queue.
+		 */
+		void retain()
+		{
+			__sync_fetch_and_add(&references, 1);
+		}
+
+		/**
+		 * @brief Drops a reference to this event.
+		 * @return true, if this was the last reference and the event may be deleted
+		 */
+		bool release()
+		{
+			return __sync_sub_and_fetch(&references, 1) == 0;
+		}
+
 		void add_binds(sqlite3_stmt *stm) override
 		{
 			EnclaveEvent::add_binds(stm);
-			sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":call_event"), static_cast<sqlite3_int64>(ocall_event->get_sql_id()));
+			if (ocall_event != nullptr)
+			{
+				sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":call_event"), static_cast<sqlite3_int64>(ocall_event->get_sql_id()));
+			}
 		}
 
-		void pre_insert(sqlite3_stmt *event_stm_p, sqlite3 *db) override
+		void pre_insert(EventWriter *writer) override
 		{
-			if (ocall_event->get_sql_id() == UINT64_MAX)
+			if (ocall_event != nullptr)
 			{
-				ocall_event->pre_insert(event_stm_p, db);
+				insert_reference(writer, ocall_event);
+			}
+		}
 
-				// Insert inner event first
-				ocall_event->sql_bind(event_stm_p);
-				sqlite3_step(event_stm_p);
-				ocall_event->set_sql_id(static_cast<uint64_t>(sqlite3_last_insert_rowid(db)));
+		void reset_sql_id() override
+		{
+			EnclaveEvent::reset_sql_id();
+			if (ocall_event != nullptr)
+			{
+				ocall_event->reset_sql_id();
 			}
 		}
 
@@ -804,12 +855,23 @@ namespace sgxperf
 			return EventType::EnclaveSyncWaitEvent;
 		}
 
+		/**
+		 * @brief Forgets the OCall of this wait, which is written without one from then on.
+		 * The OCall is freed together with its return event, which follows this event in the same queue. A wait that is evicted while an EnclaveSyncSetEvent still references it
+		 * would otherwise outlive its OCall.
+		 */
+		void detach_ocall_event()
+		{
+			ocall_event = nullptr;
+		}
+
 		EnclaveOCallEvent *get_ocall_event()
 		{
 			return ocall_event;
 		}
 	protected:
-		EnclaveOCallEvent *ocall_event;
+		EnclaveOCallEvent *ocall_event; ///< Corresponding EnclaveOCallEvent, nullptr once the wait was evicted
+		int references; ///< Number of owners of this event, i.e. the queue it is in and the EnclaveSyncSetEvent that consumed it.
 	};
 
 	class EnclaveSyncSetEvent : public EnclaveEvent
@@ -825,27 +887,17 @@ namespace sgxperf
 			sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":arg"), static_cast<sqlite3_int64>(wait_event->get_sql_id()));
 		}
 
-		void pre_insert(sqlite3_stmt *event_stm_p, sqlite3 *db) override
+		void pre_insert(EventWriter *writer) override
 		{
-			if (ocall_event->get_sql_id() == UINT64_MAX)
-			{
-				ocall_event->pre_insert(event_stm_p, db);
-
-				// Insert inner event first
-				ocall_event->sql_bind(event_stm_p);
-				sqlite3_step(event_stm_p);
-				ocall_event->set_sql_id(static_cast<uint64_t>(sqlite3_last_insert_rowid(db)));
-			}
-
-			if (wait_event->get_sql_id() == UINT64_MAX)
-			{
-				wait_event->pre_insert(event_stm_p, db);
+			insert_reference(writer, ocall_event);
+			insert_reference(writer, wait_event);
+		}
 
-				// Insert inner event first
-				wait_event->sql_bind(event_stm_p);
-				sqlite3_step(event_stm_p);
-				wait_event->set_sql_id(static_cast<uint64_t>(sqlite3_last_insert_rowid(db)));
-			}
+		void reset_sql_id() override
+		{
+			EnclaveEvent::reset_sql_id();
+			ocall_event->reset_sql_id();
+			wait_event->reset_sql_id();
 		}
 
 		EventType get_type() override
@@ -882,17 +934,15 @@ namespace sgxperf
 			sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":call_event"), static_cast<sqlite3_int64>(ecall_event->get_sql_id()));
 		}
 
-		void pre_insert(sqlite3_stmt *event_stm_p, sqlite3 *db) override
+		void pre_insert(EventWriter *writer) override
 		{
-			if (ecall_event->get_sql_id() == UINT64_MAX)
-			{
-				ecall_event->pre_insert(event_stm_p, db);
+			insert_reference(writer, ecall_event);
+		}
 
-				// Insert inner event first
-				ecall_event->sql_bind(event_stm_p);
-				sqlite3_step(event_stm_p);
-				ecall_event->set_sql_id(static_cast<uint64_t>(sqlite3_last_insert_rowid(db)));
-			}
+		void reset_sql_id() override
+		{
+			EnclaveEvent::reset_sql_id();
+			ecall_event->reset_sql_id();
 		}
 
 		EventType get_type() override
@@ -907,6 +957,116 @@ namespace sgxperf
 	protected:
 		EnclaveECallEvent *ecall_event;
 	};
+
+	/**
+	 * @brief Event representing a marker set by the application through @c sgxperf_marker.
+	 */
+	class MarkerEvent : public Event
+	{
+	public:
+		explicit MarkerEvent(std::string &name) : Event(), name(name)
+		{}
+
+		void add_binds(sqlite3_stmt *stm) override
+		{
+			sqlite3_bind_text(stm, sqlite3_bind_parameter_index(stm, ":name"), name.c_str(), static_cast<int>(name.length()), SQLITE_STATIC);
+		}
+
+		EventType get_type() override
+		{
+			return EventType::MarkerEvent;
+		}
+
+	protected:
+		std::string name; ///< Name of the marker.
+	};
+
+#define SNAPSHOT_MAX_FRAMES 32
+
+	/**
+	 * @brief Event representing a snapshot of a thread that is stuck in a call, taken by the watchdog.
+	 */
+	class EnclaveCallSnapshotEvent : public EnclaveEvent
+	{
+	public:
+		explicit EnclaveCallSnapshotEvent(EnclaveCallEvent *call) : EnclaveEvent(call->get_eid()), call_event(call), call_time(call->get_time()), frame_count(0), enclave_rip(0), frames()
+		{}
+
+		void add_binds(sqlite3_stmt *stm) override
+		{
+			EnclaveEvent::add_binds(stm);
+			sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":call_event"), static_cast<sqlite3_int64>(call_event->get_sql_id()));
+			sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":arg"), static_cast<sqlite3_int64>(enclave_rip));
+			auto stack = symbolize_stack();
+			sqlite3_bind_text(stm, sqlite3_bind_parameter_index(stm, ":name"), stack.c_str(), static_cast<int>(stack.length()), SQLITE_TRANSIENT);
+		}
+
+		void pre_insert(EventWriter *writer) override
+		{
+			insert_reference(writer, call_event);
+		}
+
+		void reset_sql_id() override
+		{
+			EnclaveEvent::reset_sql_id();
+			call_event->reset_sql_id();
+		}
+
+		EventType get_type() override
+		{
+			return EventType::EnclaveCallSnapshotEvent;
+		}
+
+		EnclaveCallEvent *get_call_event()
+		{
+			return call_event;
+		}
+
+		/**
+		 * @brief Returns the start time of the call, to tell it apart from a later call at the same address.
+		 * @return The start time of the call
+		 */
+		uint64_t get_call_time()
+		{
+			return call_time;
+		}
+
+		/**
+		 * @brief Resolves the captured untrusted stack to symbols, one frame per line.
+		 * @return The symbolized stack
+		 */
+		std::string symbolize_stack()
+		{
+			std::stringstream ss;
+			for (int i = 0; i < frame_count; ++i)
+			{
+				Dl_info dlinfo = {};
+				if (dladdr(frames[i], &dlinfo) != 0 && dlinfo.dli_sname != nullptr)
+				{
+					ss << dlinfo.dli_sname << "+0x" << std::hex << ((uint64_t)frames[i] - (uint64_t)dlinfo.dli_saddr) << std::dec;
+				}
+				else if (dlinfo.dli_fname != nullptr)
+				{
+					ss << dlinfo.dli_fname << "+0x" << std::hex << ((uint64_t)frames[i] - (uint64_t)dlinfo.dli_fbase) << std::dec;
+				}
+				else
+				{
+					ss << frames[i];
+				}
+				ss << "\n";
+			}
+			return ss.str();
+		}
+
+	protected:
+		EnclaveCallEvent *call_event; ///< The call the thread is stuck in.
+		uint64_t call_time; ///< Start time of the call
+	public:
+		// Filled in by the signal handler of the stuck thread, so these are plain fields
+		int frame_count; ///< Number of valid entries in frames
+		uint64_t enclave_rip; ///< rip inside the enclave from the SSA, 0 if unknown
+		void *frames[SNAPSHOT_MAX_FRAMES]; ///< Untrusted return addresses of the stuck thread
+	};
 }
 
 #endif //SGX_PERF_EVENTS_H
@@ -7,6 +7,7 @@
 #include "urts_calls.h"
 #include "store.h"
 #include "perf.h"
+#include "watchdog.h"
 #include "config.h"
 
 #include <unistd.h>
@@ -19,6 +20,7 @@ const char service_interp[] __attribute__((section(".interp"))) = "/lib64/ld-lin
 
 sgxperf::EventStore *event_store = nullptr;
 sgxperf::Perf *perf = nullptr;
+sgxperf::Watchdog *watchdog = nullptr;
 sgxperf::Config *config = nullptr;
 
 #define NAME "sgx-perf"
@@ -70,8 +72,7 @@ void sigint_handler(int signum, siginfo_t *siginfo, void *context)
 			if (encl->encl_start >= faddr && encl->encl_end < faddr)
 			{
 				// Fault happened inside enclave, so read out SSA to get real address
-				auto ssa_addr = (ssa_gpr_t *)(tcs_addr + 0x2);
-				ssa_addr = (ssa_gpr_t *)((uint8_t *)ssa_addr - 184);
+				auto ssa_addr = get_ssa_gpr(tcs_addr);
 				se->set_fault_addr(reinterpret_cast<void *>(ssa_addr->rip));
 			}
 			else
@@ -117,6 +118,33 @@ void sigint_handler(int signum, siginfo_t *siginfo, void *context)
 	}
 }
 
+/**
+ * @brief Signal handler that triggers a flight recorder dump.
+ * @param signum
+ */
+static void flight_recorder_handler(int signum)
+{
+	(void)signum;
+	event_store->request_dump();
+}
+
+/**
+ * @brief Marker API for applications. Records a MarkerEvent and optionally triggers a flight recorder dump.
+ * @param name Name of the marker
+ * @param trigger If non-zero, a flight recorder dump is requested
+ */
+extern "C" void sgxperf_marker(const char *name, int trigger)
+{
+	if (event_store == nullptr || event_store->is_finalized())
+		return;
+
+	std::string sname(name == nullptr ? "" : name);
+	event_store->insert_event(new sgxperf::MarkerEvent(sname));
+
+	if (trigger)
+		event_store->request_dump();
+}
+
 /**
  * @brief Main method of logger, calls the entry point libmain()
  */
@@ -169,13 +197,24 @@ static void initialize()
 		goto initerror;
 	}
 
+	event_store->calibrate();
+
 	tce = new sgxperf::ThreadCreationEvent(pthread_self(), nullptr);
 	event_store->insert_event(tce);
 
+	if (!config->get_calibration_enclave().empty())
+	{
+		calibrate_transitions(config->get_calibration_enclave().c_str());
+	}
+
 	// Initialize perf
 	perf = new sgxperf::Perf();
 	perf->init();
 
+	// Initialize watchdog
+	watchdog = new sgxperf::Watchdog();
+	watchdog->init();
+
 	// Register signal handlers
 	sig_act.sa_sigaction = sigint_handler;
 	sig_act.sa_flags = SA_SIGINFO | SA_NODEFER | SA_RESTART;
@@ -187,7 +226,17 @@ static void initialize()
 	sigaction(SIGTRAP, &sig_act, nullptr);
 	sigaction(SIGABRT, &sig_act, nullptr);
 
+	if (config->is_flight_recorder_enabled())
+	{
+		struct sigaction fr_act = {};
+		fr_act.sa_handler = flight_recorder_handler;
+		fr_act.sa_flags = SA_RESTART;
+		sigaction(config->get_flight_recorder_signal(), &fr_act, nullptr);
+	}
+
 	perf->start_sampling();
+	event_store->start_flight_recorder();
+	watchdog->start();
 
 	std::cout << "=== Done initializing" << std::endl;
 	return;
@@ -206,6 +255,8 @@ static void destroy()
 	if (event_store->is_finalized())
 		return;
 
+	watchdog->stop();
+	event_store->stop_flight_recorder();
 	perf->stop_sampling();
 
 	event_store->finalize();
@@ -10,6 +10,9 @@
 #include <dlfcn.h>
 #include <cstring>
 #include <set>
+#include <algorithm>
+#include <vector>
+#include <malloc.h>
 
 #include "store.h"
 #include "elfparser.h"
@@ -40,51 +43,264 @@ std::string __event_type_names[] = {
                                     "EnclaveSyncWaitEvent",
                                     "EnclaveSyncSetEvent",
                                     "EnclaveAEXEvent",
+                                    "MarkerEvent",
+                                    "EnclaveCallSnapshotEvent",
                                     ""};
 
 extern sgxperf::Config *config;
 
 thread_local sgxperf::Thread *current_thread = nullptr;
 
+#define CALIBRATION_ROUNDS 10000
+
+/**
+ * @brief Tables the events are written to. Each table only has the columns its event types use.
+ */
+enum __event_table
+{
+	EVENT_TABLE_CALLS = 0,
+	EVENT_TABLE_RETURNS,
+	EVENT_TABLE_SYNC,
+	EVENT_TABLE_PAGING,
+	EVENT_TABLE_THREAD,
+	EVENT_TABLE_SIGNAL,
+	EVENT_TABLE_ENCLAVE,
+	EVENT_TABLE_AEX,
+	EVENT_TABLE_ANNOTATION,
+};
+
+/**
+ * @brief Insert statements for the event tables, indexed by __event_table.
+ * Columns an event binds but its table does not have are ignored by SQLite.
+ */
+static const char *event_table_inserts[EVENT_TABLE_COUNT] = {
+		"INSERT INTO `call_events` (`id`,`type`,`time`,`involved_thread`,`core`,`eid`,`call_id`,`arg`,`call_event`) "
+		"VALUES (:id, :type, :time, :involved_thread, :core, :eid, :call_id, :arg, :call_event);",
+		"INSERT INTO `return_events` (`id`,`type`,`time`,`involved_thread`,`core`,`eid`,`call_event`,`return_value`,`aex_count`) "
+		"VALUES (:id, :type, :time, :involved_thread, :core, :eid, :call_event, :return_value, :aex_count);",
+		"INSERT INTO `sync_events` (`id`,`type`,`time`,`involved_thread`,`core`,`eid`,`call_event`,`arg`) "
+		"VALUES (:id, :type, :time, :involved_thread, :core, :eid, :call_event, :arg);",
+		"INSERT INTO `paging_events` (`id`,`type`,`time`,`involved_thread`,`core`,`eid`,`arg`) "
+		"VALUES (:id, :type, :time, :involved_thread, :core, :eid, :arg);",
+		"INSERT INTO `thread_events` (`id`,`type`,`time`,`involved_thread`,`core`,`other_thread`,`arg`,`start_function`,`return_value`,`name`) "
+		"VALUES (:id, :type, :time, :involved_thread, :core, :other_thread, :arg, :start_function, :return_value, :name);",
+		"INSERT INTO `signal_events` (`id`,`time`,`involved_thread`,`core`,`arg`,`start_address`,`return_value`) "
+		"VALUES (:id, :time, :involved_thread, :core, :arg, :start_address, :return_value);",
+		"INSERT INTO `enclave_events` (`id`,`type`,`time`,`involved_thread`,`core`,`eid`,`return_value`,`file_name`,`enclave_start`,`enclave_end`) "
+		"VALUES (:id, :type, :time, :involved_thread, :core, :eid, :return_value, :file_name, :enclave_start, :enclave_end);",
+		"INSERT INTO `aex_events` (`id`,`time`,`involved_thread`,`core`,`eid`,`call_event`) "
+		"VALUES (:id, :time, :involved_thread, :core, :eid, :call_event);",
+		"INSERT INTO `annotation_events` (`id`,`type`,`time`,`involved_thread`,`core`,`eid`,`arg`,`name`,`call_event`) "
+		"VALUES (:id, :type, :time, :involved_thread, :core, :eid, :arg, :name, :call_event);",
+};
+
+/**
+ * @brief Insert statement for the calls table, which has one row per completed call.
+ */
+static const char *call_table_insert = "INSERT INTO `calls` (`thread`,`start_time`,`id`,`end_time`,`duration`,`eid`,`type`,`call_id`,`parent_call`,`aex_count`,`depth`) "
+                                       "VALUES (:thread, :start_time, :id, :end_time, :duration, :eid, :type, :call_id, :parent_call, :aex_count, :depth);";
+
+sgxperf::EventWriter::~EventWriter()
+{
+	for (auto stm : statements)
+	{
+		sqlite3_finalize(stm);
+	}
+	sqlite3_finalize(call_statement);
+}
+
+/**
+ * @brief Prepares the insert statements of all event tables.
+ * @return true on success, false otherwise
+ */
+bool sgxperf::EventWriter::prepare()
+{
+	for (int i = 0; i < EVENT_TABLE_COUNT; ++i)
+	{
+		auto ret = sqlite3_prepare_v2(db, event_table_inserts[i], -1, &statements[i], nullptr);
+		if (ret != SQLITE_OK)
+		{
+			printf("/!\\ Could not prepare statement: %s\n", sqlite3_errmsg(db));
+			printf("Statement was: %s\n", event_table_inserts[i]);
+			return false;
+		}
+	}
+
+	if (sqlite3_prepare_v2(db, call_table_insert, -1, &call_statement, nullptr) != SQLITE_OK)
+	{
+		printf("/!\\ Could not prepare statement: %s\n", sqlite3_errmsg(db));
+		printf("Statement was: %s\n", call_table_insert);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Returns the insert statement of the table events of the given type are written to.
+ * @param type The event type
+ * @return The statement, nullptr for abstract event types
+ */
+sqlite3_stmt *sgxperf::EventWriter::statement_for(EventType type)
+{
+	switch (type)
+	{
+		case EventType::EnclaveECallEvent:
+		case EventType::EnclaveOCallEvent:
+			return statements[EVENT_TABLE_CALLS];
+		case EventType::EnclaveECallReturnEvent:
+		case EventType::EnclaveOCallReturnEvent:
+			return statements[EVENT_TABLE_RETURNS];
+		case EventType::EnclaveSyncWaitEvent:
+		case EventType::EnclaveSyncSetEvent:
+			return statements[EVENT_TABLE_SYNC];
+		case EventType::EnclavePageInEvent:
+		case EventType::EnclavePageOutEvent:
+			return statements[EVENT_TABLE_PAGING];
+		case EventType::ThreadCreationEvent:
+		case EventType::ThreadCreatorEvent:
+		case EventType::ThreadDestructionEvent:
+		case EventType::ThreadSetNameEvent:
+			return statements[EVENT_TABLE_THREAD];
+		case EventType::SignalEvent:
+			return statements[EVENT_TABLE_SIGNAL];
+		case EventType::EnclaveCreationEvent:
+		case EventType::EnclaveDestructionEvent:
+			return statements[EVENT_TABLE_ENCLAVE];
+		case EventType::EnclaveAEXEvent:
+			return statements[EVENT_TABLE_AEX];
+		case EventType::MarkerEvent:
+		case EventType::EnclaveCallSnapshotEvent:
+			return statements[EVENT_TABLE_ANNOTATION];
+		default:
+			return nullptr;
+	}
+}
+
+/**
+ * @brief Writes an event into its table and assigns its SQL id. Referenced events must have been written before.
+ * @param event The event to write
+ */
+void sgxperf::EventWriter::write(Event *event)
+{
+	auto stm = statement_for(event->get_type());
+	if (stm == nullptr)
+	{
+		return;
+	}
+
+	event->sql_bind(stm);
+	sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":id"), static_cast<sqlite3_int64>(next_id));
+	sqlite3_step(stm);
+	event->set_sql_id(next_id++);
+
+	// A return completes a call, which also gets its row in the calls table
+	if (event->get_type() == EventType::EnclaveECallReturnEvent)
+	{
+		auto ecr = dynamic_cast<EnclaveECallReturnEvent *>(event);
+		write_call(ecr->get_ecall_event(), event, static_cast<sqlite3_int64>(ecr->get_aex_count()));
+	}
+	else if (event->get_type() == EventType::EnclaveOCallReturnEvent)
+	{
+		write_call(dynamic_cast<EnclaveOCallReturnEvent *>(event)->get_ocall_event(), event, -1);
+	}
+}
+
+/**
+ * @brief Writes a completed call into the calls table. The call and its parent must have been written before.
+ * @param call The call event
+ * @param ret The return event of @p call
+ * @param aex_count Number of AEXs during the call, negative if not applicable
+ */
+void sgxperf::EventWriter::write_call(EnclaveCallEvent *call, Event *ret, sqlite3_int64 aex_count)
+{
+	auto stm = call_statement;
+	sqlite3_reset(stm);
+	sqlite3_clear_bindings(stm);
+
+	sqlite3_int64 depth = 0;
+	for (auto parent = call->get_previous_call(); parent != nullptr; parent = parent->get_previous_call())
+	{
+		depth++;
+	}
+
+	sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":thread"), static_cast<sqlite3_int64>(call->get_thread_id()));
+	sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":start_time"), static_cast<sqlite3_int64>(call->get_time()));
+	sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":id"), static_cast<sqlite3_int64>(call->get_sql_id()));
+	sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":end_time"), static_cast<sqlite3_int64>(ret->get_time()));
+	sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":duration"), static_cast<sqlite3_int64>(ret->get_time() - call->get_time()));
+	sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":eid"), static_cast<sqlite3_int64>(call->get_eid()));
+	sqlite3_bind_int(stm, sqlite3_bind_parameter_index(stm, ":type"), static_cast<int>(call->get_type()));
+	sqlite3_bind_int(stm, sqlite3_bind_parameter_index(stm, ":call_id"), call->get_call_id());
+	if (call->get_previous_call() != nullptr)
+	{
+		sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":parent_call"), static_cast<sqlite3_int64>(call->get_previous_call()->get_sql_id()));
+	}
+	if (aex_count >= 0)
+	{
+		sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":aex_count"), aex_count);
+	}
+	sqlite3_bind_int64(stm, sqlite3_bind_parameter_index(stm, ":depth"), depth);
+	sqlite3_step(stm);
+}
+
+/**
+ * @brief Writes @p event, which is referenced by this event, unless it has been written already.
+ * @param writer The writer to use
+ * @param event The referenced event
+ */
+void sgxperf::Event::insert_reference(EventWriter *writer, Event *event)
+{
+	if (event->get_sql_id() == UINT64_MAX)
+	{
+		event->pre_insert(writer);
+		writer->write(event);
+	}
+}
+
 /**
  * @brief Executes the SQL query inside the given string
+ * @param out_db The database to execute the query on
  * @param sql
  */
-void sgxperf::EventStore::sql_exec(const char *sql)
+void sgxperf::EventStore::sql_exec(sqlite3 *out_db, const char *sql)
 {
 	char *errmsg = nullptr;
-	int rc = sqlite3_exec(db, sql, nullptr, nullptr, &errmsg);
+	int rc = sqlite3_exec(out_db, sql, nullptr, nullptr, &errmsg);
 	if (rc != SQLITE_OK)
 	{
 		printf("/!\\ Could not execute statement: %s\n", errmsg);
 		printf("Statement was: %s\n", sql);
 		sqlite3_free(errmsg);
-		sqlite3_close(db);
+		sqlite3_close(out_db);
 		exit(-1);
 	}
 }
 
 /**
  * @brief Executes the SQL query inside the given string.
+ * @param out_db The database to execute the query on
  * @param sql
  */
-void sgxperf::EventStore::sql_exec(std::string const &sql)
+void sgxperf::EventStore::sql_exec(sqlite3 *out_db, std::string const &sql)
 {
-	sql_exec((char *)sql.c_str());
+	sql_exec(out_db, (char *)sql.c_str());
 }
 
 /**
  * @brief Executes the SQL query inside the given string stream.
+ * @param out_db The database to execute the query on
  * @param ss
  */
-void sgxperf::EventStore::sql_exec(std::stringstream &ss)
+void sgxperf::EventStore::sql_exec(sqlite3 *out_db, std::stringstream &ss)
 {
-	sql_exec(ss.str());
+	sql_exec(out_db, ss.str());
 	ss.str(std::string());
 }
 
 
-sgxperf::EventStore::EventStore() : enclave_map_lock({}), enclave_map(), tcs_map_lock({}), tcs_map(), thread_id(0), db(nullptr), thread_events_lock({}), thread_events(), finalized(false), main_thread(nullptr)
+sgxperf::EventStore::EventStore() : enclave_map_lock({}), enclave_map(), tcs_map_lock({}), tcs_map(), thread_id(0), db(nullptr), thread_events_lock({}), thread_events(), finalized(false), main_thread(nullptr),
+                                      locked_queues(config->is_flight_recorder_enabled() || config->is_watchdog_enabled()),
+                                      dumping(false), dump_requested(false), dumper_running(false), dumper(nullptr), dump_count(0)
 {
 	timespec t = {};
 	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
@@ -102,8 +318,17 @@ sgxperf::EventStore::~EventStore()
  */
 int sgxperf::EventStore::create_database()
 {
-	std::stringstream ss;
-	ss << "out-" << getpid() << ".db";
+	return open_database(&db);
+}
+
+/**
+ * @brief Opens a new in-memory SQLite database and adds the tables
+ * @param[out] out_db The newly opened database
+ * @return 0 on success, non-zero otherwise
+ */
+int sgxperf::EventStore::open_database(sqlite3 **out_db)
+{
+	sqlite3 *db = nullptr;
 	int rc = sqlite3_open(":memory:", &db);
 	if (rc)
 	{
@@ -119,7 +344,16 @@ int sgxperf::EventStore::create_database()
 	                     "CREATE TABLE `event_map` ( `id` INTEGER NOT NULL UNIQUE, `name` TEXT NOT NULL, PRIMARY KEY(`id`) );"
 	                     "CREATE TABLE `general` ( `key` TEXT NOT NULL, `value` INTEGER NOT NULL );"
 	                     "CREATE TABLE `threads` ( `id` INTEGER NOT NULL UNIQUE, `pthread_id` INTEGER NOT NULL, `name` TEXT NOT NULL, `start_address` INTEGER NOT NULL, `start_symbol` TEXT, `start_symbol_file_name` TEXT, `start_address_normalized` INTEGER, PRIMARY KEY(`id`) );"
-	                     "CREATE TABLE `events` ( `id` INTEGER PRIMARY KEY AUTOINCREMENT UNIQUE, `type` INTEGER NOT NULL, `time` INTEGER NOT NULL, `involved_thread` INTEGER NOT NULL, `core` INTEGER NOT NULL, `other_thread` INTEGER, `arg` INTEGER, `start_function` INTEGER, `return_value` INTEGER, `name` TEXT, `eid` INTEGER, `file_name` TEXT, `enclave_start` INTEGER, `enclave_end` INTEGER, `call_id` INTEGER, `call_event` INTEGER, `aex_count` INTEGER);"
+	                     "CREATE TABLE `call_events` ( `id` INTEGER PRIMARY KEY, `type` INTEGER NOT NULL, `time` INTEGER NOT NULL, `involved_thread` INTEGER NOT NULL, `core` INTEGER NOT NULL, `eid` INTEGER NOT NULL, `call_id` INTEGER NOT NULL, `arg` INTEGER, `call_event` INTEGER );"
+	                     "CREATE TABLE `return_events` ( `id` INTEGER PRIMARY KEY, `type` INTEGER NOT NULL, `time` INTEGER NOT NULL, `involved_thread` INTEGER NOT NULL, `core` INTEGER NOT NULL, `eid` INTEGER NOT NULL, `call_event` INTEGER NOT NULL, `return_value` INTEGER, `aex_count` INTEGER );"
+	                     "CREATE TABLE `sync_events` ( `id` INTEGER PRIMARY KEY, `type` INTEGER NOT NULL, `time` INTEGER NOT NULL, `involved_thread` INTEGER NOT NULL, `core` INTEGER NOT NULL, `eid` INTEGER NOT NULL, `call_event` INTEGER NOT NULL, `arg` INTEGER );"
+	                     "CREATE TABLE `paging_events` ( `id` INTEGER PRIMARY KEY, `type` INTEGER NOT NULL, `time` INTEGER NOT NULL, `involved_thread` INTEGER NOT NULL, `core` INTEGER NOT NULL, `eid` INTEGER NOT NULL, `arg` INTEGER NOT NULL );"
+	                     "CREATE TABLE `thread_events` ( `id` INTEGER PRIMARY KEY, `type` INTEGER NOT NULL, `time` INTEGER NOT NULL, `involved_thread` INTEGER NOT NULL, `core` INTEGER NOT NULL, `other_thread` INTEGER, `arg` INTEGER, `start_function` INTEGER, `return_value` INTEGER, `name` TEXT );"
+	                     "CREATE TABLE `signal_events` ( `id` INTEGER PRIMARY KEY, `time` INTEGER NOT NULL, `involved_thread` INTEGER NOT NULL, `core` INTEGER NOT NULL, `arg` INTEGER NOT NULL, `start_address` INTEGER, `return_value` INTEGER );"
+	                     "CREATE TABLE `enclave_events` ( `id` INTEGER PRIMARY KEY, `type` INTEGER NOT NULL, `time` INTEGER NOT NULL, `involved_thread` INTEGER NOT NULL, `core` INTEGER NOT NULL, `eid` INTEGER NOT NULL, `return_value` INTEGER, `file_name` TEXT, `enclave_start` INTEGER, `enclave_end` INTEGER );"
+	                     "CREATE TABLE `aex_events` ( `id` INTEGER PRIMARY KEY, `time` INTEGER NOT NULL, `involved_thread` INTEGER NOT NULL, `core` INTEGER NOT NULL, `eid` INTEGER NOT NULL, `call_event` INTEGER NOT NULL );"
+	                     "CREATE TABLE `calls` ( `thread` INTEGER NOT NULL, `start_time` INTEGER NOT NULL, `id` INTEGER NOT NULL, `end_time` INTEGER NOT NULL, `duration` INTEGER NOT NULL, `eid` INTEGER NOT NULL, `type` INTEGER NOT NULL, `call_id` INTEGER NOT NULL, `parent_call` INTEGER, `aex_count` INTEGER, `depth` INTEGER NOT NULL, PRIMARY KEY(`thread`,`start_time`,`id`) ) WITHOUT ROWID;"
+	                     "CREATE TABLE `annotation_events` ( `id` INTEGER PRIMARY KEY, `type` INTEGER NOT NULL, `time` INTEGER NOT NULL, `involved_thread` INTEGER NOT NULL, `core` INTEGER NOT NULL, `eid` INTEGER, `arg` INTEGER, `name` TEXT, `call_event` INTEGER );"
 	                     "CREATE TABLE `ocalls` ( `id` INTEGER NOT NULL, `eid` INTEGER NOT NULL, `symbol_name` TEXT, `symbol_file_name` TEXT, `symbol_address` INTEGER, `symbol_address_normalized` INTEGER, PRIMARY KEY(`id`,`eid`) );"
 	                     "CREATE TABLE `ecalls` ( `id` INTEGER NOT NULL, `eid` INTEGER NOT NULL, `symbol_address` INTEGER NOT NULL, `symbol_name` TEXT, `is_private` INTEGER, PRIMARY KEY(`id`,`eid`) )"
 	                     "";
@@ -135,6 +369,30 @@ int sgxperf::EventStore::create_database()
 		return -1;
 	}
 
+	// The events view has the columns of the single events table of version 1, so old queries keep working
+	std::stringstream view;
+	view << "CREATE VIEW `events` AS "
+	        "SELECT `id`, `type`, `time`, `involved_thread`, `core`, NULL AS `other_thread`, `arg`, NULL AS `start_function`, NULL AS `return_value`, NULL AS `name`, `eid`, NULL AS `file_name`, NULL AS `enclave_start`, NULL AS `enclave_end`, `call_id`, `call_event`, NULL AS `aex_count` FROM `call_events` "
+	        "UNION ALL SELECT `id`, `type`, `time`, `involved_thread`, `core`, NULL, NULL, NULL, `return_value`, NULL, `eid`, NULL, NULL, NULL, NULL, `call_event`, `aex_count` FROM `return_events` "
+	        "UNION ALL SELECT `id`, `type`, `time`, `involved_thread`, `core`, NULL, `arg`, NULL, NULL, NULL, `eid`, NULL, NULL, NULL, NULL, `call_event`, NULL FROM `sync_events` "
+	        "UNION ALL SELECT `id`, `type`, `time`, `involved_thread`, `core`, NULL, `arg`, NULL, NULL, NULL, `eid`, NULL, NULL, NULL, NULL, NULL, NULL FROM `paging_events` "
+	        "UNION ALL SELECT `id`, `type`, `time`, `involved_thread`, `core`, `other_thread`, `arg`, `start_function`, `return_value`, `name`, NULL, NULL, NULL, NULL, NULL, NULL, NULL FROM `thread_events` "
+	        "UNION ALL SELECT `id`, " << (int)EventType::SignalEvent << ", `time`, `involved_thread`, `core`, NULL, `arg`, `start_address`, `return_value`, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL FROM `signal_events` "
+	        "UNION ALL SELECT `id`, `type`, `time`, `involved_thread`, `core`, NULL, NULL, NULL, `return_value`, NULL, `eid`, `file_name`, `enclave_start`, `enclave_end`, NULL, NULL, NULL FROM `enclave_events` "
+	        "UNION ALL SELECT `id`, " << (int)EventType::EnclaveAEXEvent << ", `time`, `involved_thread`, `core`, NULL, NULL, NULL, NULL, NULL, `eid`, NULL, NULL, NULL, NULL, `call_event`, NULL FROM `aex_events` "
+	        "UNION ALL SELECT `id`, `type`, `time`, `involved_thread`, `core`, NULL, `arg`, NULL, NULL, `name`, `eid`, NULL, NULL, NULL, NULL, `call_event`, NULL FROM `annotation_events`;";
+
+	rc = sqlite3_exec(db, view.str().c_str(), nullptr, nullptr, &errmsg);
+	if (rc != SQLITE_OK)
+	{
+		printf("/!\\ Could not create events view:\n");
+		printf("%s\n", errmsg);
+		sqlite3_free(errmsg);
+		sqlite3_close(db);
+		return -1;
+	}
+
+	*out_db = db;
 	return 0;
 }
 
@@ -151,6 +409,9 @@ void sgxperf::EventStore::insert_event(pthread_t involved_thread, Event *event)
 		return;
 	}
 
+	timespec entry_time = {};
+	clock_gettime(CLOCK_MONOTONIC_RAW, &entry_time);
+
 	// Find the corresponding thread and add the event to its queue
 	// But check thread local storage first
 	if (current_thread == nullptr)
@@ -174,10 +435,7 @@ void sgxperf::EventStore::insert_event(pthread_t involved_thread, Event *event)
 	}
 
 	// Add event to thread's event queue
-	current_thread->events.push(event);
-
-	// Set the internal thread id of the event to the one of the thread
-	event->set_thread_id(current_thread->sql_id);
+	push_event(current_thread, event);
 
 	// If the event created another thread, we need to create that thread's object
 	if (auto tcevent = dynamic_cast<ThreadCreatorEvent *>(event))
@@ -242,6 +500,176 @@ void sgxperf::EventStore::insert_event(pthread_t involved_thread, Event *event)
 			}
 		}
 	}
+
+	// Account for the cost of the logger itself
+	timespec exit_time = {};
+	clock_gettime(CLOCK_MONOTONIC_RAW, &exit_time);
+	current_thread->event_count++;
+	current_thread->event_bytes += malloc_usable_size(dynamic_cast<void *>(event));
+	current_thread->logger_time += static_cast<uint64_t>((exit_time.tv_sec - entry_time.tv_sec) * 1000000000 + (exit_time.tv_nsec - entry_time.tv_nsec));
+}
+
+/**
+ * @brief Adds an event to the queue of @p thread
+ * @param thread The thread the event belongs to
+ * @param event The Event to be added
+ */
+void sgxperf::EventStore::push_event(Thread *thread, Event *event)
+{
+	// Set the internal thread id of the event to the one of the thread
+	event->set_thread_id(thread->sql_id);
+
+	if (locked_queues)
+	{
+		// The dumper or watchdog thread might access the queue, and old events have to be dropped
+		write_lock(&thread->events_lock);
+		thread->events.push(event);
+		if (config->is_flight_recorder_enabled() && !dumping)
+		{
+			evict_events(thread, event->get_time());
+		}
+		write_unlock(&thread->events_lock);
+	}
+	else
+	{
+		thread->events.push(event);
+	}
+}
+
+/**
+ * @brief Inserts a snapshot on behalf of another thread, if the thread is still in the snapshotted call. Used by the watchdog.
+ * The check and the insert happen under the events_lock of @p thread, so the call cannot return and be evicted in between.
+ * @param thread The thread the snapshot belongs to
+ * @param event The snapshot to be inserted
+ * @return true, if the snapshot has been inserted, false if the call has returned in the meantime and the snapshot has to be dropped
+ */
+bool sgxperf::EventStore::insert_snapshot(Thread *thread, EnclaveCallSnapshotEvent *event)
+{
+	if (finalized)
+	{
+		return false;
+	}
+
+	write_lock(&thread->events_lock);
+	// The call might have been freed and another one allocated at the same address, so compare the start time as well
+	auto call = get_open_call(thread);
+	if (call == nullptr || call != event->get_call_event() || call->get_time() != event->get_call_time())
+	{
+		write_unlock(&thread->events_lock);
+		return false;
+	}
+
+	event->set_thread_id(thread->sql_id);
+	thread->events.push(event);
+	if (config->is_flight_recorder_enabled() && !dumping)
+	{
+		evict_events(thread, event->get_time());
+	}
+	write_unlock(&thread->events_lock);
+
+	return true;
+}
+
+/**
+ * @brief Returns the innermost call @p thread is in. The caller has to hold the events_lock of @p thread.
+ * The thread might be between inserting a call or return and updating its current call, the last event in its queue tells.
+ * @param thread The thread
+ * @return The innermost open call, or nullptr if the thread is not in a call
+ */
+sgxperf::EnclaveCallEvent *sgxperf::EventStore::get_open_call(Thread *thread)
+{
+	auto call = thread->current_call;
+	if (!thread->events.empty())
+	{
+		auto last = thread->events.back();
+		auto lc = dynamic_cast<EnclaveCallEvent *>(last);
+		auto ecr = dynamic_cast<EnclaveECallReturnEvent *>(last);
+		auto ocr = dynamic_cast<EnclaveOCallReturnEvent *>(last);
+		if (lc != nullptr && lc != call && lc->get_previous_call() == call)
+		{
+			call = lc;
+		}
+		else if (call != nullptr && ((ecr != nullptr && ecr->get_ecall_event() == call) || (ocr != nullptr && ocr->get_ocall_event() == call)))
+		{
+			call = call->get_previous_call();
+		}
+	}
+	return call;
+}
+
+/**
+ * @brief Measures the cost of recording a call with the same steps as the OCall bridge, but without an OCall.
+ * Stores the time by which a call appears longer because of the logger and the time a nested call adds to its parent in the general table.
+ */
+void sgxperf::EventStore::calibrate()
+{
+	// Record into a scratch thread that is never serialized
+	auto scratch = new Thread(pthread_self(), UINT64_MAX);
+	auto saved_thread = current_thread;
+	current_thread = scratch;
+
+	std::vector<uint64_t> own(CALIBRATION_ROUNDS);
+	std::vector<uint64_t> nested(CALIBRATION_ROUNDS);
+	for (size_t i = 0; i < CALIBRATION_ROUNDS; ++i)
+	{
+		timespec before = {};
+		timespec after = {};
+		clock_gettime(CLOCK_MONOTONIC_RAW, &before);
+
+		auto ocall = new EnclaveOCallEvent(0, 0, nullptr, scratch->current_call);
+		insert_event(ocall);
+		scratch->current_call = ocall;
+
+		auto ocr = new EnclaveOCallReturnEvent(ocall, 0);
+		insert_event(ocr);
+		scratch->current_call = scratch->current_call->get_previous_call();
+
+		clock_gettime(CLOCK_MONOTONIC_RAW, &after);
+		own[i] = ocr->get_time() - ocall->get_time();
+		nested[i] = static_cast<uint64_t>((after.tv_sec - before.tv_sec) * 1000000000 + (after.tv_nsec - before.tv_nsec));
+	}
+
+	current_thread = saved_thread;
+	while (!scratch->events.empty())
+	{
+		delete scratch->events.front();
+		scratch->events.pop();
+	}
+	delete scratch;
+
+	// Medians, so that interrupts during calibration do not matter
+	std::nth_element(own.begin(), own.begin() + CALIBRATION_ROUNDS / 2, own.end());
+	std::nth_element(nested.begin(), nested.begin() + CALIBRATION_ROUNDS / 2, nested.end());
+	set_general("overhead_call", own[CALIBRATION_ROUNDS / 2]);
+	set_general("overhead_nested_call", nested[CALIBRATION_ROUNDS / 2]);
+
+	std::cout << "(i) Logger overhead: " << own[CALIBRATION_ROUNDS / 2] << "ns per call, " << nested[CALIBRATION_ROUNDS / 2] << "ns per nested call" << std::endl;
+}
+
+/**
+ * @brief Adds an entry to the general table of the summary. Only to be used during initialization.
+ * @param key The key of the entry
+ * @param value The value of the entry
+ */
+void sgxperf::EventStore::set_general(std::string const &key, uint64_t value)
+{
+	general_values[key] = value;
+}
+
+/**
+ * @brief Returns all threads that are still running
+ * @return A copy of the list of running threads
+ */
+std::list<sgxperf::Thread *> sgxperf::EventStore::get_threads()
+{
+	std::list<Thread *> threads;
+	read_lock(&thread_events_lock);
+	for (auto &p : thread_events)
+	{
+		threads.push_back(p.second);
+	}
+	read_unlock(&thread_events_lock);
+	return threads;
 }
 
 /**
@@ -276,10 +704,13 @@ void sgxperf::EventStore::insert_event(Event *event)
 }
 
 /**
- * @brief Create a JSON sumamry of everything stored in this EventStore
- * @return A JSON representation of the contents of this EventStore
+ * @brief Serializes the events of the given threads into a database
+ * @param out_db The database to serialize into
+ * @param threads The threads whose events are serialized
+ * @param since Events before this timestamp are skipped, unless they are referenced by a later event
+ * @param until End time of the event collection
  */
-void sgxperf::EventStore::create_summary()
+void sgxperf::EventStore::create_summary(sqlite3 *out_db, std::list<Thread *> &threads, uint64_t since, uint64_t until)
 {
 	if (config->is_benchmark_mode_enabled())
 	{
@@ -291,19 +722,29 @@ void sgxperf::EventStore::create_summary()
 	std::stringstream stm;
 	std::map<sgx_enclave_id_t, std::string> enclave_files;
 
-	if (!finalized)
+	stm << "INSERT INTO `general` (`key`,`value`) VALUES ('version',2);";
+	stm << "INSERT INTO `general` (`key`,`value`) VALUES ('start_time'," << std::max(start_time, since) << ");";
+	stm << "INSERT INTO `general` (`key`,`value`) VALUES ('end_time'," << until << ");";
+	stm << "INSERT INTO `general` (`key`,`value`) VALUES ('main_thread'," << std::dec << main_thread->sql_id << ");";
+
+	uint64_t logger_events = 0;
+	uint64_t logger_bytes = 0;
+	uint64_t logger_time = 0;
+	for (auto thread : threads)
 	{
-		printf("!!! EventStore has to be finalized before serialization!\n");
-		throw std::exception();
-		//throw std::exception("EventStore has to be finalized before outputting summary");
+		logger_events += thread->event_count;
+		logger_bytes += thread->event_bytes;
+		logger_time += thread->logger_time;
+	}
+	stm << "INSERT INTO `general` (`key`,`value`) VALUES ('logger_events'," << logger_events << ");";
+	stm << "INSERT INTO `general` (`key`,`value`) VALUES ('logger_bytes'," << logger_bytes << ");";
+	stm << "INSERT INTO `general` (`key`,`value`) VALUES ('logger_time'," << logger_time << ");";
+	for (auto &p : general_values)
+	{
+		stm << "INSERT INTO `general` (`key`,`value`) VALUES ('" << p.first << "'," << p.second << ");";
 	}
 
-	stm << "INSERT INTO `general` (`key`,`value`) VALUES ('version',1);";
-	stm << "INSERT INTO `general` (`key`,`value`) VALUES ('start_time'," << start_time << ");";
-	stm << "INSERT INTO `general` (`key`,`value`) VALUES ('end_time'," << end_time << ");";
-	stm << "INSERT INTO `general` (`key`,`value`) VALUES ('main_thread'," << std::dec << main_thread->sql_id << ");";
-
-	sql_exec(stm);
+	sql_exec(out_db, stm);
 
 	std::cout << "(i) Mapping event IDs to names" << std::endl;
 	// event id to event name mapping
@@ -314,42 +755,28 @@ void sgxperf::EventStore::create_summary()
 	// Also add last entry
 	stm << "INSERT INTO `event_map` (`id`, `name`) VALUES (" << (int)__event_type::Last << ", '" << __event_type_names[(int)__event_type::Last] << "');";
 
-	sql_exec(stm);
+	sql_exec(out_db, stm);
 
-	std::cout << "(i) Serializing events (" << thread_events.size() << " + " << finished_thread_events.size() << " threads)" << std::endl;
+	std::cout << "(i) Serializing events (" << threads.size() << " threads)" << std::endl;
 
-	auto tit = finished_thread_events.begin();
+	auto tit = threads.begin();
 	std::set<void *> thread_addresses;
-	while (tit != finished_thread_events.end())
+	while (tit != threads.end())
 	{
 		stm << "INSERT INTO `threads` (`id`, `pthread_id`, `name`, `start_address`) VALUES (" << (*tit)->sql_id << ", " << (*tit)->id << ", '" << (*tit)->name << "', 0);";
-		sql_exec(stm);
+		sql_exec(out_db, stm);
 		tit++;
 	}
 
-	stm << "INSERT INTO `events` (`type`,`time`,`involved_thread`,`core`,`other_thread`,"
-	       "`arg`,`start_function`,`return_value`,`name`,`eid`,"
-	       "`file_name`,`enclave_start`,`enclave_end`,`call_id`,`call_event`,"
-	       "`aex_count`) "
-	       "VALUES (:type, :time, :involved_thread, :core, :other_thread, "
-	       ":arg, :start_function, :return_value, :name, :eid, "
-	       ":file_name, :enclave_start, :enclave_end, :call_id, :call_event, "
-	       ":aex_count);";
-	auto event_stm = stm.str();
-	sqlite3_stmt *event_stm_p = nullptr;
-	auto ret = sqlite3_prepare_v2(db, event_stm.c_str(), static_cast<int>(event_stm.length()), &event_stm_p, nullptr);
-	if (ret != SQLITE_OK)
-	{
-		const char *errmsg = sqlite3_errmsg(db);
-		printf("/!\\ Could not prepare statement: %s\n", errmsg);
-		printf("Statement was: %s\n", event_stm.c_str());
-		sqlite3_close(db);
+	EventWriter writer(out_db);
+	if (!writer.prepare())
+	{
+		sqlite3_close(out_db);
 		exit(-1);
 	}
-	stm.str(std::string());
 
-	tit = finished_thread_events.begin();
-	while (tit != finished_thread_events.end())
+	tit = threads.begin();
+	while (tit != threads.end())
 	{
 		auto queue = (*tit)->events;
 		while (!queue.empty())
@@ -357,8 +784,14 @@ void sgxperf::EventStore::create_summary()
 			auto e = queue.front();
 			queue.pop();
 
+			// Events outside of the flight recorder window are only written if a later event references them
+			if (e->get_time() < since)
+			{
+				continue;
+			}
+
 			// Make all pre insert things happen
-			e->pre_insert(event_stm_p, db);
+			e->pre_insert(&writer);
 
 			// If this is a paging event, we need to find the enclave it belongs to.
 			if (e->get_type() == EventType::EnclavePageInEvent || e->get_type() == EventType::EnclavePageOutEvent)
@@ -387,9 +820,7 @@ void sgxperf::EventStore::create_summary()
 			// Check if event has already been inserted and only insert if not
 			if (e->get_sql_id() == UINT64_MAX)
 			{
-				e->sql_bind(event_stm_p);
-				sqlite3_step(event_stm_p);
-				e->set_sql_id(static_cast<uint64_t>(sqlite3_last_insert_rowid(db)));
+				writer.write(e);
 			}
 
 			// In case of EnclaveCreationEvent we need to add the enclave file to the enclave_files map
@@ -409,7 +840,7 @@ void sgxperf::EventStore::create_summary()
 				auto tcevent = dynamic_cast<ThreadCreatorEvent *>(e);
 				thread_addresses.insert(tcevent->get_start_function());
 				stm << "UPDATE `threads` SET `start_address` = " << (uint64_t) tcevent->get_start_function() << " WHERE `id` == " << tcevent->get_other_thread_id() << ";";
-				sql_exec(stm);
+				sql_exec(out_db, stm);
 			}
 			nextevent:;
 			//delete e;
@@ -447,7 +878,7 @@ void sgxperf::EventStore::create_summary()
 			       "`start_address_normalized` = " << ((uint64_t)*tsit - (uint64_t)dlinfo.dli_fbase) << ","
 			       "`start_symbol` = '" << info << "' WHERE `start_address` == " << (uint64_t)*tsit << ";";
 		}
-		sql_exec(stm);
+		sql_exec(out_db, stm);
 		tsit++;
 	}
 
@@ -472,7 +903,7 @@ void sgxperf::EventStore::create_summary()
 				       "" << i << ","
 				       "" << (uint64_t) enclit->first << ""
 				       ");";
-				sql_exec(stm);
+				sql_exec(out_db, stm);
 				goto next;
 			}
 			auto binary = std::string(dlinfo.dli_fname);
@@ -487,7 +918,7 @@ void sgxperf::EventStore::create_summary()
 			       "" << (uint64_t) map->table[i] << ","
 			       "" << ((uint64_t)map->table[i] - (uint64_t)dlinfo.dli_fbase) << ""
                    ");";
-			sql_exec(stm);
+			sql_exec(out_db, stm);
 		}
 		next:
 		enclit++;
@@ -517,7 +948,7 @@ void sgxperf::EventStore::create_summary()
 			       "'" << info << "',"
 			       "" <<  (ecalltable->ecall_table[i].is_priv ? "1" : "0") << ""
 			       ");";
-			sql_exec(stm);
+			sql_exec(out_db, stm);
 		}
 		enclfit++;
 		free(ecalltable);
@@ -529,11 +960,12 @@ void sgxperf::EventStore::create_summary()
 
 	std::cout << "(i) Creating DB indices" << std::endl;
 	const char *indices = ""
-	                      "CREATE UNIQUE INDEX idx_events_id ON events (id);"
-	                      "CREATE INDEX idx_events_call_id ON events (call_id);"
+	                      "CREATE INDEX idx_call_events_call_id ON call_events (call_id);"
+	                      "CREATE INDEX idx_return_events_call_event ON return_events (call_event);"
+	                      "CREATE INDEX idx_sync_events_arg ON sync_events (arg);"
 	                      "";
 	char *errmsg = nullptr;
-	int rc = sqlite3_exec(db, indices, nullptr, nullptr, &errmsg);
+	int rc = sqlite3_exec(out_db, indices, nullptr, nullptr, &errmsg);
 
 	if (rc != SQLITE_OK)
 	{
@@ -585,25 +1017,16 @@ void sgxperf::EventStore::write_summary(std::string &filename)
 	std::ofstream file;
 	try
 	{
-		create_summary();
-		printf("(i) Writing out file\n");
-		sqlite3 *fdb;
-		int rc = sqlite3_open(filename.c_str(), &fdb);
-		if (rc == SQLITE_OK)
+		if (!finalized)
 		{
-			sqlite3_backup *p = sqlite3_backup_init(fdb, "main", db, "main");
-			if (p)
-			{
-				sqlite3_backup_step(p, -1);
-				sqlite3_backup_finish(p);
-			}
-			rc = sqlite3_errcode(fdb);
-		}
-		else
-		{
-			std::cout << "!!! Could not open file for writing!" << std::endl;
+			printf("!!! EventStore has to be finalized before serialization!\n");
+			throw std::exception();
+			//throw std::exception("EventStore has to be finalized before outputting summary");
 		}
-		sqlite3_close(fdb);
+
+		create_summary(db, finished_thread_events, 0, end_time);
+		printf("(i) Writing out file\n");
+		backup_database(db, filename);
 	}
 	catch (std::exception &e)
 	{
@@ -613,6 +1036,34 @@ void sgxperf::EventStore::write_summary(std::string &filename)
 	sqlite3_close(db);
 }
 
+/**
+ * @brief Copies an in-memory database to a file
+ * @param from The database to copy
+ * @param filename Name of the file that the database shall be written to
+ * @return SQLITE_OK on success, an SQLite error code otherwise
+ */
+int sgxperf::EventStore::backup_database(sqlite3 *from, std::string &filename)
+{
+	sqlite3 *fdb;
+	int rc = sqlite3_open(filename.c_str(), &fdb);
+	if (rc == SQLITE_OK)
+	{
+		sqlite3_backup *p = sqlite3_backup_init(fdb, "main", from, "main");
+		if (p)
+		{
+			sqlite3_backup_step(p, -1);
+			sqlite3_backup_finish(p);
+		}
+		rc = sqlite3_errcode(fdb);
+	}
+	else
+	{
+		std::cout << "!!! Could not open file for writing!" << std::endl;
+	}
+	sqlite3_close(fdb);
+	return rc;
+}
+
 /**
  * @brief Finalize the EventStore to stop accepting events
  */
@@ -629,38 +1080,324 @@ void sgxperf::EventStore::finalize()
 		auto thread = it->second;
 
 		// Find open calls and finalize them
-		while (thread->current_call != nullptr)
+		close_open_calls(thread->events, thread->current_call, end_time);
+		thread->current_call = nullptr;
+
+		finished_thread_events.push_back(thread);
+		it++;
+	}
+	thread_events.clear();
+
+}
+
+/**
+ * @brief Closes the call @p call and all calls it is nested in by appending return events to @p queue
+ * @param queue The event queue of the thread that is in the call
+ * @param call The innermost open call
+ * @param time Timestamp of the return events
+ */
+void sgxperf::EventStore::close_open_calls(std::queue<Event *> &queue, EnclaveCallEvent *call, uint64_t time)
+{
+	while (call != nullptr)
+	{
+		auto ec = dynamic_cast<EnclaveECallEvent *>(call);
+		if (ec != nullptr)
+		{
+			// is an ECallEvent
+			auto ecr = new sgxperf::EnclaveECallReturnEvent(ec, SGX_SUCCESS, ec->aex_counter);
+			ecr->set_thread_id(ec->get_thread_id());
+			ecr->set_time(time);
+			queue.push(ecr);
+
+		}
+		else
 		{
-			auto ec = dynamic_cast<EnclaveECallEvent *>(thread->current_call);
-			if (ec != nullptr)
+			auto oc = dynamic_cast<EnclaveOCallEvent *>(call);
+			if (oc != nullptr)
 			{
-				// is an ECallEvent
-				auto ecr = new sgxperf::EnclaveECallReturnEvent(ec, SGX_SUCCESS, ec->aex_counter);
-				ecr->set_thread_id(ec->get_thread_id());
-				ecr->set_time(end_time);
-				thread->events.push(ecr);
+				// is an OCallEvent
+				auto ocr = new sgxperf::EnclaveOCallReturnEvent(oc, SGX_SUCCESS);
+				ocr->set_thread_id(oc->get_thread_id());
+				ocr->set_time(time);
+				queue.push(ocr);
 
 			}
-			else
+		}
+
+		call = call->get_previous_call();
+	}
+}
+
+/**
+ * @brief Drops all events of @p thread that are older than the flight recorder window. The thread's events_lock has to be held.
+ * @param thread The thread whose queue is trimmed
+ * @param now Timestamp of the newest event of the thread
+ */
+void sgxperf::EventStore::evict_events(Thread *thread, uint64_t now)
+{
+	uint64_t window = config->get_flight_recorder_window();
+	if (now < window)
+	{
+		return;
+	}
+
+	uint64_t horizon = now - window;
+	while (!thread->events.empty() && thread->events.front()->get_time() < horizon)
+	{
+		auto e = thread->events.front();
+		thread->events.pop();
+		evict_event(e);
+	}
+}
+
+/**
+ * @brief Frees an event that dropped out of the flight recorder window.
+ * Calls are still referenced by nested calls, AEXs and sync events, so they are freed together with their return event instead.
+ * @param event The event to free
+ */
+void sgxperf::EventStore::evict_event(Event *event)
+{
+	switch (event->get_type())
+	{
+		case EventType::EnclaveECallEvent:
+		case EventType::EnclaveOCallEvent:
+		{
+			// Owned by the return event
+			return;
+		}
+		case EventType::EnclaveECallReturnEvent:
+		{
+			delete dynamic_cast<EnclaveECallReturnEvent *>(event)->get_ecall_event();
+			break;
+		}
+		case EventType::EnclaveOCallReturnEvent:
+		{
+			delete dynamic_cast<EnclaveOCallReturnEvent *>(event)->get_ocall_event();
+			break;
+		}
+		case EventType::EnclaveSyncWaitEvent:
+		{
+			// If nobody consumed the wait yet, nobody may do so after it is gone
+			auto wait = dynamic_cast<EnclaveSyncWaitEvent *>(event);
+			write_lock(&tcs_map_lock);
+			auto it = tcs_map.begin();
+			while (it != tcs_map.end())
 			{
-				auto oc = dynamic_cast<EnclaveOCallEvent *>(thread->current_call);
-				if (oc != nullptr)
+				if (it->second == wait)
 				{
-					// is an ECallEvent
-					auto ocr = new sgxperf::EnclaveOCallReturnEvent(oc, SGX_SUCCESS);
-					ocr->set_thread_id(oc->get_thread_id());
-					ocr->set_time(end_time);
-					thread->events.push(ocr);
-
+					tcs_map.erase(it);
+					break;
 				}
+				it++;
+			}
+			write_unlock(&tcs_map_lock);
+			// A set event may keep the wait alive after its OCall is gone
+			wait->detach_ocall_event();
+			if (wait->release())
+			{
+				delete wait;
+			}
+			return;
+		}
+		case EventType::EnclaveSyncSetEvent:
+		{
+			auto wait = dynamic_cast<EnclaveSyncSetEvent *>(event)->get_wait_event();
+			if (wait->release())
+			{
+				delete wait;
 			}
+			break;
+		}
+		default:
+		{
+			// Nothing references other events
+		}
+	}
+	delete event;
+}
+
+/**
+ * @brief Trims the queues of all threads, including finished ones, to the flight recorder window.
+ * Threads only evict on their own inserts, so an idle thread would otherwise keep its events until shutdown.
+ */
+void sgxperf::EventStore::evict_idle_events()
+{
+	timespec t = {};
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	auto now = static_cast<uint64_t>(t.tv_nsec + t.tv_sec * 1000000000);
+
+	read_lock(&thread_events_lock);
+	std::list<Thread *> threads(finished_thread_events.begin(), finished_thread_events.end());
+	for (auto &p : thread_events)
+	{
+		threads.push_back(p.second);
+	}
+	for (auto thread : threads)
+	{
+		write_lock(&thread->events_lock);
+		evict_events(thread, now);
+		write_unlock(&thread->events_lock);
+	}
+	read_unlock(&thread_events_lock);
+}
+
+/**
+ * @brief Starts the dumper thread of the flight recorder, if enabled
+ */
+void sgxperf::EventStore::start_flight_recorder()
+{
+	if (!config->is_flight_recorder_enabled())
+	{
+		return;
+	}
+
+	dumper_running = true;
+	dumper = new std::thread([this] () { dumper_thread(); });
+	pthread_setname_np(dumper->native_handle(), "sgxperf dumper");
+}
+
+/**
+ * @brief Stops the dumper thread of the flight recorder
+ */
+void sgxperf::EventStore::stop_flight_recorder()
+{
+	if (dumper == nullptr)
+	{
+		return;
+	}
+
+	dumper_running = false;
+	dumper->join();
+	delete dumper;
+	dumper = nullptr;
+}
 
-			thread->current_call = thread->current_call->get_previous_call();
+/**
+ * @brief Requests a flight recorder dump. Only sets a flag, so this is safe to call from a signal handler.
+ */
+void sgxperf::EventStore::request_dump()
+{
+	if (config->is_flight_recorder_enabled())
+	{
+		dump_requested = true;
+	}
+}
+
+/**
+ * @brief Main loop of the dumper thread. Polls for dump requests and trims the queues of idle threads.
+ */
+void sgxperf::EventStore::dumper_thread()
+{
+	auto next_trim = std::chrono::steady_clock::now();
+	while (dumper_running)
+	{
+		if (dump_requested.exchange(false))
+		{
+			dump();
+			// Triggers that fired while dumping are covered by this dump
+			dump_requested = false;
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
 		}
 
-		finished_thread_events.push_back(thread);
-		it++;
+		if (std::chrono::steady_clock::now() >= next_trim)
+		{
+			evict_idle_events();
+			next_trim = std::chrono::steady_clock::now() + std::chrono::milliseconds(FLIGHT_RECORDER_TRIM_INTERVAL);
+		}
 	}
-	thread_events.clear();
+}
 
+/**
+ * @brief Writes the current flight recorder window to out-<pid>-<n>.db.
+ * Calls that started before the window are written as well, and calls that are still open are closed at the dump time.
+ */
+void sgxperf::EventStore::dump()
+{
+	timespec t = {};
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	auto until = static_cast<uint64_t>(t.tv_nsec + t.tv_sec * 1000000000);
+	auto window = config->get_flight_recorder_window();
+	auto since = until > window ? until - window : 0;
+
+	std::list<Thread *> threads;
+	std::list<Thread *> snapshot;
+	std::list<size_t> recorded;
+
+	// Take a snapshot of all queues. Eviction is suspended until the snapshot is serialized.
+	write_lock(&thread_events_lock);
+	for (auto &p : thread_events)
+	{
+		threads.push_back(p.second);
+	}
+	threads.insert(threads.end(), finished_thread_events.begin(), finished_thread_events.end());
+	for (auto thread : threads)
+	{
+		write_lock(&thread->events_lock);
+	}
+
+	for (auto thread : threads)
+	{
+		auto copy = new Thread(thread->id, thread->sql_id);
+		copy->name = thread->name;
+		copy->events = thread->events;
+		copy->event_count = thread->event_count;
+		copy->event_bytes = thread->event_bytes;
+		copy->logger_time = thread->logger_time;
+		recorded.push_back(copy->events.size());
+
+		close_open_calls(copy->events, get_open_call(thread), until);
+		snapshot.push_back(copy);
+	}
+	dumping = true;
+
+	for (auto thread : threads)
+	{
+		write_unlock(&thread->events_lock);
+	}
+	write_unlock(&thread_events_lock);
+
+	std::stringstream ss;
+	ss << "out-" << getpid() << "-" << dump_count++ << ".db";
+	auto filename = ss.str();
+	std::cout << "=== Flight recorder dump to " << filename << std::endl;
+
+	sqlite3 *dump_db = nullptr;
+	if (open_database(&dump_db) == 0)
+	{
+		read_lock(&enclave_map_lock);
+		create_summary(dump_db, snapshot, since, until);
+		read_unlock(&enclave_map_lock);
+	}
+
+	// Events are shared with the live queues, so make them insertable again and free the synthetic returns
+	auto rit = recorded.begin();
+	for (auto copy : snapshot)
+	{
+		size_t i = 0;
+		while (!copy->events.empty())
+		{
+			auto e = copy->events.front();
+			copy->events.pop();
+			if (e->get_sql_id() != UINT64_MAX)
+			{
+				e->reset_sql_id();
+			}
+			if (i++ >= *rit)
+			{
+				delete e;
+			}
+		}
+		delete copy;
+		rit++;
+	}
+	dumping = false;
+
+	if (dump_db != nullptr)
+	{
+		backup_database(dump_db, filename);
+		sqlite3_close(dump_db);
+	}
 }
@@ -12,6 +12,7 @@
 #include <map>
 #include <unordered_map>
 #include <atomic>
+#include <thread>
 #include <rwlock.h>
 
 #include "events.h"
@@ -20,6 +21,16 @@
 #ifndef SGX_PERF_STORE_H
 #define SGX_PERF_STORE_H
 
+/**
+ * @brief Number of tables events are written to, see EventWriter.
+ */
+#define EVENT_TABLE_COUNT 9
+
+/**
+ * @brief Interval in ms at which the dumper thread trims the queues of all threads to the flight recorder window
+ */
+#define FLIGHT_RECORDER_TRIM_INTERVAL 100
+
 namespace sgxperf
 {
 	/**
@@ -34,7 +45,8 @@ namespace sgxperf
 		                                                                        orig_table(nullptr),
 		                                                                        subst_ocall_table(nullptr),
 		                                                                        creation_time(0),
-		                                                                        destruction_time(UINT64_MAX)
+		                                                                        destruction_time(UINT64_MAX),
+		                                                                        is_debug(false)
 		{
 			encl_end = (void *)((uint64_t)encl_start + size);
 		}
@@ -68,6 +80,7 @@ namespace sgxperf
 		struct ocall_table *subst_ocall_table; ///< Pointer to our interceptor OCall table for this enclave
 		uint64_t creation_time; ///< Timestamp of the EnclaveCreationEvent
 		uint64_t destruction_time; ///< Timestamp of the EnclaveDestructionEvent. Can be UINT64_MAX to indicate that the enclave has not been destroyed yet.
+		bool is_debug; ///< Whether this is a debug enclave, whose memory can be read
 	};
 
 	/**
@@ -81,7 +94,11 @@ namespace sgxperf
 		                                              current_call(nullptr),
 		                                              last_enclave(nullptr),
 		                                              name(""),
-		                                              events() {}
+		                                              events(),
+		                                              events_lock({}),
+		                                              event_count(0),
+		                                              event_bytes(0),
+		                                              logger_time(0) {}
 		virtual ~Thread() = default;
 		pthread_t id; ///< pthread id of the thread
 		uint64_t sql_id; ///< SQL id of the thread
@@ -89,9 +106,33 @@ namespace sgxperf
 		Enclave *last_enclave; ///< Pointer to an Enclave object representing the last enclave that has been entered by this thread.
 		std::string name; ///< The name of this thread.
 		std::queue<Event *> events; ///< All events associated with this thread.
+		rwlock_t events_lock; ///< Lock for the events queue. Only taken in flight recorder or watchdog mode, where other threads access the queue.
+		uint64_t event_count; ///< Number of events this thread inserted
+		uint64_t event_bytes; ///< Heap memory used by the events this thread inserted
+		uint64_t logger_time; ///< Time in ns this thread spent inserting events
 	private:
 	};
 
+	/**
+	 * @brief Writes events into the per-type event tables of a summary database.
+	 * Event ids are handed out by the writer, so they are unique across all tables.
+	 */
+	class EventWriter
+	{
+	public:
+		explicit EventWriter(sqlite3 *db) : db(db), next_id(1), statements(), call_statement(nullptr) {}
+		~EventWriter();
+		bool prepare();
+		void write(Event *event);
+	private:
+		sqlite3_stmt *statement_for(EventType type);
+		void write_call(EnclaveCallEvent *call, Event *ret, sqlite3_int64 aex_count);
+		sqlite3 *db; ///< Database the events are written to
+		uint64_t next_id; ///< Id of the next written event
+		sqlite3_stmt *statements[EVENT_TABLE_COUNT]; ///< Prepared insert statements, one per event table
+		sqlite3_stmt *call_statement; ///< Prepared insert statement for the calls table
+	};
+
 	/**
 	 * @brief The event store that manages all events.
 	 */
@@ -108,12 +149,21 @@ namespace sgxperf
 		bool is_finalized() { return finalized; }
 		void insert_event(pthread_t involved_thread, Event *event);
 		void insert_event(Event *event);
+		bool insert_snapshot(Thread *thread, EnclaveCallSnapshotEvent *event);
+		EnclaveCallEvent *get_open_call(Thread *thread);
+		std::list<Thread *> get_threads();
+		void calibrate();
+		void set_general(std::string const &key, uint64_t value);
 		void write_summary(std::string &filename);
 		Thread *get_thread();
 		int create_database();
-		void sql_exec(const char *sql);
-		void sql_exec(std::string const &sql);
-		void sql_exec(std::stringstream &ss);
+		void sql_exec(sqlite3 *out_db, const char *sql);
+		void sql_exec(sqlite3 *out_db, std::string const &sql);
+		void sql_exec(sqlite3 *out_db, std::stringstream &ss);
+
+		void start_flight_recorder();
+		void stop_flight_recorder();
+		void request_dump();
 
 		rwlock_t enclave_map_lock; ///< Lock for the enclave_map
 		std::unordered_map<sgx_enclave_id_t, Enclave *> enclave_map; ///< Maps enclave ids to enclaves
@@ -123,7 +173,16 @@ namespace sgxperf
 	private:
 		uint64_t thread_id; ///< Counter that holds the next thread id that is to be given to a new thread
 		sqlite3 *db; ///< SQLite database that holds the events
-		void create_summary();
+		int open_database(sqlite3 **out_db);
+		void create_summary(sqlite3 *out_db, std::list<Thread *> &threads, uint64_t since, uint64_t until);
+		int backup_database(sqlite3 *from, std::string &filename);
+		void close_open_calls(std::queue<Event *> &queue, EnclaveCallEvent *call, uint64_t time);
+		void evict_events(Thread *thread, uint64_t now);
+		void evict_event(Event *event);
+		void evict_idle_events();
+		void push_event(Thread *thread, Event *event);
+		void dumper_thread();
+		void dump();
 		rwlock_t thread_events_lock; ///< Read-Write lock for the thread_events map
 		std::unordered_map<pthread_t, Thread *> thread_events; ///< Maps pthread ids to Thread objects
 		std::list<Thread *> finished_thread_events; ///< List that stores all threads that have finished execution
@@ -131,6 +190,14 @@ namespace sgxperf
 		uint64_t end_time; ///< End time of the event collection
 		Thread *main_thread; ///< Thread object of the main thread
 		uint64_t start_time; ///< Start time of the event collection
+		bool locked_queues; ///< Whether the event queues are accessed by other threads and need locking
+		std::map<std::string, uint64_t> general_values; ///< Additional entries for the general table
+
+		std::atomic<bool> dumping; ///< Indicates that a flight recorder dump is in progress, which suspends eviction
+		std::atomic<bool> dump_requested; ///< Set by a trigger, consumed by the dumper thread
+		std::atomic<bool> dumper_running; ///< Keeps the dumper thread alive
+		std::thread *dumper; ///< Thread that writes out flight recorder dumps
+		uint32_t dump_count; ///< Number of flight recorder dumps written so far
 	};
 }
 
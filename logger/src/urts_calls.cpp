@@ -13,6 +13,8 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <iostream>
+#include <vector>
+#include <algorithm>
 
 #include "urts_calls.h"
 #include "elfparser.h"
@@ -31,6 +33,25 @@ static int (*real_sgx_thread_set_untrusted_event_ocall)(const void *self) = null
 
 static void patch_aep();
 
+/**
+ * @brief Number of timed rounds per ECall during transition calibration.
+ */
+#define TRANSITION_CALIBRATION_ROUNDS 10000
+
+/**
+ * @brief Number of untimed rounds before the timed ones, see examples/Benchmark.
+ */
+#define TRANSITION_CALIBRATION_WARMUP 1000
+
+/**
+ * @brief ECalls of the calibration enclave, see examples/Benchmark/misc/enclave.edl.
+ */
+enum __calibration_ecall
+{
+	CALIBRATION_ECALL_SINGLE = 0,
+	CALIBRATION_ECALL_WITH_OCALL = 1,
+};
+
 CEnclavePoolInstance cenclavepoolinstance = nullptr;
 CEnclavePoolGetEvent cenclavepoolgetevent = nullptr;
 CEnclavePoolGetEnclave cenclavepoolgetenclave = nullptr;
@@ -158,6 +179,31 @@ bool read_from_enclave(void *addr, void *buffer, size_t size, size_t *read_nr =
 	return true;
 }
 
+/**
+ * @brief Computes the address of the GPR area inside the SSA frame that an AEX of a thread using @p tcs saved its state to.
+ * @param tcs Address of the TCS, as found in rbx after an AEX
+ * @return Address of the GPR area, inside enclave memory
+ */
+ssa_gpr_t *get_ssa_gpr(tcs_t *tcs)
+{
+	auto ssa_addr = (ssa_gpr_t *)(tcs + 0x2);
+	return (ssa_gpr_t *)((uint8_t *)ssa_addr - 184);
+}
+
+/**
+ * @brief Reads the rip saved by the last AEX of a thread using @p tcs. Only works for debug enclaves.
+ * Only uses pread on an already opened file, so this is safe to call from a signal handler.
+ * @param mem_fd File descriptor of /proc/self/mem
+ * @param tcs Address of the TCS, as found in rbx after an AEX
+ * @param[out] rip The rip inside the enclave
+ * @return true on success, false otherwise.
+ */
+bool read_ssa_rip(int mem_fd, tcs_t *tcs, uint64_t *rip)
+{
+	auto offset = reinterpret_cast<__off64_t>(&get_ssa_gpr(tcs)->rip);
+	return pread64(mem_fd, rip, sizeof(*rip), offset) == sizeof(*rip);
+}
+
 // Disable optimizations
 #pragma GCC push_options
 #pragma GCC optimize ("O0")
@@ -200,9 +246,7 @@ extern "C" __attribute__((optimize("O0"))) void __really_new_aep()
 	// Save TCS address so we can read out SSA
 	tcs_t *tcs_addr = nullptr;
 	__asm__("mov %%rbx, %0" : "=g"(tcs_addr) : : "rax", "rbx", "rcx");
-	auto ssa_addr = (ssa_gpr_t *)(tcs_addr + 0x2);
-	ssa_addr = (ssa_gpr_t *)((uint8_t *)ssa_addr - 184);
-	auto exit_info = &ssa_addr->exit_info;
+	auto exit_info = &get_ssa_gpr(tcs_addr)->exit_info;
 
 	uint8_t ei[sizeof(exit_info_t)];
 	bool r = read_from_enclave(exit_info, ei, sizeof(ei));
@@ -324,6 +368,100 @@ static void patch_aep()
 	std::cout << "/i\\ AEP patched" << std::endl;
 }
 
+/**
+ * @brief Empty OCall used for all entries of the calibration OCall table.
+ * @param pms Unused marshalling struct
+ */
+static sgx_status_t calibration_ocall(void *pms)
+{
+	(void)pms;
+	return SGX_SUCCESS;
+}
+
+/**
+ * @brief OCall table handed to the calibration enclave. It only issues OCall 0, the other entries cover the OCalls imported from sgx_tstdc.
+ */
+static struct
+{
+	size_t count;
+	void *table[8];
+} calibration_ocall_table = {8, {(void *)calibration_ocall, (void *)calibration_ocall, (void *)calibration_ocall, (void *)calibration_ocall,
+                                 (void *)calibration_ocall, (void *)calibration_ocall, (void *)calibration_ocall, (void *)calibration_ocall}};
+
+/**
+ * @brief Times @p ecall_id of the calibration enclave.
+ * @param eid ID of the calibration enclave
+ * @param ecall_id The ECall to time
+ * @param median Pointer to save the median round trip time in ns to
+ * @return true, if all ECalls succeeded, false otherwise.
+ */
+static bool time_calibration_ecall(sgx_enclave_id_t eid, int ecall_id, uint64_t *median)
+{
+	auto table = reinterpret_cast<struct ocall_table *>(&calibration_ocall_table);
+	for (int i = 0; i < TRANSITION_CALIBRATION_WARMUP; ++i)
+	{
+		if (real_sgx_ecall(eid, ecall_id, table, nullptr) != SGX_SUCCESS)
+		{
+			return false;
+		}
+	}
+
+	std::vector<uint64_t> times(TRANSITION_CALIBRATION_ROUNDS);
+	for (size_t i = 0; i < TRANSITION_CALIBRATION_ROUNDS; ++i)
+	{
+		timespec before = {};
+		timespec after = {};
+		clock_gettime(CLOCK_MONOTONIC_RAW, &before);
+		sgx_status_t ret = real_sgx_ecall(eid, ecall_id, table, nullptr);
+		clock_gettime(CLOCK_MONOTONIC_RAW, &after);
+		if (ret != SGX_SUCCESS)
+		{
+			return false;
+		}
+		times[i] = static_cast<uint64_t>((after.tv_sec - before.tv_sec) * 1000000000 + (after.tv_nsec - before.tv_nsec));
+	}
+
+	std::nth_element(times.begin(), times.begin() + TRANSITION_CALIBRATION_ROUNDS / 2, times.end());
+	*median = times[TRANSITION_CALIBRATION_ROUNDS / 2];
+	return true;
+}
+
+/**
+ * @brief Measures the round trip time of an empty ECall and an empty OCall on this machine with the calibration enclave,
+ * i.e., the benchmark enclave of examples/Benchmark. The enclave is neither recorded nor are its calls.
+ * The results are saved to the general table as @c ecall_roundtrip and @c ocall_roundtrip.
+ * @param file_name Path to the signed calibration enclave
+ */
+void calibrate_transitions(const char *file_name)
+{
+	sgx_launch_token_t token = {0};
+	int updated = 0;
+	sgx_enclave_id_t eid = 0;
+
+	sgx_status_t ret = real_sgx_create_enclave(file_name, 1, &token, &updated, &eid, nullptr);
+	if (ret != SGX_SUCCESS)
+	{
+		std::cout << "/!\\ Could not create calibration enclave " << file_name << ": 0x" << std::hex << ret << std::dec << std::endl;
+		return;
+	}
+
+	uint64_t ecall = 0;
+	uint64_t ecall_with_ocall = 0;
+	if (!time_calibration_ecall(eid, CALIBRATION_ECALL_SINGLE, &ecall) || !time_calibration_ecall(eid, CALIBRATION_ECALL_WITH_OCALL, &ecall_with_ocall))
+	{
+		std::cout << "/!\\ Calibration enclave " << file_name << " failed, is it the Benchmark enclave?" << std::endl;
+		real_sgx_destroy_enclave(eid);
+		return;
+	}
+	real_sgx_destroy_enclave(eid);
+
+	uint64_t ocall = ecall_with_ocall > ecall ? ecall_with_ocall - ecall : 0;
+	event_store->set_general("ecall_roundtrip", ecall);
+	event_store->set_general("ocall_roundtrip", ocall);
+
+	std::cout << "(i) Transition cost: " << ecall << "ns per ECall, " << ocall << "ns per OCall" << std::endl;
+}
+
 /**
  * @return @c true, if we are running in hardware mode,
  */
@@ -367,6 +505,7 @@ extern "C" sgx_status_t sgx_create_enclave(const char *file_name, const int debu
 	auto enclave_end = reinterpret_cast<uint64_t>(cenclinst->start_address) + cenclinst->size;
 
 	auto encl = new sgxperf::Enclave(*enclave_id, cenclinst->start_address, cenclinst->size);
+	encl->is_debug = debug != 0;
 
 	std::string sname(file_name);
 	auto ece = new sgxperf::EnclaveCreationEvent(*enclave_id, sname, ret, enclave_start, enclave_end);
@@ -484,6 +623,8 @@ extern "C" int sgx_thread_set_untrusted_event_ocall(const void *waiter)
 	{
 		wait_event = it->second;
 		event_store->tcs_map.erase(it);
+		// The set event keeps the wait event alive, even if the waiter's queue drops it
+		dynamic_cast<sgxperf::EnclaveSyncWaitEvent *>(wait_event)->retain();
 	}
 	write_unlock(&event_store->tcs_map_lock);
 
@@ -650,7 +791,15 @@ extern "C" sgx_status_t sgx_ecall(const sgx_enclave_id_t eid, const int ecall_id
 
 	sgx_status_t ret = real_sgx_ecall(eid, ecall_id, ocall_table, arg_struct);
 
-	event_store->insert_event(new sgxperf::EnclaveECallReturnEvent(ecall, ret, dynamic_cast<sgxperf::EnclaveECallEvent *>(t->current_call)->aex_counter));
+	auto ecr = new sgxperf::EnclaveECallReturnEvent(ecall, ret, dynamic_cast<sgxperf::EnclaveECallEvent *>(t->current_call)->aex_counter);
+	uint64_t duration = ecr->get_time() - ecall->get_time();
+	event_store->insert_event(ecr);
 	t->current_call = t->current_call->get_previous_call();
+
+	// Slow ECalls trigger a flight recorder dump
+	if (config->get_flight_recorder_threshold() != 0 && duration > config->get_flight_recorder_threshold())
+	{
+		event_store->request_dump();
+	}
 	return ret;
 }
@@ -12,6 +12,7 @@
 
 int initialize_urts_calls();
 bool is_hw_mode();
+void calibrate_transitions(const char *file_name);
 
 /**
  * @brief struct describing the OCall table
@@ -112,5 +113,7 @@ typedef struct __ms_sgx_thread_setwait_untrusted_events_ocall
 } ms_sgx_thread_setwait_untrusted_events_ocall_t;
 
 bool read_from_enclave(void *addr, void *buffer, size_t size, size_t *read_nr);
+ssa_gpr_t *get_ssa_gpr(tcs_t *tcs);
+bool read_ssa_rip(int mem_fd, tcs_t *tcs, uint64_t *rip);
 
 #endif //SGX_PERF_URTS_CALLS_H
@@ -0,0 +1,259 @@
+/**
+ * @file watchdog.cpp
+ * @author weichbr
+ */
+
+#include "watchdog.h"
+#include "events.h"
+#include "store.h"
+#include "config.h"
+#include "urts_calls.h"
+#include <csignal>
+#include <ucontext.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+
+/**
+ * @brief Signal that is sent to stuck threads. Real-time signals are not used by the SDK.
+ */
+#define WATCHDOG_SIGNAL (SIGRTMIN + 4)
+
+/**
+ * @brief ERESUME leaf, found in rax after an AEX.
+ */
+#define ERESUME 3
+
+extern sgxperf::EventStore *event_store;
+extern sgxperf::Config *config;
+
+static sgxperf::EnclaveCallSnapshotEvent *volatile pending_snapshot = nullptr; //!< Snapshot the signal handler fills in
+static sgxperf::Thread *volatile pending_thread = nullptr; //!< Thread the pending snapshot is taken of
+static volatile bool snapshot_done = false; //!< Set by the signal handler once the snapshot is filled in
+static int enclave_mem_fd = -1; //!< /proc/self/mem, opened before the signal handler is installed and only read with pread
+
+/**
+ * @brief Signal handler running on the stuck thread. Captures the untrusted stack and, for debug enclaves, the rip inside the enclave.
+ * Only touches memory that has been allocated by the watchdog beforehand, and only reads enclave memory with pread on its own file descriptor.
+ * @param signum
+ * @param siginfo
+ * @param context
+ */
+static void snapshot_handler(int signum, siginfo_t *siginfo, void *context)
+{
+	(void)signum;
+	(void)siginfo;
+
+	auto thread = pending_thread;
+	if (thread == nullptr || !pthread_equal(thread->id, pthread_self()))
+	{
+		// Late signal for a snapshot the watchdog already gave up on
+		return;
+	}
+
+	// Claim the snapshot, the watchdog might give up on it concurrently
+	auto event = __sync_lock_test_and_set(&pending_snapshot, nullptr);
+	if (event == nullptr)
+	{
+		return;
+	}
+
+	event->frame_count = backtrace(event->frames, SNAPSHOT_MAX_FRAMES);
+
+	// If the signal interrupted the enclave, the AEX left ERESUME in rax and the TCS address in rbx
+	auto uc = static_cast<ucontext_t *>(context);
+	auto rax = static_cast<uint64_t>(uc->uc_mcontext.gregs[REG_RAX]);
+	auto tcs_addr = reinterpret_cast<tcs_t *>(uc->uc_mcontext.gregs[REG_RBX]);
+	auto encl = thread->last_enclave;
+	if (rax == ERESUME && encl != nullptr && encl->is_debug && enclave_mem_fd != -1 && encl->is_within_enclave(tcs_addr))
+	{
+		uint64_t rip = 0;
+		if (read_ssa_rip(enclave_mem_fd, tcs_addr, &rip))
+		{
+			event->enclave_rip = rip;
+		}
+	}
+
+	__sync_synchronize();
+	snapshot_done = true;
+}
+
+/**
+ * @brief Initializes the watchdog, if enabled.
+ */
+void sgxperf::Watchdog::init()
+{
+	if (!config->is_watchdog_enabled())
+	{
+		return;
+	}
+
+	// The first call of backtrace loads libgcc, which must not happen inside the signal handler
+	void *buffer[1];
+	backtrace(buffer, 1);
+
+	// Neither open nor the shared file of read_from_enclave may be used inside the signal handler
+	enclave_mem_fd = open("/proc/self/mem", O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+	if (enclave_mem_fd == -1)
+	{
+		std::cout << "/!\\ Could not open enclave memory, snapshots will not contain the rip inside the enclave" << std::endl;
+	}
+
+	struct sigaction sig_act = {};
+	sig_act.sa_sigaction = snapshot_handler;
+	sig_act.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigaction(WATCHDOG_SIGNAL, &sig_act, nullptr);
+}
+
+/**
+ * @brief Starts the watchdog thread.
+ */
+void sgxperf::Watchdog::start()
+{
+	if (!config->is_watchdog_enabled())
+	{
+		return;
+	}
+
+	running = true;
+	worker = new std::thread([this] () { watchdog_thread(); });
+	pthread_setname_np(worker->native_handle(), "sgxperf watchdog");
+}
+
+/**
+ * @brief Stops the watchdog thread.
+ */
+void sgxperf::Watchdog::stop()
+{
+	if (worker == nullptr)
+	{
+		return;
+	}
+
+	running = false;
+	worker->join();
+	delete worker;
+	worker = nullptr;
+}
+
+/**
+ * @brief Main loop of the watchdog thread.
+ */
+void sgxperf::Watchdog::watchdog_thread()
+{
+	while (running)
+	{
+		std::this_thread::sleep_for(std::chrono::nanoseconds(config->get_watchdog_interval()));
+		scan();
+	}
+}
+
+/**
+ * @brief Checks the innermost open call of every thread. A call is snapshotted when it runs longer than the threshold,
+ * and again every time its duration doubles.
+ */
+void sgxperf::Watchdog::scan()
+{
+	timespec t = {};
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	auto now = static_cast<uint64_t>(t.tv_nsec + t.tv_sec * 1000000000);
+	auto threshold = config->get_watchdog_threshold();
+	auto self = pthread_self();
+
+	for (auto thread : event_store->get_threads())
+	{
+		if (pthread_equal(thread->id, self))
+		{
+			continue;
+		}
+
+		// The calls of the thread are freed when the flight recorder evicts them, which happens under its events_lock
+		read_lock(&thread->events_lock);
+		EnclaveCallEvent *call = event_store->get_open_call(thread);
+		if (call == nullptr)
+		{
+			read_unlock(&thread->events_lock);
+			stuck_calls.erase(thread);
+			continue;
+		}
+
+		auto &stuck = stuck_calls[thread];
+		if (stuck.call != call || stuck.start != call->get_time())
+		{
+			stuck.call = call;
+			stuck.start = call->get_time();
+			stuck.next_snapshot = threshold;
+		}
+
+		auto age = now > stuck.start ? now - stuck.start : 0;
+		if (age < stuck.next_snapshot)
+		{
+			read_unlock(&thread->events_lock);
+			continue;
+		}
+		stuck.next_snapshot *= 2;
+		auto event = new EnclaveCallSnapshotEvent(call);
+		read_unlock(&thread->events_lock);
+
+		// The thread must be able to return from the call and log it while the watchdog waits for the signal handler
+		if (!snapshot(thread, event))
+		{
+			continue;
+		}
+
+		// Drops the snapshot if the call returned in the meantime, it would otherwise point to a call that is freed on eviction
+		if (!event_store->insert_snapshot(thread, event))
+		{
+			delete event;
+		}
+	}
+}
+
+/**
+ * @brief Interrupts @p thread to fill in the snapshot @p event. Called without the thread's events_lock, the call of the snapshot might return meanwhile.
+ * @param thread The stuck thread
+ * @param event The snapshot of the call the thread is stuck in
+ * @return true, if the signal handler filled in the snapshot, false if the thread did not run it. The snapshot is freed then.
+ */
+bool sgxperf::Watchdog::snapshot(Thread *thread, EnclaveCallSnapshotEvent *event)
+{
+	snapshot_done = false;
+	pending_thread = thread;
+	__sync_synchronize();
+	pending_snapshot = event;
+
+	if (pthread_kill(thread->id, WATCHDOG_SIGNAL) != 0)
+	{
+		pending_snapshot = nullptr;
+		pending_thread = nullptr;
+		delete event;
+		return false;
+	}
+
+	// Give the thread some time to run the handler
+	for (int i = 0; i < 100 && !snapshot_done; ++i)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	if (!snapshot_done)
+	{
+		if (__sync_lock_test_and_set(&pending_snapshot, nullptr) != nullptr)
+		{
+			// The handler did not run, e.g. because the thread blocks the signal
+			pending_thread = nullptr;
+			delete event;
+			return false;
+		}
+
+		// The handler claimed the snapshot and is still capturing
+		while (!snapshot_done)
+		{
+			std::this_thread::yield();
+		}
+	}
+	pending_thread = nullptr;
+
+	return true;
+}
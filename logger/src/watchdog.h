@@ -0,0 +1,51 @@
+/**
+ * @file watchdog.h
+ * @author weichbr
+ */
+
+#ifndef SGX_PERF_WATCHDOG_H
+#define SGX_PERF_WATCHDOG_H
+
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+
+#include "store.h"
+
+namespace sgxperf
+{
+	/**
+	 * @brief Class for detecting threads that are stuck in a call and taking snapshots of them.
+	 */
+	class Watchdog
+	{
+	public:
+		Watchdog() : running(false), worker(nullptr), stuck_calls() {}
+		~Watchdog() = default;
+		void init();
+
+		void start();
+		void stop();
+	private:
+		/**
+		 * @brief A call that is running longer than the threshold.
+		 */
+		typedef struct __stuck_call
+		{
+			EnclaveCallEvent *call; ///< Innermost open call of the thread
+			uint64_t start; ///< Start time of the call, to tell it apart from a later call at the same address
+			uint64_t next_snapshot; ///< Duration of the call at which the next snapshot is taken
+		} stuck_call_t;
+
+		std::atomic<bool> running;
+		std::thread *worker;
+		std::unordered_map<Thread *, stuck_call_t> stuck_calls;
+
+		void watchdog_thread();
+		void scan();
+		bool snapshot(Thread *thread, EnclaveCallSnapshotEvent *event);
+	};
+}
+
+#endif //SGX_PERF_WATCHDOG_H